@@ -0,0 +1,119 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Measures fs_geometry_pool.h against a buffer pair per mesh, for many small
+// meshes: initial upload, then rounds of removing and re-adding a random
+// subset, with the fragmentation that leaves and what compacting costs.
+//
+// Runs on the NOOP backend, so times are Filament's CPU-side cost.
+//
+
+#include <filament/Engine.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "fs_geometry_pool.h"
+#include "fs_mesh.h"
+
+namespace {
+
+double MsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  using namespace filament;
+  using clock = std::chrono::steady_clock;
+
+  constexpr int kMeshes = 4000;
+  constexpr int kRounds = 8;
+
+  Engine* engine = Engine::create(Engine::Backend::NOOP);
+
+  // Small meshes of varied sizes, as a scene of props would have.
+  std::vector<fs::MeshData> meshes;
+  std::mt19937 rng(1);
+  for (int i = 0; i < kMeshes; ++i) {
+    const int n = 2 + rng() % 7;
+    meshes.push_back(i % 2 ? fs::MeshSphere(n, 2 * n) : fs::MeshBox(n / 2));
+    fs::OptimizeMesh(meshes.back());
+  }
+
+  // One buffer pair each.
+  auto start = clock::now();
+  std::vector<fs::Mesh> separate;
+  for (const fs::MeshData& mesh : meshes) {
+    separate.push_back(fs::UploadMesh(*engine, mesh));
+  }
+  engine->flushAndWait();
+  const double separate_ms = MsSince(start);
+  for (fs::Mesh& mesh : separate) fs::DestroyMesh(*engine, mesh);
+
+  // Pooled, with 25% headroom.
+  size_t vertices = 0;
+  size_t indices = 0;
+  for (const fs::MeshData& mesh : meshes) {
+    vertices += mesh.vertices.size();
+    indices += mesh.indices.size();
+  }
+  fs::GeometryPool pool(engine, uint32_t(vertices * 5 / 4),
+                        uint32_t(indices * 5 / 4));
+  start = clock::now();
+  std::vector<uint32_t> ids;
+  for (const fs::MeshData& mesh : meshes) ids.push_back(pool.Add(mesh));
+  engine->flushAndWait();
+  const double pooled_ms = MsSince(start);
+
+  std::printf("%d meshes, %zu vertices, %zu indices\n", kMeshes, vertices,
+              indices);
+  std::printf("upload: separate %.2f ms (%d buffers), pooled %.2f ms (2)\n",
+              separate_ms, 2 * kMeshes, pooled_ms);
+
+  std::printf("%5s %9s %9s %9s %9s %11s\n", "round", "churn ms", "v frag",
+              "i frag", "v used", "compactions");
+  for (int round = 0; round < kRounds; ++round) {
+    start = clock::now();
+    for (int i = 0; i < kMeshes / 4; ++i) {
+      const size_t k = rng() % ids.size();
+      pool.Remove(ids[k]);
+      ids[k] = pool.Add(meshes[rng() % meshes.size()]);
+    }
+    engine->flushAndWait();
+    const fs::GeometryPoolStats stats = pool.stats();
+    std::printf("%5d %9.2f %9.3f %9.3f %8.1f%% %11u\n", round, MsSince(start),
+                stats.vertex_fragmentation, stats.index_fragmentation,
+                100.0 * stats.vertices_used / stats.vertex_capacity,
+                stats.compactions);
+  }
+
+  start = clock::now();
+  pool.Compact();
+  engine->flushAndWait();
+  std::printf("compact: %.2f ms\n", MsSince(start));
+
+  pool = {};
+  Engine::destroy(&engine);
+  return 0;
+}
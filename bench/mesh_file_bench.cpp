@@ -0,0 +1,123 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Measures loading .fsmesh files (fs_mesh_file.h) straight from a mapping,
+// against reading the same bytes into a MeshData and calling UploadMesh(...),
+// which is what a parser-based loader would at best do.
+//
+// Files are written to the temp directory and are warm in the page cache, so
+// this measures the loaders, not the disk. Uploads go through the NOOP
+// backend.
+//
+
+#include <filament/Engine.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "fs_mapped_file.h"
+#include "fs_mesh.h"
+#include "fs_mesh_file.h"
+
+namespace {
+
+// Calls 'fn' until it's taken at least 'min_seconds', and returns the average
+// time per call in milliseconds.
+double TimeMs(const std::function<void()>& fn, double min_seconds = 0.25) {
+  using clock = std::chrono::steady_clock;
+  const auto start = clock::now();
+  int runs = 0;
+  double elapsed = 0;
+  do {
+    fn();
+    ++runs;
+    elapsed = std::chrono::duration<double>(clock::now() - start).count();
+  } while (elapsed < min_seconds);
+  return elapsed * 1000 / runs;
+}
+
+// Reads a .fsmesh the copying way: whole file into memory, then into a
+// MeshData with widened indices, then UploadMesh(...)'s own copies.
+fs::Mesh LoadByCopying(filament::Engine& engine, const char* path) {
+  std::FILE* const file = std::fopen(path, "rb");
+  if (!file) return {};
+  std::fseek(file, 0, SEEK_END);
+  std::vector<uint8_t> bytes(std::ftell(file));
+  std::fseek(file, 0, SEEK_SET);
+  const size_t read = std::fread(bytes.data(), 1, bytes.size(), file);
+  std::fclose(file);
+
+  fs::MeshFileView view;
+  if (read != bytes.size() ||
+      !fs::ParseMeshFile(bytes.data(), bytes.size(), view)) {
+    return {};
+  }
+  fs::MeshData mesh;
+  mesh.vertices.resize(view.header->vertex_count);
+  std::memcpy(mesh.vertices.data(), view.vertices, view.VertexBytes());
+  mesh.indices.resize(view.header->index_count);
+  for (size_t i = 0; i < mesh.indices.size(); ++i) {
+    mesh.indices[i] = view.header->index_size == 2
+                          ? ((const uint16_t*)view.indices)[i]
+                          : ((const uint32_t*)view.indices)[i];
+  }
+  fs::ComputeMeshBounds(mesh);
+  return fs::UploadMesh(engine, mesh);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  using namespace filament;
+
+  Engine* engine = Engine::create(Engine::Backend::NOOP);
+
+  std::printf("%6s %9s %9s %9s %11s %9s %9s\n", "rows", "verts", "tris", "KiB",
+              "write ms", "mmap ms", "copy ms");
+  for (int rows : {16, 64, 256, 1024}) {
+    fs::MeshData mesh = fs::MeshSphere(rows, 2 * rows);
+    fs::OptimizeMesh(mesh);
+    const std::string path =
+        "/tmp/mesh_file_bench_" + std::to_string(rows) + ".fsmesh";
+
+    const double write_ms =
+        TimeMs([&] { fs::WriteMeshFile(path.c_str(), mesh); });
+    const double mmap_ms = TimeMs([&] {
+      fs::Mesh gpu = fs::LoadMeshFile(*engine, path.c_str());
+      engine->flushAndWait();
+      fs::DestroyMesh(*engine, gpu);
+    });
+    const double copy_ms = TimeMs([&] {
+      fs::Mesh gpu = LoadByCopying(*engine, path.c_str());
+      engine->flushAndWait();
+      fs::DestroyMesh(*engine, gpu);
+    });
+
+    std::printf("%6d %9zu %9zu %9zu %11.3f %9.3f %9.3f\n", rows,
+                mesh.vertices.size(), mesh.indices.size() / 3,
+                fs::MappedFile(path.c_str()).size() / 1024, write_ms, mmap_ms,
+                copy_ms);
+    std::remove(path.c_str());
+  }
+
+  Engine::destroy(&engine);
+  return 0;
+}
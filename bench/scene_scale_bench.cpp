@@ -0,0 +1,328 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Measures how Renderer::render() scales with renderables, point lights and
+// materials in a Demo-like scene: 10 to 100K spheres of a few tessellations on
+// a grid, each its own renderable, in view of the camera.
+//
+// Runs on the NOOP backend, so times are Filament's CPU-side cost:
+//  - render: Renderer::render(view), i.e. culling, light binning and command
+//    generation, on this thread.
+//  - culled: the same with the camera turned away, so every renderable is
+//    culled; roughly the culling and per-renderable bookkeeping share.
+//  - backend: endFrame() and flushAndWait(), i.e. the render thread executing
+//    the frame's commands.
+//  - rss: the process' resident memory after the scene's frames. Freed memory
+//    isn't always returned, so it's most telling as scenes grow.
+//
+// The lit and unlit materials' OpenGL packages, which every platform builds
+// and the NOOP backend accepts, are read from build/ (see `build.sh
+// resources`), or the directory passed as the first argument; without them,
+// every sphere uses Filament's default material. Either way, "mixed" scenes
+// spread spheres over 8 instances of each material, which Filament batches
+// separately.
+//
+
+#include <filament/Camera.h>
+#include <filament/Engine.h>
+#include <filament/LightManager.h>
+#include <filament/Material.h>
+#include <filament/MaterialInstance.h>
+#include <filament/RenderableManager.h>
+#include <filament/Renderer.h>
+#include <filament/Scene.h>
+#include <filament/TransformManager.h>
+#include <filament/View.h>
+#include <filament/Viewport.h>
+#include <utils/EntityManager.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "filament_glfw_imgui/material_cache.h"
+#include "fs_benchmark.h"
+#include "fs_mapped_file.h"
+#include "fs_mesh.h"
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+double MsSince(clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(clock::now() - start)
+      .count();
+}
+
+size_t ResidentBytes() {
+#if defined(__APPLE__)
+  mach_task_basic_info info = {};
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info,
+                &count) != KERN_SUCCESS) {
+    return 0;
+  }
+  return info.resident_size;
+#else
+  FILE* file = std::fopen("/proc/self/statm", "r");
+  if (!file) return 0;
+  unsigned long pages = 0;
+  const bool read = std::fscanf(file, "%*s %lu", &pages) == 1;
+  std::fclose(file);
+  return read ? pages * sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+struct SceneConfig {
+  size_t renderables;
+  size_t lights;
+  bool mixed_materials;
+};
+
+struct SceneTimes {
+  fs::Percentiles render;
+  fs::Percentiles culled;
+  fs::Percentiles backend;
+  double build_ms = 0;
+  size_t resident_bytes = 0;
+};
+
+class SceneBench {
+ public:
+  static constexpr int kWarmupFrames = 5;
+  static constexpr int kFrames = 30;
+  static constexpr int kInstancesPerMaterial = 8;
+
+  explicit SceneBench(const char* material_dir)
+      : engine_(filament::Engine::create(filament::Engine::Backend::NOOP)),
+        materials_(engine_) {
+    using namespace filament;
+    swap_chain_ = engine_->createSwapChain(1280, 720);
+    renderer_ = engine_->createRenderer();
+    camera_entity_ = utils::EntityManager::get().create();
+    camera_ = engine_->createCamera(camera_entity_);
+    camera_->setProjection(45.0, 1280.0 / 720, 0.3, 1000,
+                           Camera::Fov::VERTICAL);
+    view_ = engine_->createView();
+    view_->setPostProcessingEnabled(false);  // As in the demo.
+    view_->setCamera(camera_);
+    view_->setViewport({0, 0, 1280, 720});
+
+    // Shared, as a real scene's props would be.
+    for (int n : {8, 16, 32}) {
+      fs::MeshData sphere = fs::MeshSphere(n, 2 * n);
+      fs::OptimizeMesh(sphere);
+      spheres_.push_back(fs::UploadMesh(*engine_, sphere));
+    }
+
+    for (const char* name : {"lit_vertex_color", "vertex_color"}) {
+      const std::string path = std::string(material_dir) + "/" + name +
+                               "_opengl.filamat";
+      const fs::MappedFile file(path.c_str());
+      if (!file.data()) continue;
+      Material* material = materials_.Acquire(file.data(), file.size());
+      if (!material) continue;
+      acquired_.push_back(material);
+      for (int i = 0; i < kInstancesPerMaterial; ++i) {
+        instances_.push_back(material->createInstance());
+      }
+    }
+    if (instances_.empty()) {
+      std::printf("no materials in %s/, using the default material\n",
+                  material_dir);
+      const Material* material = engine_->getDefaultMaterial();
+      for (int i = 0; i < kInstancesPerMaterial; ++i) {
+        instances_.push_back(material->createInstance());
+      }
+    }
+  }
+
+  SceneBench(const SceneBench&) = delete;
+  SceneBench& operator=(const SceneBench&) = delete;
+
+  ~SceneBench() {
+    for (filament::MaterialInstance* instance : instances_) {
+      engine_->destroy(instance);
+    }
+    for (filament::Material* material : acquired_) materials_.Release(material);
+    for (fs::Mesh& sphere : spheres_) fs::DestroyMesh(*engine_, sphere);
+    engine_->destroy(view_);
+    engine_->destroyCameraComponent(camera_entity_);
+    utils::EntityManager::get().destroy(camera_entity_);
+    engine_->destroy(renderer_);
+    engine_->destroy(swap_chain_);
+    materials_ = {};
+    filament::Engine::destroy(&engine_);
+  }
+
+  SceneTimes Run(const SceneConfig& config) {
+    using namespace filament;
+    SceneTimes times;
+
+    auto start = clock::now();
+    Scene* scene = engine_->createScene();
+    const float side = std::ceil(std::cbrt(float(config.renderables)));
+    std::vector<utils::Entity> entities = BuildSpheres(config, side);
+    scene->addEntities(entities.data(), entities.size());
+    std::vector<utils::Entity> lights = BuildLights(config, side);
+    scene->addEntities(lights.data(), lights.size());
+    view_->setScene(scene);
+    engine_->flushAndWait();
+    times.build_ms = MsSince(start);
+
+    // Far enough back for the whole grid to be in view.
+    const math::float3 center = {0, 0, 0};
+    const math::float3 eye = {0, 0.5f * side, 2.0f * side + 2};
+    std::vector<double> render_ms;
+    std::vector<double> culled_ms;
+    std::vector<double> backend_ms;
+    for (bool culled : {false, true}) {
+      camera_->lookAt(eye, culled ? 2.0f * eye : center, {0, 1, 0});
+      for (int frame = 0; frame < kWarmupFrames + kFrames; ++frame) {
+        if (!renderer_->beginFrame(swap_chain_)) {
+          engine_->flushAndWait();
+          continue;
+        }
+        start = clock::now();
+        renderer_->render(view_);
+        const double ms = MsSince(start);
+        start = clock::now();
+        renderer_->endFrame();
+        engine_->flushAndWait();
+        if (frame < kWarmupFrames) continue;
+        (culled ? culled_ms : render_ms).push_back(ms);
+        if (!culled) backend_ms.push_back(MsSince(start));
+      }
+    }
+    times.render = fs::ComputePercentiles(render_ms);
+    times.culled = fs::ComputePercentiles(culled_ms);
+    times.backend = fs::ComputePercentiles(backend_ms);
+    times.resident_bytes = ResidentBytes();
+
+    view_->setScene(nullptr);
+    engine_->destroy(scene);
+    for (utils::Entity entity : entities) engine_->destroy(entity);
+    for (utils::Entity entity : lights) engine_->destroy(entity);
+    utils::EntityManager::get().destroy(entities.size(), entities.data());
+    utils::EntityManager::get().destroy(lights.size(), lights.data());
+    engine_->flushAndWait();
+    return times;
+  }
+
+ private:
+  std::vector<utils::Entity> BuildSpheres(const SceneConfig& config,
+                                          float side) {
+    using namespace filament;
+    std::vector<utils::Entity> entities(config.renderables);
+    utils::EntityManager::get().create(entities.size(), entities.data());
+
+    TransformManager& transforms = engine_->getTransformManager();
+    std::mt19937 rng(1);
+    const int grid = int(side);
+    for (size_t i = 0; i < entities.size(); ++i) {
+      const fs::Mesh& sphere = spheres_[rng() % spheres_.size()];
+      MaterialInstance* const instance =
+          config.mixed_materials ? instances_[rng() % instances_.size()]
+                                 : instances_[0];
+      RenderableManager::Builder(1)
+          .boundingBox(sphere.bounds)
+          .material(0, instance)
+          .geometry(0, RenderableManager::PrimitiveType::TRIANGLES,
+                    sphere.vertex_buf, sphere.index_buf, 0, sphere.index_count)
+          .receiveShadows(false)
+          .castShadows(false)
+          .build(*engine_, entities[i]);
+
+      const float offset = -0.5f * (side - 1);
+      const math::float3 position = {offset + i % grid,
+                                     offset + i / grid % grid,
+                                     offset + i / grid / grid};
+      transforms.create(entities[i]);
+      transforms.setTransform(transforms.getInstance(entities[i]),
+                              math::mat4f::translation(position) *
+                                  math::mat4f::scaling(0.4f));
+    }
+    return entities;
+  }
+
+  std::vector<utils::Entity> BuildLights(const SceneConfig& config,
+                                         float side) {
+    using namespace filament;
+    std::vector<utils::Entity> lights(config.lights);
+    utils::EntityManager::get().create(lights.size(), lights.data());
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<float> coord(-0.5f * side, 0.5f * side);
+    for (utils::Entity light : lights) {
+      LightManager::Builder(LightManager::Type::POINT)
+          .color({1, 0.9f, 0.8f})
+          .intensity(10000)
+          .position({coord(rng), coord(rng), coord(rng)})
+          .falloff(3)
+          .castShadows(false)
+          .build(*engine_, light);
+    }
+    return lights;
+  }
+
+  filament::Engine* engine_ = nullptr;
+  filament_glfw_imgui::MaterialCache materials_;
+  filament::SwapChain* swap_chain_ = nullptr;
+  filament::Renderer* renderer_ = nullptr;
+  utils::Entity camera_entity_;
+  filament::Camera* camera_ = nullptr;
+  filament::View* view_ = nullptr;
+
+  std::vector<fs::Mesh> spheres_;
+  std::vector<filament::Material*> acquired_;  // From materials_.
+  std::vector<filament::MaterialInstance*> instances_;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  SceneBench bench(argc > 1 ? argv[1] : "build");
+
+  std::printf("%9s %6s %5s | %9s %9s | %9s %9s | %9s | %8s %8s\n", "spheres",
+              "lights", "mats", "render50", "render90", "culled50",
+              "culled90", "backend50", "build ms", "rss MB");
+  for (size_t renderables : {10, 100, 1000, 10000, 100000}) {
+    // Filament bins at most 255 lights per view, less the sun it reserves.
+    for (const SceneConfig& config :
+         {SceneConfig{renderables, 0, false}, SceneConfig{renderables, 0, true},
+          SceneConfig{renderables, 64, true},
+          SceneConfig{renderables, 250, true}}) {
+      const SceneTimes times = bench.Run(config);
+      std::printf(
+          "%9zu %6zu %5s | %9.3f %9.3f | %9.3f %9.3f | %9.3f | %8.1f %8.1f\n",
+          config.renderables, config.lights,
+          config.mixed_materials ? "mixed" : "one", times.render.p50,
+          times.render.p90, times.culled.p50, times.culled.p90,
+          times.backend.p50, times.build_ms,
+          times.resident_bytes / (1024.0 * 1024.0));
+    }
+  }
+  return 0;
+}
@@ -16,6 +16,10 @@
 
 CC=clang++
 OPTS="-std=c++20 -fno-exceptions -O3 -g"
+if [[ -n "$TRACK_ALLOCATIONS" ]]; then
+  # Counts heap allocations; see filament_glfw_imgui/alloc_tracking.h.
+  OPTS="$OPTS -DFILAMENT_GLFW_IMGUI_TRACK_ALLOCATIONS"
+fi
 CPUNAME=x86_64
 OUT=build   # Folder in which to place outputs.
 
@@ -85,27 +89,50 @@ if [[ "$1" = "deps" ]]; then
 #-------------------------------------------------------------------------------
 elif [[ "$1" = "resources" ]]; then
   # Copy environments to the output folder. These aren't compiled as resources
-  # but are loaded at runtime. Then, build all materials and bundle them, as
-  # well as fonts for the demo. The -a option may be overkill for your platform.
-  mkdir -p $OUT && cp -r demo/environments $OUT && \
-  $FILAMENT_BIN/matc -p all -a all -o \
-    $OUT/vertex_color.filamat demo/materials/vertex_color.mat && \
-  $FILAMENT_BIN/matc -p all -a all -o \
-    $OUT/lit_vertex_color.filamat demo/materials/lit_vertex_color.mat && \
-  $FILAMENT_BIN/matc -p all -a all -o \
-    $OUT/filament_imgui.filamat filament_glfw_imgui/filament_imgui.mat && \
-  $FILAMENT_BIN/resgen --deploy=demo/ --json \
-    $OUT/vertex_color.filamat \
-    $OUT/lit_vertex_color.filamat \
-    $OUT/filament_imgui.filamat \
+  # but are loaded at runtime.
+  mkdir -p $OUT && cp -r demo/environments $OUT || exit 1
+
+  # Build each material for desktop GPUs, once per backend this platform runs
+  # (e.g. build/lit_vertex_color_vulkan.filamat), rather than one package with
+  # every platform and backend in it. The app only reads the package for its
+  # backend; see MaterialPackage in filament_glfw_imgui/material_cache.h.
+  if [[ "$OSTYPE" =~ ^darwin ]]; then
+    MATERIAL_APIS="metal opengl"
+  else
+    MATERIAL_APIS="vulkan opengl"
+  fi
+  PACKAGES=""
+  for MATERIAL in demo/materials/vertex_color.mat \
+      demo/materials/lit_vertex_color.mat \
+      filament_glfw_imgui/filament_imgui.mat; do
+    for API in $MATERIAL_APIS; do
+      PACKAGE=$OUT/$(basename $MATERIAL .mat)_$API.filamat
+      $FILAMENT_BIN/matc -p desktop -a $API -o $PACKAGE $MATERIAL || exit 1
+      PACKAGES="$PACKAGES $PACKAGE"
+    done
+  done
+  echo "material packages: $(cat $PACKAGES | wc -c) bytes"
+
+  # Bundle the materials and the demo's fonts. The bundle only has this
+  # platform's backends, so rerun this when switching platforms.
+  $FILAMENT_BIN/resgen --deploy=demo/ --json $PACKAGES \
+    demo/fonts/Roboto_Regular.ttf \
+    demo/fonts/Inconsolata_Regular.ttf || exit 1
+
+  # Write the same resources to a pack, for 'build/demo --resources
+  # resources.fspack'. Materials are stored as is, so only the package in use
+  # is ever paged in; the fonts are compressed.
+  $CC $OPTS -Idemo/ tools/pack_resources.cpp -o $OUT/pack_resources -lz && \
+  $OUT/pack_resources $OUT/resources.fspack $PACKAGES --zlib \
     demo/fonts/Roboto_Regular.ttf \
     demo/fonts/Inconsolata_Regular.ttf
-  exit 0
+  exit $?
 
 #-------------------------------------------------------------------------------
-# Builds the demo.
+# Builds the demo, the benchmarks, the tests, or the tools.
 #-------------------------------------------------------------------------------
-elif [[ "$1" = "demo" ]]; then
+elif [[ "$1" = "demo" || "$1" = "benchmark" || "$1" = "bench" ||
+        "$1" = "test" || "$1" = "tools" ]]; then
   # Detect OS and set platform-specific variables.
   if [[ "$OSTYPE" =~ ^darwin ]]; then
     # NOTE(ambrus): the macos version thing shuts the linker up about version mismatch.
@@ -131,9 +158,35 @@ elif [[ "$1" = "demo" ]]; then
     exit 1
   fi
 
+  # Each tests/*.cpp is a separate, windowless program on the NOOP backend,
+  # run once built; it exits 1 on failure.
+  if [[ "$1" = "test" ]]; then
+    mkdir -p $OUT
+    INCLUDES="-I. -I3p/ -Idemo/ $FILAMENT_INCLUDES"
+    for PROGRAM in tests/*.cpp; do
+      $CC $OPTS $INCLUDES $PROGRAM -o $OUT/$(basename $PROGRAM .cpp) \
+        $FILAMENT_LIBS -lz || exit 1
+      $OUT/$(basename $PROGRAM .cpp) || exit 1
+    done
+    exit 0
+  fi
+
+  # Each bench/*.cpp is a separate, windowless program on the NOOP backend,
+  # and each tools/*.cpp a command-line program.
+  if [[ "$1" = "bench" || "$1" = "tools" ]]; then
+    mkdir -p $OUT
+    INCLUDES="-I. -I3p/ -Idemo/ $FILAMENT_INCLUDES"
+    for PROGRAM in $1/*.cpp; do
+      $CC $OPTS $INCLUDES $PROGRAM -o $OUT/$(basename $PROGRAM .cpp) \
+        $FILAMENT_LIBS -lz || exit 1
+    done
+    exit 0
+  fi
+
   # App inputs.
   SRCS="\
     3p/stb/stb_image.cpp \
+    3p/stb/stb_image_resize.cpp \
     3p/imgui/imgui.cpp \
     3p/imgui/imgui_demo.cpp \
     3p/imgui/imgui_draw.cpp \
@@ -143,11 +196,24 @@ elif [[ "$1" = "demo" ]]; then
     $FILAMENT_NATIVE_SRCS \
     $RESOURCES \
     demo/demo.cpp"
+  if [[ -n "$COMPILED" ]]; then
+    # Builds the library once rather than in every translation unit; see
+    # filament_glfw_imgui/config.h.
+    OPTS="$OPTS -DFILAMENT_GLFW_IMGUI_COMPILED"
+    SRCS="$SRCS filament_glfw_imgui/filament_glfw_imgui.cpp"
+  fi
   INCLUDES="-I. -I3p/ -Idemo/ $FILAMENT_INCLUDES $GLFW_INCLUDES"
-  LIBS="$FILAMENT_LIBS $GLFW_LIBS"
+  LIBS="$FILAMENT_LIBS $GLFW_LIBS -lz"
 
   # Build the app.
-  $CC $OPTS $INCLUDES $SRCS -o build/demo $LIBS
+  $CC $OPTS $INCLUDES $SRCS -o build/demo $LIBS || exit 1
+
+  # Runs the scripted demo benchmark, passing on the remaining options, e.g.
+  # --baseline. Paths are relative to build/, where the environments are.
+  if [[ "$1" = "benchmark" ]]; then
+    (cd $OUT && ./demo --benchmark benchmark.json "${@:2}")
+    exit $?
+  fi
   exit 0
 
 else
@@ -161,10 +227,33 @@ else
   echo ""
   echo "  build.sh resources"
   echo "    Bundles demo app resources with matc and resgen, placing results in"
-  echo "    demo/, and copies environments to build/."
+  echo "    demo/, and copies environments to build/. Materials are compiled"
+  echo "    per backend, for this platform's backends only. Also writes them"
+  echo "    to build/resources.fspack, for 'build/demo --resources FILE'."
   echo ""
   echo "  build.sh demo"
-  echo "    Builds the demo app"
+  echo "    Builds the demo app. With TRACK_ALLOCATIONS=1, counts heap"
+  echo "    allocations, and 'build/demo --check-allocations' fails if frames"
+  echo "    allocate once warmed up. With COMPILED=1, builds the library as"
+  echo "    its own translation unit instead of header-only."
+  echo ""
+  echo "  build.sh benchmark [options]"
+  echo "    Builds the demo and runs it headless (NOOP backend, hidden window)"
+  echo "    on a scripted camera path, writing build/benchmark.json. Options:"
+  echo "      --frames N                 frames to measure (default 600)"
+  echo "      --baseline FILE            exit 1 on regressions against FILE"
+  echo "      --time-threshold RATIO     allowed slowdown (default 0.10)"
+  echo "      --memory-threshold RATIO   allowed memory growth (default 0.05)"
+  echo "      --gpu                      render on the default backend"
+  echo ""
+  echo "  build.sh bench"
+  echo "    Builds each benchmark in bench/ into build/"
+  echo ""
+  echo "  build.sh test"
+  echo "    Builds and runs each test in tests/, stopping at the first failure"
+  echo ""
+  echo "  build.sh tools"
+  echo "    Builds each tool in tools/ (e.g. obj_to_fsmesh) into build/"
   echo ""
   exit 1
 fi
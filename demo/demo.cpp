@@ -32,16 +32,33 @@
 #include <utils/EntityManager.h>
 
 #include <chrono>
+#include <cmath>
 #include <cstdint>
-#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <string>
 #include <thread>
 
+#include <sys/resource.h>
+
+#include "filament_glfw_imgui/alloc_tracking_hooks.h"
 #include "filament_glfw_imgui/filament_glfw_imgui.h"
+#include "filament_glfw_imgui/gpu_memory_imgui.h"
+#include "filament_glfw_imgui/logger.h"
+#include "filament_glfw_imgui/profiler_imgui.h"
+#include "fs_benchmark.h"
 #include "fs_env_prefilter.h"
 #include "fs_orbit_controller.h"
 #include "fs_primitives.h"
+#include "fs_resource_pack.h"
 #include "resources.h"
 
+using filament_glfw_imgui::Logger;
+using filament_glfw_imgui::LogLevel;
+using filament_glfw_imgui::ScopedProfileZone;
+
 static constexpr char kEnvNames[][128] = {
     "environments/flower_road_2k.hdr",
     "environments/flower_road_no_sun_2k.hdr",
@@ -55,11 +72,113 @@ static constexpr char kEnvNames[][128] = {
     "environments/the_sky_is_on_fire_2k.hdr",
     "environments/venetian_crossroads_2k.hdr",
 };
+static constexpr int kEnvCount = sizeof(kEnvNames) / sizeof(kEnvNames[0]);
+
+// `build.sh resources` compiles each material for each backend this platform
+// runs, and links them and the fonts into the demo. It also writes them to
+// build/resources.fspack, which --resources maps instead. Either way, only the
+// engine's package of a material is built, when the material is first used.
+using filament_glfw_imgui::MaterialPackage;
+using Backend = filament::Engine::Backend;
+#if defined(__APPLE__)
+static constexpr Backend kMaterialBackends[] = {Backend::METAL,
+                                                Backend::OPENGL};
+static constexpr const char* kMaterialApis[] = {"metal", "opengl"};
+#else
+static constexpr Backend kMaterialBackends[] = {Backend::VULKAN,
+                                                Backend::OPENGL};
+static constexpr const char* kMaterialApis[] = {"vulkan", "opengl"};
+#endif
+static constexpr size_t kMaterialPackageCount =
+    sizeof(kMaterialBackends) / sizeof(kMaterialBackends[0]);
+
+struct DemoResources {
+  MaterialPackage imgui_material[kMaterialPackageCount];
+  MaterialPackage lit_vertex_color_material[kMaterialPackageCount];
+  fs::ResourceView roboto_font;
+  fs::ResourceView inconsolata_font;
+};
+
+// The resources linked into the demo.
+static DemoResources LinkedResources() {
+  return {
+#if defined(__APPLE__)
+      .imgui_material = {{Backend::METAL, RESOURCES_FILAMENT_IMGUI_METAL_DATA,
+                          RESOURCES_FILAMENT_IMGUI_METAL_SIZE},
+                         {Backend::OPENGL, RESOURCES_FILAMENT_IMGUI_OPENGL_DATA,
+                          RESOURCES_FILAMENT_IMGUI_OPENGL_SIZE}},
+      .lit_vertex_color_material =
+          {{Backend::METAL, RESOURCES_LIT_VERTEX_COLOR_METAL_DATA,
+            RESOURCES_LIT_VERTEX_COLOR_METAL_SIZE},
+           {Backend::OPENGL, RESOURCES_LIT_VERTEX_COLOR_OPENGL_DATA,
+            RESOURCES_LIT_VERTEX_COLOR_OPENGL_SIZE}},
+#else
+      .imgui_material = {{Backend::VULKAN, RESOURCES_FILAMENT_IMGUI_VULKAN_DATA,
+                          RESOURCES_FILAMENT_IMGUI_VULKAN_SIZE},
+                         {Backend::OPENGL, RESOURCES_FILAMENT_IMGUI_OPENGL_DATA,
+                          RESOURCES_FILAMENT_IMGUI_OPENGL_SIZE}},
+      .lit_vertex_color_material =
+          {{Backend::VULKAN, RESOURCES_LIT_VERTEX_COLOR_VULKAN_DATA,
+            RESOURCES_LIT_VERTEX_COLOR_VULKAN_SIZE},
+           {Backend::OPENGL, RESOURCES_LIT_VERTEX_COLOR_OPENGL_DATA,
+            RESOURCES_LIT_VERTEX_COLOR_OPENGL_SIZE}},
+#endif
+      .roboto_font = {RESOURCES_ROBOTO_REGULAR_DATA,
+                      RESOURCES_ROBOTO_REGULAR_SIZE},
+      .inconsolata_font = {RESOURCES_INCONSOLATA_REGULAR_DATA,
+                           RESOURCES_INCONSOLATA_REGULAR_SIZE},
+  };
+}
+
+// The same resources from 'pack', which must outlive their use. Returns
+// 'false' and logs an error if one is missing.
+static bool PackedResources(fs::ResourcePack& pack, DemoResources& resources) {
+  const auto find = [&](const std::string& name, fs::ResourceView& view) {
+    view = pack.Find(name);
+    if (!view.data) {
+      Logger::Default().Log(LogLevel::kError, "--resources: no %s",
+                            name.c_str());
+    }
+    return view.data != nullptr;
+  };
+  fs::ResourceView view;
+  for (size_t i = 0; i < kMaterialPackageCount; ++i) {
+    const std::string api = kMaterialApis[i];
+    if (!find("filament_imgui_" + api + ".filamat", view)) return false;
+    resources.imgui_material[i] = {kMaterialBackends[i], view.data, view.size};
+    if (!find("lit_vertex_color_" + api + ".filamat", view)) return false;
+    resources.lit_vertex_color_material[i] = {kMaterialBackends[i], view.data,
+                                              view.size};
+  }
+  return find("Roboto_Regular.ttf", resources.roboto_font) &&
+         find("Inconsolata_Regular.ttf", resources.inconsolata_font);
+}
+
+// The package of 'packages' for 'engine', for APIs taking a single .filamat.
+// If there's none, returns an empty one, which fails to build.
+static MaterialPackage PackageFor(const filament::Engine& engine,
+                                  const MaterialPackage* packages) {
+  const MaterialPackage* const package =
+      filament_glfw_imgui::FindMaterialPackage(engine.getBackend(), packages,
+                                               kMaterialPackageCount);
+  return package ? *package : MaterialPackage{engine.getBackend(), nullptr, 0};
+}
 
 class Demo {
  public:
   Demo() = default;
-  Demo(filament::Engine* engine) : engine_(engine) {}
+  Demo(filament::Engine* engine,
+       filament_glfw_imgui::MaterialCache* material_cache,
+       filament_glfw_imgui::RetireQueue* retire_queue,
+       filament_glfw_imgui::FrameScheduler* scheduler,
+       filament_glfw_imgui::UploadScheduler* uploads,
+       const DemoResources* resources)
+      : engine_(engine),
+        material_cache_(material_cache),
+        retire_queue_(retire_queue),
+        scheduler_(scheduler),
+        uploads_(uploads),
+        resources_(resources) {}
 
   Demo(const Demo&) = delete;
   Demo& operator=(const Demo&) = delete;
@@ -67,6 +186,11 @@ class Demo {
   Demo(Demo&& other) { *this = std::move(other); }
   Demo& operator=(Demo&& other) {
     std::swap(engine_, other.engine_);
+    std::swap(material_cache_, other.material_cache_);
+    std::swap(retire_queue_, other.retire_queue_);
+    std::swap(scheduler_, other.scheduler_);
+    std::swap(uploads_, other.uploads_);
+    std::swap(resources_, other.resources_);
 
     std::swap(camera_entity_, other.camera_entity_);
     std::swap(direct_light_, other.direct_light_);
@@ -78,7 +202,16 @@ class Demo {
     std::swap(i_env_, other.i_env_);
     std::swap(env_prefilter_, other.env_prefilter_);
     std::swap(env_, other.env_);
+    std::swap(refining_env_, other.refining_env_);
+    std::swap(env_loads_, other.env_loads_);
     std::swap(visual_, other.visual_);
+    std::swap(stress_, other.stress_);
+    std::swap(stress_pool_, other.stress_pool_);
+    std::swap(stress_build_ms_, other.stress_build_ms_);
+    std::swap(stress_lod_ms_, other.stress_lod_ms_);
+    std::swap(show_gpu_memory_, other.show_gpu_memory_);
+    std::swap(show_profiler_, other.show_profiler_);
+    std::swap(profiler_window_, other.profiler_window_);
     std::swap(orbit_controller_, other.orbit_controller_);
 
     return *this;
@@ -117,32 +250,37 @@ class Demo {
     // Set up image-based lighting.
     i_env_ = 3;
     env_prefilter_ = std::make_unique<fs::EnvPrefilter>(*engine_);
+    env_prefilter_->set_retire_queue(retire_queue_);
+    env_prefilter_->set_upload_scheduler(uploads_);
     if (env_prefilter_->LoadEquirect(kEnvNames[i_env_], env_)) {
-      std::cout << "IBL " << env_.ibl() << std::endl;
-      std::cout << "IBL " << env_.skybox() << std::endl;
+      Logger::Default().Log(LogLevel::kDebug, "IBL %p, skybox %p",
+                            (void*)env_.ibl(), (void*)env_.skybox());
       scene_->setIndirectLight(env_.ibl());
       scene_->setSkybox(env_.skybox());
     }
 
     // Add something to draw.
-    visual_ = fs::VisualSphere(*engine_, RESOURCES_LIT_VERTEX_COLOR_DATA,
-                               RESOURCES_LIT_VERTEX_COLOR_SIZE);
+    const MaterialPackage lit =
+        PackageFor(*engine_, resources_->lit_vertex_color_material);
+    visual_ = fs::VisualSphere(*engine_, *material_cache_,
+                               (const uint8_t*)lit.data, lit.size);
     scene_->addEntity(visual_.entity());
 
     // Load ImGui fonts.
     ImGuiIO& imgui_io = ImGui::GetIO();
-    filament_imgui::AddFont("Roboto18", (void*)RESOURCES_ROBOTO_REGULAR_DATA,
-                            RESOURCES_ROBOTO_REGULAR_SIZE, 18,
+    const fs::ResourceView roboto = resources_->roboto_font;
+    const fs::ResourceView inconsolata = resources_->inconsolata_font;
+    filament_imgui::AddFont("Roboto18", (void*)roboto.data, roboto.size, 18,
                             /*free_when_done=*/false, *imgui_io.Fonts);
-    filament_imgui::AddFont("Inconsolata18",
-                            (void*)RESOURCES_INCONSOLATA_REGULAR_DATA,
-                            RESOURCES_INCONSOLATA_REGULAR_SIZE, 18,
+    filament_imgui::AddFont("Inconsolata18", (void*)inconsolata.data,
+                            inconsolata.size, 18,
                             /*free_when_done=*/false, *imgui_io.Fonts);
   }
 
   void ProcessInput(const glfw_input::State& input) {
     // Handle event-based inputs.
     int increment_env = 0;
+    bool toggle_stress = false;
     for (const glfw_input::Event& event : input.events) {
       switch (event.type) {
         case glfw_input::Event::kCursorPos:
@@ -163,6 +301,15 @@ class Demo {
               case GLFW_KEY_P:
                 increment_env = 1;
                 break;
+              case GLFW_KEY_I:
+                toggle_stress = true;
+                break;
+              case GLFW_KEY_M:
+                show_gpu_memory_ = !show_gpu_memory_;
+                break;
+              case GLFW_KEY_F:
+                show_profiler_ = !show_profiler_;
+                break;
             }
           }
           break;
@@ -171,19 +318,11 @@ class Demo {
 
     // Load the next environment if requested.
     if (increment_env) {
-      const int i_next_env =
-          fs::Clamped(i_env_ + increment_env, 0,
-                      sizeof(kEnvNames) / sizeof(kEnvNames[0]) - 1);
-      if (i_next_env != i_env_) {
-        i_env_ = i_next_env;
-        std::cout << "i_env " << i_env_ << std::endl;
-        if (env_prefilter_->LoadEquirect(kEnvNames[i_env_], env_)) {
-          scene_->setSkybox(env_.skybox());
-          scene_->setIndirectLight(env_.ibl());
-        }
-      }
+      SwitchEnvironment(fs::Clamped(i_env_ + increment_env, 0, kEnvCount - 1));
     }
 
+    if (toggle_stress) ToggleStressScene();
+
     {  // Handle state-based inputs.
       float pan_horiz = input.keys.Axis(GLFW_KEY_A, GLFW_KEY_D);
       float pan_vert = input.keys.Axis(GLFW_KEY_S, GLFW_KEY_W);
@@ -197,7 +336,23 @@ class Demo {
     }
   }
 
-  void UpdateUi() {
+  // Replaces ProcessInput(...) for --benchmark, so runs are repeatable: the
+  // camera circles the visual, bobbing and dollying as if driven at 60 Hz, and
+  // the next environment loads every kScriptedEnvFrames.
+  void ProcessScriptedInput(uint64_t frame) {
+    const float time = frame / 60.0f;
+    orbit_controller_.theta = 0.5f * time;
+    orbit_controller_.phi = 0.3f * std::sin(0.7f * time);
+    orbit_controller_.radius = 5 + 2 * std::sin(0.3f * time);
+
+    if (frame && frame % kScriptedEnvFrames == 0) {
+      SwitchEnvironment((i_env_ + 1) % kEnvCount);
+    }
+  }
+
+  // 'alloc_stats' are shown if allocations are tracked.
+  void UpdateUi(const filament_glfw_imgui::AppAllocStats& alloc_stats,
+                const filament_glfw_imgui::ImGuiAllocStats& imgui_allocs) {
     ImGui::ShowDemoWindow();
 
     constexpr ImGuiWindowFlags overlay_flags =
@@ -215,6 +370,23 @@ class Demo {
       ImGui::SetNextWindowSize(ImVec2(0, 0));
       ImGui::Begin("FPSCounter", nullptr, overlay_flags);
       ImGui::Text("FPS: %.1f", ImGui::GetIO().Framerate);
+      if constexpr (filament_glfw_imgui::kTrackAllocations) {
+        ImGui::SameLine();
+        ImGui::Text("allocs/frame: %llu",
+                    (unsigned long long)alloc_stats.frame.allocs);
+      }
+      ImGui::SameLine();
+      ImGui::Text("imgui: %llu allocs/frame, %zu KiB pooled",
+                  (unsigned long long)imgui_allocs.frame.allocs,
+                  imgui_allocs.reserved_bytes / 1024);
+      ImGui::SameLine();
+      ImGui::Text("tasks: %u resumed/frame, %u live",
+                  scheduler_->stats().resumed, scheduler_->stats().tasks);
+      const filament_glfw_imgui::UploadStats& uploads = uploads_->stats();
+      ImGui::SameLine();
+      ImGui::Text("uploads: %zu KiB/frame, %u queued (%zu KiB)",
+                  uploads.bytes / 1024, uploads.queued,
+                  uploads.queued_bytes / 1024);
       ImGui::End();
     }
 
@@ -228,11 +400,40 @@ class Demo {
       ImGui::Text("     w,a,s,d - move camera");
       ImGui::Text("         q,e - zoom");
       ImGui::Text("         o,p - change env");
+      ImGui::Text("           i - toggle stress scene");
+      ImGui::Text("           m - toggle gpu memory");
+      ImGui::Text("           f - toggle frame profiler");
       ImGui::End();
       ImGui::PopFont();
     }
+
+    if (stress_.size()) {
+      AnimateStressScene();
+
+      ImGui::SetNextWindowPos(ImVec2(10, 235));
+      ImGui::SetNextWindowSize(ImVec2(0, 0));
+      ImGui::Begin("StressStats", nullptr, overlay_flags);
+      ImGui::Text("instances: %zu", stress_.size());
+      ImGui::Text("build: %.1f ms", stress_build_ms_);
+      const fs::TransformBatchStats& transforms = stress_.transforms().stats();
+      ImGui::Text("transforms: %.3f ms", transforms.update_ms);
+      ImGui::Text("  compose: %.3f ms", transforms.compose_ms);
+      ImGui::Text("  commit: %.3f ms", transforms.commit_ms);
+      ImGui::Text("lod select: %.3f ms", stress_lod_ms_);
+      const auto& lod_counts = stress_.lod_counts();
+      for (size_t lod = 0; lod < lod_counts.size(); ++lod) {
+        ImGui::Text("  lod %zu: %u", lod, lod_counts[lod]);
+      }
+      ImGui::Text("triangles: %zu", stress_.TriangleCount());
+      ImGui::End();
+    }
     ImGui::PopStyleColor();
 
+    if (show_gpu_memory_) {
+      filament_glfw_imgui::ShowGpuMemoryWindow(&show_gpu_memory_);
+    }
+    if (show_profiler_) profiler_window_.Show(&show_profiler_);
+
     orbit_controller_.Update();
     orbit_controller_.ApplyTo(camera_);
   }
@@ -248,14 +449,153 @@ class Demo {
     camera_->setProjection(45.0, aspect, 0.3, 1000, Camera::Fov::VERTICAL);
     view_->setViewport({0, 0, width_px, height_px});
 
+    if (stress_.size()) {
+      const ScopedProfileZone zone("SelectLods");
+      const auto start = std::chrono::steady_clock::now();
+      stress_.SelectLods(fs::MakeLodView(*camera_, height_px));
+      stress_lod_ms_ = std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    }
+
+    const ScopedProfileZone zone("Renderer::render");
     renderer.render(view_);
   }
 
+  void SwitchEnvironment(int i_env) {
+    if (i_env == i_env_) return;
+    i_env_ = i_env;
+    Logger::Default().Log(LogLevel::kInfo, "i_env %d", i_env_);
+    scheduler_->Spawn(LoadEnvironment(i_env_, ++env_loads_));
+  }
+
+  // Decodes environment 'i_env' on a worker thread, a band at a time, and
+  // uploads each band at low priority, so switching costs neither a long frame
+  // nor a full-size copy of the image. Then shows it coarsely and starts
+  // refining it. Stops after any step if another switch started meanwhile.
+  filament_glfw_imgui::FrameTask LoadEnvironment(int i_env, uint32_t load) {
+    const fs::EnvSettings settings = env_prefilter_->settings();
+    if (settings.cpu_prefilter) {  // Filters the whole image on the CPU.
+      fs::EquirectImage image;
+      co_await scheduler_->Worker([&settings, &image, i_env] {
+        image = fs::DecodeEquirectImage(kEnvNames[i_env], settings);
+      });
+      if (load != env_loads_) co_return;
+      ShowEnvironment(
+          env_prefilter_->LoadEquirectProgressive(std::move(image), env_));
+      co_return;
+    }
+
+    fs::EquirectStream stream;
+    bool opened = false;
+    co_await scheduler_->Worker([&settings, &stream, &opened, i_env] {
+      opened = stream.Open(kEnvNames[i_env], settings);
+    });
+    if (load != env_loads_ || !opened) co_return;
+
+    env_prefilter_->BeginEquirect(stream);
+    while (!stream.done()) {
+      fs::Band band = env_prefilter_->AcquireBand();
+      if (!band) {  // Every band is on its way to the engine.
+        co_await scheduler_->NextFrame();
+        if (load != env_loads_) co_return;
+        continue;
+      }
+      const int y = stream.row();
+      int rows = 0;
+      co_await scheduler_->Worker([&stream, &band, &rows] {
+        rows = stream.ReadBand(fs::EnvPrefilter::kBandRows, band.pixels());
+      });
+      if (load != env_loads_) co_return;  // 'band' goes back unused.
+      env_prefilter_->UploadBand(std::move(band), y, rows);
+    }
+    while (env_prefilter_->uploading_bands()) {
+      co_await scheduler_->NextFrame();
+      if (load != env_loads_) co_return;
+    }
+    ShowEnvironment(env_prefilter_->FinishEquirect(stream, env_));
+  }
+
+  // Shows env_ if 'loaded', and refines it while there's refining to do.
+  void ShowEnvironment(bool loaded) {
+    if (loaded) {
+      scene_->setSkybox(env_.skybox());
+      scene_->setIndirectLight(env_.ibl());
+    }
+    if (env_prefilter_->refining() && !refining_env_) {
+      refining_env_ = true;
+      scheduler_->Spawn(RefineEnvironment());
+    }
+  }
+
+  // Progressively-loaded environments get refined a little every frame, with
+  // the CPU-filtered steps on a worker thread. A switch while refining
+  // restarts refinement, which this task picks up.
+  filament_glfw_imgui::FrameTask RefineEnvironment() {
+    while (env_prefilter_->refining()) {
+      const fs::RefineJob job = env_prefilter_->TakeRefineJob();
+      if (job) co_await scheduler_->Worker(job);
+      if (env_prefilter_->Refine(env_)) {
+        scene_->setSkybox(env_.skybox());
+        scene_->setIndirectLight(env_.ibl());
+      }
+      if (!job) co_await scheduler_->NextFrame();
+    }
+    refining_env_ = false;
+  }
+
+  // Adds a grid of kStressGridSize^2 instanced spheres under the visual, or
+  // removes it.
+  void ToggleStressScene() {
+    if (stress_.size()) {
+      stress_.RemoveFromScene(*scene_);
+      stress_ = {};
+      return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    if (!stress_pool_) stress_pool_ = std::make_unique<fs::WorkerPool>();
+    const MaterialPackage lit =
+        PackageFor(*engine_, resources_->lit_vertex_color_material);
+    stress_ = fs::VisualSphereInstances(
+        *engine_, *material_cache_, (const uint8_t*)lit.data, lit.size,
+        kStressGridSize * kStressGridSize);
+    stress_.AddToScene(*scene_);
+    stress_build_ms_ = std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    Logger::Default().Log(LogLevel::kInfo,
+                          "Stress scene: %zu instances in %.1f ms",
+                          stress_.size(), stress_build_ms_);
+  }
+
+  // Bobs every instance, so each frame has a full set of transform updates.
+  void AnimateStressScene() {
+    const float time = float(ImGui::GetTime());
+    stress_.transforms().Update(
+        stress_pool_.get(), [time](const fs::TransformBatch::Chunk& chunk) {
+          constexpr float kSpacing = 0.4f;
+          constexpr float kOffset = -0.5f * kSpacing * (kStressGridSize - 1);
+          for (size_t i = chunk.begin; i < chunk.end; ++i) {
+            const int x = int(i % kStressGridSize);
+            const int z = int(i / kStressGridSize);
+            chunk.x[i] = kOffset + x * kSpacing;
+            chunk.y[i] = -1.5f + 0.1f * std::sin(time * 2 + 0.3f * (x + z));
+            chunk.z[i] = kOffset + z * kSpacing;
+            chunk.scale[i] = 0.12f;
+          }
+        });
+
+    const ScopedProfileZone zone("CommitTransforms");
+    stress_.CommitTransforms(stress_pool_.get());
+  }
+
   ~Demo() {
     if (!engine_) return;
 
     orbit_controller_ = {};
     visual_ = {};
+    stress_ = {};
     env_ = {};
     env_prefilter_ = {};
 
@@ -271,7 +611,12 @@ class Demo {
   }
 
  private:
-  filament::Engine* engine_ = nullptr;  // Not owned.
+  filament::Engine* engine_ = nullptr;                            // Not owned.
+  filament_glfw_imgui::MaterialCache* material_cache_ = nullptr;  // Not owned.
+  filament_glfw_imgui::RetireQueue* retire_queue_ = nullptr;      // Not owned.
+  filament_glfw_imgui::FrameScheduler* scheduler_ = nullptr;      // Not owned.
+  filament_glfw_imgui::UploadScheduler* uploads_ = nullptr;       // Not owned.
+  const DemoResources* resources_ = nullptr;                      // Not owned.
 
   utils::Entity camera_entity_ = {};
   utils::Entity direct_light_ = {};
@@ -280,31 +625,348 @@ class Demo {
   filament::Scene* scene_ = nullptr;
   filament::Camera* camera_ = nullptr;
 
+  static constexpr uint64_t kScriptedEnvFrames = 120;
   int i_env_ = 0;
   std::unique_ptr<fs::EnvPrefilter> env_prefilter_;
   fs::Environment env_;
+  bool refining_env_ = false;  // RefineEnvironment() is running.
+  uint32_t env_loads_ = 0;     // LoadEnvironment() calls; the last one wins.
   fs::Visual visual_;
   fs::OrbitController orbit_controller_;
+
+  static constexpr int kStressGridSize = 100;
+  fs::VisualInstances stress_;
+  std::unique_ptr<fs::WorkerPool> stress_pool_;  // Updates stress_ transforms.
+  double stress_build_ms_ = 0;
+  double stress_lod_ms_ = 0;
+
+  bool show_gpu_memory_ = false;
+  bool show_profiler_ = false;
+  filament_glfw_imgui::ProfilerWindow profiler_window_;
+};
+
+// For --check-allocations: fails if any frame after warm-up allocates on the
+// main thread. Logging doesn't allocate either, so reports don't fail the
+// following frame.
+class AllocationCheck {
+ public:
+  static constexpr uint64_t kWarmupFrames = 300;
+  static constexpr uint64_t kCheckedFrames = 300;
+
+  // Call after each App::PollEvents(). Returns 'false' when done.
+  bool Update(const filament_glfw_imgui::AppAllocStats& stats) {
+    using filament_glfw_imgui::AppPhase;
+    if (stats.frames <= kWarmupFrames) return true;
+    if (stats.frame.allocs) {
+      ++failed_frames_;
+      char phases[160] = "";
+      for (size_t i = 0, n = 0; i < size_t(AppPhase::kCount); ++i) {
+        n += std::snprintf(phases + n, sizeof(phases) - n, ", %s %llu",
+                           AppPhaseName(AppPhase(i)),
+                           (unsigned long long)stats.phases[i].allocs);
+      }
+      Logger::Default().Log(LogLevel::kError,
+                            "frame %llu: %llu allocations (%llu from ImGui)%s",
+                            (unsigned long long)stats.frames,
+                            (unsigned long long)stats.frame.allocs,
+                            (unsigned long long)stats.frame.imgui_allocs,
+                            phases);
+    }
+    return stats.frames < kWarmupFrames + kCheckedFrames;
+  }
+
+  bool passed() const { return failed_frames_ == 0; }
+
+ private:
+  uint64_t failed_frames_ = 0;
 };
 
+// For --benchmark: after warm-up, samples a fixed number of scripted frames,
+// then writes a report of per-phase CPU times, memory peaks and UI sizes, and
+// compares it to a baseline report if there is one.
+class Benchmark {
+ public:
+  static constexpr uint64_t kWarmupFrames = 60;
+
+  struct Options {
+    const char* out_path = nullptr;  // Runs the benchmark if set.
+    const char* baseline_path = nullptr;
+    uint64_t frames = 600;
+    fs::RegressionThresholds thresholds;
+    bool gpu = false;  // Renders on the default backend rather than NOOP.
+  };
+
+  explicit Benchmark(const Options& options) : options_(options) {}
+
+  // Frames polled so far; drives the scripted input.
+  uint64_t frame() const { return frame_; }
+
+  // Call after each App::PollEvents(). Returns 'false' when done.
+  bool Update(const filament_glfw_imgui::AppAllocStats& stats,
+              const filament_glfw_imgui::ImGuiAllocStats& imgui_allocs) {
+    using filament_glfw_imgui::Profiler;
+    ++frame_;
+
+    // Profiles and allocation counts are of the frame that just ended, so
+    // they lag the frames SampleUi() sees by one.
+    if (frame_ > kWarmupFrames + 1) {
+      const Profiler& profiler = Profiler::Get();
+      if (profiler.frame_count()) {
+        times_.AddFrame(profiler.frame(profiler.frame_count() - 1));
+      }
+      allocs_ += stats.frame.allocs;
+      imgui_allocs_ += imgui_allocs.frame.allocs;
+      imgui_system_allocs_ += imgui_allocs.frame.system_allocs;
+    }
+    return frame_ <= kWarmupFrames + options_.frames;
+  }
+
+  // Call after App::EndUiFrame().
+  void SampleUi() {
+    const ImDrawData* draw_data = ImGui::GetDrawData();
+    if (frame_ <= kWarmupFrames || !draw_data) return;
+    size_t commands = 0;
+    for (int i = 0; i < draw_data->CmdListsCount; ++i) {
+      commands += draw_data->CmdLists[i]->CmdBuffer.Size;
+    }
+    ui_.Add(draw_data->TotalVtxCount, draw_data->TotalIdxCount, commands);
+  }
+
+  // Writes the report and compares it to the baseline, if any. Returns the
+  // exit code: 0 on success, 1 on regressions, 2 on errors.
+  int Finish(const filament_glfw_imgui::MaterialCache& materials,
+             const filament_glfw_imgui::ImGuiAllocStats& imgui_allocs) {
+    using namespace filament_glfw_imgui;
+    fs::BenchmarkReport report;
+    report.name = "demo";
+    times_.AppendTo(report);
+
+    auto& metrics = report.metrics;
+    metrics.emplace_back("frames", double(ui_.frames));
+    metrics.emplace_back("ui_vertices_mean", ui_.Mean(ui_.vertices));
+    metrics.emplace_back("ui_vertices_max", double(ui_.max_vertices));
+    metrics.emplace_back("ui_indices_mean", ui_.Mean(ui_.indices));
+    metrics.emplace_back("ui_indices_max", double(ui_.max_indices));
+    metrics.emplace_back("ui_draw_commands_mean", ui_.Mean(ui_.commands));
+    metrics.emplace_back("ui_draw_commands_max", double(ui_.max_commands));
+    if constexpr (kTrackAllocations) {
+      metrics.emplace_back("allocs_per_frame_mean", ui_.Mean(allocs_));
+    }
+    metrics.emplace_back("imgui_allocs_per_frame_mean",
+                         ui_.Mean(imgui_allocs_));
+    metrics.emplace_back("imgui_system_allocs_per_frame_mean",
+                         ui_.Mean(imgui_system_allocs_));
+    metrics.emplace_back("imgui_peak_live_bytes",
+                         double(imgui_allocs.peak_live_bytes));
+    metrics.emplace_back("imgui_pool_reserved_bytes",
+                         double(imgui_allocs.reserved_bytes));
+    metrics.emplace_back("material_build_ms", materials.build_ms());
+    metrics.emplace_back("material_package_bytes",
+                         double(materials.built_bytes()));
+
+    const GpuMemory& gpu_memory = GpuMemory::Get();
+    metrics.emplace_back("gpu_memory_peak_bytes",
+                         double(gpu_memory.total().peak_bytes));
+    for (size_t i = 0; i < size_t(GpuMemoryTag::kCount); ++i) {
+      std::string name = GpuMemoryTagName(GpuMemoryTag(i));
+      for (char& c : name) c = c == ' ' ? '_' : c;
+      const GpuMemoryUsage usage = gpu_memory.usage(GpuMemoryTag(i));
+      metrics.emplace_back("gpu_memory_" + name + "_peak_bytes",
+                           double(usage.peak_bytes));
+    }
+
+    rusage resources = {};
+    getrusage(RUSAGE_SELF, &resources);
+#if defined(__APPLE__)
+    const double max_rss_bytes = resources.ru_maxrss;
+#else
+    const double max_rss_bytes = resources.ru_maxrss * 1024.0;  // In KiB.
+#endif
+    metrics.emplace_back("max_rss_bytes", max_rss_bytes);
+
+    Logger& log = Logger::Default();
+    if (!fs::WriteBenchmarkJson(options_.out_path, report)) {
+      log.Log(LogLevel::kError, "--benchmark: can't write %s",
+              options_.out_path);
+      return 2;
+    }
+    for (const auto& [name, p] : report.phases) {
+      log.Log(LogLevel::kInfo, "%-24s p50 %7.3f  p90 %7.3f  p99 %7.3f ms",
+              name.c_str(), p.p50, p.p90, p.p99);
+    }
+    log.Log(LogLevel::kInfo, "--benchmark: wrote %s", options_.out_path);
+
+    if (!options_.baseline_path) return 0;
+    fs::BenchmarkValues baseline;
+    if (!fs::ReadBenchmarkJson(options_.baseline_path, baseline)) {
+      log.Log(LogLevel::kError, "--benchmark: can't read baseline %s",
+              options_.baseline_path);
+      return 2;
+    }
+    const int regressions =
+        fs::CompareBenchmarks(fs::FlattenBenchmark(report), baseline,
+                              options_.thresholds, log);
+    log.Log(regressions ? LogLevel::kError : LogLevel::kInfo,
+            "--benchmark: %d regressions against %s", regressions,
+            options_.baseline_path);
+    return regressions ? 1 : 0;
+  }
+
+ private:
+  struct UiStats {
+    uint64_t frames = 0;
+    uint64_t vertices = 0;
+    uint64_t indices = 0;
+    uint64_t commands = 0;
+    size_t max_vertices = 0;
+    size_t max_indices = 0;
+    size_t max_commands = 0;
+
+    void Add(size_t frame_vertices, size_t frame_indices,
+             size_t frame_commands) {
+      ++frames;
+      vertices += frame_vertices;
+      indices += frame_indices;
+      commands += frame_commands;
+      max_vertices = std::max(max_vertices, frame_vertices);
+      max_indices = std::max(max_indices, frame_indices);
+      max_commands = std::max(max_commands, frame_commands);
+    }
+    double Mean(uint64_t total) const {
+      return frames ? double(total) / frames : 0;
+    }
+  };
+
+  Options options_;
+  uint64_t frame_ = 0;
+  fs::PhaseTimes times_;
+  UiStats ui_;
+  uint64_t allocs_ = 0;
+  uint64_t imgui_allocs_ = 0;
+  uint64_t imgui_system_allocs_ = 0;
+};
+
+struct Args {
+  // --check-allocations runs a fixed number of frames, and exits with 1 if any
+  // steady-state frame allocated.
+  bool check_allocations = false;
+
+  // --benchmark out.json [--frames N] [--baseline base.json]
+  //     [--time-threshold ratio] [--memory-threshold ratio] [--gpu]
+  Benchmark::Options benchmark;
+
+  // --resources FILE reads materials and fonts from a resource pack, rather
+  // than the copies linked in.
+  const char* resources_path = nullptr;
+};
+
+// Returns 'false' and logs an error on bad arguments.
+bool ParseArgs(int argc, char** argv, Args& args) {
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    if (!std::strcmp(arg, "--check-allocations")) {
+      args.check_allocations = true;
+      continue;
+    }
+    if (!std::strcmp(arg, "--gpu")) {
+      args.benchmark.gpu = true;
+      continue;
+    }
+
+    // The rest take a value.
+    const char* value = i + 1 < argc ? argv[++i] : nullptr;
+    char* end = nullptr;
+    if (!value) {
+      // Falls through to the error below.
+    } else if (!std::strcmp(arg, "--benchmark")) {
+      args.benchmark.out_path = value;
+      continue;
+    } else if (!std::strcmp(arg, "--resources")) {
+      args.resources_path = value;
+      continue;
+    } else if (!std::strcmp(arg, "--baseline")) {
+      args.benchmark.baseline_path = value;
+      continue;
+    } else if (!std::strcmp(arg, "--frames")) {
+      args.benchmark.frames = std::strtoull(value, &end, 10);
+      if (*end == '\0' && args.benchmark.frames > 0) continue;
+    } else if (!std::strcmp(arg, "--time-threshold")) {
+      args.benchmark.thresholds.time_ratio = std::strtod(value, &end);
+      if (*end == '\0') continue;
+    } else if (!std::strcmp(arg, "--memory-threshold")) {
+      args.benchmark.thresholds.memory_ratio = std::strtod(value, &end);
+      if (*end == '\0') continue;
+    }
+    Logger::Default().Log(LogLevel::kError, "bad argument: %s %s", arg,
+                          value ? value : "");
+    return false;
+  }
+  return true;
+}
+
 int main(int argc, char** argv) {
+  Args args;
+  if (!ParseArgs(argc, argv, args)) return 2;
+  const bool check_allocations = args.check_allocations;
+  if (check_allocations && !filament_glfw_imgui::kTrackAllocations) {
+    Logger::Default().Log(LogLevel::kError,
+                          "--check-allocations needs a build with allocation "
+                          "tracking: TRACK_ALLOCATIONS=1 ./build.sh demo");
+    return 1;
+  }
+  AllocationCheck allocation_check;
+
+  // Fonts and materials point into the pack, so it's mapped until exit.
+  DemoResources resources = LinkedResources();
+  fs::ResourcePack pack;
+  if (args.resources_path) {
+    pack = fs::ResourcePack(args.resources_path);
+    if (!pack.valid()) {
+      Logger::Default().Log(LogLevel::kError, "--resources: can't read %s",
+                            args.resources_path);
+      return 2;
+    }
+    if (!PackedResources(pack, resources)) return 2;
+  }
+
   // Initialize GLFW
   if (!glfwInit()) {
-    std::cout << "Failed to init GLFW." << std::endl;
+    Logger::Default().Log(LogLevel::kError, "Failed to init GLFW.");
     return -1;
   }
 
+  // Benchmarks measure CPU time on the NOOP backend by default. They still
+  // need a display for the (hidden, fixed-size) window, e.g. Xvfb.
+  std::optional<Benchmark> benchmark;
+  auto backend = filament::Engine::Backend::DEFAULT;
+  if (args.benchmark.out_path) {
+    benchmark.emplace(args.benchmark);
+    if (!args.benchmark.gpu) backend = filament::Engine::Backend::NOOP;
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  }
+
   // Set the GLFW hint to disable the creation of a context
   glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
   GLFWwindow* window =
-      glfwCreateWindow(640, 480, "Filament Glfw ImGui", NULL, NULL);
+      benchmark ? glfwCreateWindow(1280, 720, "Filament Glfw ImGui", NULL, NULL)
+                : glfwCreateWindow(640, 480, "Filament Glfw ImGui", NULL, NULL);
 
-  auto app = filament_glfw_imgui::App(window, RESOURCES_FILAMENT_IMGUI_DATA,
-                                      RESOURCES_FILAMENT_IMGUI_SIZE);
+  auto app = filament_glfw_imgui::App(window, resources.imgui_material,
+                                      kMaterialPackageCount,
+                                      &Logger::Default(), backend);
   if (!app.Init()) return 1;  // App does logging by default.
 
-  auto demo = Demo(app.engine());
+  // Windows saved by earlier interactive runs would change what's drawn.
+  if (benchmark) ImGui::GetIO().IniFilename = nullptr;
+
+  auto demo = Demo(app.engine(), app.material_cache(), app.retire_queue(),
+                   app.frame_scheduler(), app.upload_scheduler(), &resources);
   demo.Init();
+  Logger::Default().Log(LogLevel::kInfo,
+                        "Materials: %zu built from %zu bytes in %.1f ms",
+                        app.material_cache()->builds(),
+                        app.material_cache()->built_bytes(),
+                        app.material_cache()->build_ms());
 
   // Loop until the user closes the window
   bool render_skipped = false;
@@ -319,27 +981,65 @@ int main(int argc, char** argv) {
       std::this_thread::sleep_for(std::chrono::milliseconds(1));
     } else {
       const glfw_input::State& input = *app.PollEvents();
-      demo.ProcessInput(input);
+      if (check_allocations && !allocation_check.Update(app.alloc_stats())) {
+        break;
+      }
+      if (benchmark && !benchmark->Update(app.alloc_stats(),
+                                          app.imgui_allocator()->stats())) {
+        break;
+      }
+      {
+        const ScopedProfileZone zone("Demo::ProcessInput");
+        if (benchmark) {
+          demo.ProcessScriptedInput(benchmark->frame());
+        } else {
+          demo.ProcessInput(input);
+        }
+      }
       app.BeginUiFrame();
-      demo.UpdateUi();
+      {
+        const ScopedProfileZone zone("Demo::UpdateUi");
+        demo.UpdateUi(app.alloc_stats(), app.imgui_allocator()->stats());
+      }
       app.EndUiFrame();
+      if (benchmark) benchmark->SampleUi();
     }
 
     if (app.BeginRender()) {
       render_skipped = false;
-      demo.Render(*app.renderer());
-      app.renderer()->render(app.ui()->view());
+      {
+        const ScopedProfileZone zone("Demo::Render");
+        demo.Render(*app.renderer());
+      }
+      {
+        const ScopedProfileZone zone("Renderer::render ui");
+        app.renderer()->render(app.ui()->view());
+      }
+      const ScopedProfileZone zone("Renderer::endFrame");
       app.renderer()->endFrame();
     } else {
       render_skipped = true;
     }
   }
 
+  // Report before teardown, while GPU memory peaks are still recorded.
+  const int benchmark_result =
+      benchmark ? benchmark->Finish(*app.material_cache(),
+                                    app.imgui_allocator()->stats())
+                : 0;
+
   demo = {};
   app = {};
 
   glfwDestroyWindow(window);
   glfwTerminate();
 
-  return 0;
+  if (check_allocations) {
+    Logger::Default().Log(
+        allocation_check.passed() ? LogLevel::kInfo : LogLevel::kError,
+        "--check-allocations: %s",
+        allocation_check.passed() ? "passed" : "FAILED");
+    return allocation_check.passed() ? 0 : 1;
+  }
+  return benchmark_result;
 }
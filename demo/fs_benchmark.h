@@ -0,0 +1,141 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Frame-time statistics, JSON reports, and comparison against a baseline, for
+// benchmark runs.
+//
+// A report is written as:
+//
+//   {
+//     "benchmark": "demo",
+//     "phases": {
+//       "frame": {"samples": 600, "mean_ms": 1.2, "p50_ms": 1.1, ...},
+//       "App::EndUiFrame": {...},
+//       ...
+//     },
+//     "metrics": {"gpu_memory_peak_bytes": 1234, ...}
+//   }
+//
+// and read back flattened to dotted keys, e.g. "phases.frame.p50_ms", so
+// names mustn't contain dots.
+//
+// Usage:
+//
+//   fs::PhaseTimes times;
+//   // Each frame, e.g. right after App::PollEvents():
+//   times.AddFrame(profiler.frame(profiler.frame_count() - 1));
+//   ...
+//   fs::BenchmarkReport report;
+//   report.name = "demo";
+//   times.AppendTo(report);
+//   report.metrics.push_back({"gpu_memory_peak_bytes", double(peak)});
+//   fs::WriteBenchmarkJson("out.json", report);
+//
+//   fs::BenchmarkValues baseline;
+//   if (fs::ReadBenchmarkJson("baseline.json", baseline)) {
+//     const int regressions = fs::CompareBenchmarks(
+//         fs::FlattenBenchmark(report), baseline, {}, logger);
+//   }
+//
+
+#ifndef FS_BENCHMARK_H_
+#define FS_BENCHMARK_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "filament_glfw_imgui/logger.h"
+#include "filament_glfw_imgui/profiler.h"
+
+namespace fs {
+
+using filament_glfw_imgui::Logger;
+using filament_glfw_imgui::LogLevel;
+
+struct Percentiles {
+  size_t samples = 0;
+  double mean = 0;
+  double p50 = 0;
+  double p90 = 0;
+  double p99 = 0;
+  double max = 0;
+};
+
+// Nearest-rank percentiles. Sorts 'samples'.
+Percentiles ComputePercentiles(std::vector<double>& samples);
+
+struct BenchmarkReport {
+  std::string name;
+  std::vector<std::pair<std::string, Percentiles>> phases;  // In ms.
+  std::vector<std::pair<std::string, double>> metrics;
+};
+
+// Collects per-frame milliseconds of the whole frame, as "frame", and of each
+// profiler zone name, summed over the zone's occurrences in the frame. Zones
+// only get samples from frames they occur in.
+class PhaseTimes {
+ public:
+  void AddFrame(const filament_glfw_imgui::ProfileFrame& frame);
+
+  // Appends "frame" first, then zones in the order they were first seen.
+  void AppendTo(BenchmarkReport& report);
+
+ private:
+  struct Phase {
+    std::string name;
+    std::vector<double> ms;
+  };
+  std::vector<double>& Samples(const char* name);
+
+  std::vector<double> frame_ms_;
+  std::vector<Phase> phases_;
+};
+
+bool WriteBenchmarkJson(const char* path, const BenchmarkReport& report);
+
+// Numeric values by dotted key, e.g. {"phases.frame.p50_ms", 1.1}.
+using BenchmarkValues = std::vector<std::pair<std::string, double>>;
+
+BenchmarkValues FlattenBenchmark(const BenchmarkReport& report);
+
+// Reads the numbers of any JSON document into 'values'. Returns 'false' if
+// the file can't be read or isn't valid JSON.
+bool ReadBenchmarkJson(const char* path, BenchmarkValues& values);
+
+struct RegressionThresholds {
+  // A phase percentile regresses when it's this much slower, relative to the
+  // baseline, AND at least min_time_ms slower, so tiny phases don't flap.
+  double time_ratio = 0.10;
+  double min_time_ms = 0.05;
+
+  // A "*_bytes" metric regresses when it's this much larger.
+  double memory_ratio = 0.05;
+};
+
+// Compares the p50, p90 and p99 of every phase, and every "*_bytes" metric,
+// present in both. Logs each regression (and improvement) to 'log', and
+// returns the number of regressions.
+int CompareBenchmarks(const BenchmarkValues& current,
+                      const BenchmarkValues& baseline,
+                      const RegressionThresholds& thresholds, Logger& log);
+
+}  // namespace fs
+
+#include "fs_benchmark_impl.h"
+
+#endif  // FS_BENCHMARK_H_
@@ -0,0 +1,275 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+#ifndef FS_BENCHMARK_IMPL_H_
+#define FS_BENCHMARK_IMPL_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace fs {
+
+inline Percentiles ComputePercentiles(std::vector<double>& samples) {
+  Percentiles p;
+  p.samples = samples.size();
+  if (samples.empty()) return p;
+  std::sort(samples.begin(), samples.end());
+  const auto rank = [&samples](double q) {
+    const size_t i = size_t(std::ceil(q * samples.size()));
+    return samples[std::clamp<size_t>(i, 1, samples.size()) - 1];
+  };
+  double sum = 0;
+  for (double s : samples) sum += s;
+  p.mean = sum / samples.size();
+  p.p50 = rank(0.50);
+  p.p90 = rank(0.90);
+  p.p99 = rank(0.99);
+  p.max = samples.back();
+  return p;
+}
+
+inline void PhaseTimes::AddFrame(
+    const filament_glfw_imgui::ProfileFrame& frame) {
+  frame_ms_.push_back(frame.ms());
+
+  // A name can occur more than once per frame, so sum before sampling. Frames
+  // hold a few dozen zones at most, so quadratic is fine.
+  for (uint32_t i = 0; i < frame.zone_count; ++i) {
+    const char* name = frame.zones[i].name;
+    bool seen = false;
+    for (uint32_t j = 0; j < i && !seen; ++j) {
+      seen = std::strcmp(frame.zones[j].name, name) == 0;
+    }
+    if (seen) continue;
+    uint64_t ns = 0;
+    for (uint32_t j = i; j < frame.zone_count; ++j) {
+      const filament_glfw_imgui::ProfileZone& zone = frame.zones[j];
+      if (std::strcmp(zone.name, name) == 0) ns += zone.end_ns - zone.start_ns;
+    }
+    Samples(name).push_back(ns * 1e-6);
+  }
+}
+
+inline void PhaseTimes::AppendTo(BenchmarkReport& report) {
+  report.phases.emplace_back("frame", ComputePercentiles(frame_ms_));
+  for (Phase& phase : phases_) {
+    report.phases.emplace_back(phase.name, ComputePercentiles(phase.ms));
+  }
+}
+
+inline std::vector<double>& PhaseTimes::Samples(const char* name) {
+  for (Phase& phase : phases_) {
+    if (phase.name == name) return phase.ms;
+  }
+  phases_.push_back({name, {}});
+  return phases_.back().ms;
+}
+
+inline bool WriteBenchmarkJson(const char* path,
+                               const BenchmarkReport& report) {
+  FILE* file = std::fopen(path, "w");
+  if (!file) return false;
+  // Names are zone names and metric keys from code, so they aren't escaped.
+  std::fprintf(file, "{\n  \"benchmark\": \"%s\",\n  \"phases\": {",
+               report.name.c_str());
+  for (size_t i = 0; i < report.phases.size(); ++i) {
+    const auto& [name, p] = report.phases[i];
+    std::fprintf(file,
+                 "%s\n    \"%s\": {\"samples\": %zu, \"mean_ms\": %.4f, "
+                 "\"p50_ms\": %.4f, \"p90_ms\": %.4f, \"p99_ms\": %.4f, "
+                 "\"max_ms\": %.4f}",
+                 i ? "," : "", name.c_str(), p.samples, p.mean, p.p50, p.p90,
+                 p.p99, p.max);
+  }
+  std::fprintf(file, "\n  },\n  \"metrics\": {");
+  for (size_t i = 0; i < report.metrics.size(); ++i) {
+    const auto& [name, value] = report.metrics[i];
+    std::fprintf(file, "%s\n    \"%s\": %.17g", i ? "," : "", name.c_str(),
+                 value);
+  }
+  std::fprintf(file, "\n  }\n}\n");
+  return std::fclose(file) == 0;
+}
+
+inline BenchmarkValues FlattenBenchmark(const BenchmarkReport& report) {
+  BenchmarkValues values;
+  for (const auto& [name, p] : report.phases) {
+    const std::string prefix = "phases." + name + ".";
+    values.emplace_back(prefix + "samples", double(p.samples));
+    values.emplace_back(prefix + "mean_ms", p.mean);
+    values.emplace_back(prefix + "p50_ms", p.p50);
+    values.emplace_back(prefix + "p90_ms", p.p90);
+    values.emplace_back(prefix + "p99_ms", p.p99);
+    values.emplace_back(prefix + "max_ms", p.max);
+  }
+  for (const auto& [name, value] : report.metrics) {
+    values.emplace_back("metrics." + name, value);
+  }
+  return values;
+}
+
+namespace internal {
+
+// Just enough JSON to read reports back: objects, arrays, strings without
+// unicode escapes, numbers, true/false/null. Only numbers are kept.
+class JsonNumbers {
+ public:
+  JsonNumbers(const char* p, const char* end, BenchmarkValues& values)
+      : p_(p), end_(end), values_(values) {}
+
+  bool Parse() {
+    std::string key;
+    if (!Value(key)) return false;
+    SkipSpace();
+    return p_ == end_;
+  }
+
+ private:
+  void SkipSpace() {
+    while (p_ < end_ && std::strchr(" \t\r\n", *p_)) ++p_;
+  }
+
+  bool Consume(char c) {
+    SkipSpace();
+    if (p_ == end_ || *p_ != c) return false;
+    ++p_;
+    return true;
+  }
+
+  bool String(std::string& out) {
+    if (!Consume('"')) return false;
+    out.clear();
+    while (p_ < end_ && *p_ != '"') {
+      if (*p_ == '\\' && ++p_ == end_) return false;
+      out.push_back(*p_++);
+    }
+    return Consume('"');
+  }
+
+  bool Value(const std::string& key) {
+    SkipSpace();
+    if (p_ == end_) return false;
+    if (*p_ == '{') {
+      ++p_;
+      if (Consume('}')) return true;
+      std::string name;
+      do {
+        if (!String(name) || !Consume(':')) return false;
+        if (!Value(key.empty() ? name : key + "." + name)) return false;
+      } while (Consume(','));
+      return Consume('}');
+    }
+    if (*p_ == '[') {
+      ++p_;
+      if (Consume(']')) return true;
+      size_t i = 0;
+      do {
+        if (!Value(key + "." + std::to_string(i++))) return false;
+      } while (Consume(','));
+      return Consume(']');
+    }
+    if (*p_ == '"') {
+      std::string ignored;
+      return String(ignored);
+    }
+    for (const char* word : {"true", "false", "null"}) {
+      const size_t n = std::strlen(word);
+      if (size_t(end_ - p_) >= n && std::strncmp(p_, word, n) == 0) {
+        p_ += n;
+        return true;
+      }
+    }
+    // The buffer is null-terminated, so strtod can't run past it.
+    char* number_end = nullptr;
+    const double number = std::strtod(p_, &number_end);
+    if (number_end == p_) return false;
+    p_ = number_end;
+    values_.emplace_back(key, number);
+    return true;
+  }
+
+  const char* p_;
+  const char* const end_;
+  BenchmarkValues& values_;
+};
+
+inline const double* FindValue(const BenchmarkValues& values,
+                               const std::string& key) {
+  for (const auto& [name, value] : values) {
+    if (name == key) return &value;
+  }
+  return nullptr;
+}
+
+inline bool EndsWith(const std::string& s, const char* suffix) {
+  const size_t n = std::strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+}  // namespace internal
+
+inline bool ReadBenchmarkJson(const char* path, BenchmarkValues& values) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return false;
+  const std::string text((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+  values.clear();
+  return internal::JsonNumbers(text.c_str(), text.c_str() + text.size(),
+                               values)
+      .Parse();
+}
+
+inline int CompareBenchmarks(const BenchmarkValues& current,
+                             const BenchmarkValues& baseline,
+                             const RegressionThresholds& thresholds,
+                             Logger& log) {
+  int regressions = 0;
+  for (const auto& [key, value] : current) {
+    const bool is_time =
+        key.starts_with("phases.") &&
+        (internal::EndsWith(key, ".p50_ms") ||
+         internal::EndsWith(key, ".p90_ms") ||
+         internal::EndsWith(key, ".p99_ms"));
+    const bool is_memory = internal::EndsWith(key, "_bytes");
+    if (!is_time && !is_memory) continue;
+    const double* base = internal::FindValue(baseline, key);
+    if (!base) continue;
+
+    const double ratio = is_time ? thresholds.time_ratio
+                                 : thresholds.memory_ratio;
+    const double min_delta = is_time ? thresholds.min_time_ms : 0;
+    const double delta = value - *base;
+    const double change = *base > 0 ? delta / *base : 0;
+    if (delta > min_delta && value > *base * (1 + ratio)) {
+      ++regressions;
+      log.Log(LogLevel::kError, "REGRESSION %s: %.4g -> %.4g (%+.1f%%)",
+              key.c_str(), *base, value, change * 100);
+    } else if (-delta > min_delta && value < *base * (1 - ratio)) {
+      log.Log(LogLevel::kInfo, "improved %s: %.4g -> %.4g (%+.1f%%)",
+              key.c_str(), *base, value, change * 100);
+    }
+  }
+  return regressions;
+}
+
+}  // namespace fs
+
+#endif  // FS_BENCHMARK_IMPL_H_
@@ -0,0 +1,166 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// CPU versions of IBLPrefilterContext's equirect-to-cubemap and specular
+// filters, for backends that can't run them (e.g. NOOP in headless CI), and as
+// a reference to benchmark and regression-test the GPU path against.
+//
+// Follows the same conventions as the GPU filters: cmgen's cubemap face
+// orientation, the GGX kernel, and the roughness-per-level mapping.
+//
+// Usage:
+//
+//   fs::WorkerPool pool;
+//   fs::CpuCubemap sky = fs::EquirectToCubemapCpu(pixels, w, h, 256, &pool);
+//   fs::CpuCubemap refl = fs::SpecularFilterCpu(sky, 256, 5, 1024, 1, &pool);
+//   filament::Texture* ibl_cube = fs::UploadCubemap(engine, refl);
+//
+
+#ifndef FS_CPU_PREFILTER_H_
+#define FS_CPU_PREFILTER_H_
+
+#include <filament/Engine.h>
+#include <filament/Texture.h>
+#include <math/vec3.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "filament_glfw_imgui/gpu_memory.h"
+#include "filament_glfw_imgui/upload_scheduler.h"
+#include "fs_worker_pool.h"
+
+namespace fs {
+
+// Textures and buffers from fs helpers are accounted in gpu_memory.h.
+using filament_glfw_imgui::DestroyTracked;
+using filament_glfw_imgui::GpuMemoryTag;
+using filament_glfw_imgui::TrackBuffer;
+using filament_glfw_imgui::TrackTexture;
+using filament_glfw_imgui::UploadPriority;
+using filament_glfw_imgui::UploadScheduler;
+
+// A cubemap with a mip chain, in CPU memory.
+struct CpuCubemap {
+  // Faces, in Filament order (+X, -X, +Y, -Y, +Z, -Z).
+  static constexpr int kFaces = 6;
+
+  uint32_t size = 0;  // Of level 0.
+
+  // levels[i] holds all 6 faces of level i, each (size >> i)^2 texels,
+  // row-major, top row first.
+  std::vector<std::vector<filament::math::float3>> levels;
+
+  uint32_t LevelSize(size_t level) const {
+    return std::max(size >> level, 1u);
+  }
+};
+
+// Resamples a 'width' x 'height' equirect into a 'size' cubemap, and box
+// filters a full mip chain.
+CpuCubemap EquirectToCubemapCpu(const filament::math::float3* equirect,
+                                int width, int height, uint32_t size,
+                                WorkerPool* pool);
+
+// GGX-prefiltered reflections from 'cube' (which needs a full mip chain), with
+// 'level_count' levels of increasing roughness.
+CpuCubemap SpecularFilterCpu(const CpuCubemap& cube, uint32_t size,
+                             uint8_t level_count, uint16_t sample_count,
+                             float lod_offset, WorkerPool* pool);
+
+// SpecularFilterCpu(...) for faces ['face_begin', 'face_end') of one 'level'
+// only, into 'texels', which holds all 6 faces of that level.
+void SpecularFilterFacesCpu(const CpuCubemap& cube, uint32_t size,
+                            size_t level, uint8_t level_count,
+                            uint16_t sample_count, float lod_offset,
+                            int face_begin, int face_end,
+                            filament::math::float3* texels, WorkerPool* pool);
+
+// EquirectToCubemapCpu(...) then SpecularFilterCpu(...), split into steps
+// short enough to spread over frames, or to run on a worker thread between
+// them: the sky cube first, then one face of one reflections level per step.
+//  - Run(...) may be called on any thread, one at a time. Levels below
+//    levels_done() can be read meanwhile on another.
+class CpuPrefilterSteps {
+ public:
+  // Filters a 'width' x 'height' 'equirect', as the functions above would.
+  CpuPrefilterSteps(std::vector<filament::math::float3> equirect, int width,
+                    int height, uint32_t size, uint8_t level_count,
+                    uint16_t sample_count, float lod_offset);
+
+  CpuPrefilterSteps(const CpuPrefilterSteps&) = delete;
+  CpuPrefilterSteps& operator=(const CpuPrefilterSteps&) = delete;
+
+  // Runs the next step, if any are left.
+  void Run(WorkerPool* pool);
+
+  int step_count() const { return 1 + level_count_ * CpuCubemap::kFaces; }
+  int steps_done() const { return steps_done_.load(std::memory_order_acquire); }
+  bool done() const { return steps_done() == step_count(); }
+
+  // Levels of reflections() that are fully filtered.
+  size_t levels_done() const {
+    return size_t(std::max(steps_done() - 1, 0) / CpuCubemap::kFaces);
+  }
+
+  // Estimated filter samples (texels x samples per texel) of the next step.
+  uint64_t next_cost() const;
+
+  // Every level is allocated up front; see levels_done().
+  const CpuCubemap& reflections() const { return reflections_; }
+
+ private:
+  std::vector<filament::math::float3> equirect_;  // Freed by the first step.
+  int width_;
+  int height_;
+  uint8_t level_count_;
+  uint16_t sample_count_;
+  float lod_offset_;
+
+  CpuCubemap sky_;
+  CpuCubemap reflections_;
+  std::atomic<int> steps_done_{0};
+};
+
+// Creates an R11F_G11F_B10F cubemap texture that takes uploads, accounted in
+// gpu_memory.h.
+filament::Texture* CreateUploadCubemap(filament::Engine& engine,
+                                       uint32_t size, uint8_t levels);
+
+// Uploads 'level' of 'cube' to that level of 'texture'.
+//  - With 'uploads', it's queued there at 'priority' instead, and the level
+//    holds garbage until it's submitted.
+void UploadCubemapLevel(filament::Engine& engine, filament::Texture* texture,
+                        const CpuCubemap& cube, size_t level,
+                        UploadScheduler* uploads = nullptr,
+                        UploadPriority priority = UploadPriority::kNormal);
+
+// Creates an R11F_G11F_B10F cubemap texture and uploads every level of 'cube'.
+//  - With 'uploads', the levels are queued there at 'priority' instead, and
+//    the texture holds garbage until they're submitted.
+filament::Texture* UploadCubemap(
+    filament::Engine& engine, const CpuCubemap& cube,
+    UploadScheduler* uploads = nullptr,
+    UploadPriority priority = UploadPriority::kNormal);
+
+}  // namespace fs
+
+#include "fs_cpu_prefilter_impl.h"
+
+#endif  // FS_CPU_PREFILTER_H_
@@ -0,0 +1,444 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+#ifndef FS_CPU_PREFILTER_IMPL_H_
+#define FS_CPU_PREFILTER_IMPL_H_
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+namespace fs {
+
+// Work is split into tiles of this many rows of one face.
+constexpr uint32_t kCpuPrefilterTileRows = 8;
+
+// Direction through face coordinates (cx, cy) in [-1, 1], with +cy up.
+inline filament::math::float3 CubeDirection(int face, float cx, float cy) {
+  switch (face) {
+    case 0:
+      return {1, cy, -cx};
+    case 1:
+      return {-1, cy, cx};
+    case 2:
+      return {cx, 1, -cy};
+    case 3:
+      return {cx, -1, cy};
+    case 4:
+      return {cx, cy, 1};
+    default:
+      return {-cx, cy, -1};
+  }
+}
+
+// Inverse of CubeDirection(...): the face 'dir' hits, and where.
+inline int CubeFaceCoords(const filament::math::float3& dir, float& cx,
+                          float& cy) {
+  const float ax = std::abs(dir.x);
+  const float ay = std::abs(dir.y);
+  const float az = std::abs(dir.z);
+  if (ax >= ay && ax >= az) {
+    cy = dir.y / ax;
+    cx = dir.x > 0 ? -dir.z / ax : dir.z / ax;
+    return dir.x > 0 ? 0 : 1;
+  }
+  if (ay >= az) {
+    cx = dir.x / ay;
+    cy = dir.y > 0 ? -dir.z / ay : dir.z / ay;
+    return dir.y > 0 ? 2 : 3;
+  }
+  cy = dir.y / az;
+  cx = dir.z > 0 ? dir.x / az : -dir.x / az;
+  return dir.z > 0 ? 4 : 5;
+}
+
+// Bilinear lookup at pixel coordinates (texel centers at +0.5). 'wrap_x' wraps
+// horizontally (for equirects), otherwise edges clamp.
+inline filament::math::float3 SampleBilinear(
+    const filament::math::float3* image, int width, int height, float px,
+    float py, bool wrap_x) {
+  px -= 0.5f;
+  py -= 0.5f;
+  const float fx = std::floor(px);
+  const float fy = std::floor(py);
+  const float tx = px - fx;
+  const float ty = py - fy;
+
+  int x0 = int(fx);
+  int x1 = x0 + 1;
+  if (wrap_x) {
+    x0 = (x0 % width + width) % width;
+    x1 = (x1 % width + width) % width;
+  } else {
+    x0 = std::clamp(x0, 0, width - 1);
+    x1 = std::clamp(x1, 0, width - 1);
+  }
+  const int y0 = std::clamp(int(fy), 0, height - 1);
+  const int y1 = std::clamp(int(fy) + 1, 0, height - 1);
+
+  const auto& a = image[size_t(y0) * width + x0];
+  const auto& b = image[size_t(y0) * width + x1];
+  const auto& c = image[size_t(y1) * width + x0];
+  const auto& d = image[size_t(y1) * width + x1];
+  return (a * (1 - tx) + b * tx) * (1 - ty) + (c * (1 - tx) + d * tx) * ty;
+}
+
+// Bilinear lookup in one level of 'cube'. Doesn't filter across faces.
+inline filament::math::float3 SampleCube(const CpuCubemap& cube, size_t level,
+                                         const filament::math::float3& dir) {
+  float cx, cy;
+  const int face = CubeFaceCoords(dir, cx, cy);
+  const int dim = int(cube.LevelSize(level));
+  const filament::math::float3* const texels =
+      cube.levels[level].data() + size_t(face) * dim * dim;
+  return SampleBilinear(texels, dim, dim, (cx + 1) * 0.5f * dim,
+                        (1 - cy) * 0.5f * dim, /*wrap_x=*/false);
+}
+
+// Runs fn(face, y) for every row of faces ['face_begin', 'face_end') of one
+// level, in tiles.
+template <typename F>
+void ForEachCubeRow(uint32_t dim, int face_begin, int face_end,
+                    WorkerPool* pool, F&& fn) {
+  const uint32_t tiles_per_face =
+      (dim + kCpuPrefilterTileRows - 1) / kCpuPrefilterTileRows;
+  const auto run = [&](size_t begin, size_t end) {
+    for (size_t tile = begin; tile < end; ++tile) {
+      const int face = face_begin + int(tile / tiles_per_face);
+      const uint32_t y0 =
+          uint32_t(tile % tiles_per_face) * kCpuPrefilterTileRows;
+      const uint32_t y1 = std::min(y0 + kCpuPrefilterTileRows, dim);
+      for (uint32_t y = y0; y < y1; ++y) fn(face, y);
+    }
+  };
+  const size_t tiles = size_t(face_end - face_begin) * tiles_per_face;
+  if (pool) {
+    pool->ParallelFor(tiles, 1, run);
+  } else {
+    run(0, tiles);
+  }
+}
+
+// Runs fn(face, y) for every row of one level, in tiles.
+template <typename F>
+void ForEachCubeRow(uint32_t dim, WorkerPool* pool, F&& fn) {
+  ForEachCubeRow(dim, 0, CpuCubemap::kFaces, pool, std::forward<F>(fn));
+}
+
+// Fills levels 1.. of 'cube' by 2x2 box filtering the level above.
+inline void GenerateCubeMips(CpuCubemap& cube, WorkerPool* pool) {
+  using namespace filament;
+  for (size_t level = 1; cube.LevelSize(level - 1) > 1; ++level) {
+    const uint32_t src_dim = cube.LevelSize(level - 1);
+    const uint32_t dim = cube.LevelSize(level);
+    cube.levels.emplace_back(size_t(CpuCubemap::kFaces) * dim * dim);
+    const math::float3* const src = cube.levels[level - 1].data();
+    math::float3* const dst = cube.levels[level].data();
+
+    ForEachCubeRow(dim, pool, [&](int face, uint32_t y) {
+      const math::float3* s = src + (size_t(face) * src_dim + 2 * y) * src_dim;
+      math::float3* d = dst + (size_t(face) * dim + y) * dim;
+      for (uint32_t x = 0; x < dim; ++x) {
+        d[x] = (s[2 * x] + s[2 * x + 1] + s[src_dim + 2 * x] +
+                s[src_dim + 2 * x + 1]) *
+               0.25f;
+      }
+    });
+  }
+}
+
+inline CpuCubemap EquirectToCubemapCpu(const filament::math::float3* equirect,
+                                       int width, int height, uint32_t size,
+                                       WorkerPool* pool) {
+  using namespace filament;
+
+  CpuCubemap cube;
+  cube.size = size;
+  cube.levels.emplace_back(size_t(CpuCubemap::kFaces) * size * size);
+  math::float3* const texels = cube.levels[0].data();
+
+  // A face spans a quarter of the equirect's width. Supersample when that's
+  // more than one source pixel per texel, so small cubes don't alias.
+  const int n = std::clamp(int(std::ceil(width / (4.0f * size))), 1, 4);
+  const float inv_n2 = 1.0f / (n * n);
+
+  ForEachCubeRow(size, pool, [&](int face, uint32_t y) {
+    math::float3* row = texels + (size_t(face) * size + y) * size;
+    for (uint32_t x = 0; x < size; ++x) {
+      math::float3 sum = {0, 0, 0};
+      for (int j = 0; j < n; ++j) {
+        for (int i = 0; i < n; ++i) {
+          const float cx = 2 * (x + (i + 0.5f) / n) / size - 1;
+          const float cy = 1 - 2 * (y + (j + 0.5f) / n) / size;
+          const math::float3 dir = normalize(CubeDirection(face, cx, cy));
+          // Same mapping as ShIrradiance: +Y on top, center column faces +Z.
+          const float u = std::atan2(dir.x, dir.z) * float(0.5 / M_PI) + 0.5f;
+          const float v = std::acos(std::clamp(dir.y, -1.0f, 1.0f)) *
+                          float(1.0 / M_PI);
+          sum += SampleBilinear(equirect, width, height, u * width, v * height,
+                                /*wrap_x=*/true);
+        }
+      }
+      row[x] = sum * inv_n2;
+    }
+  });
+
+  GenerateCubeMips(cube, pool);
+  return cube;
+}
+
+// out[i] = a * x[i] + b * y[i] + c * z[i]. Kept to one output array so the
+// compiler vectorizes it, which it gives up on for several at once.
+inline void MultiplyAdd3(float a, const float* x, float b, const float* y,
+                         float c, const float* z, size_t count, float* out) {
+  for (size_t i = 0; i < count; ++i) out[i] = a * x[i] + b * y[i] + c * z[i];
+}
+
+// Same mapping as IBLPrefilterContext: level / (level_count - 1) is the LOD
+// fraction, and LOD = r * (2 - r) for perceptual roughness r.
+inline float LevelPerceptualRoughness(size_t level, uint8_t level_count) {
+  if (level == 0 || level_count < 2) return 0;
+  const float lod = float(level) / (level_count - 1);
+  return std::clamp(1 - std::sqrt(1 - lod), 0.0f, 1.0f);
+}
+
+inline void SpecularFilterFacesCpu(const CpuCubemap& cube, uint32_t size,
+                                   size_t level, uint8_t level_count,
+                                   uint16_t sample_count, float lod_offset,
+                                   int face_begin, int face_end,
+                                   filament::math::float3* texels,
+                                   WorkerPool* pool) {
+  using namespace filament;
+
+  const uint32_t dim = std::max(size >> level, 1u);
+  const float max_src_lod = float(cube.levels.size() - 1);
+
+  // Importance samples depend only on roughness, so each level builds one
+  // table in tangent space (N = V = +Z) and rotates it per texel. The table
+  // is kept as separate arrays so the rotation loop is straight-line math.
+  std::vector<float> lx, ly, lz, weight, lod;
+
+  const float roughness = LevelPerceptualRoughness(level, level_count);
+  const float a = roughness * roughness;
+  const float a2 = a * a;
+  const float texel_solid_angle =
+      4 * float(M_PI) / (6.0f * cube.size * cube.size);
+
+  if (roughness == 0) {
+    // A mirror: one sample, from the source level closest to this size.
+    lx.push_back(0);
+    ly.push_back(0);
+    lz.push_back(1);
+    weight.push_back(1);
+    lod.push_back(std::max(0.0f, std::log2(float(cube.size) / dim)));
+  } else {
+    for (uint32_t i = 0; i < sample_count; ++i) {
+      // Hammersley point set.
+      uint32_t bits = i;
+      bits = (bits << 16u) | (bits >> 16u);
+      bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+      bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+      bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+      bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+      const float u = float(i) / sample_count;
+      const float v = float(bits) * 2.3283064365386963e-10f;
+
+      // GGX half vector, reflected about V = N.
+      const float phi = 2 * float(M_PI) * u;
+      const float cos_h = std::sqrt((1 - v) / (1 + (a2 - 1) * v));
+      const float sin_h = std::sqrt(1 - cos_h * cos_h);
+      const float hx = sin_h * std::cos(phi);
+      const float hy = sin_h * std::sin(phi);
+      const float n_dot_l = 2 * cos_h * cos_h - 1;
+      if (n_dot_l <= 0) continue;
+
+      // Filtered importance sampling: read from the source level whose
+      // texels cover about the solid angle this sample represents.
+      const float d = cos_h * cos_h * (a2 - 1) + 1;
+      const float pdf = a2 / (float(M_PI) * d * d) / 4;
+      const float sample_solid_angle = 1 / (sample_count * pdf);
+
+      lx.push_back(2 * cos_h * hx);
+      ly.push_back(2 * cos_h * hy);
+      lz.push_back(n_dot_l);
+      weight.push_back(n_dot_l);
+      lod.push_back(std::clamp(
+          0.5f * std::log2(sample_solid_angle / texel_solid_angle) +
+              lod_offset,
+          0.0f, max_src_lod));
+    }
+  }
+
+  const size_t n = lx.size();
+  float total_weight = 0;
+  for (float w : weight) total_weight += w;
+  const float inv_total_weight = 1 / total_weight;
+
+  ForEachCubeRow(dim, face_begin, face_end, pool, [&](int face, uint32_t y) {
+    // Sample directions for one texel, reused by every row this thread
+    // filters, so rows don't allocate.
+    thread_local std::vector<float> dirs;
+    dirs.resize(3 * n);
+    float* const dx = dirs.data();
+    float* const dy = dx + n;
+    float* const dz = dy + n;
+    math::float3* row = texels + (size_t(face) * dim + y) * dim;
+    for (uint32_t x = 0; x < dim; ++x) {
+      const float cx = 2 * (x + 0.5f) / dim - 1;
+      const float cy = 1 - 2 * (y + 0.5f) / dim;
+      const math::float3 N = normalize(CubeDirection(face, cx, cy));
+      const math::float3 up = std::abs(N.z) < 0.999f ? math::float3{0, 0, 1}
+                                                     : math::float3{1, 0, 0};
+      const math::float3 T = normalize(cross(up, N));
+      const math::float3 B = cross(N, T);
+
+      // Vectorized; the lookups below are gathers, and stay scalar.
+      MultiplyAdd3(T.x, lx.data(), B.x, ly.data(), N.x, lz.data(), n, dx);
+      MultiplyAdd3(T.y, lx.data(), B.y, ly.data(), N.y, lz.data(), n, dy);
+      MultiplyAdd3(T.z, lx.data(), B.z, ly.data(), N.z, lz.data(), n, dz);
+
+      math::float3 sum = {0, 0, 0};
+      for (size_t i = 0; i < n; ++i) {
+        // Trilinear: blend the two nearest source levels.
+        const math::float3 dir = {dx[i], dy[i], dz[i]};
+        const size_t l0 = size_t(lod[i]);
+        const size_t l1 = std::min(l0 + 1, cube.levels.size() - 1);
+        const float t = lod[i] - l0;
+        const math::float3 c = SampleCube(cube, l0, dir) * (1 - t) +
+                               SampleCube(cube, l1, dir) * t;
+        sum += c * weight[i];
+      }
+      row[x] = sum * inv_total_weight;
+    }
+  });
+}
+
+inline CpuCubemap SpecularFilterCpu(const CpuCubemap& cube, uint32_t size,
+                                    uint8_t level_count, uint16_t sample_count,
+                                    float lod_offset, WorkerPool* pool) {
+  CpuCubemap out;
+  out.size = size;
+  for (size_t level = 0; level < level_count; ++level) {
+    const uint32_t dim = out.LevelSize(level);
+    out.levels.emplace_back(size_t(CpuCubemap::kFaces) * dim * dim);
+    SpecularFilterFacesCpu(cube, size, level, level_count, sample_count,
+                           lod_offset, 0, CpuCubemap::kFaces,
+                           out.levels[level].data(), pool);
+  }
+  return out;
+}
+
+inline CpuPrefilterSteps::CpuPrefilterSteps(
+    std::vector<filament::math::float3> equirect, int width, int height,
+    uint32_t size, uint8_t level_count, uint16_t sample_count,
+    float lod_offset)
+    : equirect_(std::move(equirect)),
+      width_(width),
+      height_(height),
+      level_count_(level_count),
+      sample_count_(sample_count),
+      lod_offset_(lod_offset) {
+  sky_.size = size;
+  reflections_.size = size;
+  for (size_t level = 0; level < level_count; ++level) {
+    const uint32_t dim = reflections_.LevelSize(level);
+    reflections_.levels.emplace_back(size_t(CpuCubemap::kFaces) * dim * dim);
+  }
+}
+
+inline void CpuPrefilterSteps::Run(WorkerPool* pool) {
+  const int step = steps_done_.load(std::memory_order_relaxed);
+  if (step == step_count()) return;
+  if (step == 0) {
+    sky_ = EquirectToCubemapCpu(equirect_.data(), width_, height_, sky_.size,
+                                pool);
+    equirect_ = {};
+  } else {
+    const size_t level = size_t(step - 1) / CpuCubemap::kFaces;
+    const int face = (step - 1) % CpuCubemap::kFaces;
+    SpecularFilterFacesCpu(sky_, reflections_.size, level, level_count_,
+                           sample_count_, lod_offset_, face, face + 1,
+                           reflections_.levels[level].data(), pool);
+  }
+  steps_done_.store(step + 1, std::memory_order_release);
+}
+
+inline uint64_t CpuPrefilterSteps::next_cost() const {
+  const int step = steps_done();
+  const uint64_t size = reflections_.size;
+  if (step == step_count()) return 0;
+  if (step == 0) return CpuCubemap::kFaces * size * size * 4 / 3;
+  const size_t level = size_t(step - 1) / CpuCubemap::kFaces;
+  const uint64_t dim = reflections_.LevelSize(level);
+  return dim * dim * (level == 0 ? 1 : sample_count_);
+}
+
+inline filament::Texture* CreateUploadCubemap(filament::Engine& engine,
+                                              uint32_t size, uint8_t levels) {
+  using namespace filament;
+  Texture* const texture = Texture::Builder()
+                               .width(size)
+                               .height(size)
+                               .levels(levels)
+                               .format(Texture::InternalFormat::R11F_G11F_B10F)
+                               .sampler(Texture::Sampler::SAMPLER_CUBEMAP)
+                               .build(engine);
+  TrackTexture(texture, GpuMemoryTag::kEnvironment);
+  return texture;
+}
+
+inline void UploadCubemapLevel(filament::Engine& engine,
+                               filament::Texture* texture,
+                               const CpuCubemap& cube, size_t level,
+                               UploadScheduler* uploads,
+                               UploadPriority priority) {
+  using namespace filament;
+
+  // Filament owns the upload buffer until it's consumed.
+  const uint32_t dim = cube.LevelSize(level);
+  const size_t face_size = size_t(dim) * dim * sizeof(math::float3);
+  const size_t size = CpuCubemap::kFaces * face_size;
+  void* const data = malloc(size);
+  std::memcpy(data, cube.levels[level].data(), size);
+
+  auto pixels = Texture::PixelBufferDescriptor(
+      data, size, Texture::Format::RGB, Texture::Type::FLOAT,
+      [](void* buffer, size_t size, void* user) { free(buffer); });
+  if (uploads) {
+    uploads->EnqueueCubeImage(texture, uint8_t(level), std::move(pixels),
+                              Texture::FaceOffsets(face_size), priority);
+  } else {
+    texture->setImage(engine, level, std::move(pixels),
+                      Texture::FaceOffsets(face_size));
+  }
+}
+
+inline filament::Texture* UploadCubemap(filament::Engine& engine,
+                                        const CpuCubemap& cube,
+                                        UploadScheduler* uploads,
+                                        UploadPriority priority) {
+  filament::Texture* const texture =
+      CreateUploadCubemap(engine, cube.size, uint8_t(cube.levels.size()));
+  for (size_t level = 0; level < cube.levels.size(); ++level) {
+    UploadCubemapLevel(engine, texture, cube, level, uploads, priority);
+  }
+  return texture;
+}
+
+}  // namespace fs
+
+#endif  // FS_CPU_PREFILTER_IMPL_H_
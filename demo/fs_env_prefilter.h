@@ -27,25 +27,430 @@
 #include <filament-iblprefilter/IBLPrefilterContext.h>
 #include <filament/Engine.h>
 
-#include <ostream>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "filament_glfw_imgui/logger.h"
+#include "filament_glfw_imgui/retire_queue.h"
+#include "fs_cpu_prefilter.h"
+#include "fs_hdr_stream.h"
+#include "fs_spherical_harmonics.h"
+#include "fs_worker_pool.h"
 
 namespace fs {
 
+using filament_glfw_imgui::Logger;
+using filament_glfw_imgui::LogLevel;
+using filament_glfw_imgui::RetireOrDestroy;
+using filament_glfw_imgui::RetireQueue;
+
 class Environment;
 
+// Quality and memory trade-offs for EnvPrefilter.
+//  - Defaults match IBLPrefilterContext's own defaults.
+//  - See the kEnv... presets below.
+struct EnvSettings {
+  // Resolution of the skybox and reflections cubemaps.
+  uint32_t cube_size = 256;
+
+  // Importance samples per texel for the reflections filter.
+  uint16_t sample_count = 1024;
+
+  // Reflections mip levels, from mirror-like to fully rough. Must not exceed
+  // log2(cube_size) + 1.
+  uint8_t level_count = 5;
+
+  // Biases which source mip the reflections filter samples from. Higher is
+  // blurrier, but less noisy at low sample counts.
+  float lod_offset = 1.0f;
+
+  // Gives the intermediate equirect texture a full mip chain, which reduces
+  // aliasing when cube_size is much smaller than the source. Costs 1/3 more
+  // GPU memory (and a mipmap pass) during each load.
+  bool equirect_mipmaps = false;
+
+  // Halves the source on the CPU until it's at most this wide, before upload.
+  // 0 keeps the full resolution.
+  int max_source_width = 0;
+
+  // Projects the source onto spherical harmonics while it's decoded, and
+  // gives them to the IndirectLight for diffuse lighting. Otherwise, Filament
+  // derives irradiance from the reflections cube, at extra shader cost.
+  bool irradiance_sh = true;
+
+  // Resamples and filters on the CPU worker pool instead of the GPU, and
+  // uploads the finished cubes. Always on with the NOOP backend, where
+  // IBLPrefilterContext's passes don't run.
+  bool cpu_prefilter = false;
+};
+
+// For low-end devices: fast loads and small cubes; visibly blurrier.
+inline constexpr EnvSettings kEnvLow = {
+    .cube_size = 128,
+    .sample_count = 256,
+    .level_count = 5,
+    .lod_offset = 2.0f,
+    .max_source_width = 1024,
+};
+
+// Close to the defaults, with a cheaper filter and 2K sources.
+inline constexpr EnvSettings kEnvMedium = {
+    .cube_size = 256,
+    .sample_count = 512,
+    .level_count = 5,
+    .lod_offset = 1.5f,
+    .max_source_width = 2048,
+};
+
+// Sharp reflections from full-resolution sources.
+inline constexpr EnvSettings kEnvHigh = {
+    .cube_size = 512,
+    .sample_count = 1024,
+    .level_count = 6,
+    .equirect_mipmaps = true,
+};
+
+// What the last load cost. Sizes are estimates, in bytes.
+struct EnvLoadStats {
+  double seconds = 0;  // Wall time on the calling thread.
+  int source_width = 0;
+  int source_height = 0;
+  int width = 0;  // After max_source_width downscaling.
+  int height = 0;
+  size_t cpu_bytes = 0;            // Peak decoded-pixel buffers.
+  size_t gpu_transient_bytes = 0;  // Equirect texture, freed by the load.
+  size_t gpu_bytes = 0;            // Cubemaps kept by the Environment.
+};
+
+// A source decoded (and downscaled) in CPU memory, for EnvPrefilter.
+struct EquirectImage {
+  std::vector<filament::math::float3> pixels;  // Empty if decoding failed.
+  int source_width = 0;
+  int source_height = 0;
+  int width = 0;  // After max_source_width downscaling.
+  int height = 0;
+  size_t cpu_bytes = 0;  // Peak while decoding.
+
+  // With settings.irradiance_sh.
+  std::array<filament::math::float3, 9> irradiance_sh = {};
+};
+
+// Decodes 'path' as EnvPrefilter would with 'settings'. Doesn't touch the
+// engine, so it can run on a worker thread, e.g. FrameScheduler::Worker(...).
+//  - 'pool' speeds up the irradiance projection, but may only be used by one
+//    thread at a time; EnvPrefilter uses its own on the calling thread.
+EquirectImage DecodeEquirectImage(const char* path,
+                                  const EnvSettings& settings,
+                                  WorkerPool* pool = nullptr,
+                                  Logger* log = &Logger::Default());
+
+// Decodes an equirect a band of rows at a time, downscaled to the settings'
+// max_source_width, and projects it onto spherical harmonics as it goes.
+//  - Radiance .hdr files are decoded from a mapping as bands are read, so
+//    only the band (and 'scale' source rows) is in memory. Other formats, and
+//    .hdr files the streaming decoder rejects, are decoded whole by Open(...).
+//  - Doesn't touch the engine, so it can run on a worker thread, e.g.
+//    FrameScheduler::Worker(...), as long as one thread uses it at a time.
+class EquirectStream {
+ public:
+  EquirectStream() = default;
+  ~EquirectStream();
+
+  EquirectStream(const EquirectStream&) = delete;
+  EquirectStream& operator=(const EquirectStream&) = delete;
+
+  // Opens 'path'. Returns 'false' if it can't be decoded.
+  //  - 'pool' speeds up the irradiance projection; see DecodeEquirectImage.
+  bool Open(const char* path, const EnvSettings& settings,
+            WorkerPool* pool = nullptr, Logger* log = &Logger::Default());
+
+  // Decodes the next band of up to 'max_rows' rows into 'band', which holds
+  // max_rows * width() pixels. Returns the number of rows, or 0 once done(),
+  // or if a scanline is corrupt, which also makes the stream failed().
+  int ReadBand(int max_rows, filament::math::float3* band);
+
+  // 'true' once every row has been read, or a read has failed.
+  bool done() const { return row_ >= height_; }
+  bool failed() const { return failed_; }
+
+  // The first row the next ReadBand(...) decodes.
+  int row() const { return row_; }
+
+  int source_width() const { return source_width_; }
+  int source_height() const { return source_height_; }
+  int width() const { return width_; }  // After max_source_width downscaling.
+  int height() const { return height_; }
+
+  // Decoded pixels the stream holds: the whole source if it wasn't streamed,
+  // otherwise the source rows a downscaled row is filtered from.
+  size_t cpu_bytes() const;
+
+  // Of every row read, with settings.irradiance_sh; zeros otherwise.
+  std::array<filament::math::float3, 9> irradiance_sh() const;
+
+  // Also keeps a copy of the rows read, downscaled to within 'max_width', for
+  // TakeCopy(). Call before the first ReadBand(...); bands should then be
+  // EnvPrefilter::kBandRows rows, apart from the last.
+  void KeepCopy(int max_width);
+
+  // The copy KeepCopy(...) asked for: pixels, width and height only.
+  EquirectImage TakeCopy();
+
+ private:
+  std::string path_;  // For logging.
+  Logger* log_ = nullptr;
+  HdrStream hdr_;
+  filament::math::float3* decoded_ = nullptr;  // From stbi_loadf, if any.
+  std::vector<filament::math::float3> source_rows_;
+  std::unique_ptr<ShIrradiance> sh_;
+  std::vector<filament::math::float3> copy_;  // For KeepCopy(...).
+
+  int scale_ = 1;
+  int copy_scale_ = 0;  // 0 without a copy.
+  int source_width_ = 0;
+  int source_height_ = 0;
+  int width_ = 0;
+  int height_ = 0;
+  int row_ = 0;
+  bool failed_ = false;
+};
+
+// A fixed set of equally sized buffers, lent to the engine with band uploads
+// and handed back by their descriptors' callbacks, which may run on any
+// thread. Bounds how much of a streamed source is in CPU memory at once.
+//  - Lives on the heap, and outlives Close() until every buffer is back, so
+//    uploads still in flight when a load is abandoned stay valid.
+class BandBuffers {
+ public:
+  // Up to 'count' buffers of 'bytes' each, allocated as they're first needed.
+  static BandBuffers* Create(int count, size_t bytes);
+
+  BandBuffers(const BandBuffers&) = delete;
+  BandBuffers& operator=(const BandBuffers&) = delete;
+
+  // Gives up ownership: frees the buffers now, or as they come back.
+  void Close();
+
+  // A free buffer, or nullptr while every one is lent out.
+  void* Acquire();
+
+  // Returns a buffer from Acquire() that wasn't uploaded.
+  void Release(void* buffer);
+
+  // Describes 'bytes' of 'buffer', from Acquire(), for an upload that hands
+  // it back once the engine is done with it.
+  filament::Texture::PixelBufferDescriptor Describe(void* buffer,
+                                                    size_t bytes);
+
+  // 'true' if no buffer is lent out.
+  bool idle() const;
+
+  // Of all the buffers, whether allocated yet or not.
+  size_t capacity_bytes() const { return size_t(count_) * bytes_; }
+
+ private:
+  BandBuffers(int count, size_t bytes) : count_(count), bytes_(bytes) {}
+  ~BandBuffers();
+
+  const int count_;
+  const size_t bytes_;
+
+  mutable std::mutex mutex_;  // Guards the rest.
+  std::vector<void*> free_;
+  int allocated_ = 0;
+  int lent_ = 0;
+  bool closed_ = false;
+};
+
+// A buffer lent by BandBuffers, handed back when destroyed unless uploaded.
+class Band {
+ public:
+  Band() = default;
+  Band(BandBuffers* buffers, void* data) : buffers_(buffers), data_(data) {}
+
+  Band(const Band&) = delete;
+  Band& operator=(const Band&) = delete;
+
+  Band(Band&& other) { *this = std::move(other); }
+  Band& operator=(Band&& other) {
+    std::swap(buffers_, other.buffers_);
+    std::swap(data_, other.data_);
+    return *this;
+  }
+
+  ~Band() {
+    if (data_) buffers_->Release(data_);
+  }
+
+  explicit operator bool() const { return data_ != nullptr; }
+  filament::math::float3* pixels() const {
+    return (filament::math::float3*)data_;
+  }
+  BandBuffers* buffers() const { return buffers_; }
+
+  // Describes the first 'bytes' for an upload, which hands the buffer back.
+  filament::Texture::PixelBufferDescriptor Upload(size_t bytes) {
+    return buffers_->Describe(std::exchange(data_, nullptr), bytes);
+  }
+
+ private:
+  BandBuffers* buffers_ = nullptr;  // Not owned.
+  void* data_ = nullptr;
+};
+
+// The next step of EnvPrefilter's CPU refinement, for FrameScheduler::Worker.
+// Holds on to what the step uses, so it may outlast its EnvPrefilter.
+class RefineJob {
+ public:
+  RefineJob() = default;
+  RefineJob(std::shared_ptr<CpuPrefilterSteps> steps,
+            std::shared_ptr<WorkerPool> pool)
+      : steps_(std::move(steps)), pool_(std::move(pool)) {}
+
+  explicit operator bool() const { return steps_ != nullptr; }
+  void operator()() const { steps_->Run(pool_.get()); }
+
+ private:
+  std::shared_ptr<CpuPrefilterSteps> steps_;
+  std::shared_ptr<WorkerPool> pool_;
+};
+
 // Loader and filter for image-based lighting environments.
 class EnvPrefilter {
  public:
   // Creates a bank of IBLPrefilters for this engine.
   //  - Set 'log' to nullptr to silence logging.
   explicit EnvPrefilter(filament::Engine& engine,
-                        std::ostream* log = &std::cout);
+                        const EnvSettings& settings = {},
+                        Logger* log = &Logger::Default());
 
   // Loads and filters an environment for image-based-lighting and reflections.
+  //  - Radiance .hdr files are streamed in bands of kBandRows scanlines,
+  //    through kBandsInFlight buffers the engine hands back once it has
+  //    copied them, so CPU memory stays at kBandsInFlight bands regardless of
+  //    image size. With every buffer in flight, the load polls for the oldest
+  //    to come back: it never drains the engine with flushAndWait(), but does
+  //    wait for that band's copy.
+  //  - Other formats (or .hdr files the streaming decoder rejects) are
+  //    decoded whole with stb_image.
+  //  - With settings().cpu_prefilter, the whole source is decoded into CPU
+  //    memory instead, and nothing is rendered.
   bool LoadEquirect(const char* path, Environment& env);
 
+  static constexpr int kBandRows = 32;
+  static constexpr int kBandsInFlight = 4;
+
+  // Progressive alternative to LoadEquirect(...), for loading environments
+  // while rendering without a long frame.
+  //  - Fills 'env' with a low-resolution skybox and coarse reflections.
+  //  - Call Refine(env) once per frame until refining() is 'false'.
+  //  - With settings().cpu_prefilter, does a full LoadEquirect(...) instead.
+  bool LoadEquirectProgressive(const char* path, Environment& env);
+
+  // As above, from a source decoded with DecodeEquirectImage(...), which
+  // leaves only uploads and GPU passes for the calling thread. Returns 'false'
+  // if 'image' is empty.
+  bool LoadEquirectProgressive(EquirectImage&& image, Environment& env);
+
+  // Streaming alternative to LoadEquirectProgressive(...), for coroutines
+  // that read bands on a worker thread and upload them through the upload
+  // scheduler (at UploadPriority::kLow), so no frame decodes or uploads the
+  // whole source:
+  //
+  //   EquirectStream stream;
+  //   co_await scheduler.Worker([&] { stream.Open(path, settings); });
+  //   prefilter.BeginEquirect(stream);
+  //   while (!stream.done()) {
+  //     Band band = prefilter.AcquireBand();
+  //     if (!band) {  // kBandsInFlight are uploading.
+  //       co_await scheduler.NextFrame();
+  //       continue;
+  //     }
+  //     const int y = stream.row();
+  //     int rows = 0;
+  //     co_await scheduler.Worker(
+  //         [&] { rows = stream.ReadBand(kBandRows, band.pixels()); });
+  //     prefilter.UploadBand(std::move(band), y, rows);
+  //   }
+  //   while (prefilter.uploading_bands()) co_await scheduler.NextFrame();
+  //   prefilter.FinishEquirect(stream, env);
+  //
+  // Any other load, or another BeginEquirect(...), cancels the one in
+  // progress; its bands are then dropped by UploadBand(...).
+
+  // Starts uploading 'stream' into a new equirect texture. Call before its
+  // first ReadBand(...): it keeps a copy for the refinement.
+  void BeginEquirect(EquirectStream& stream);
+
+  // A buffer for the next band, or an empty one while kBandsInFlight bands
+  // are uploading, or if no streaming load is in progress.
+  Band AcquireBand();
+
+  // Uploads 'rows' rows of 'band' to the equirect at row 'y'. Drops bands
+  // from a cancelled load, and empty ones.
+  void UploadBand(Band&& band, int y, int rows);
+
+  // 'true' while bands are still on their way to the engine.
+  bool uploading_bands() const { return bands_ && !bands_->idle(); }
+
+  // Once 'stream' is done and its bands are uploaded, shows a coarse
+  // environment in 'env', as LoadEquirectProgressive(...) does. Returns
+  // 'false' if 'stream' failed, or no streaming load is in progress.
+  bool FinishEquirect(EquirectStream& stream, Environment& env);
+
+  // Runs the next refinement stages for the environment from
+  // LoadEquirectProgressive(...), at least one per call, while their estimated
+  // cost stays within 'sample_budget' filter samples.
+  //
+  // The full-quality reflections are filtered on the CPU with
+  // CpuPrefilterSteps, one face of one level per step. Refine(...) runs those
+  // steps itself, in the same budget, until TakeRefineJob() is first called;
+  // either way, it uploads each finished level at UploadPriority::kLow, and
+  // shows them once all are through.
+  //
+  // Returns 'true' if 'env' changed, so the caller should re-attach its
+  // skybox() and ibl() to the scene.
+  bool Refine(Environment& env, uint64_t sample_budget = kRefineSampleBudget);
+
+  // 'true' while Refine(...) has stages left to run.
+  bool refining() const { return stage_ != kStageDone; }
+
+  // The next CPU refinement step, to run on a worker thread, e.g. with
+  // co_await scheduler.Worker(job), then call Refine(...) to pick up its
+  // result. Empty while the last job is running, or none is ready yet.
+  //  - From the first call on, Refine(...) leaves every step to jobs.
+  RefineJob TakeRefineJob();
+
+  // With default settings: enough for the full-resolution cube plus the
+  // medium-quality reflections in one frame, leaving the full-quality
+  // reflections' steps for later ones.
+  static constexpr uint64_t kRefineSampleBudget = 200'000'000;
+
+  ~EnvPrefilter();
+
+  // Environments loaded afterwards, and textures replaced while refining, are
+  // retired through 'queue' instead of destroyed right away. It must outlive
+  // them, and this class; nullptr destroys right away.
+  void set_retire_queue(RetireQueue* queue) { retire_queue_ = queue; }
+
+  // Cubes filtered on the CPU are uploaded through 'uploads', which must
+  // outlive this class; nullptr uploads them right away.
+  //  - Equirect sources always upload right away: the GPU filters read them
+  //    in the same call, so they can't wait for a later frame's budget.
+  void set_upload_scheduler(UploadScheduler* uploads) { uploads_ = uploads; }
+
   // Field accessors.
   filament::Engine& engine() { return engine_; }
+  RetireQueue* retire_queue() const { return retire_queue_; }
+  UploadScheduler* upload_scheduler() const { return uploads_; }
+  const EnvSettings& settings() const { return settings_; }
+  const EnvLoadStats& last_load() const { return last_load_; }
   IBLPrefilterContext& context() { return context_; }
   IBLPrefilterContext::EquirectangularToCubemap& equirect_to_cube() {
     return equirect_to_cube_;
@@ -55,21 +460,129 @@ class EnvPrefilter {
   }
 
  private:
+  // Returns the equirect texture, or nullptr if 'path' can't be decoded.
+  // Fills in the size fields of last_load_, and irradiance_sh_.
+  //  - 'refine_source', if set, receives a copy for CpuPrefilterSteps.
+  filament::Texture* LoadEquirectTexture(
+      const char* path, EquirectImage* refine_source = nullptr);
+
+  // Fills in the size fields of last_load_, and irradiance_sh_, from 'image'.
+  void UseDecoded(const EquirectImage& image);
+
+  // Uploads a 'width' x 'height' equirect into a new texture, a band at a
+  // time through kBandsInFlight buffers, with read(band, y, rows) filling
+  // each. Returns nullptr if a read returns 'false'.
+  template <typename F>
+  filament::Texture* UploadEquirectBands(int width, int height, F&& read);
+
+  // LoadEquirect(...) for settings_.cpu_prefilter.
+  bool LoadEquirectCpu(const char* path, Environment& env);
+  bool LoadEquirectCpu(EquirectImage&& image, Environment& env,
+                       std::chrono::steady_clock::time_point start);
+
+  // Shows a coarse environment from 'equirect' in 'env', and keeps
+  // 'equirect' for Refine(...). 'start' is when the load began.
+  bool StartRefine(filament::Texture* equirect, Environment& env,
+                   std::chrono::steady_clock::time_point start);
+
+  // A buffer from 'bands'. If they're all in flight, flushes the engine and
+  // runs its callbacks until one comes back. nullptr if out of memory.
+  void* AcquireBandPolling(BandBuffers& bands);
+
+  filament::Texture* CreateEquirectTexture(int width, int height);
+  filament::Texture* CreateCubemapTexture(uint32_t size);
+  filament::Texture* CreateReflectionsTexture(uint32_t size);
+
+  // Reflections from 'ibl_cube', plus irradiance_sh_ if enabled.
+  filament::IndirectLight* CreateIndirectLight(filament::Texture* ibl_cube);
+
+  // Filters 'skybox_cube' into a new reflections cube.
+  filament::Texture* FilterReflections(
+      IBLPrefilterContext::SpecularFilter& filter, uint32_t size,
+      filament::Texture* skybox_cube);
+
+  // Fills in the sizes of the cubes in 'env', and logs last_load_.
+  void FinishLoadStats(const Environment& env, double seconds);
+
+  // Cancels any streaming load, or refinement, in progress.
+  void CancelRefine();
+
+  // Widest source the CPU refinement needs: 4 texels per cube texel across.
+  int RefineSourceWidth() const { return 4 * int(settings_.cube_size); }
+
+  // Starts kStageFullSpecular from refine_source_.
+  void StartSpecularSteps();
+
+  // Uploads the levels specular_steps_ has finished. Once they're all through
+  // the upload scheduler, shows them in 'env' and returns 'true'.
+  bool UploadSpecularLevels(Environment& env);
+
+  // Refinement stages, in the order Refine(...) runs them.
+  enum Stage {
+    kStageCube,            // Full-resolution skybox from pending_equirect_.
+    kStageMediumSpecular,  // Reflections with medium_specular_.
+    kStageFullSpecular,    // Reflections with specular_steps_.
+    kStageDone,
+  };
+
+  // Estimated filter samples (texels x samples per texel) for 'stage'.
+  uint64_t StageCost(Stage stage) const;
+
   filament::Engine& engine_;  // Not owned.
-  std::ostream* log_;         // Not owned.
+  EnvSettings settings_;
+  Logger* log_;                          // Not owned.
+  RetireQueue* retire_queue_ = nullptr;  // Not owned.
+  UploadScheduler* uploads_ = nullptr;   // Not owned.
 
   IBLPrefilterContext context_;
   IBLPrefilterContext::EquirectangularToCubemap equirect_to_cube_;
   IBLPrefilterContext::SpecularFilter specular_to_diffuse_;
+
+  // Lower sample counts, for progressive loading.
+  IBLPrefilterContext::SpecularFilter coarse_specular_;
+  IBLPrefilterContext::SpecularFilter medium_specular_;
+
+  // A streaming load: the equirect its bands upload to, and their buffers.
+  filament::Texture* loading_equirect_ = nullptr;
+  BandBuffers* bands_ = nullptr;
+  std::chrono::steady_clock::time_point load_start_;
+
+  Stage stage_ = kStageDone;
+  filament::Texture* pending_equirect_ = nullptr;  // Kept until kStageCube.
+
+  // Source of the full-quality reflections, downscaled to RefineSourceWidth().
+  EquirectImage refine_source_;
+
+  // kStageFullSpecular: its steps, where they're shared with jobs, and the
+  // cube their levels upload to.
+  std::shared_ptr<CpuPrefilterSteps> specular_steps_;
+  std::shared_ptr<WorkerPool> refine_pool_;  // For jobs; one per refinement.
+  filament::Texture* specular_cube_ = nullptr;
+  int steps_taken_ = 0;         // Steps run, or handed out as jobs.
+  size_t levels_uploaded_ = 0;  // To specular_cube_.
+  bool refine_jobs_ = false;    // TakeRefineJob() has been called.
+
+  // For CPU passes over the decoded source.
+  WorkerPool pool_;
+
+  // From the last decoded source.
+  std::array<filament::math::float3, 9> irradiance_sh_ = {};
+
+  EnvLoadStats last_load_;
 };
 
 class Environment {
  public:
-  // If 'engine' is non-null, dtor calls engine->destroy on other arguments.
+  // If 'engine' is non-null, dtor calls engine->destroy on other arguments,
+  // or retires them through 'retire_queue' if that's set. Moving into an
+  // Environment destroys (or retires) the one it held.
+  //  - Uploads to the cubes still queued in 'uploads' are cancelled first.
   Environment() = default;
   Environment(filament::Engine* engine, filament::Texture* skybox_cube,
               filament::Skybox* skybox, filament::Texture* ibl_cube,
-              filament::IndirectLight* ibl);
+              filament::IndirectLight* ibl,
+              RetireQueue* retire_queue = nullptr,
+              UploadScheduler* uploads = nullptr);
 
   Environment(const Environment&) = delete;
   Environment& operator=(const Environment&) = delete;
@@ -80,13 +593,27 @@ class Environment {
   ~Environment();
 
   filament::Engine* engine() const { return engine_; }
+  RetireQueue* retire_queue() const { return retire_queue_; }
+  UploadScheduler* upload_scheduler() const { return uploads_; }
   filament::Texture* skybox_cube() const { return skybox_cube_; }
   filament::Skybox* skybox() const { return skybox_; }
   filament::Texture* ibl_cube() const { return ibl_cube_; }
   filament::IndirectLight* ibl() const { return ibl_; }
 
+  // Destroys (or retires) the current skybox (or IBL) and takes ownership of
+  // the new one.
+  //  - Re-attach skybox() (or ibl()) to your scene afterwards.
+  void ReplaceSkybox(filament::Texture* skybox_cube, filament::Skybox* skybox);
+  void ReplaceIbl(filament::Texture* ibl_cube, filament::IndirectLight* ibl);
+
  private:
-  filament::Engine* engine_ = nullptr;  // Not owned.
+  // Cancels the uploads to 'object', then destroys or retires it.
+  template <typename T>
+  void Dispose(T* object);
+
+  filament::Engine* engine_ = nullptr;   // Not owned.
+  RetireQueue* retire_queue_ = nullptr;  // Not owned.
+  UploadScheduler* uploads_ = nullptr;   // Not owned.
   filament::Texture* skybox_cube_ = nullptr;
   filament::Skybox* skybox_ = nullptr;
   filament::Texture* ibl_cube_ = nullptr;
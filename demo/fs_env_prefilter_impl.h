@@ -18,72 +18,842 @@
 #define FS_ENV_PREFILTER_IMPL_H_
 
 #include <stb/stb_image.h>
+#include <stb/stb_image_resize.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
 
 namespace fs {
 
-inline EnvPrefilter::EnvPrefilter(filament::Engine& engine, std::ostream* log)
+inline EnvPrefilter::EnvPrefilter(filament::Engine& engine,
+                                  const EnvSettings& settings,
+                                  Logger* log)
     : engine_(engine),
+      settings_(settings),
       log_(log),
       context_(engine),
       equirect_to_cube_(context_),
-      specular_to_diffuse_(context_) {}
+      specular_to_diffuse_(context_, {.sampleCount = settings.sample_count,
+                                      .levelCount = settings.level_count}),
+      coarse_specular_(
+          context_,
+          {.sampleCount = uint16_t(std::max(16, settings.sample_count / 64)),
+           .levelCount = settings.level_count}),
+      medium_specular_(
+          context_,
+          {.sampleCount = uint16_t(std::max(16, settings.sample_count / 4)),
+           .levelCount = settings.level_count}) {
+  if (engine.getBackend() == filament::backend::Backend::NOOP) {
+    settings_.cpu_prefilter = true;
+  }
+}
 
-inline bool EnvPrefilter::LoadEquirect(const char* path, Environment& env) {
+inline EnvPrefilter::~EnvPrefilter() { CancelRefine(); }
+
+inline BandBuffers* BandBuffers::Create(int count, size_t bytes) {
+  return new BandBuffers(count, bytes);
+}
+
+inline BandBuffers::~BandBuffers() {
+  for (void* buffer : free_) free(buffer);
+}
+
+inline void BandBuffers::Close() {
+  bool last = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    for (void* buffer : free_) free(buffer);
+    free_.clear();
+    last = lent_ == 0;
+  }
+  if (last) delete this;
+}
+
+inline void* BandBuffers::Acquire() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  void* buffer = nullptr;
+  if (!free_.empty()) {
+    buffer = free_.back();
+    free_.pop_back();
+  } else if (allocated_ < count_) {
+    buffer = malloc(bytes_);
+    if (!buffer) return nullptr;
+    ++allocated_;
+  } else {
+    return nullptr;
+  }
+  ++lent_;
+  return buffer;
+}
+
+inline void BandBuffers::Release(void* buffer) {
+  bool last = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --lent_;
+    if (closed_) {
+      free(buffer);
+      last = lent_ == 0;
+    } else {
+      free_.push_back(buffer);
+    }
+  }
+  if (last) delete this;
+}
+
+inline filament::Texture::PixelBufferDescriptor BandBuffers::Describe(
+    void* buffer, size_t bytes) {
   using namespace filament;
+  return Texture::PixelBufferDescriptor(
+      buffer, bytes, Texture::Format::RGB, Texture::Type::FLOAT,
+      [](void* buffer, size_t size, void* user) {
+        ((BandBuffers*)user)->Release(buffer);
+      },
+      this);
+}
+
+inline bool BandBuffers::idle() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return lent_ == 0;
+}
+
+// Looks like this is ~1/3 the sun?
+constexpr float kIndirectLightIntensity = 30000.0f;
+
+inline filament::Skybox* CreateSkybox(filament::Engine& engine,
+                                      filament::Texture* skybox_cube) {
+  return filament::Skybox::Builder()
+      .environment(skybox_cube)
+      .showSun(true)
+      .build(engine);
+}
+
 
-  int n, w, h;
-  math::float3* const data = (math::float3*)stbi_loadf(path, &w, &h, &n, 3);
-  const size_t size = w * h * sizeof(math::float3);
-  if (data == nullptr || n != 3) {
+// Bytes for a 4-byte-per-texel (e.g. R11F_G11F_B10F) image, with 'levels' mips
+// (0xff for a full chain).
+inline size_t TextureBytes(uint32_t width, uint32_t height, uint8_t levels,
+                           uint32_t faces = 1) {
+  size_t bytes = 0;
+  for (uint8_t i = 0; i < levels && (width || height); ++i) {
+    bytes += size_t(std::max(width, 1u)) * std::max(height, 1u) * 4 * faces;
+    width /= 2;
+    height /= 2;
+  }
+  return bytes;
+}
+
+// Box-filters rows of an equirect down by an integer factor.
+//  - With integer ratios, no output pixel depends on rows outside 'src', so
+//    bands can be downscaled independently without seams.
+inline bool DownscaleEquirect(const filament::math::float3* src, int width,
+                              int height, filament::math::float3* dst,
+                              int dst_width, int dst_height) {
+  return stbir_resize_float_generic(
+      &src->x, width, height, 0, &dst->x, dst_width, dst_height, 0, 3,
+      STBIR_ALPHA_CHANNEL_NONE, 0, STBIR_EDGE_CLAMP, STBIR_FILTER_BOX,
+      STBIR_COLORSPACE_LINEAR, nullptr);
+}
+
+inline filament::Texture* EnvPrefilter::CreateEquirectTexture(int width,
+                                                             int height) {
+  using namespace filament;
+  Texture* const texture =
+      Texture::Builder()
+          .width((uint32_t)width)
+          .height((uint32_t)height)
+          .levels(settings_.equirect_mipmaps ? 0xff : 1)
+          .format(Texture::InternalFormat::R11F_G11F_B10F)
+          .sampler(Texture::Sampler::SAMPLER_2D)
+          .build(engine_);
+  TrackTexture(texture, GpuMemoryTag::kEnvironment);
+  return texture;
+}
+
+// Same layout as IBLPrefilterContext's default cubemap, at a chosen size.
+inline filament::Texture* EnvPrefilter::CreateCubemapTexture(uint32_t size) {
+  using namespace filament;
+  Texture* const texture =
+      Texture::Builder()
+          .width(size)
+          .height(size)
+          .levels(0xff)
+          .format(Texture::InternalFormat::R11F_G11F_B10F)
+          .sampler(Texture::Sampler::SAMPLER_CUBEMAP)
+          .usage(Texture::Usage::COLOR_ATTACHMENT | Texture::Usage::SAMPLEABLE)
+          .build(engine_);
+  TrackTexture(texture, GpuMemoryTag::kEnvironment);
+  return texture;
+}
+
+// Like CreateCubemapTexture(...), but with only the levels the filter writes.
+inline filament::Texture* EnvPrefilter::CreateReflectionsTexture(
+    uint32_t size) {
+  using namespace filament;
+  Texture* const texture =
+      Texture::Builder()
+          .width(size)
+          .height(size)
+          .levels(settings_.level_count)
+          .format(Texture::InternalFormat::R11F_G11F_B10F)
+          .sampler(Texture::Sampler::SAMPLER_CUBEMAP)
+          .usage(Texture::Usage::COLOR_ATTACHMENT | Texture::Usage::SAMPLEABLE)
+          .build(engine_);
+  TrackTexture(texture, GpuMemoryTag::kEnvironment);
+  return texture;
+}
+
+inline filament::IndirectLight* EnvPrefilter::CreateIndirectLight(
+    filament::Texture* ibl_cube) {
+  filament::IndirectLight::Builder builder;
+  builder.reflections(ibl_cube).intensity(kIndirectLightIntensity);
+  if (settings_.irradiance_sh) builder.irradiance(3, irradiance_sh_.data());
+  return builder.build(engine_);
+}
+
+inline filament::Texture* EnvPrefilter::FilterReflections(
+    IBLPrefilterContext::SpecularFilter& filter, uint32_t size,
+    filament::Texture* skybox_cube) {
+  IBLPrefilterContext::SpecularFilter::Options options;
+  options.lodOffset = settings_.lod_offset;
+  return filter(options, skybox_cube, CreateReflectionsTexture(size));
+}
+
+// Power-of-two factor that brings 'width' within 'max_width', if positive.
+inline int EquirectScale(int width, int max_width) {
+  int scale = 1;
+  if (max_width > 0) {
+    while (width / scale > max_width) scale *= 2;
+  }
+  return scale;
+}
+
+inline void* EnvPrefilter::AcquireBandPolling(BandBuffers& bands) {
+  void* band = bands.Acquire();
+  if (band) return band;
+  // Waits for the oldest band only, rather than the whole engine.
+  engine_.flush();
+  while (!(band = bands.Acquire()) && !bands.idle()) {
+    std::this_thread::yield();
+    engine_.pumpMessageQueues();  // Runs the callbacks that hand bands back.
+  }
+  return band;  // nullptr only if allocating the first one failed.
+}
+
+inline EquirectStream::~EquirectStream() {
+  if (decoded_) stbi_image_free(decoded_);
+}
+
+inline bool EquirectStream::Open(const char* path, const EnvSettings& settings,
+                                 WorkerPool* pool, Logger* log) {
+  using namespace filament;
+
+  path_ = path;
+  log_ = log;
+  hdr_ = HdrStream(path);
+  bool streaming = hdr_.valid();
+  if (streaming) {
+    source_width_ = hdr_.width();
+    source_height_ = hdr_.height();
+  } else {
+    int n;
+    decoded_ = (math::float3*)stbi_loadf(path, &source_width_,
+                                         &source_height_, &n, 3);
+    if (decoded_ == nullptr) {
+      if (log) log->Log(LogLevel::kError, "Could not decode image %s", path);
+      return false;
+    }
+  }
+
+  if (log) {
+    log->Log(LogLevel::kInfo, "EnvPrefilter::LoadEquirect: %s %d,%d (%s)",
+             path, source_width_, source_height_,
+             streaming ? "streaming" : "decoded");
+  }
+
+  scale_ = EquirectScale(source_width_, settings.max_source_width);
+  width_ = source_width_ / scale_;
+  height_ = source_height_ / scale_;
+  // When downscaling a stream, source rows are decoded 'scale' at a time and
+  // filtered into one row of the band.
+  if (streaming && scale_ > 1) source_rows_.resize(scale_ * source_width_);
+  if (settings.irradiance_sh) {
+    sh_ = std::make_unique<ShIrradiance>(width_, height_, pool);
+  }
+  return true;
+}
+
+inline int EquirectStream::ReadBand(int max_rows,
+                                    filament::math::float3* band) {
+  if (done()) return 0;
+  const int rows = std::min(max_rows, height_ - row_);
+  bool ok = true;
+  if (decoded_ && scale_ == 1) {
+    memcpy(band, decoded_ + size_t(row_) * width_,
+           size_t(rows) * width_ * sizeof(filament::math::float3));
+  } else if (decoded_) {
+    ok = DownscaleEquirect(decoded_ + size_t(row_) * scale_ * source_width_,
+                           source_width_, rows * scale_, band, width_, rows);
+  } else if (scale_ == 1) {
+    ok = hdr_.ReadRows(rows, band);
+  } else {
+    for (int i = 0; ok && i < rows; ++i) {
+      ok = hdr_.ReadRows(scale_, source_rows_.data()) &&
+           DownscaleEquirect(source_rows_.data(), source_width_, scale_,
+                             band + i * width_, width_, 1);
+    }
+  }
+  if (!ok) {
     if (log_) {
-      (*log_) << "Could not decode image " << std::endl;
+      log_->Log(LogLevel::kError,
+                "EnvPrefilter::LoadEquirect: corrupt scanline %d in %s",
+                hdr_.row(), path_.c_str());
+    }
+    failed_ = true;
+    row_ = height_;
+    return 0;
+  }
+
+  if (sh_) sh_->AddRows(row_, rows, band);
+  if (copy_scale_ && row_ % copy_scale_ == 0) {
+    // Whole groups of copy_scale_ rows only; a last partial one is dropped.
+    const int copy_width = width_ / copy_scale_;
+    const int copy_rows = rows / copy_scale_;
+    filament::math::float3* const dst =
+        copy_.data() + size_t(row_ / copy_scale_) * copy_width;
+    if (copy_scale_ == 1) {
+      memcpy(dst, band, size_t(rows) * width_ * sizeof(filament::math::float3));
+    } else if (copy_rows > 0) {
+      DownscaleEquirect(band, width_, copy_rows * copy_scale_, dst, copy_width,
+                        copy_rows);
+    }
+  }
+  row_ += rows;
+  return rows;
+}
+
+inline size_t EquirectStream::cpu_bytes() const {
+  const size_t pixels =
+      decoded_ ? size_t(source_width_) * source_height_ : source_rows_.size();
+  return pixels * sizeof(filament::math::float3);
+}
+
+inline std::array<filament::math::float3, 9> EquirectStream::irradiance_sh()
+    const {
+  return sh_ ? sh_->Coefficients() : std::array<filament::math::float3, 9>{};
+}
+
+inline void EquirectStream::KeepCopy(int max_width) {
+  // Bands are downscaled on their own, so the factor has to divide them.
+  copy_scale_ =
+      std::min(EquirectScale(width_, max_width), EnvPrefilter::kBandRows);
+  copy_.resize(size_t(width_ / copy_scale_) * (height_ / copy_scale_));
+}
+
+inline EquirectImage EquirectStream::TakeCopy() {
+  EquirectImage copy;
+  if (copy_scale_) {
+    copy.pixels = std::move(copy_);
+    copy.width = width_ / copy_scale_;
+    copy.height = height_ / copy_scale_;
+  }
+  copy_scale_ = 0;
+  return copy;
+}
+
+template <typename F>
+filament::Texture* EnvPrefilter::UploadEquirectBands(int width, int height,
+                                                     F&& read) {
+  using namespace filament;
+
+  Texture* const equirect = CreateEquirectTexture(width, height);
+
+  // Filament uploads asynchronously, so a band buffer can only be reused once
+  // the engine has copied it and handed it back. Cycling through a small
+  // fixed set bounds CPU memory.
+  const size_t band_bytes = size_t(kBandRows) * width * sizeof(math::float3);
+  BandBuffers* const bands = BandBuffers::Create(kBandsInFlight, band_bytes);
+
+  for (int y = 0; y < height; y += kBandRows) {
+    const int rows = std::min(kBandRows, height - y);
+    auto* const band = (math::float3*)AcquireBandPolling(*bands);
+    if (!band || !read(band, y, rows)) {
+      if (band) bands->Release(band);
+      bands->Close();  // Uploaded bands come back once the engine is done.
+      DestroyTracked(engine_, equirect);
+      return nullptr;
     }
+
+    // Not through uploads_: equirect_to_cube_ reads it before any Submit().
+    equirect->setImage(
+        engine_, 0, 0, (uint32_t)y, (uint32_t)width, (uint32_t)rows,
+        bands->Describe(band, rows * width * sizeof(math::float3)));
+  }
+  bands->Close();
+
+  if (settings_.equirect_mipmaps) equirect->generateMipmaps(engine_);
+  last_load_.cpu_bytes += size_t(kBandsInFlight) * band_bytes;
+  last_load_.gpu_transient_bytes =
+      TextureBytes(width, height, settings_.equirect_mipmaps ? 0xff : 1);
+  return equirect;
+}
+
+inline filament::Texture* EnvPrefilter::LoadEquirectTexture(
+    const char* path, EquirectImage* refine_source) {
+  last_load_ = {};
+  EquirectStream stream;
+  if (!stream.Open(path, settings_, &pool_, log_)) return nullptr;
+  if (refine_source) stream.KeepCopy(RefineSourceWidth());
+
+  last_load_.source_width = stream.source_width();
+  last_load_.source_height = stream.source_height();
+  last_load_.width = stream.width();
+  last_load_.height = stream.height();
+  last_load_.cpu_bytes = stream.cpu_bytes();
+
+  filament::Texture* const equirect = UploadEquirectBands(
+      stream.width(), stream.height(),
+      [&stream](filament::math::float3* band, int y, int rows) {
+        return stream.ReadBand(rows, band) == rows;
+      });
+  if (equirect && settings_.irradiance_sh) {
+    irradiance_sh_ = stream.irradiance_sh();
+  }
+  if (equirect && refine_source) *refine_source = stream.TakeCopy();
+  return equirect;
+}
+
+inline EquirectImage DecodeEquirectImage(const char* path,
+                                         const EnvSettings& settings,
+                                         WorkerPool* pool, Logger* log) {
+  EquirectStream stream;
+  if (!stream.Open(path, settings, pool, log)) return {};
+
+  // Bands land straight in the image, so downscaling needs no second copy.
+  EquirectImage image;
+  image.pixels.resize(size_t(stream.width()) * stream.height());
+  while (!stream.done()) {
+    const size_t offset = size_t(stream.row()) * stream.width();
+    stream.ReadBand(EnvPrefilter::kBandRows, image.pixels.data() + offset);
+  }
+  if (stream.failed()) return {};
+
+  image.source_width = stream.source_width();
+  image.source_height = stream.source_height();
+  image.width = stream.width();
+  image.height = stream.height();
+  image.cpu_bytes =
+      stream.cpu_bytes() + image.pixels.size() * sizeof(filament::math::float3);
+  image.irradiance_sh = stream.irradiance_sh();
+  return image;
+}
+
+inline void EnvPrefilter::UseDecoded(const EquirectImage& image) {
+  last_load_.source_width = image.source_width;
+  last_load_.source_height = image.source_height;
+  last_load_.width = image.width;
+  last_load_.height = image.height;
+  last_load_.cpu_bytes = image.cpu_bytes;
+  if (settings_.irradiance_sh) irradiance_sh_ = image.irradiance_sh;
+}
+
+inline void EnvPrefilter::BeginEquirect(EquirectStream& stream) {
+  CancelRefine();
+  stream.KeepCopy(RefineSourceWidth());
+  last_load_ = {};
+  load_start_ = std::chrono::steady_clock::now();
+
+  const int w = stream.width();
+  loading_equirect_ = CreateEquirectTexture(w, stream.height());
+  bands_ = BandBuffers::Create(
+      kBandsInFlight, size_t(kBandRows) * w * sizeof(filament::math::float3));
+}
+
+inline Band EnvPrefilter::AcquireBand() {
+  void* const data = bands_ ? bands_->Acquire() : nullptr;
+  return data ? Band(bands_, data) : Band();
+}
+
+inline void EnvPrefilter::UploadBand(Band&& band, int y, int rows) {
+  using namespace filament;
+  // Dropped bands go back to their buffers as 'band' goes out of scope.
+  if (!band || band.buffers() != bands_ || rows <= 0) return;
+
+  const uint32_t w = loading_equirect_->getWidth();
+  Texture::PixelBufferDescriptor pixels =
+      band.Upload(size_t(rows) * w * sizeof(math::float3));
+  if (uploads_) {
+    uploads_->EnqueueSubImage(loading_equirect_, 0, 0, uint32_t(y), w,
+                              uint32_t(rows), std::move(pixels),
+                              UploadPriority::kLow);
+  } else {
+    loading_equirect_->setImage(engine_, 0, 0, uint32_t(y), w, uint32_t(rows),
+                                std::move(pixels));
+  }
+}
+
+inline bool EnvPrefilter::FinishEquirect(EquirectStream& stream,
+                                         Environment& env) {
+  if (!loading_equirect_ || stream.failed() || !stream.done() ||
+      uploading_bands()) {
+    CancelRefine();
     return false;
   }
 
+  last_load_.source_width = stream.source_width();
+  last_load_.source_height = stream.source_height();
+  last_load_.width = stream.width();
+  last_load_.height = stream.height();
+  last_load_.cpu_bytes = stream.cpu_bytes() + bands_->capacity_bytes();
+  if (settings_.irradiance_sh) irradiance_sh_ = stream.irradiance_sh();
+
+  bands_->Close();
+  bands_ = nullptr;
+  filament::Texture* const equirect = std::exchange(loading_equirect_, nullptr);
+  if (settings_.equirect_mipmaps) equirect->generateMipmaps(engine_);
+  last_load_.gpu_transient_bytes =
+      TextureBytes(stream.width(), stream.height(),
+                   settings_.equirect_mipmaps ? 0xff : 1);
+  refine_source_ = stream.TakeCopy();
+  return StartRefine(equirect, env, load_start_);
+}
+
+inline bool EnvPrefilter::LoadEquirectCpu(const char* path, Environment& env) {
+  const auto start = std::chrono::steady_clock::now();
+  return LoadEquirectCpu(DecodeEquirectImage(path, settings_, &pool_, log_),
+                         env, start);
+}
+
+inline bool EnvPrefilter::LoadEquirectCpu(
+    EquirectImage&& image, Environment& env,
+    std::chrono::steady_clock::time_point start) {
+  using namespace filament;
+
+  CancelRefine();
+  last_load_ = {};
+  if (image.pixels.empty()) return false;
+  UseDecoded(image);
+
+  const uint32_t size = settings_.cube_size;
+  const CpuCubemap sky = EquirectToCubemapCpu(
+      image.pixels.data(), image.width, image.height, size, &pool_);
+  const CpuCubemap reflections =
+      SpecularFilterCpu(sky, size, settings_.level_count,
+                        settings_.sample_count, settings_.lod_offset, &pool_);
+
+  // Both cubes and the source are alive at once, on top of the decode.
+  size_t cube_bytes = 0;
+  for (const CpuCubemap* cube : {&sky, &reflections}) {
+    for (const auto& level : cube->levels) {
+      cube_bytes += level.size() * sizeof(math::float3);
+    }
+  }
+  last_load_.cpu_bytes += cube_bytes;
+
+  // 'env' shows them right away, so they upload ahead of anything else.
+  auto skybox_cube =
+      UploadCubemap(engine_, sky, uploads_, UploadPriority::kHigh);
+  auto skybox = CreateSkybox(engine_, skybox_cube);
+  auto ibl_cube =
+      UploadCubemap(engine_, reflections, uploads_, UploadPriority::kHigh);
+  auto ibl = CreateIndirectLight(ibl_cube);
+
+  env = Environment(&engine_, skybox_cube, skybox, ibl_cube, ibl,
+                    retire_queue_, uploads_);
+
+  FinishLoadStats(env, std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count());
+  return true;
+}
+
+inline void EnvPrefilter::FinishLoadStats(const Environment& env,
+                                          double seconds) {
+  last_load_.seconds = seconds;
+  last_load_.gpu_bytes = 0;
+  if (env.skybox_cube()) {
+    const uint32_t size = env.skybox_cube()->getWidth();
+    last_load_.gpu_bytes += TextureBytes(size, size, 0xff, 6);
+  }
+  if (env.ibl_cube()) {
+    const uint32_t size = env.ibl_cube()->getWidth();
+    last_load_.gpu_bytes += TextureBytes(size, size, settings_.level_count, 6);
+  }
+
   if (log_) {
-    (*log_) << "EnvPrefilter::LoadEquirect: " << path << " " << w << "," << h
-            << " " << n << std::endl;
-  }
-
-  Texture* const equirect = Texture::Builder()
-                                .width((uint32_t)w)
-                                .height((uint32_t)h)
-                                .levels(0xff)
-                                .format(Texture::InternalFormat::R11F_G11F_B10F)
-                                .sampler(Texture::Sampler::SAMPLER_2D)
-                                .build(engine_);
-
-  equirect->setImage(engine_, 0,
-                     Texture::PixelBufferDescriptor(
-                         data, size, Texture::Format::RGB, Texture::Type::FLOAT,
-                         [](void* buffer, size_t size, void* user) {
-                           stbi_image_free(buffer);
-                         }));
-
-  auto skybox_cube = equirect_to_cube_(equirect);
-  engine_.destroy(equirect);
-  auto skybox =
-      Skybox::Builder().environment(skybox_cube).showSun(true).build(engine_);
-
-  // Looks like this is ~1/3 the sun?
-  constexpr float kIndirectLightIntensity = 30000.0f;
-  auto ibl_cube = specular_to_diffuse_(skybox_cube);
-  auto ibl = IndirectLight::Builder()
-                 .reflections(ibl_cube)
-                 .intensity(kIndirectLightIntensity)
-                 .build(engine_);
-
-  env = {&engine_, skybox_cube, skybox, ibl_cube, ibl};
+    log_->Log(LogLevel::kInfo,
+              "EnvPrefilter: %g ms, %dx%d from %dx%d, CPU %zu KiB, GPU %zu KiB "
+              "(+%zu KiB transient)",
+              last_load_.seconds * 1000, last_load_.width, last_load_.height,
+              last_load_.source_width, last_load_.source_height,
+              last_load_.cpu_bytes / 1024, last_load_.gpu_bytes / 1024,
+              last_load_.gpu_transient_bytes / 1024);
+  }
+}
+
+inline bool EnvPrefilter::LoadEquirect(const char* path, Environment& env) {
+  using namespace filament;
+  if (settings_.cpu_prefilter) return LoadEquirectCpu(path, env);
+
+  const auto start = std::chrono::steady_clock::now();
+  CancelRefine();
+
+  Texture* const equirect = LoadEquirectTexture(path);
+  if (!equirect) return false;
+
+  const uint32_t size = settings_.cube_size;
+  auto skybox_cube = equirect_to_cube_(equirect, CreateCubemapTexture(size));
+  DestroyTracked(engine_, equirect);
+  auto skybox = CreateSkybox(engine_, skybox_cube);
+
+  auto ibl_cube = FilterReflections(specular_to_diffuse_, size, skybox_cube);
+  auto ibl = CreateIndirectLight(ibl_cube);
+
+  env = Environment(&engine_, skybox_cube, skybox, ibl_cube, ibl,
+                    retire_queue_, uploads_);
+
+  FinishLoadStats(env, std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count());
   return true;
 }
 
+inline bool EnvPrefilter::LoadEquirectProgressive(const char* path,
+                                                  Environment& env) {
+  if (settings_.cpu_prefilter) return LoadEquirectCpu(path, env);
+
+  const auto start = std::chrono::steady_clock::now();
+  CancelRefine();
+
+  filament::Texture* const equirect =
+      LoadEquirectTexture(path, &refine_source_);
+  if (!equirect) return false;
+  return StartRefine(equirect, env, start);
+}
+
+inline bool EnvPrefilter::LoadEquirectProgressive(EquirectImage&& image,
+                                                  Environment& env) {
+  const auto start = std::chrono::steady_clock::now();
+  if (settings_.cpu_prefilter) {
+    return LoadEquirectCpu(std::move(image), env, start);
+  }
+
+  CancelRefine();
+  last_load_ = {};
+  if (image.pixels.empty()) return false;
+  UseDecoded(image);
+  const auto read = [&image](filament::math::float3* band, int y, int rows) {
+    const size_t w = image.width;
+    memcpy(band, image.pixels.data() + y * w,
+           rows * w * sizeof(filament::math::float3));
+    return true;
+  };
+  filament::Texture* const equirect =
+      UploadEquirectBands(image.width, image.height, read);
+  if (!equirect) return false;
+
+  // The refinement only needs RefineSourceWidth(), but keeps the image as is
+  // if that needs no copy.
+  const int scale = EquirectScale(image.width, RefineSourceWidth());
+  if (scale > 1) {
+    refine_source_.width = image.width / scale;
+    refine_source_.height = image.height / scale;
+    refine_source_.pixels.resize(size_t(refine_source_.width) *
+                                 refine_source_.height);
+    DownscaleEquirect(image.pixels.data(), image.width,
+                      refine_source_.height * scale,
+                      refine_source_.pixels.data(), refine_source_.width,
+                      refine_source_.height);
+  } else {
+    refine_source_ = std::move(image);
+  }
+  return StartRefine(equirect, env, start);
+}
+
+inline bool EnvPrefilter::StartRefine(
+    filament::Texture* equirect, Environment& env,
+    std::chrono::steady_clock::time_point start) {
+  using namespace filament;
+
+  // A small cube and a handful of samples are cheap enough to show right away.
+  const uint32_t size = std::max(settings_.cube_size / 4, 16u);
+  auto skybox_cube = equirect_to_cube_(equirect, CreateCubemapTexture(size));
+  auto skybox = CreateSkybox(engine_, skybox_cube);
+
+  auto ibl_cube = FilterReflections(coarse_specular_, size, skybox_cube);
+  auto ibl = CreateIndirectLight(ibl_cube);
+
+  env = Environment(&engine_, skybox_cube, skybox, ibl_cube, ibl,
+                    retire_queue_, uploads_);
+
+  pending_equirect_ = equirect;
+  stage_ = kStageCube;
+
+  // Covers the coarse environment only; the equirect is still alive.
+  FinishLoadStats(env, std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count());
+  return true;
+}
+
+inline uint64_t EnvPrefilter::StageCost(Stage stage) const {
+  // Texels in a cube with a full mip chain (~4/3 of level 0).
+  const uint64_t size = settings_.cube_size;
+  const uint64_t cube_texels = 6 * size * size * 4 / 3;
+  switch (stage) {
+    case kStageCube:
+      return cube_texels;
+    case kStageMediumSpecular:
+      return cube_texels * std::max(16, settings_.sample_count / 4);
+    case kStageFullSpecular:
+      return specular_steps_ ? specular_steps_->next_cost() : 0;
+    case kStageDone:
+      break;
+  }
+  return 0;
+}
+
+inline bool EnvPrefilter::Refine(Environment& env, uint64_t sample_budget) {
+  using namespace filament;
+
+  // NOTE: GPU time can't be measured without blocking on a fence, which is
+  // exactly the long frame we're trying to avoid, so the budget is expressed
+  // as estimated filter samples instead.
+  const uint32_t size = settings_.cube_size;
+  bool changed = false;
+  bool ran = false;
+  uint64_t spent = 0;
+  while (stage_ != kStageDone) {
+    if (stage_ == kStageFullSpecular) {
+      while (!refine_jobs_ && !specular_steps_->done()) {
+        const uint64_t cost = StageCost(stage_);
+        if (ran && spent + cost > sample_budget) break;
+        spent += cost;
+        specular_steps_->Run(&pool_);
+        ++steps_taken_;
+        ran = true;
+      }
+      // Finished levels go up even when the budget is spent.
+      if (UploadSpecularLevels(env)) changed = true;
+      break;
+    }
+
+    const uint64_t cost = StageCost(stage_);
+    if (ran && spent + cost > sample_budget) break;
+    spent += cost;
+
+    switch (stage_) {
+      case kStageCube: {
+        auto skybox_cube =
+            equirect_to_cube_(pending_equirect_, CreateCubemapTexture(size));
+        RetireOrDestroy(engine_, retire_queue_, pending_equirect_);
+        pending_equirect_ = nullptr;
+        env.ReplaceSkybox(skybox_cube, CreateSkybox(engine_, skybox_cube));
+        stage_ = kStageMediumSpecular;
+        break;
+      }
+      case kStageMediumSpecular: {
+        auto ibl_cube =
+            FilterReflections(medium_specular_, size, env.skybox_cube());
+        env.ReplaceIbl(ibl_cube, CreateIndirectLight(ibl_cube));
+        StartSpecularSteps();
+        break;
+      }
+      case kStageFullSpecular:
+      case kStageDone:
+        break;
+    }
+    changed = true;
+    ran = true;
+  }
+  return changed;
+}
+
+inline RefineJob EnvPrefilter::TakeRefineJob() {
+  refine_jobs_ = true;
+  if (stage_ != kStageFullSpecular || specular_steps_->done() ||
+      steps_taken_ > specular_steps_->steps_done()) {
+    return {};
+  }
+  steps_taken_ = specular_steps_->steps_done() + 1;
+  if (!refine_pool_) refine_pool_ = std::make_shared<WorkerPool>();
+  return RefineJob(specular_steps_, refine_pool_);
+}
+
+inline void EnvPrefilter::StartSpecularSteps() {
+  stage_ = kStageDone;
+  if (refine_source_.pixels.empty()) return;
+
+  const uint32_t size = settings_.cube_size;
+  specular_steps_ = std::make_shared<CpuPrefilterSteps>(
+      std::move(refine_source_.pixels), refine_source_.width,
+      refine_source_.height, size, settings_.level_count,
+      settings_.sample_count, settings_.lod_offset);
+  refine_source_ = {};
+  specular_cube_ = CreateUploadCubemap(engine_, size, settings_.level_count);
+  steps_taken_ = 0;
+  levels_uploaded_ = 0;
+  stage_ = kStageFullSpecular;
+}
+
+inline bool EnvPrefilter::UploadSpecularLevels(Environment& env) {
+  using namespace filament;
+
+  const CpuCubemap& reflections = specular_steps_->reflections();
+  const size_t levels_done = specular_steps_->levels_done();
+  for (; levels_uploaded_ < levels_done; ++levels_uploaded_) {
+    UploadCubemapLevel(engine_, specular_cube_, reflections, levels_uploaded_,
+                       uploads_, UploadPriority::kLow);
+  }
+  if (levels_uploaded_ < reflections.levels.size()) return false;
+  if (uploads_ && uploads_->Queued(specular_cube_)) return false;
+
+  Texture* const ibl_cube = std::exchange(specular_cube_, nullptr);
+  env.ReplaceIbl(ibl_cube, CreateIndirectLight(ibl_cube));
+  specular_steps_ = nullptr;
+  refine_pool_ = nullptr;
+  stage_ = kStageDone;
+  return true;
+}
+
+inline void EnvPrefilter::CancelRefine() {
+  if (loading_equirect_) {
+    if (uploads_) uploads_->Cancel(loading_equirect_);
+    RetireOrDestroy(engine_, retire_queue_, loading_equirect_);
+    loading_equirect_ = nullptr;
+  }
+  if (bands_) {
+    bands_->Close();  // Bands still lent out come back as they're dropped.
+    bands_ = nullptr;
+  }
+  RetireOrDestroy(engine_, retire_queue_, pending_equirect_);  // nullptr ok.
+  pending_equirect_ = nullptr;
+  if (specular_cube_) {
+    if (uploads_) uploads_->Cancel(specular_cube_);
+    RetireOrDestroy(engine_, retire_queue_, specular_cube_);
+    specular_cube_ = nullptr;
+  }
+  // A job still running keeps its own references, and finishes unseen.
+  specular_steps_ = nullptr;
+  refine_pool_ = nullptr;
+  refine_source_ = {};
+  stage_ = kStageDone;
+}
+
 inline Environment::Environment(filament::Engine* engine,
                                 filament::Texture* skybox_cube,
                                 filament::Skybox* skybox,
                                 filament::Texture* ibl_cube,
-                                filament::IndirectLight* ibl)
+                                filament::IndirectLight* ibl,
+                                RetireQueue* retire_queue,
+                                UploadScheduler* uploads)
     : engine_(engine),
+      retire_queue_(retire_queue),
+      uploads_(uploads),
       skybox_cube_(skybox_cube),
       skybox_(skybox),
       ibl_cube_(ibl_cube),
@@ -95,6 +865,8 @@ inline Environment::Environment(Environment&& other) {
 
 inline Environment& Environment::operator=(Environment&& other) {
   std::swap(engine_, other.engine_);
+  std::swap(retire_queue_, other.retire_queue_);
+  std::swap(uploads_, other.uploads_);
   std::swap(skybox_cube_, other.skybox_cube_);
   std::swap(skybox_, other.skybox_);
   std::swap(ibl_cube_, other.ibl_cube_);
@@ -102,13 +874,40 @@ inline Environment& Environment::operator=(Environment&& other) {
   return *this;
 }
 
+template <typename T>
+void Environment::Dispose(T* object) {
+  // Without a queue, nothing else cancels them before the object is gone.
+  if (uploads_) uploads_->Cancel(object);
+  RetireOrDestroy(*engine_, retire_queue_, object);
+}
+
+inline void Environment::ReplaceSkybox(filament::Texture* skybox_cube,
+                                       filament::Skybox* skybox) {
+  if (engine_) {
+    Dispose(skybox_);
+    Dispose(skybox_cube_);
+  }
+  skybox_cube_ = skybox_cube;
+  skybox_ = skybox;
+}
+
+inline void Environment::ReplaceIbl(filament::Texture* ibl_cube,
+                                    filament::IndirectLight* ibl) {
+  if (engine_) {
+    Dispose(ibl_);
+    Dispose(ibl_cube_);
+  }
+  ibl_cube_ = ibl_cube;
+  ibl_ = ibl;
+}
+
 inline Environment::~Environment() {
   if (engine_) {
-    // engine_->destroy(nullptr) is okay.
-    engine_->destroy(skybox_cube_);
-    engine_->destroy(skybox_);
-    engine_->destroy(ibl_cube_);
-    engine_->destroy(ibl_);
+    // Skyboxes and lights before the cubes they sample; nullptr is okay.
+    Dispose(skybox_);
+    Dispose(skybox_cube_);
+    Dispose(ibl_);
+    Dispose(ibl_cube_);
   }
 }
 
@@ -0,0 +1,203 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Many small meshes sub-allocated from one shared vertex buffer and one
+// shared index buffer, instead of a buffer pair each.
+//
+// Usage:
+//
+//   fs::GeometryPool pool(engine, 1 << 20, 4 << 20);
+//   const uint32_t id = pool.Add(fs::MeshSphere(16, 32));
+//   RenderableManager::Builder(1)
+//       .geometry(0, PrimitiveType::TRIANGLES, pool.vertex_buf(),
+//                 pool.index_buf(), pool.Get(id).index_offset,
+//                 pool.Get(id).index_count)
+//       ...
+//       .build(*engine, entity);
+//   pool.Bind(id, entity);  // So Compact() can move it.
+//   ...
+//   engine->destroy(entity);
+//   pool.Remove(id);
+//
+
+#ifndef FS_GEOMETRY_POOL_H_
+#define FS_GEOMETRY_POOL_H_
+
+#include <filament/Box.h>
+#include <filament/Engine.h>
+#include <filament/IndexBuffer.h>
+#include <filament/RenderableManager.h>
+#include <filament/VertexBuffer.h>
+#include <utils/Entity.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "fs_mesh.h"
+
+namespace fs {
+
+// First-fit allocator of [offset, offset + size) ranges within a capacity,
+// with adjacent free ranges coalesced.
+class RangeAllocator {
+ public:
+  static constexpr uint32_t kInvalid = ~0u;
+
+  RangeAllocator() = default;
+  explicit RangeAllocator(uint32_t capacity) : capacity_(capacity) {
+    if (capacity) free_.push_back({0, capacity});
+  }
+
+  // Returns the offset of a 'size' range, or kInvalid if none fits.
+  uint32_t Allocate(uint32_t size);
+
+  // Returns a range from Allocate(...).
+  void Free(uint32_t offset, uint32_t size);
+
+  // Makes [0, used) allocated and the rest one free range.
+  void Reset(uint32_t used);
+
+  uint32_t capacity() const { return capacity_; }
+  uint32_t used() const { return used_; }
+  uint32_t LargestFree() const;
+
+  // 0 when all free space is one range, approaching 1 as it splinters.
+  float Fragmentation() const;
+
+ private:
+  struct Block {
+    uint32_t offset;
+    uint32_t size;
+  };
+
+  uint32_t capacity_ = 0;
+  uint32_t used_ = 0;
+  std::vector<Block> free_;  // Sorted by offset, never adjacent.
+};
+
+struct GeometryPoolStats {
+  uint32_t allocations = 0;
+
+  uint32_t vertex_capacity = 0;
+  uint32_t vertices_used = 0;
+  uint32_t largest_free_vertices = 0;
+  float vertex_fragmentation = 0;  // See RangeAllocator::Fragmentation().
+
+  uint32_t index_capacity = 0;
+  uint32_t indices_used = 0;
+  uint32_t largest_free_indices = 0;
+  float index_fragmentation = 0;
+
+  uint32_t compactions = 0;
+  size_t gpu_bytes = 0;  // Both buffers, at capacity.
+};
+
+class GeometryPool {
+ public:
+  static constexpr uint32_t kInvalid = ~0u;
+
+  // Where one mesh lives in the shared buffers.
+  struct Allocation {
+    uint32_t vertex_offset = 0;
+    uint32_t vertex_count = 0;
+    uint32_t index_offset = 0;  // In indices, for geometry(...).
+    uint32_t index_count = 0;
+    filament::Box bounds;
+  };
+
+  GeometryPool() = default;
+
+  // Creates the shared buffers. Indices are 16-bit if 'vertex_capacity'
+  // allows it.
+  GeometryPool(filament::Engine* engine, uint32_t vertex_capacity,
+               uint32_t index_capacity);
+
+  GeometryPool(const GeometryPool&) = delete;
+  GeometryPool& operator=(const GeometryPool&) = delete;
+
+  GeometryPool(GeometryPool&& other);
+  GeometryPool& operator=(GeometryPool&& other);
+
+  // Destroys the buffers. Renderables using them must be destroyed first.
+  ~GeometryPool();
+
+  // Copies 'mesh' into free ranges and uploads it. Returns an id for Get(...)
+  // and Remove(...), or kInvalid if there's no room, even after compacting,
+  // or if 'mesh' has no vertices or indices.
+  uint32_t Add(const MeshData& mesh);
+
+  // Frees the ranges of 'id' for reuse.
+  void Remove(uint32_t id);
+
+  // Valid until the next Compact().
+  const Allocation& Get(uint32_t id) const { return allocations_[id]; }
+
+  // Registers primitive 'primitive' of the renderable on 'entity' as drawing
+  // 'id', so Compact() can point it at the moved ranges. Remove(id) forgets
+  // bindings; destroy the renderable before that.
+  void Bind(uint32_t id, utils::Entity entity, size_t primitive = 0);
+
+  // Slides every allocation to the front of both buffers, rewrites indices
+  // for their new vertex offsets, re-uploads the used part of both buffers,
+  // and updates bound renderables. Add(...) calls this when free space is
+  // too fragmented.
+  void Compact();
+
+  GeometryPoolStats stats() const;
+
+  filament::VertexBuffer* vertex_buf() const { return vertex_buf_; }
+  filament::IndexBuffer* index_buf() const { return index_buf_; }
+
+ private:
+  struct Binding {
+    uint32_t id;
+    utils::Entity entity;
+    size_t primitive;
+  };
+
+  // Uploads [first, first + count) of the CPU copies.
+  void UploadVertices(uint32_t first, uint32_t count);
+  void UploadIndices(uint32_t first, uint32_t count);
+
+  // Points every binding of 'id' at its current ranges.
+  void UpdateBindings(uint32_t id);
+
+  filament::Engine* engine_ = nullptr;  // Not owned.
+  filament::VertexBuffer* vertex_buf_ = nullptr;
+  filament::IndexBuffer* index_buf_ = nullptr;
+  bool short_indices_ = false;
+
+  RangeAllocator vertex_ranges_;
+  RangeAllocator index_ranges_;
+
+  // CPU copies of both buffers, with indices already rebased to absolute
+  // vertex numbers. Compaction rebuilds the GPU buffers from these.
+  std::vector<MeshVertex> vertices_;
+  std::vector<uint32_t> indices_;
+
+  std::vector<Allocation> allocations_;  // Indexed by id.
+  std::vector<bool> live_;               // Per id.
+  std::vector<uint32_t> free_ids_;
+  std::vector<Binding> bindings_;
+  uint32_t compactions_ = 0;
+};
+
+}  // namespace fs
+
+#include "fs_geometry_pool_impl.h"
+
+#endif  // FS_GEOMETRY_POOL_H_
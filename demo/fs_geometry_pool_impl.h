@@ -0,0 +1,304 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+#ifndef FS_GEOMETRY_POOL_IMPL_H_
+#define FS_GEOMETRY_POOL_IMPL_H_
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+
+namespace fs {
+
+inline uint32_t RangeAllocator::Allocate(uint32_t size) {
+  if (size == 0) return kInvalid;
+  for (size_t i = 0; i < free_.size(); ++i) {
+    Block& block = free_[i];
+    if (block.size < size) continue;
+    const uint32_t offset = block.offset;
+    block.offset += size;
+    block.size -= size;
+    if (block.size == 0) free_.erase(free_.begin() + i);
+    used_ += size;
+    return offset;
+  }
+  return kInvalid;
+}
+
+inline void RangeAllocator::Free(uint32_t offset, uint32_t size) {
+  if (size == 0) return;
+  used_ -= size;
+  auto next = std::lower_bound(free_.begin(), free_.end(), offset,
+                               [](const Block& block, uint32_t offset) {
+                                 return block.offset < offset;
+                               });
+
+  // Merge with the neighbors it touches.
+  const bool joins_prev =
+      next != free_.begin() && (next - 1)->offset + (next - 1)->size == offset;
+  const bool joins_next = next != free_.end() && offset + size == next->offset;
+  if (joins_prev && joins_next) {
+    (next - 1)->size += size + next->size;
+    free_.erase(next);
+  } else if (joins_prev) {
+    (next - 1)->size += size;
+  } else if (joins_next) {
+    next->offset = offset;
+    next->size += size;
+  } else {
+    free_.insert(next, {offset, size});
+  }
+}
+
+inline void RangeAllocator::Reset(uint32_t used) {
+  used_ = used;
+  free_.clear();
+  if (used < capacity_) free_.push_back({used, capacity_ - used});
+}
+
+inline uint32_t RangeAllocator::LargestFree() const {
+  uint32_t largest = 0;
+  for (const Block& block : free_) largest = std::max(largest, block.size);
+  return largest;
+}
+
+inline float RangeAllocator::Fragmentation() const {
+  const uint32_t free = capacity_ - used_;
+  return free ? 1 - float(LargestFree()) / free : 0;
+}
+
+inline GeometryPool::GeometryPool(filament::Engine* engine,
+                                  uint32_t vertex_capacity,
+                                  uint32_t index_capacity)
+    : engine_(engine),
+      short_indices_(vertex_capacity <= 0x10000),
+      vertex_ranges_(vertex_capacity),
+      index_ranges_(index_capacity),
+      vertices_(vertex_capacity),
+      indices_(index_capacity) {
+  using namespace filament;
+  vertex_buf_ = CreateMeshVertexBuffer(*engine_, vertex_capacity);
+  index_buf_ = IndexBuffer::Builder()
+                   .indexCount(index_capacity)
+                   .bufferType(short_indices_ ? IndexBuffer::IndexType::USHORT
+                                              : IndexBuffer::IndexType::UINT)
+                   .build(*engine_);
+  TrackBuffer(index_buf_, GpuMemoryTag::kVisuals,
+              size_t(index_capacity) * (short_indices_ ? 2 : 4));
+}
+
+inline GeometryPool::GeometryPool(GeometryPool&& other) {
+  *this = std::move(other);
+}
+
+inline GeometryPool& GeometryPool::operator=(GeometryPool&& other) {
+  std::swap(engine_, other.engine_);
+  std::swap(vertex_buf_, other.vertex_buf_);
+  std::swap(index_buf_, other.index_buf_);
+  std::swap(short_indices_, other.short_indices_);
+  std::swap(vertex_ranges_, other.vertex_ranges_);
+  std::swap(index_ranges_, other.index_ranges_);
+  std::swap(vertices_, other.vertices_);
+  std::swap(indices_, other.indices_);
+  std::swap(allocations_, other.allocations_);
+  std::swap(live_, other.live_);
+  std::swap(free_ids_, other.free_ids_);
+  std::swap(bindings_, other.bindings_);
+  std::swap(compactions_, other.compactions_);
+  return *this;
+}
+
+inline GeometryPool::~GeometryPool() {
+  if (!engine_) return;
+  DestroyTracked(*engine_, vertex_buf_);
+  DestroyTracked(*engine_, index_buf_);
+}
+
+inline uint32_t GeometryPool::Add(const MeshData& mesh) {
+  const uint32_t vertex_count = uint32_t(mesh.vertices.size());
+  const uint32_t index_count = uint32_t(mesh.indices.size());
+  // Allocate(0) can't return an offset, and there's nothing to draw anyway.
+  if (vertex_count == 0 || index_count == 0) return kInvalid;
+  if (vertex_count > vertex_ranges_.capacity() - vertex_ranges_.used() ||
+      index_count > index_ranges_.capacity() - index_ranges_.used()) {
+    return kInvalid;
+  }
+
+  uint32_t vertex_offset = vertex_ranges_.Allocate(vertex_count);
+  uint32_t index_offset = index_ranges_.Allocate(index_count);
+  if (vertex_offset == kInvalid || index_offset == kInvalid) {
+    // There's room in total, so compacting makes it one block.
+    vertex_ranges_.Free(vertex_offset == kInvalid ? 0 : vertex_offset,
+                        vertex_offset == kInvalid ? 0 : vertex_count);
+    index_ranges_.Free(index_offset == kInvalid ? 0 : index_offset,
+                       index_offset == kInvalid ? 0 : index_count);
+    Compact();
+    vertex_offset = vertex_ranges_.Allocate(vertex_count);
+    index_offset = index_ranges_.Allocate(index_count);
+  }
+
+  std::copy(mesh.vertices.begin(), mesh.vertices.end(),
+            vertices_.begin() + vertex_offset);
+  for (uint32_t i = 0; i < index_count; ++i) {
+    indices_[index_offset + i] = vertex_offset + mesh.indices[i];
+  }
+  UploadVertices(vertex_offset, vertex_count);
+  UploadIndices(index_offset, index_count);
+
+  uint32_t id;
+  if (free_ids_.empty()) {
+    id = uint32_t(allocations_.size());
+    allocations_.emplace_back();
+    live_.push_back(false);
+  } else {
+    id = free_ids_.back();
+    free_ids_.pop_back();
+  }
+  allocations_[id] = {vertex_offset, vertex_count, index_offset, index_count,
+                      mesh.bounds};
+  live_[id] = true;
+  return id;
+}
+
+inline void GeometryPool::Remove(uint32_t id) {
+  if (id >= live_.size() || !live_[id]) return;
+  const Allocation& allocation = allocations_[id];
+  vertex_ranges_.Free(allocation.vertex_offset, allocation.vertex_count);
+  index_ranges_.Free(allocation.index_offset, allocation.index_count);
+  live_[id] = false;
+  free_ids_.push_back(id);
+  std::erase_if(bindings_,
+                [id](const Binding& binding) { return binding.id == id; });
+}
+
+inline void GeometryPool::Bind(uint32_t id, utils::Entity entity,
+                               size_t primitive) {
+  bindings_.push_back({id, entity, primitive});
+}
+
+inline void GeometryPool::UpdateBindings(uint32_t id) {
+  using namespace filament;
+  RenderableManager& rm = engine_->getRenderableManager();
+  const Allocation& allocation = allocations_[id];
+  for (const Binding& binding : bindings_) {
+    if (binding.id != id) continue;
+    rm.setGeometryAt(rm.getInstance(binding.entity), binding.primitive,
+                     RenderableManager::PrimitiveType::TRIANGLES, vertex_buf_,
+                     index_buf_, allocation.index_offset,
+                     allocation.index_count);
+  }
+}
+
+inline void GeometryPool::Compact() {
+  std::vector<uint32_t> ids;
+  for (uint32_t id = 0; id < live_.size(); ++id) {
+    if (live_[id]) ids.push_back(id);
+  }
+
+  // Vertices keep their relative order, so each moves down or stays put.
+  std::sort(ids.begin(), ids.end(), [this](uint32_t a, uint32_t b) {
+    return allocations_[a].vertex_offset < allocations_[b].vertex_offset;
+  });
+  std::vector<uint32_t> old_vertex_offsets(allocations_.size());
+  uint32_t vertex_end = 0;
+  for (uint32_t id : ids) {
+    Allocation& allocation = allocations_[id];
+    old_vertex_offsets[id] = allocation.vertex_offset;
+    std::copy_n(vertices_.begin() + allocation.vertex_offset,
+                allocation.vertex_count, vertices_.begin() + vertex_end);
+    allocation.vertex_offset = vertex_end;
+    vertex_end += allocation.vertex_count;
+  }
+
+  // Same for indices, rebasing them onto the new vertex offsets.
+  std::sort(ids.begin(), ids.end(), [this](uint32_t a, uint32_t b) {
+    return allocations_[a].index_offset < allocations_[b].index_offset;
+  });
+  uint32_t index_end = 0;
+  for (uint32_t id : ids) {
+    Allocation& allocation = allocations_[id];
+    const uint32_t delta = allocation.vertex_offset - old_vertex_offsets[id];
+    for (uint32_t i = 0; i < allocation.index_count; ++i) {
+      indices_[index_end + i] = indices_[allocation.index_offset + i] + delta;
+    }
+    allocation.index_offset = index_end;
+    index_end += allocation.index_count;
+  }
+
+  vertex_ranges_.Reset(vertex_end);
+  index_ranges_.Reset(index_end);
+  UploadVertices(0, vertex_end);
+  UploadIndices(0, index_end);
+  for (uint32_t id : ids) UpdateBindings(id);
+  ++compactions_;
+}
+
+inline void GeometryPool::UploadVertices(uint32_t first, uint32_t count) {
+  using namespace filament;
+  if (count == 0) return;
+
+  // Filament reads uploads later, by which time Compact() may have moved
+  // things around in vertices_, so it gets its own copy.
+  const size_t size = size_t(count) * sizeof(MeshVertex);
+  void* const data = malloc(size);
+  std::memcpy(data, vertices_.data() + first, size);
+  vertex_buf_->setBufferAt(
+      *engine_, 0,
+      VertexBuffer::BufferDescriptor(
+          data, size, [](void* buffer, size_t, void*) { free(buffer); }),
+      uint32_t(first * sizeof(MeshVertex)));
+}
+
+inline void GeometryPool::UploadIndices(uint32_t first, uint32_t count) {
+  using namespace filament;
+  if (count == 0) return;
+
+  const size_t index_size = short_indices_ ? 2 : 4;
+  const size_t size = count * index_size;
+  void* const data = malloc(size);
+  if (short_indices_) {
+    std::copy_n(indices_.begin() + first, count, (uint16_t*)data);
+  } else {
+    std::memcpy(data, indices_.data() + first, size);
+  }
+  index_buf_->setBuffer(
+      *engine_,
+      IndexBuffer::BufferDescriptor(
+          data, size, [](void* buffer, size_t, void*) { free(buffer); }),
+      uint32_t(first * index_size));
+}
+
+inline GeometryPoolStats GeometryPool::stats() const {
+  GeometryPoolStats stats;
+  stats.allocations = uint32_t(live_.size() - free_ids_.size());
+  stats.vertex_capacity = vertex_ranges_.capacity();
+  stats.vertices_used = vertex_ranges_.used();
+  stats.largest_free_vertices = vertex_ranges_.LargestFree();
+  stats.vertex_fragmentation = vertex_ranges_.Fragmentation();
+  stats.index_capacity = index_ranges_.capacity();
+  stats.indices_used = index_ranges_.used();
+  stats.largest_free_indices = index_ranges_.LargestFree();
+  stats.index_fragmentation = index_ranges_.Fragmentation();
+  stats.compactions = compactions_;
+  stats.gpu_bytes = size_t(stats.vertex_capacity) * sizeof(MeshVertex) +
+                    size_t(stats.index_capacity) * (short_indices_ ? 2 : 4);
+  return stats;
+}
+
+}  // namespace fs
+
+#endif  // FS_GEOMETRY_POOL_IMPL_H_
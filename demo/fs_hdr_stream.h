@@ -0,0 +1,96 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Streaming decoder for Radiance (.hdr) images.
+//
+// Unlike stbi_loadf, this never holds the whole decoded image in memory: the
+// file is memory-mapped and decoded a band of scanlines at a time, into a
+// buffer the caller provides.
+//
+// Usage:
+//
+//   fs::HdrStream hdr(path);
+//   if (!hdr.valid()) return;
+//   std::vector<math::float3> band(kBandRows * hdr.width());
+//   for (int y = 0; y < hdr.height(); y += kBandRows) {
+//     const int rows = std::min(kBandRows, hdr.height() - y);
+//     if (!hdr.ReadRows(rows, band.data())) return;
+//     // Use 'band'...
+//   }
+//
+
+#ifndef FS_HDR_STREAM_H_
+#define FS_HDR_STREAM_H_
+
+#include <math/vec3.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "fs_mapped_file.h"
+
+namespace fs {
+
+class HdrStream {
+ public:
+  HdrStream() = default;
+
+  // Maps 'path' and parses the header. Check valid() for success.
+  //  - Only the common "-Y height +X width" orientation is supported.
+  explicit HdrStream(const char* path);
+
+  HdrStream(const HdrStream&) = delete;
+  HdrStream& operator=(const HdrStream&) = delete;
+
+  HdrStream(HdrStream&&) = default;
+  HdrStream& operator=(HdrStream&&) = default;
+
+  // 'true' if the header was parsed, and no scanline has failed to decode.
+  bool valid() const { return valid_; }
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+  // Index of the next scanline ReadRows() will decode.
+  int row() const { return row_; }
+
+  // Decodes the next 'rows' scanlines into 'out' (rows * width() pixels).
+  // Returns 'false' (and invalidates the stream) on truncated or corrupt data.
+  bool ReadRows(int rows, filament::math::float3* out);
+
+ private:
+  // Decodes one scanline into rgbe_.
+  bool ReadScanline();
+
+  MappedFile file_;
+  const uint8_t* cur_ = nullptr;  // Read cursor into file_.
+  const uint8_t* end_ = nullptr;
+
+  bool valid_ = false;
+  bool flat_ = false;  // Scanlines are stored as raw RGBE, without RLE.
+  int width_ = 0;
+  int height_ = 0;
+  int row_ = 0;
+
+  std::vector<uint8_t> rgbe_;  // One scanline, 4 bytes per pixel.
+};
+
+}  // namespace fs
+
+#include "fs_hdr_stream_impl.h"
+
+#endif  // FS_HDR_STREAM_H_
@@ -0,0 +1,145 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+#ifndef FS_HDR_STREAM_IMPL_H_
+#define FS_HDR_STREAM_IMPL_H_
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace fs {
+
+// Copies the next '\n'-terminated line into 'line' (truncated, always
+// null-terminated) and advances 'cur' past it. Returns 'false' at end of data.
+inline bool ReadHdrHeaderLine(const uint8_t*& cur, const uint8_t* end,
+                              char (&line)[128]) {
+  size_t n = 0;
+  while (cur < end && *cur != '\n') {
+    if (n < sizeof(line) - 1) line[n++] = char(*cur);
+    ++cur;
+  }
+  line[n] = '\0';
+  if (cur == end) return false;
+  ++cur;  // Skip '\n'.
+  return true;
+}
+
+inline HdrStream::HdrStream(const char* path)
+    : file_(path, /*sequential=*/true) {
+  if (!file_.valid()) return;
+  cur_ = file_.data();
+  end_ = file_.data() + file_.size();
+
+  char line[128];
+  if (!ReadHdrHeaderLine(cur_, end_, line)) return;
+  if (std::strcmp(line, "#?RADIANCE") != 0 &&
+      std::strcmp(line, "#?RGBE") != 0) {
+    return;
+  }
+
+  // Header variables, terminated by an empty line.
+  while (true) {
+    if (!ReadHdrHeaderLine(cur_, end_, line)) return;
+    if (line[0] == '\0') break;
+    if (std::strncmp(line, "FORMAT=", 7) == 0 &&
+        std::strcmp(line, "FORMAT=32-bit_rle_rgbe") != 0) {
+      return;  // e.g. 32-bit_rle_xyze.
+    }
+  }
+
+  if (!ReadHdrHeaderLine(cur_, end_, line)) return;
+  if (std::sscanf(line, "-Y %d +X %d", &height_, &width_) != 2) return;
+  if (width_ <= 0 || height_ <= 0) return;
+
+  // Very narrow or very wide images can't be run-length encoded.
+  flat_ = width_ < 8 || width_ >= 32768;
+  rgbe_.resize(size_t(width_) * 4);
+  valid_ = true;
+}
+
+inline bool HdrStream::ReadScanline() {
+  uint8_t* const rgbe = rgbe_.data();
+
+  // Files written without RLE are detected from the first scanline.
+  if (!flat_) {
+    if (end_ - cur_ < 4) return false;
+    const bool is_rle = cur_[0] == 2 && cur_[1] == 2 && !(cur_[2] & 0x80);
+    if (!is_rle) {
+      if (row_ != 0) return false;
+      flat_ = true;
+    }
+  }
+
+  if (flat_) {
+    const size_t size = size_t(width_) * 4;
+    if (size_t(end_ - cur_) < size) return false;
+    std::memcpy(rgbe, cur_, size);
+    cur_ += size;
+    return true;
+  }
+
+  if (((cur_[2] << 8) | cur_[3]) != width_) return false;
+  cur_ += 4;
+
+  // Each of the four channels is run-length encoded separately.
+  for (int c = 0; c < 4; ++c) {
+    int x = 0;
+    while (x < width_) {
+      if (cur_ >= end_) return false;
+      int count = *cur_++;
+      if (count > 128) {
+        count -= 128;
+        if (count > width_ - x || cur_ >= end_) return false;
+        const uint8_t value = *cur_++;
+        for (int i = 0; i < count; ++i) rgbe[4 * x++ + c] = value;
+      } else {
+        if (count == 0 || count > width_ - x || end_ - cur_ < count) {
+          return false;
+        }
+        for (int i = 0; i < count; ++i) rgbe[4 * x++ + c] = *cur_++;
+      }
+    }
+  }
+  return true;
+}
+
+inline bool HdrStream::ReadRows(int rows, filament::math::float3* out) {
+  if (!valid_ || rows < 0 || rows > height_ - row_) return false;
+
+  for (int y = 0; y < rows; ++y, ++row_) {
+    if (!ReadScanline()) {
+      valid_ = false;
+      return false;
+    }
+
+    // Same conversion as stb_image, so both paths produce identical results.
+    const uint8_t* p = rgbe_.data();
+    for (int x = 0; x < width_; ++x, p += 4, ++out) {
+      if (p[3] == 0) {
+        *out = {0, 0, 0};
+      } else {
+        const float f = std::ldexp(1.0f, int(p[3]) - (128 + 8));
+        *out = {p[0] * f, p[1] * f, p[2] * f};
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace fs
+
+#endif  // FS_HDR_STREAM_IMPL_H_
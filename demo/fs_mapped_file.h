@@ -0,0 +1,88 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Read-only memory mapping of a whole file.
+//
+// Pages are loaded lazily by the OS as they're touched, so mapping a large
+// file costs address space, not resident memory.
+//
+// NOTE: uses POSIX mmap (Linux and MacOS).
+//
+
+#ifndef FS_MAPPED_FILE_H_
+#define FS_MAPPED_FILE_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace fs {
+
+class MappedFile {
+ public:
+  MappedFile() = default;
+
+  // Maps the file at 'path'. Check valid() for success.
+  //  - 'sequential' hints the OS to read ahead and drop pages behind us.
+  explicit MappedFile(const char* path, bool sequential = false) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st = {};
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (data != MAP_FAILED) {
+        data_ = (const uint8_t*)data;
+        size_ = st.st_size;
+        if (sequential) madvise(data, size_, MADV_SEQUENTIAL);
+      }
+    }
+    // The mapping keeps its own reference to the file.
+    close(fd);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) { *this = std::move(other); }
+  MappedFile& operator=(MappedFile&& other) {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    return *this;
+  }
+
+  ~MappedFile() {
+    if (data_) munmap((void*)data_, size_);
+  }
+
+  bool valid() const { return data_ != nullptr; }
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+}  // namespace fs
+
+#endif  // FS_MAPPED_FILE_H_
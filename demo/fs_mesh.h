@@ -0,0 +1,153 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Procedural meshes in a compact vertex layout, with a vertex-cache
+// optimization pass and a helper to upload them to Filament buffers.
+//
+// Usage:
+//
+//   fs::MeshData mesh = fs::MeshSphere(32, 64);
+//   fs::OptimizeMesh(mesh);
+//   fs::Mesh gpu = fs::UploadMesh(engine, mesh);
+//   RenderableManager::Builder(1)
+//       .boundingBox(gpu.bounds)
+//       .geometry(0, RenderableManager::PrimitiveType::TRIANGLES,
+//                 gpu.vertex_buf, gpu.index_buf)
+//       ...
+//
+
+#ifndef FS_MESH_H_
+#define FS_MESH_H_
+
+#include <filament/Box.h>
+#include <filament/Engine.h>
+#include <filament/IndexBuffer.h>
+#include <filament/VertexBuffer.h>
+#include <math/half.h>
+#include <math/mat3.h>
+#include <math/norm.h>
+#include <math/vec3.h>
+#include <math/vec4.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "filament_glfw_imgui/gpu_memory.h"
+
+namespace fs {
+
+// Textures and buffers from fs helpers are accounted in gpu_memory.h.
+using filament_glfw_imgui::DestroyTracked;
+using filament_glfw_imgui::GpuMemoryTag;
+using filament_glfw_imgui::TrackBuffer;
+using filament_glfw_imgui::TrackTexture;
+
+// 20 bytes, vs. 32 for float3 positions and float4 tangents.
+//  - 'position' w is always 1.
+//  - 'tangents' is the tangent frame quaternion, as SNORM16.
+//  - 'color' is RGBA8, red in the low byte.
+struct MeshVertex {
+  filament::math::half4 position;
+  filament::math::short4 tangents;
+  uint32_t color;
+};
+
+// An indexed triangle list in CPU memory.
+struct MeshData {
+  std::vector<MeshVertex> vertices;
+  std::vector<uint32_t> indices;  // Narrowed to 16 bits on upload if they fit.
+  filament::Box bounds;           // Of the quantized positions.
+
+  // Vertex and index bytes once uploaded.
+  size_t VertexBytes() const { return vertices.size() * sizeof(MeshVertex); }
+  size_t IndexBytes() const {
+    return indices.size() * (vertices.size() > 0x10000 ? 4 : 2);
+  }
+};
+
+// Unit sphere with poles at +-Z: 'rows' latitude bands of 'cols' quads
+// (triangles at the poles).
+MeshData MeshSphere(int rows, int cols, uint32_t color = 0xffffffffu);
+
+// Cube from -1 to 1, with 'divisions' x 'divisions' quads per face.
+MeshData MeshBox(int divisions = 1, uint32_t color = 0xffffffffu);
+
+// Square from -1 to 1 in XY, facing +Z.
+MeshData MeshPlane(int cols = 1, int rows = 1, uint32_t color = 0xffffffffu);
+
+// Unit-radius cylinder from z = -1 to 1, with 'segments' around and 'rows'
+// along its axis, and optionally flat caps.
+MeshData MeshCylinder(int segments, int rows = 1, bool caps = true,
+                      uint32_t color = 0xffffffffu);
+
+// A range of a mesh's indices, drawn as one level of detail.
+struct MeshLod {
+  uint32_t index_offset = 0;
+  uint32_t index_count = 0;
+
+  // Smallest projected bounding diameter, in pixels, this level is used at.
+  float min_pixels = 0;
+};
+
+// Appends 'meshes' into one, so they can share buffers, and sets 'ranges' to
+// where each one's indices landed. Indices are rebased onto the combined
+// vertex array. Each range's min_pixels is left 0.
+//  - Optimize each mesh first: OptimizeMesh(...) on the result would mix the
+//    ranges together.
+MeshData ConcatMeshes(const std::vector<MeshData>& meshes,
+                      std::vector<MeshLod>& ranges);
+
+// Reorders triangles for the post-transform vertex cache (Forsyth's linear
+// speed algorithm), then renumbers vertices in first-use order so vertex
+// fetches are sequential too. Doesn't change the rendered result.
+void OptimizeMesh(MeshData& mesh);
+
+// Just the triangle reordering from OptimizeMesh(...).
+void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertex_count);
+
+// Average cache miss ratio (vertex shader runs per triangle) with a FIFO
+// cache of 'cache_size' entries. 0.5 is ideal for large regular meshes, 3 is
+// the worst case.
+float AverageCacheMissRatio(const std::vector<uint32_t>& indices,
+                            size_t vertex_count, int cache_size = 16);
+
+// Filament buffers for a MeshData. Caller owns the buffers.
+struct Mesh {
+  filament::VertexBuffer* vertex_buf = nullptr;
+  filament::IndexBuffer* index_buf = nullptr;
+  uint32_t index_count = 0;
+  filament::Box bounds;
+};
+
+// An empty vertex buffer for 'vertex_count' MeshVertex: POSITION (HALF4),
+// TANGENTS (SHORT4, normalized) and COLOR (UBYTE4, normalized), interleaved
+// in buffer 0. Tracked as GpuMemoryTag::kVisuals.
+filament::VertexBuffer* CreateMeshVertexBuffer(filament::Engine& engine,
+                                               uint32_t vertex_count);
+
+// Uploads 'mesh' into a CreateMeshVertexBuffer(...) and an index buffer.
+// Indices are 16 bits when the vertex count allows it, otherwise 32.
+Mesh UploadMesh(filament::Engine& engine, const MeshData& mesh);
+
+// Untracks and destroys both buffers of 'mesh', and clears it.
+void DestroyMesh(filament::Engine& engine, Mesh& mesh);
+
+}  // namespace fs
+
+#include "fs_mesh_impl.h"
+
+#endif  // FS_MESH_H_
@@ -0,0 +1,126 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// .fsmesh: a binary mesh file laid out so it can be uploaded straight from a
+// memory mapping, with no parsing or intermediate copies.
+//
+// Layout (little-endian, each section 16-byte aligned):
+//
+//   MeshFileHeader
+//   MeshFileAttribute[attribute_count]  // Vertex layout, for buffer 0.
+//   MeshLod[lod_count]                  // Index ranges, finest first.
+//   vertices                            // vertex_count * vertex_stride bytes.
+//   indices                             // index_count * index_size bytes.
+//
+// Attribute and type codes are Filament's VertexAttribute and AttributeType,
+// so the version must be bumped if those ever change.
+//
+// Usage:
+//
+//   fs::WriteMeshFile("ball.fsmesh", mesh, lods);  // Offline, see tools/.
+//   ...
+//   std::vector<fs::MeshLod> lods;
+//   fs::Mesh gpu = fs::LoadMeshFile(*engine, "ball.fsmesh", &lods);
+//   if (!gpu.vertex_buf) return;  // Missing or corrupt.
+//
+
+#ifndef FS_MESH_FILE_H_
+#define FS_MESH_FILE_H_
+
+#include <filament/Engine.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "fs_mesh.h"
+
+namespace fs {
+
+constexpr char kMeshFileMagic[4] = {'F', 'S', 'M', 'S'};
+constexpr uint32_t kMeshFileVersion = 1;
+constexpr uint32_t kMeshFileAlignment = 16;
+
+struct MeshFileHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t vertex_count;
+  uint32_t vertex_stride;
+  uint32_t index_count;
+  uint32_t index_size;  // 2 or 4.
+  uint32_t attribute_count;
+  uint32_t lod_count;
+  float bounds_min[3];
+  float bounds_max[3];
+
+  // Byte offsets of each section from the start of the file.
+  uint64_t attributes_offset;
+  uint64_t lods_offset;
+  uint64_t vertices_offset;
+  uint64_t indices_offset;
+};
+
+struct MeshFileAttribute {
+  uint8_t attribute;   // filament::VertexAttribute.
+  uint8_t type;        // filament::VertexBuffer::AttributeType.
+  uint8_t normalized;  // 0 or 1.
+  uint8_t reserved;
+  uint32_t offset;  // Within a vertex.
+};
+
+static_assert(sizeof(MeshFileHeader) == 88);
+static_assert(sizeof(MeshFileAttribute) == 8);
+static_assert(sizeof(MeshLod) == 12);
+
+// Pointers to the sections of a .fsmesh in memory.
+struct MeshFileView {
+  const MeshFileHeader* header = nullptr;
+  const MeshFileAttribute* attributes = nullptr;
+  const MeshLod* lods = nullptr;
+  const uint8_t* vertices = nullptr;
+  const uint8_t* indices = nullptr;
+
+  size_t VertexBytes() const {
+    return size_t(header->vertex_count) * header->vertex_stride;
+  }
+  size_t IndexBytes() const {
+    return size_t(header->index_count) * header->index_size;
+  }
+};
+
+// Writes 'mesh' in MeshVertex layout, with indices narrowed as UploadMesh(...)
+// would. If 'lods' is empty, one level covering every index is written.
+// Returns 'false' if the file couldn't be written.
+bool WriteMeshFile(const char* path, const MeshData& mesh,
+                   const std::vector<MeshLod>& lods = {});
+
+// Checks 'data' is a well-formed .fsmesh, with every section and index range
+// inside 'size' bytes, and points 'view' at its sections. Files without
+// vertices, indices or attributes are rejected, as Filament can't build them.
+bool ParseMeshFile(const uint8_t* data, size_t size, MeshFileView& view);
+
+// Maps the .fsmesh at 'path' and uploads it straight from the mapping. The
+// mapping is released once Filament has consumed both buffers. Returns a
+// Mesh with null buffers on failure. If 'lods' is given, it's set to the
+// file's levels.
+Mesh LoadMeshFile(filament::Engine& engine, const char* path,
+                  std::vector<MeshLod>* lods = nullptr);
+
+}  // namespace fs
+
+#include "fs_mesh_file_impl.h"
+
+#endif  // FS_MESH_FILE_H_
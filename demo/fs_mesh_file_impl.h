@@ -0,0 +1,269 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+#ifndef FS_MESH_FILE_IMPL_H_
+#define FS_MESH_FILE_IMPL_H_
+
+#include <filament/IndexBuffer.h>
+#include <filament/VertexBuffer.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+#include "fs_mapped_file.h"
+
+namespace fs {
+
+inline uint64_t AlignMeshFileOffset(uint64_t offset) {
+  return (offset + kMeshFileAlignment - 1) & ~uint64_t(kMeshFileAlignment - 1);
+}
+
+inline bool WriteMeshFile(const char* path, const MeshData& mesh,
+                          const std::vector<MeshLod>& lods) {
+  using filament::VertexAttribute;
+  using AttributeType = filament::VertexBuffer::AttributeType;
+
+  // Same layout as CreateMeshVertexBuffer(...).
+  const MeshFileAttribute attributes[] = {
+      {uint8_t(VertexAttribute::POSITION), uint8_t(AttributeType::HALF4), 0, 0,
+       offsetof(MeshVertex, position)},
+      {uint8_t(VertexAttribute::TANGENTS), uint8_t(AttributeType::SHORT4), 1, 0,
+       offsetof(MeshVertex, tangents)},
+      {uint8_t(VertexAttribute::COLOR), uint8_t(AttributeType::UBYTE4), 1, 0,
+       offsetof(MeshVertex, color)},
+  };
+  const std::vector<MeshLod> levels =
+      lods.empty() ? std::vector<MeshLod>{{0, uint32_t(mesh.indices.size())}}
+                   : lods;
+
+  MeshFileHeader header = {};
+  std::memcpy(header.magic, kMeshFileMagic, sizeof(header.magic));
+  header.version = kMeshFileVersion;
+  header.vertex_count = uint32_t(mesh.vertices.size());
+  header.vertex_stride = sizeof(MeshVertex);
+  header.index_count = uint32_t(mesh.indices.size());
+  header.index_size = mesh.vertices.size() <= 0x10000 ? 2 : 4;
+  header.attribute_count = std::size(attributes);
+  header.lod_count = uint32_t(levels.size());
+  const filament::math::float3 lo = mesh.bounds.getMin();
+  const filament::math::float3 hi = mesh.bounds.getMax();
+  for (int i = 0; i < 3; ++i) {
+    header.bounds_min[i] = lo[i];
+    header.bounds_max[i] = hi[i];
+  }
+  header.attributes_offset = AlignMeshFileOffset(sizeof(header));
+  header.lods_offset = AlignMeshFileOffset(
+      header.attributes_offset + sizeof(attributes));
+  header.vertices_offset = AlignMeshFileOffset(
+      header.lods_offset + levels.size() * sizeof(MeshLod));
+  header.indices_offset =
+      AlignMeshFileOffset(header.vertices_offset + mesh.VertexBytes());
+
+  std::vector<uint16_t> short_indices;
+  const void* indices = mesh.indices.data();
+  if (header.index_size == 2) {
+    short_indices.assign(mesh.indices.begin(), mesh.indices.end());
+    indices = short_indices.data();
+  }
+
+  FILE* const file = std::fopen(path, "wb");
+  if (!file) return false;
+
+  // Writes 'size' bytes at 'offset', zero-padding from the previous section.
+  uint64_t pos = 0;
+  bool ok = true;
+  const auto write = [&](uint64_t offset, const void* data, size_t size) {
+    static const uint8_t kZeros[kMeshFileAlignment] = {};
+    ok = ok && std::fwrite(kZeros, 1, offset - pos, file) == offset - pos &&
+         std::fwrite(data, 1, size, file) == size;
+    pos = offset + size;
+  };
+  write(0, &header, sizeof(header));
+  write(header.attributes_offset, attributes, sizeof(attributes));
+  write(header.lods_offset, levels.data(), levels.size() * sizeof(MeshLod));
+  write(header.vertices_offset, mesh.vertices.data(), mesh.VertexBytes());
+  write(header.indices_offset, indices,
+        size_t(header.index_count) * header.index_size);
+  return std::fclose(file) == 0 && ok;
+}
+
+// Bytes in one attribute of 'type' (a VertexBuffer::AttributeType), or 0 if
+// it isn't one.
+inline uint32_t MeshAttributeSize(uint8_t type) {
+  using Type = filament::VertexBuffer::AttributeType;
+  switch (Type(type)) {
+    case Type::BYTE:
+    case Type::UBYTE:
+      return 1;
+    case Type::BYTE2:
+    case Type::UBYTE2:
+    case Type::SHORT:
+    case Type::USHORT:
+    case Type::HALF:
+      return 2;
+    case Type::BYTE3:
+    case Type::UBYTE3:
+      return 3;
+    case Type::BYTE4:
+    case Type::UBYTE4:
+    case Type::SHORT2:
+    case Type::USHORT2:
+    case Type::HALF2:
+    case Type::INT:
+    case Type::UINT:
+    case Type::FLOAT:
+      return 4;
+    case Type::SHORT3:
+    case Type::USHORT3:
+    case Type::HALF3:
+      return 6;
+    case Type::SHORT4:
+    case Type::USHORT4:
+    case Type::HALF4:
+    case Type::FLOAT2:
+      return 8;
+    case Type::FLOAT3:
+      return 12;
+    case Type::FLOAT4:
+      return 16;
+  }
+  return 0;
+}
+
+inline bool ParseMeshFile(const uint8_t* data, size_t size,
+                          MeshFileView& view) {
+  if (size < sizeof(MeshFileHeader)) return false;
+  const MeshFileHeader* const header = (const MeshFileHeader*)data;
+  if (std::memcmp(header->magic, kMeshFileMagic, sizeof(header->magic)) != 0 ||
+      header->version != kMeshFileVersion || header->vertex_count == 0 ||
+      header->index_count == 0 || header->attribute_count == 0 ||
+      header->vertex_stride == 0 ||
+      header->vertex_stride > 255 ||
+      (header->index_size != 2 && header->index_size != 4)) {
+    return false;
+  }
+
+  // Counts are 32-bit, so none of these overflow 64 bits.
+  const auto in_file = [&](uint64_t offset, uint64_t bytes) {
+    return offset % kMeshFileAlignment == 0 && offset <= size &&
+           bytes <= size - offset;
+  };
+  if (!in_file(header->attributes_offset,
+               uint64_t(header->attribute_count) * sizeof(MeshFileAttribute)) ||
+      !in_file(header->lods_offset,
+               uint64_t(header->lod_count) * sizeof(MeshLod)) ||
+      !in_file(header->vertices_offset,
+               uint64_t(header->vertex_count) * header->vertex_stride) ||
+      !in_file(header->indices_offset,
+               uint64_t(header->index_count) * header->index_size)) {
+    return false;
+  }
+
+  view.header = header;
+  view.attributes =
+      (const MeshFileAttribute*)(data + header->attributes_offset);
+  view.lods = (const MeshLod*)(data + header->lods_offset);
+  view.vertices = data + header->vertices_offset;
+  view.indices = data + header->indices_offset;
+
+  for (uint32_t i = 0; i < header->attribute_count; ++i) {
+    // Each attribute must be a known type, and fit in the vertex.
+    const MeshFileAttribute& attribute = view.attributes[i];
+    const uint32_t bytes = MeshAttributeSize(attribute.type);
+    if (attribute.attribute >= filament::backend::MAX_VERTEX_ATTRIBUTE_COUNT ||
+        bytes == 0 || attribute.offset > header->vertex_stride ||
+        bytes > header->vertex_stride - attribute.offset) {
+      return false;
+    }
+  }
+  // Index values aren't checked against vertex_count: that would touch every
+  // page of the mapping before the upload does.
+  for (uint32_t i = 0; i < header->lod_count; ++i) {
+    const MeshLod& lod = view.lods[i];
+    if (lod.index_offset > header->index_count ||
+        lod.index_count > header->index_count - lod.index_offset) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline Mesh LoadMeshFile(filament::Engine& engine, const char* path,
+                         std::vector<MeshLod>* lods) {
+  using namespace filament;
+
+  // Kept alive by the two uploads, and unmapped after the last one.
+  struct Upload {
+    MappedFile file;
+    std::atomic<int> refs = 2;
+  };
+  Upload* const upload = new Upload{MappedFile(path, /*sequential=*/true)};
+
+  MeshFileView view;
+  if (!upload->file.valid() ||
+      !ParseMeshFile(upload->file.data(), upload->file.size(), view)) {
+    delete upload;
+    return {};
+  }
+  const MeshFileHeader& header = *view.header;
+
+  VertexBuffer::Builder builder;
+  builder.vertexCount(header.vertex_count).bufferCount(1);
+  for (uint32_t i = 0; i < header.attribute_count; ++i) {
+    const MeshFileAttribute& attribute = view.attributes[i];
+    builder.attribute(VertexAttribute(attribute.attribute), 0,
+                      VertexBuffer::AttributeType(attribute.type),
+                      attribute.offset, uint8_t(header.vertex_stride));
+    if (attribute.normalized) {
+      builder.normalized(VertexAttribute(attribute.attribute));
+    }
+  }
+  VertexBuffer* const vb = builder.build(engine);
+  IndexBuffer* const ib =
+      IndexBuffer::Builder()
+          .indexCount(header.index_count)
+          .bufferType(header.index_size == 2 ? IndexBuffer::IndexType::USHORT
+                                             : IndexBuffer::IndexType::UINT)
+          .build(engine);
+  TrackBuffer(vb, GpuMemoryTag::kVisuals, view.VertexBytes());
+  TrackBuffer(ib, GpuMemoryTag::kVisuals, view.IndexBytes());
+
+  static const auto Release = [](void*, size_t, void* user) {
+    Upload* const upload = (Upload*)user;
+    if (--upload->refs == 0) delete upload;
+  };
+  vb->setBufferAt(engine, 0,
+                  VertexBuffer::BufferDescriptor(
+                      view.vertices, view.VertexBytes(), Release, upload));
+  ib->setBuffer(engine, IndexBuffer::BufferDescriptor(
+                            view.indices, view.IndexBytes(), Release, upload));
+
+  if (lods) lods->assign(view.lods, view.lods + header.lod_count);
+
+  Box bounds;
+  bounds.set(math::float3(header.bounds_min[0], header.bounds_min[1],
+                          header.bounds_min[2]),
+             math::float3(header.bounds_max[0], header.bounds_max[1],
+                          header.bounds_max[2]));
+  return {vb, ib, header.index_count, bounds};
+}
+
+}  // namespace fs
+
+#endif  // FS_MESH_FILE_IMPL_H_
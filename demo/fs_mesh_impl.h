@@ -0,0 +1,515 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+#ifndef FS_MESH_IMPL_H_
+#define FS_MESH_IMPL_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+namespace fs {
+
+// Quantizes a vertex. 't', 'b', 'n' must be an orthonormal, right-handed
+// frame (b = cross(n, t)).
+inline MeshVertex PackMeshVertex(const filament::math::float3& p,
+                                 const filament::math::float3& t,
+                                 const filament::math::float3& b,
+                                 const filament::math::float3& n,
+                                 uint32_t color) {
+  using namespace filament::math;
+  const quatf q = mat3f::packTangentFrame(mat3f(t, b, n));
+  return {half4(half(p.x), half(p.y), half(p.z), half(1.0f)),
+          packSnorm16(q.xyzw), color};
+}
+
+// Sets mesh.bounds from the (quantized) vertex positions.
+inline void ComputeMeshBounds(MeshData& mesh) {
+  using namespace filament::math;
+  if (mesh.vertices.empty()) {
+    mesh.bounds = {};
+    return;
+  }
+  float3 lo(std::numeric_limits<float>::max());
+  float3 hi(-std::numeric_limits<float>::max());
+  for (const MeshVertex& v : mesh.vertices) {
+    const float3 p(float(v.position.x), float(v.position.y),
+                   float(v.position.z));
+    lo = min(lo, p);
+    hi = max(hi, p);
+  }
+  mesh.bounds.set(lo, hi);
+}
+
+// Writes a grid of 'cols' x 'rows' quads spanning origin + s u + t v, for s
+// and t in [-1, 1], at mesh.vertices[v_base] and mesh.indices[i_base].
+//  - 'n' must be cross(u, v); triangles wind counter-clockwise around it.
+inline void WriteMeshGrid(MeshData& mesh, size_t v_base, size_t i_base,
+                          const filament::math::float3& origin,
+                          const filament::math::float3& u,
+                          const filament::math::float3& v,
+                          const filament::math::float3& n, int cols, int rows,
+                          uint32_t color) {
+  MeshVertex* verts = mesh.vertices.data() + v_base;
+  for (int j = 0; j <= rows; ++j) {
+    const float t = 2.0f * j / rows - 1;
+    for (int i = 0; i <= cols; ++i) {
+      const float s = 2.0f * i / cols - 1;
+      *verts++ = PackMeshVertex(origin + u * s + v * t, u, v, n, color);
+    }
+  }
+
+  uint32_t* inds = mesh.indices.data() + i_base;
+  const uint32_t stride = cols + 1;
+  for (int j = 0; j < rows; ++j) {
+    for (int i = 0; i < cols; ++i) {
+      const uint32_t i0 = uint32_t(v_base) + j * stride + i;
+      const uint32_t i1 = i0 + 1;
+      const uint32_t i2 = i0 + stride;
+      const uint32_t i3 = i2 + 1;
+      *inds++ = i0;
+      *inds++ = i1;
+      *inds++ = i3;
+      *inds++ = i0;
+      *inds++ = i3;
+      *inds++ = i2;
+    }
+  }
+}
+
+inline MeshData MeshSphere(int rows, int cols, uint32_t color) {
+  using namespace filament::math;
+  rows = std::max(rows, 2);
+  cols = std::max(cols, 3);
+
+  MeshData mesh;
+  mesh.vertices.resize(size_t(rows - 1) * cols + 2);
+  mesh.indices.resize(size_t(3) * cols * (rows - 1) * 2);
+  MeshVertex* verts = mesh.vertices.data();
+  uint32_t* inds = mesh.indices.data();
+
+  // Longitude sines and cosines are the same on every row.
+  std::vector<float2> ring(cols);
+  for (int i = 0; i < cols; ++i) {
+    const float th = float(2 * M_PI) * i / cols;
+    ring[i] = {std::cos(th), std::sin(th)};
+  }
+
+  const uint32_t v_top = 0;
+  *verts++ = PackMeshVertex({0, 0, 1}, {1, 0, 0}, {0, 1, 0}, {0, 0, 1}, color);
+
+  for (int i_row = 1; i_row < rows; ++i_row) {
+    const float ph = float(M_PI) * i_row / rows;
+    const float z = std::cos(ph);
+    const float zr = std::sin(ph);
+    for (int i = 0; i < cols; ++i) {
+      const float3 n(zr * ring[i].x, zr * ring[i].y, z);
+      const float3 t(-ring[i].y, ring[i].x, 0);
+      *verts++ = PackMeshVertex(n, t, cross(n, t), n, color);
+    }
+  }
+
+  const uint32_t v_bot = uint32_t(mesh.vertices.size() - 1);
+  *verts++ = PackMeshVertex({0, 0, -1}, {1, 0, 0}, {0, -1, 0}, {0, 0, -1},
+                            color);
+
+  for (int i = 0; i < cols; ++i) {
+    *inds++ = v_top;
+    *inds++ = 1 + i;
+    *inds++ = 1 + (i + 1) % cols;
+  }
+  for (int i_row = 2; i_row < rows; ++i_row) {
+    const uint32_t v_base = 1 + (i_row - 1) * cols;
+    for (int i = 0; i < cols; ++i) {
+      const uint32_t v_cur = v_base + i;
+      const uint32_t v_next = v_base + (i + 1) % cols;
+      *inds++ = v_cur - cols;
+      *inds++ = v_cur;
+      *inds++ = v_next;
+      *inds++ = v_cur - cols;
+      *inds++ = v_next;
+      *inds++ = v_next - cols;
+    }
+  }
+  const uint32_t v_last = v_bot - cols;
+  for (int i = 0; i < cols; ++i) {
+    *inds++ = v_last + (i + 1) % cols;
+    *inds++ = v_last + i;
+    *inds++ = v_bot;
+  }
+
+  ComputeMeshBounds(mesh);
+  return mesh;
+}
+
+inline MeshData MeshBox(int divisions, uint32_t color) {
+  using namespace filament::math;
+  divisions = std::max(divisions, 1);
+
+  // Normal, then the face's u and v axes, with cross(u, v) = normal.
+  static constexpr float kFaces[6][3][3] = {
+      {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}},  {{-1, 0, 0}, {0, 0, 1}, {0, 1, 0}},
+      {{0, 1, 0}, {0, 0, 1}, {1, 0, 0}},  {{0, -1, 0}, {1, 0, 0}, {0, 0, 1}},
+      {{0, 0, 1}, {1, 0, 0}, {0, 1, 0}},  {{0, 0, -1}, {0, 1, 0}, {1, 0, 0}},
+  };
+
+  const size_t face_verts = size_t(divisions + 1) * (divisions + 1);
+  const size_t face_inds = size_t(6) * divisions * divisions;
+  MeshData mesh;
+  mesh.vertices.resize(6 * face_verts);
+  mesh.indices.resize(6 * face_inds);
+  for (int f = 0; f < 6; ++f) {
+    const float3 n(kFaces[f][0][0], kFaces[f][0][1], kFaces[f][0][2]);
+    const float3 u(kFaces[f][1][0], kFaces[f][1][1], kFaces[f][1][2]);
+    const float3 v(kFaces[f][2][0], kFaces[f][2][1], kFaces[f][2][2]);
+    WriteMeshGrid(mesh, f * face_verts, f * face_inds, n, u, v, n, divisions,
+                  divisions, color);
+  }
+
+  ComputeMeshBounds(mesh);
+  return mesh;
+}
+
+inline MeshData MeshPlane(int cols, int rows, uint32_t color) {
+  cols = std::max(cols, 1);
+  rows = std::max(rows, 1);
+
+  MeshData mesh;
+  mesh.vertices.resize(size_t(cols + 1) * (rows + 1));
+  mesh.indices.resize(size_t(6) * cols * rows);
+  WriteMeshGrid(mesh, 0, 0, {0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {0, 0, 1}, cols,
+                rows, color);
+
+  ComputeMeshBounds(mesh);
+  return mesh;
+}
+
+inline MeshData MeshCylinder(int segments, int rows, bool caps,
+                             uint32_t color) {
+  using namespace filament::math;
+  segments = std::max(segments, 3);
+  rows = std::max(rows, 1);
+
+  // Caps get their own vertices, so the edges stay hard.
+  const size_t side_verts = size_t(rows + 1) * segments;
+  const size_t cap_verts = segments + 1;
+  MeshData mesh;
+  mesh.vertices.resize(side_verts + (caps ? 2 * cap_verts : 0));
+  mesh.indices.resize(size_t(6) * segments * rows +
+                      (caps ? size_t(6) * segments : 0));
+  MeshVertex* verts = mesh.vertices.data();
+  uint32_t* inds = mesh.indices.data();
+
+  std::vector<float2> ring(segments);
+  for (int i = 0; i < segments; ++i) {
+    const float th = float(2 * M_PI) * i / segments;
+    ring[i] = {std::cos(th), std::sin(th)};
+  }
+
+  for (int j = 0; j <= rows; ++j) {
+    const float z = 2.0f * j / rows - 1;
+    for (int i = 0; i < segments; ++i) {
+      const float3 n(ring[i].x, ring[i].y, 0);
+      const float3 t(-ring[i].y, ring[i].x, 0);
+      *verts++ = PackMeshVertex({n.x, n.y, z}, t, {0, 0, 1}, n, color);
+    }
+  }
+  for (int j = 0; j < rows; ++j) {
+    const uint32_t base = j * segments;
+    for (int i = 0; i < segments; ++i) {
+      const uint32_t a = base + i;
+      const uint32_t b = base + (i + 1) % segments;
+      *inds++ = a;
+      *inds++ = b;
+      *inds++ = b + segments;
+      *inds++ = a;
+      *inds++ = b + segments;
+      *inds++ = a + segments;
+    }
+  }
+
+  if (caps) {
+    for (const float z : {1.0f, -1.0f}) {
+      const uint32_t center = uint32_t(verts - mesh.vertices.data());
+      const float3 n(0, 0, z);
+      const float3 b(0, z, 0);
+      *verts++ = PackMeshVertex(n, {1, 0, 0}, b, n, color);
+      for (int i = 0; i < segments; ++i) {
+        *verts++ = PackMeshVertex({ring[i].x, ring[i].y, z}, {1, 0, 0}, b, n,
+                                  color);
+      }
+      for (int i = 0; i < segments; ++i) {
+        const uint32_t v_cur = center + 1 + i;
+        const uint32_t v_next = center + 1 + (i + 1) % segments;
+        *inds++ = center;
+        *inds++ = z > 0 ? v_cur : v_next;
+        *inds++ = z > 0 ? v_next : v_cur;
+      }
+    }
+  }
+
+  ComputeMeshBounds(mesh);
+  return mesh;
+}
+
+inline MeshData ConcatMeshes(const std::vector<MeshData>& meshes,
+                             std::vector<MeshLod>& ranges) {
+  size_t vertex_count = 0, index_count = 0;
+  for (const MeshData& mesh : meshes) {
+    vertex_count += mesh.vertices.size();
+    index_count += mesh.indices.size();
+  }
+
+  MeshData out;
+  out.vertices.reserve(vertex_count);
+  out.indices.reserve(index_count);
+  ranges.clear();
+  for (const MeshData& mesh : meshes) {
+    const uint32_t base = uint32_t(out.vertices.size());
+    ranges.push_back({uint32_t(out.indices.size()),
+                      uint32_t(mesh.indices.size())});
+    out.vertices.insert(out.vertices.end(), mesh.vertices.begin(),
+                        mesh.vertices.end());
+    for (uint32_t index : mesh.indices) out.indices.push_back(base + index);
+  }
+
+  ComputeMeshBounds(out);
+  return out;
+}
+
+inline void OptimizeVertexCache(std::vector<uint32_t>& indices,
+                                size_t vertex_count) {
+  constexpr int kCacheSize = 32;
+  const size_t tri_count = indices.size() / 3;
+  if (tri_count == 0) return;
+
+  // Scores from Forsyth, "Linear-Speed Vertex Cache Optimisation": recently
+  // used vertices score high (the last triangle's three equally), and so do
+  // vertices with few triangles left, so stragglers get finished off.
+  const auto vertex_score = [](int cache_pos, uint32_t remaining) {
+    if (remaining == 0) return -1.0f;
+    float score = 0;
+    if (cache_pos >= 0) {
+      score = cache_pos < 3
+                  ? 0.75f
+                  : std::pow(1 - float(cache_pos - 3) / (kCacheSize - 3), 1.5f);
+    }
+    return score + 2 / std::sqrt(float(remaining));
+  };
+
+  // Each vertex's unemitted triangles, packed: [tri_start[v], +remaining[v]).
+  std::vector<uint32_t> remaining(vertex_count, 0);
+  for (uint32_t v : indices) ++remaining[v];
+  std::vector<uint32_t> tri_start(vertex_count + 1, 0);
+  for (size_t v = 0; v < vertex_count; ++v) {
+    tri_start[v + 1] = tri_start[v] + remaining[v];
+  }
+  std::vector<uint32_t> tris(indices.size());
+  {
+    std::vector<uint32_t> fill(tri_start.begin(), tri_start.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) {
+      tris[fill[indices[i]]++] = uint32_t(i / 3);
+    }
+  }
+
+  std::vector<int> cache_pos(vertex_count, -1);
+  std::vector<float> score(vertex_count);
+  for (size_t v = 0; v < vertex_count; ++v) {
+    score[v] = vertex_score(-1, remaining[v]);
+  }
+  std::vector<float> tri_score(tri_count);
+  for (size_t t = 0; t < tri_count; ++t) {
+    tri_score[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] +
+                   score[indices[3 * t + 2]];
+  }
+  std::vector<bool> emitted(tri_count, false);
+
+  std::vector<uint32_t> out;
+  out.reserve(indices.size());
+  uint32_t cache[kCacheSize + 3];
+  int cache_count = 0;
+
+  int64_t best = int64_t(std::max_element(tri_score.begin(), tri_score.end()) -
+                         tri_score.begin());
+  size_t cursor = 0;  // Every triangle before this has been emitted.
+  for (size_t n_out = 0; n_out < tri_count; ++n_out) {
+    if (best < 0) {
+      // Nothing in the cache has triangles left; start a new island.
+      while (emitted[cursor]) ++cursor;
+      best = int64_t(cursor);
+    }
+
+    const uint32_t* const tri = &indices[3 * best];
+    emitted[best] = true;
+    out.insert(out.end(), tri, tri + 3);
+
+    // Retire the triangle from its vertices' lists.
+    for (int k = 0; k < 3; ++k) {
+      const uint32_t v = tri[k];
+      uint32_t* const list = &tris[tri_start[v]];
+      const uint32_t* const pos =
+          std::find(list, list + remaining[v], uint32_t(best));
+      std::swap(list[pos - list], list[remaining[v] - 1]);
+      --remaining[v];
+    }
+
+    // Move its vertices to the front of the LRU cache. The cache can overflow
+    // by up to 3 while evicted vertices are rescored.
+    uint32_t next[kCacheSize + 3];
+    int next_count = 0;
+    for (int k = 0; k < 3; ++k) {
+      if (std::find(next, next + next_count, tri[k]) == next + next_count) {
+        next[next_count++] = tri[k];
+      }
+    }
+    for (int i = 0; i < cache_count; ++i) {
+      if (std::find(next, next + next_count, cache[i]) == next + next_count) {
+        next[next_count++] = cache[i];
+      }
+    }
+
+    // Rescore the cached (and just evicted) vertices, and their triangles.
+    for (int i = 0; i < next_count; ++i) {
+      const uint32_t v = next[i];
+      cache_pos[v] = i < kCacheSize ? i : -1;
+      score[v] = vertex_score(cache_pos[v], remaining[v]);
+    }
+    best = -1;
+    float best_score = -1;
+    for (int i = 0; i < next_count; ++i) {
+      const uint32_t v = next[i];
+      for (uint32_t j = 0; j < remaining[v]; ++j) {
+        const uint32_t t = tris[tri_start[v] + j];
+        tri_score[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] +
+                       score[indices[3 * t + 2]];
+        if (tri_score[t] > best_score) {
+          best_score = tri_score[t];
+          best = t;
+        }
+      }
+    }
+
+    cache_count = std::min(next_count, kCacheSize);
+    std::copy(next, next + cache_count, cache);
+  }
+
+  indices = std::move(out);
+}
+
+inline void OptimizeMesh(MeshData& mesh) {
+  OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+
+  constexpr uint32_t kUnused = ~0u;
+  std::vector<uint32_t> remap(mesh.vertices.size(), kUnused);
+  std::vector<MeshVertex> vertices;
+  vertices.reserve(mesh.vertices.size());
+  for (uint32_t& index : mesh.indices) {
+    if (remap[index] == kUnused) {
+      remap[index] = uint32_t(vertices.size());
+      vertices.push_back(mesh.vertices[index]);
+    }
+    index = remap[index];
+  }
+  mesh.vertices = std::move(vertices);  // Drops unreferenced vertices.
+}
+
+inline float AverageCacheMissRatio(const std::vector<uint32_t>& indices,
+                                   size_t vertex_count, int cache_size) {
+  if (indices.size() < 3) return 0;
+  // When each vertex entered the FIFO, in 'misses' ticks.
+  std::vector<int64_t> entered(vertex_count, -int64_t(cache_size) - 1);
+  int64_t misses = 0;
+  for (uint32_t v : indices) {
+    if (misses - entered[v] > cache_size) entered[v] = misses++;
+  }
+  return float(misses) / (indices.size() / 3);
+}
+
+inline filament::VertexBuffer* CreateMeshVertexBuffer(
+    filament::Engine& engine, uint32_t vertex_count) {
+  using namespace filament;
+  constexpr uint8_t kStride = sizeof(MeshVertex);
+  VertexBuffer* const vb =
+      VertexBuffer::Builder()
+          .vertexCount(vertex_count)
+          .bufferCount(1)
+          .attribute(VertexAttribute::POSITION, 0,
+                     VertexBuffer::AttributeType::HALF4,
+                     offsetof(MeshVertex, position), kStride)
+          .attribute(VertexAttribute::TANGENTS, 0,
+                     VertexBuffer::AttributeType::SHORT4,
+                     offsetof(MeshVertex, tangents), kStride)
+          .normalized(VertexAttribute::TANGENTS)
+          .attribute(VertexAttribute::COLOR, 0,
+                     VertexBuffer::AttributeType::UBYTE4,
+                     offsetof(MeshVertex, color), kStride)
+          .normalized(VertexAttribute::COLOR)
+          .build(engine);
+  TrackBuffer(vb, GpuMemoryTag::kVisuals, size_t(vertex_count) * kStride);
+  return vb;
+}
+
+inline Mesh UploadMesh(filament::Engine& engine, const MeshData& mesh) {
+  using namespace filament;
+
+  static const auto FreeCallback = [](void* buffer, size_t size,
+                                      void* user) -> void { free(buffer); };
+
+  // Filament owns the upload buffers until it's consumed them.
+  const size_t verts_size = mesh.VertexBytes();
+  void* const verts_data = malloc(verts_size);
+  std::memcpy(verts_data, mesh.vertices.data(), verts_size);
+
+  const bool short_indices = mesh.vertices.size() <= 0x10000;
+  const size_t inds_size = mesh.IndexBytes();
+  void* const inds_data = malloc(inds_size);
+  if (short_indices) {
+    std::copy(mesh.indices.begin(), mesh.indices.end(), (uint16_t*)inds_data);
+  } else {
+    std::memcpy(inds_data, mesh.indices.data(), inds_size);
+  }
+
+  VertexBuffer* const vb =
+      CreateMeshVertexBuffer(engine, uint32_t(mesh.vertices.size()));
+  vb->setBufferAt(engine, 0,
+                  VertexBuffer::BufferDescriptor(verts_data, verts_size,
+                                                 FreeCallback));
+
+  IndexBuffer* const ib =
+      IndexBuffer::Builder()
+          .indexCount(uint32_t(mesh.indices.size()))
+          .bufferType(short_indices ? IndexBuffer::IndexType::USHORT
+                                    : IndexBuffer::IndexType::UINT)
+          .build(engine);
+  TrackBuffer(ib, GpuMemoryTag::kVisuals, inds_size);
+  ib->setBuffer(engine, IndexBuffer::BufferDescriptor(inds_data, inds_size,
+                                                      FreeCallback));
+
+  return {vb, ib, uint32_t(mesh.indices.size()), mesh.bounds};
+}
+
+inline void DestroyMesh(filament::Engine& engine, Mesh& mesh) {
+  DestroyTracked(engine, mesh.vertex_buf);
+  DestroyTracked(engine, mesh.index_buf);
+  mesh = {};
+}
+
+}  // namespace fs
+
+#endif  // FS_MESH_IMPL_H_
@@ -17,29 +17,48 @@
 #ifndef FS_PRIMITIVES_H_
 #define FS_PRIMITIVES_H_
 
+#include <filament/Camera.h>
 #include <filament/IndexBuffer.h>
 #include <filament/Material.h>
+#include <filament/MaterialInstance.h>
 #include <filament/RenderableManager.h>
+#include <filament/Scene.h>
 #include <filament/TransformManager.h>
 #include <filament/VertexBuffer.h>
 #include <utils/Entity.h>
 #include <utils/EntityManager.h>
 
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
-#include <cstdlib>
+#include <utility>
 #include <vector>
 
+#include "filament_glfw_imgui/material_cache.h"
+#include "fs_geometry_pool.h"
+#include "fs_mesh.h"
+#include "fs_mesh_file.h"
+#include "fs_transform_batch.h"
+#include "fs_worker_pool.h"
+
 namespace fs {
 
+// Visuals acquire their materials from the App's cache.
+using filament_glfw_imgui::MaterialCache;
+
 class Visual {
  public:
   Visual() = default;
 
-  Visual(filament::Engine* engine, filament::Material* material,
+  // Takes ownership of everything but 'materials', and releases
+  // 'material_instance's material to 'materials' when done.
+  Visual(filament::Engine* engine, MaterialCache* materials,
+         filament::MaterialInstance* material_instance,
          filament::VertexBuffer* vertex_buf, filament::IndexBuffer* index_buf,
          utils::Entity& entity)
       : engine_(engine),
-        material_(material),
+        materials_(materials),
+        material_instance_(material_instance),
         vertex_buf_(vertex_buf),
         index_buf_(index_buf),
         entity_(entity) {}
@@ -49,198 +68,439 @@ class Visual {
 
   Visual(Visual&& other) {
     std::swap(engine_, other.engine_);
-    std::swap(material_, other.material_);
+    std::swap(materials_, other.materials_);
+    std::swap(material_instance_, other.material_instance_);
     std::swap(vertex_buf_, other.vertex_buf_);
     std::swap(index_buf_, other.index_buf_);
     std::swap(entity_, other.entity_);
   }
   Visual& operator=(Visual&& other) {
     std::swap(engine_, other.engine_);
-    std::swap(material_, other.material_);
+    std::swap(materials_, other.materials_);
+    std::swap(material_instance_, other.material_instance_);
     std::swap(vertex_buf_, other.vertex_buf_);
     std::swap(index_buf_, other.index_buf_);
     std::swap(entity_, other.entity_);
     return *this;
   }
   ~Visual() {
-    if (engine_ && material_) engine_->destroy(material_);
-    if (engine_ && vertex_buf_) engine_->destroy(vertex_buf_);
-    if (engine_ && index_buf_) engine_->destroy(index_buf_);
     if (engine_) engine_->destroy(entity_);
+    if (engine_ && material_instance_) {
+      const filament::Material* const material =
+          material_instance_->getMaterial();
+      engine_->destroy(material_instance_);
+      if (materials_) materials_->Release(material);
+    }
+    if (engine_ && vertex_buf_) DestroyTracked(*engine_, vertex_buf_);
+    if (engine_ && index_buf_) DestroyTracked(*engine_, index_buf_);
     utils::EntityManager::get().destroy(entity_);
   }
 
   filament::Engine* engine() const { return engine_; }
-  filament::Material* material() const { return material_; }
+  filament::MaterialInstance* material_instance() const {
+    return material_instance_;
+  }
   filament::VertexBuffer* vertex_buf() const { return vertex_buf_; }
   filament::IndexBuffer* index_buf() const { return index_buf_; }
   utils::Entity entity() const { return entity_; }
 
  private:
   filament::Engine* engine_ = nullptr;
-  filament::Material* material_ = nullptr;
+  MaterialCache* materials_ = nullptr;  // Not owned.
+  filament::MaterialInstance* material_instance_ = nullptr;
   filament::VertexBuffer* vertex_buf_ = nullptr;
   filament::IndexBuffer* index_buf_ = nullptr;
   utils::Entity entity_;
 };
 
 // Shader should be a compiled .filamat (e.g. from resources, or loaded from
-// file).
-inline Visual VisualSphere(filament::Engine& engine, const uint8_t* shader,
-                           size_t shader_size) {
+// file). It's built once per 'materials', however many visuals use it.
+inline Visual VisualSphere(filament::Engine& engine, MaterialCache& materials,
+                           const uint8_t* shader, size_t shader_size) {
   using namespace filament;
 
-  struct Vertex {
-    math::float3 position;
-    math::quatf tangents;
-    uint32_t color;
-  };
-
-  const int n_rows = 32;
-  const int n_cols = 64;
-
-  const int n_verts = (n_rows - 1) * n_cols + 2;
-  const int n_inds = 3 * (n_cols * (n_rows - 1) * 2);
-
-  auto verts = std::vector<Vertex>();
-  auto inds = std::vector<uint16_t>();
-
-  verts.reserve(n_verts);
-  inds.reserve(n_inds);
-
-  const float d_ph = float(M_PI) / n_rows;
-  const float d_th = float(2 * M_PI) / n_cols;
-
-  const float ph = d_ph;
-  const float z = std::cos(ph);
-  const float zr = std::sin(ph);
-
-  const auto rot_ph = math::quatf::fromAxisAngle(math::float3(0, 1, 0), ph);
-
-  verts.push_back({{0, 0, 1},
-                   math::quatf::fromAxisAngle(math::float3(1, 0, 0), 0),
-                   0xffff0000u});
-  const size_t v_top = 0;
-  const size_t v_base = v_top + 1;
-  for (int i = 0; i < n_cols; ++i) {
-    const size_t v_cur = v_base + i;
-    const size_t v_next = v_base + (i + 1) % n_cols;
-    inds.push_back(v_top);
-    inds.push_back(v_cur);
-    inds.push_back(v_next);
-
-    const float th = i * d_th;
-    const float x = zr * std::cos(th);
-    const float y = zr * std::sin(th);
-    const math::float3 dir(x, y, z);
-    const auto rot_th = math::quatf::fromAxisAngle(math::float3(0, 0, 1), th);
-    const auto tangents = rot_th * rot_ph;
-    const auto perp = normalize(cross(dir, math::float3(0, 0, 1)));
-    const uint32_t color = 0xffff0000u | (uint32_t(255 * ph / M_PI) << 8);
-    verts.push_back({dir, tangents, color});
-  }
-
-  for (int i_row = 1; i_row < n_rows - 1; ++i_row) {
-    const float ph = (i_row + 1) * d_ph;
-    const float z = std::cos(ph);
-    const float zr = std::sin(ph);
-
-    const auto rot_ph = math::quatf::fromAxisAngle(math::float3(0, 1, 0), ph);
-
-    const size_t v_base = verts.size();
-    for (int i = 0; i < n_cols; ++i) {
-      const size_t v_cur = v_base + i;
-      const size_t v_next = v_base + (i + 1) % n_cols;
-      const size_t v_a = v_cur - n_cols;
-      const size_t v_b = v_next - n_cols;
-      inds.push_back(v_a);
-      inds.push_back(v_cur);
-      inds.push_back(v_next);
-      inds.push_back(v_a);
-      inds.push_back(v_next);
-      inds.push_back(v_b);
-
-      const float th = i * d_th;
-      const float x = zr * std::cos(th);
-      const float y = zr * std::sin(th);
-      const math::float3 dir(x, y, z);
-      const auto rot_th = math::quatf::fromAxisAngle(math::float3(0, 0, 1), th);
-      const auto tangents = rot_th * rot_ph;
-      const auto perp = normalize(cross(dir, math::float3(0, 0, 1)));
-      const uint32_t color = 0xffff0000u | (uint32_t(255 * ph / M_PI) << 8);
-      // verts.push_back({dir, math::quatf::fromAxisAngle(perp, ph), color});
-      verts.push_back({dir, tangents, color});
-    }
+  MeshData sphere = MeshSphere(32, 64);
+
+  // Blue to cyan, from the north pole to the south.
+  for (MeshVertex& v : sphere.vertices) {
+    const float ph = std::acos(std::clamp(float(v.position.z), -1.0f, 1.0f));
+    v.color = 0xffff0000u | (uint32_t(255 * ph / M_PI) << 8);
   }
+  OptimizeMesh(sphere);
+  const Mesh mesh = UploadMesh(engine, sphere);
 
-  {
-    const size_t v_bot = verts.size();
-    verts.push_back({{0, 0, -1},
-                     math::quatf::fromAxisAngle(math::float3(1, 0, 0), M_PI),
-                     0xffffff00u});
+  auto mat = materials.Acquire(shader, shader_size)->createInstance();
 
-    const size_t v_base = v_bot - n_cols;
-    for (int i = 0; i < n_cols; ++i) {
-      const size_t v_cur = v_base + i;
-      const size_t v_next = v_base + (i + 1) % n_cols;
-      inds.push_back(v_next);
-      inds.push_back(v_cur);
-      inds.push_back(v_bot);
-    }
+  auto entity = utils::EntityManager::get().create();
+  RenderableManager::Builder(1)
+      .boundingBox(mesh.bounds)
+      .material(0, mat)
+      .geometry(0, RenderableManager::PrimitiveType::TRIANGLES,
+                mesh.vertex_buf, mesh.index_buf, 0, mesh.index_count)
+      .receiveShadows(false)
+      .castShadows(false)
+      .build(engine, entity);
+
+  return {&engine, &materials, mat, mesh.vertex_buf, mesh.index_buf, entity};
+}
+
+// A .fsmesh from 'path', drawn at its finest level of detail. Returns an
+// empty Visual if the file is missing or corrupt.
+inline Visual VisualMeshFile(filament::Engine& engine, MaterialCache& materials,
+                             const char* path, const uint8_t* shader,
+                             size_t shader_size) {
+  using namespace filament;
+
+  std::vector<MeshLod> lods;
+  Mesh mesh = LoadMeshFile(engine, path, &lods);
+  if (!mesh.vertex_buf || lods.empty()) {
+    DestroyMesh(engine, mesh);
+    return {};
   }
 
-  const size_t verts_data_size = verts.size() * sizeof(Vertex);
-  const size_t inds_data_size = inds.size() * sizeof(uint16_t);
-
-  void* verts_data = malloc(verts_data_size);
-  void* inds_data = malloc(inds_data_size);
-
-  // Filament wants to own the data during async upload to the GPU, and there's
-  // no simple way to give it ownership of the C++ vectors. For a quick and
-  // dirty implementation, we can deal with the extra copy."
-  std::memcpy(verts_data, verts.data(), verts_data_size);
-  std::memcpy(inds_data, inds.data(), inds_data_size);
-
-  static const auto FreeCallback = [](void* buffer, size_t size,
-                                      void* user) -> void { free(buffer); };
-
-  auto vb =
-      VertexBuffer::Builder()
-          .vertexCount(verts.size())
-          .bufferCount(1)
-          .attribute(VertexAttribute::POSITION, 0,
-                     VertexBuffer::AttributeType::FLOAT3, 0, sizeof(Vertex))
-          .attribute(VertexAttribute::TANGENTS, 0,
-                     VertexBuffer::AttributeType::FLOAT4, 12, sizeof(Vertex))
-          .attribute(VertexAttribute::COLOR, 0,
-                     VertexBuffer::AttributeType::UBYTE4, 28, sizeof(Vertex))
-          .normalized(VertexAttribute::COLOR)
-          .build(engine);
-  vb->setBufferAt(engine, 0,
-                  VertexBuffer::BufferDescriptor(verts_data, verts_data_size,
-                                                 FreeCallback));
-
-  auto ib = IndexBuffer::Builder()
-                .indexCount(inds.size())
-                .bufferType(IndexBuffer::IndexType::USHORT)
-                .build(engine);
-  ib->setBuffer(engine, IndexBuffer::BufferDescriptor(inds_data, inds_data_size,
-                                                      FreeCallback));
-
-  auto mat = Material::Builder().package(shader, shader_size).build(engine);
+  auto mat = materials.Acquire(shader, shader_size)->createInstance();
 
   auto entity = utils::EntityManager::get().create();
   RenderableManager::Builder(1)
-      .boundingBox({{-1, -1, -1}, {1, 1, 1}})
-      .material(0, mat->getDefaultInstance())
-      .geometry(0, RenderableManager::PrimitiveType::TRIANGLES, vb, ib, 0,
-                inds.size())
-      .culling(false)
+      .boundingBox(mesh.bounds)
+      .material(0, mat)
+      .geometry(0, RenderableManager::PrimitiveType::TRIANGLES,
+                mesh.vertex_buf, mesh.index_buf, lods[0].index_offset,
+                lods[0].index_count)
       .receiveShadows(false)
       .castShadows(false)
       .build(engine, entity);
 
-  return {&engine, mat, vb, ib, entity};
+  return {&engine, &materials, mat, mesh.vertex_buf, mesh.index_buf, entity};
+}
+
+// Like Visual, but drawing a range of a GeometryPool's shared buffers rather
+// than owning buffers of its own.
+class PooledVisual {
+ public:
+  PooledVisual() = default;
+
+  // Builds a renderable for 'id' in 'pool', and takes ownership of it, the
+  // pool range and 'material_instance'. 'pool' must outlive this class.
+  PooledVisual(filament::Engine* engine, MaterialCache* materials,
+               GeometryPool* pool, uint32_t id,
+               filament::MaterialInstance* material_instance)
+      : engine_(engine),
+        materials_(materials),
+        pool_(pool),
+        id_(id),
+        material_instance_(material_instance) {
+    using namespace filament;
+    const GeometryPool::Allocation& range = pool_->Get(id_);
+    entity_ = utils::EntityManager::get().create();
+    RenderableManager::Builder(1)
+        .boundingBox(range.bounds)
+        .material(0, material_instance_)
+        .geometry(0, RenderableManager::PrimitiveType::TRIANGLES,
+                  pool_->vertex_buf(), pool_->index_buf(), range.index_offset,
+                  range.index_count)
+        .receiveShadows(false)
+        .castShadows(false)
+        .build(*engine_, entity_);
+    pool_->Bind(id_, entity_);
+  }
+
+  PooledVisual(const PooledVisual&) = delete;
+  PooledVisual& operator=(const PooledVisual&) = delete;
+
+  PooledVisual(PooledVisual&& other) { *this = std::move(other); }
+  PooledVisual& operator=(PooledVisual&& other) {
+    std::swap(engine_, other.engine_);
+    std::swap(materials_, other.materials_);
+    std::swap(pool_, other.pool_);
+    std::swap(id_, other.id_);
+    std::swap(material_instance_, other.material_instance_);
+    std::swap(entity_, other.entity_);
+    return *this;
+  }
+  ~PooledVisual() {
+    if (!engine_) return;
+    engine_->destroy(entity_);
+    utils::EntityManager::get().destroy(entity_);
+    pool_->Remove(id_);
+    const filament::Material* const material =
+        material_instance_->getMaterial();
+    engine_->destroy(material_instance_);
+    if (materials_) materials_->Release(material);
+  }
+
+  filament::MaterialInstance* material_instance() const {
+    return material_instance_;
+  }
+  utils::Entity entity() const { return entity_; }
+
+ private:
+  filament::Engine* engine_ = nullptr;  // Not owned.
+  MaterialCache* materials_ = nullptr;  // Not owned.
+  GeometryPool* pool_ = nullptr;        // Not owned.
+  uint32_t id_ = GeometryPool::kInvalid;
+  filament::MaterialInstance* material_instance_ = nullptr;
+  utils::Entity entity_;
+};
+
+// Adds 'mesh' to 'pool' and makes a visual of it, or returns an empty one if
+// the pool is full.
+inline PooledVisual PooledVisualMesh(filament::Engine& engine,
+                                     MaterialCache& materials,
+                                     GeometryPool& pool, const MeshData& mesh,
+                                     const uint8_t* shader,
+                                     size_t shader_size) {
+  const uint32_t id = pool.Add(mesh);
+  if (id == GeometryPool::kInvalid) return {};
+  auto mat = materials.Acquire(shader, shader_size)->createInstance();
+  return {&engine, &materials, &pool, id, mat};
+}
+
+// What LOD selection needs to know about the camera.
+struct LodView {
+  filament::math::float3 eye = {0, 0, 0};
+
+  // Projected pixels per world unit, at a distance of 1.
+  float pixel_scale = 1;
+};
+
+inline LodView MakeLodView(const filament::Camera& camera,
+                           uint32_t viewport_height) {
+  // For a perspective projection, [1][1] is 1 / tan(fov_y / 2).
+  const double proj_y = camera.getProjectionMatrix()[1][1];
+  return {camera.getPosition(), float(0.5 * viewport_height * proj_y)};
+}
+
+// Many renderables sharing one geometry and one MaterialInstance, so adding
+// an instance costs an entity and two components, not uploads or material
+// builds.
+//
+// Usage:
+//
+//   auto spheres = fs::VisualSphereInstances(engine, shader, size, 10000);
+//   spheres.AddToScene(*scene);
+//   ...  // Every frame:
+//   spheres.transforms().Update(&pool, [&](const auto& chunk) { ... });
+//   spheres.CommitTransforms(&pool);
+//   spheres.SelectLods(fs::MakeLodView(*camera, viewport_height));
+//
+class VisualInstances {
+ public:
+  VisualInstances() = default;
+
+  // Creates 'count' entities drawing 'mesh' with an instance of 'material'.
+  // Takes ownership of the buffers in 'mesh', and of one reference to
+  // 'material' in 'materials'.
+  //  - 'lods' optionally splits mesh's indices into levels of detail, finest
+  //    first, for SelectLods(...). Instances start at the finest.
+  VisualInstances(filament::Engine* engine, MaterialCache* materials,
+                  filament::Material* material, const Mesh& mesh, size_t count,
+                  std::vector<MeshLod> lods = {})
+      : engine_(engine),
+        materials_(materials),
+        material_(material),
+        material_instance_(material->createInstance()),
+        vertex_buf_(mesh.vertex_buf),
+        index_buf_(mesh.index_buf),
+        lods_(std::move(lods)),
+        entities_(count) {
+    using namespace filament;
+
+    if (lods_.empty()) lods_.push_back({0, mesh.index_count, 0});
+    lod_counts_.assign(lods_.size(), 0);
+    lod_counts_[0] = uint32_t(count);
+    current_lods_.assign(count, 0);
+
+    // The bounding sphere of the box is conservative, which biases selection
+    // towards finer levels.
+    bound_radius_ = length(mesh.bounds.halfExtent);
+
+    utils::EntityManager::get().create(count, entities_.data());
+
+    // Builders copy their settings on build(...), so one serves every
+    // instance.
+    RenderableManager::Builder builder(1);
+    builder.boundingBox(mesh.bounds)
+        .material(0, material_instance_)
+        .geometry(0, RenderableManager::PrimitiveType::TRIANGLES, vertex_buf_,
+                  index_buf_, lods_[0].index_offset, lods_[0].index_count)
+        .receiveShadows(false)
+        .castShadows(false);
+
+    for (utils::Entity entity : entities_) builder.build(*engine_, entity);
+    transforms_ = TransformBatch(engine_, entities_.data(), count);
+  }
+
+  VisualInstances(const VisualInstances&) = delete;
+  VisualInstances& operator=(const VisualInstances&) = delete;
+
+  VisualInstances(VisualInstances&& other) { *this = std::move(other); }
+  VisualInstances& operator=(VisualInstances&& other) {
+    std::swap(engine_, other.engine_);
+    std::swap(materials_, other.materials_);
+    std::swap(material_, other.material_);
+    std::swap(material_instance_, other.material_instance_);
+    std::swap(vertex_buf_, other.vertex_buf_);
+    std::swap(index_buf_, other.index_buf_);
+    std::swap(lods_, other.lods_);
+    std::swap(bound_radius_, other.bound_radius_);
+    std::swap(entities_, other.entities_);
+    std::swap(transforms_, other.transforms_);
+    std::swap(projected_pixels_, other.projected_pixels_);
+    std::swap(current_lods_, other.current_lods_);
+    std::swap(lod_counts_, other.lod_counts_);
+    std::swap(lod_changes_, other.lod_changes_);
+    return *this;
+  }
+
+  ~VisualInstances() {
+    if (!engine_) return;
+    // Renderables go first, since they reference everything else.
+    for (utils::Entity entity : entities_) engine_->destroy(entity);
+    utils::EntityManager::get().destroy(entities_.size(), entities_.data());
+    engine_->destroy(material_instance_);
+    materials_->Release(material_);
+    DestroyTracked(*engine_, vertex_buf_);
+    DestroyTracked(*engine_, index_buf_);
+  }
+
+  // Adds (or removes) every instance with one call.
+  void AddToScene(filament::Scene& scene) const {
+    scene.addEntities(entities_.data(), entities_.size());
+  }
+  void RemoveFromScene(filament::Scene& scene) const {
+    scene.removeEntities(entities_.data(), entities_.size());
+  }
+
+  // Per-instance placement. Update freely, then CommitTransforms().
+  TransformBatch& transforms() { return transforms_; }
+
+  // Pushes transforms() to the TransformManager in a single local transform
+  // transaction; see TransformBatch::Commit(...).
+  void CommitTransforms(WorkerPool* pool = nullptr) {
+    transforms_.Commit(pool);
+  }
+
+  // Picks each instance's level of detail from its projected size in 'view',
+  // and updates the primitive ranges of the instances whose level changed.
+  //  - Runs as flat passes over all instances, so thousands of them cost
+  //    little more than the RenderableManager calls for actual changes.
+  //  - Uses the transforms from the last CommitTransforms().
+  void SelectLods(const LodView& view) {
+    using namespace filament;
+    if (lods_.size() < 2) return;
+
+    // Projected diameters.
+    const size_t count = transforms_.size();
+    projected_pixels_.resize(count);
+    const float diameter_pixels = 2 * bound_radius_ * view.pixel_scale;
+    const float* x = transforms_.x();
+    const float* y = transforms_.y();
+    const float* z = transforms_.z();
+    const float* scale = transforms_.scale();
+    for (size_t i = 0; i < count; ++i) {
+      const float dx = x[i] - view.eye.x;
+      const float dy = y[i] - view.eye.y;
+      const float dz = z[i] - view.eye.z;
+      const float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+      projected_pixels_[i] =
+          diameter_pixels * scale[i] / std::max(distance, 1e-4f);
+    }
+
+    // Levels, touching the RenderableManager only for changes.
+    RenderableManager& rm = engine_->getRenderableManager();
+    const uint8_t coarsest = uint8_t(lods_.size() - 1);
+    std::fill(lod_counts_.begin(), lod_counts_.end(), 0);
+    lod_changes_ = 0;
+    for (size_t i = 0; i < count; ++i) {
+      uint8_t lod = 0;
+      while (lod < coarsest && projected_pixels_[i] < lods_[lod].min_pixels) {
+        ++lod;
+      }
+      ++lod_counts_[lod];
+      if (lod == current_lods_[i]) continue;
+
+      current_lods_[i] = lod;
+      ++lod_changes_;
+      // Looked up here: RenderableManager moves its last component into the
+      // slot of any it destroys, so instances don't stay valid.
+      rm.setGeometryAt(rm.getInstance(entities_[i]), 0,
+                       RenderableManager::PrimitiveType::TRIANGLES,
+                       vertex_buf_, index_buf_, lods_[lod].index_offset,
+                       lods_[lod].index_count);
+    }
+  }
+
+  // Instances at each level of detail, and how many changed level, as of the
+  // last SelectLods(...).
+  const std::vector<uint32_t>& lod_counts() const { return lod_counts_; }
+  uint32_t lod_changes() const { return lod_changes_; }
+
+  // Triangles submitted across all instances at their current levels.
+  size_t TriangleCount() const {
+    size_t indices = 0;
+    for (size_t lod = 0; lod < lods_.size(); ++lod) {
+      indices += size_t(lod_counts_[lod]) * lods_[lod].index_count;
+    }
+    return indices / 3;
+  }
+
+  size_t size() const { return entities_.size(); }
+  filament::Engine* engine() const { return engine_; }
+  const std::vector<MeshLod>& lods() const { return lods_; }
+  filament::MaterialInstance* material_instance() const {
+    return material_instance_;
+  }
+  const std::vector<utils::Entity>& entities() const { return entities_; }
+
+ private:
+  filament::Engine* engine_ = nullptr;      // Not owned.
+  MaterialCache* materials_ = nullptr;      // Not owned.
+  filament::Material* material_ = nullptr;  // From materials_.
+  filament::MaterialInstance* material_instance_ = nullptr;
+  filament::VertexBuffer* vertex_buf_ = nullptr;
+  filament::IndexBuffer* index_buf_ = nullptr;
+  std::vector<MeshLod> lods_;  // Finest first.
+  float bound_radius_ = 0;     // Of the mesh, before scaling.
+
+  // Parallel arrays, one entry per instance.
+  std::vector<utils::Entity> entities_;
+  TransformBatch transforms_;
+  std::vector<float> projected_pixels_;  // Scratch for SelectLods(...).
+  std::vector<uint8_t> current_lods_;
+
+  std::vector<uint32_t> lod_counts_;  // Per level.
+  uint32_t lod_changes_ = 0;
+};
+
+// 'count' instances of a sphere, all at the origin, with four levels of
+// detail from VisualSphere(...)'s tessellation down to 48 triangles.
+inline VisualInstances VisualSphereInstances(filament::Engine& engine,
+                                             MaterialCache& materials,
+                                             const uint8_t* shader,
+                                             size_t shader_size, size_t count) {
+  using namespace filament;
+
+  // Tessellation, and the smallest projected diameter it's used at.
+  constexpr struct {
+    int rows;
+    float min_pixels;
+  } kLevels[] = {{32, 256}, {16, 96}, {8, 32}, {4, 0}};
+
+  std::vector<MeshData> levels;
+  for (const auto& level : kLevels) {
+    levels.push_back(MeshSphere(level.rows, 2 * level.rows, 0xff40c0ffu));
+    OptimizeMesh(levels.back());
+  }
+  std::vector<MeshLod> lods;
+  const MeshData sphere = ConcatMeshes(levels, lods);
+  for (size_t i = 0; i < lods.size(); ++i) {
+    lods[i].min_pixels = kLevels[i].min_pixels;
+  }
+
+  filament::Material* const mat = materials.Acquire(shader, shader_size);
+  return {&engine, &materials, mat, UploadMesh(engine, sphere), count,
+          std::move(lods)};
 }
 
 }  // namespace fs
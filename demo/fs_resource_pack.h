@@ -0,0 +1,167 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// .fspack: named resources in one file, which is memory-mapped and resolved by
+// name, instead of being linked into the executable.
+//
+// Opening a pack reads just its table of contents. Each resource starts on a
+// page of its own, so the OS pages it in when it's first touched, and the
+// pages of a mapped pack are shared by every process using it. Resources can
+// be zlib-compressed one by one; those are inflated on first use instead.
+//
+// Layout (little-endian):
+//
+//   ResourcePackHeader
+//   ResourcePackEntry[entry_count]  // Sorted by name.
+//   names                           // Concatenated, not null-terminated.
+//   blobs                           // Each kResourcePackAlignment aligned.
+//
+// Usage:
+//
+//   fs::WriteResourcePack("res.fspack", inputs);  // Offline, see tools/.
+//   ...
+//   fs::ResourcePack pack("res.fspack");
+//   if (!pack.valid()) return;  // Missing or corrupt.
+//   const fs::ResourceView font = pack.Find("Roboto_Regular.ttf");
+//   if (!font.data) return;  // Missing, or failed to decompress.
+//
+// NOTE: uses POSIX mmap (Linux and MacOS), and zlib (link with -lz).
+//
+
+#ifndef FS_RESOURCE_PACK_H_
+#define FS_RESOURCE_PACK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "fs_mapped_file.h"
+
+namespace fs {
+
+constexpr char kResourcePackMagic[4] = {'F', 'S', 'P', 'K'};
+constexpr uint32_t kResourcePackVersion = 1;
+
+// A common page size. Larger pages (e.g. 16 KiB on Apple silicon) still hold
+// whole blobs, just not one each.
+constexpr uint64_t kResourcePackAlignment = 4096;
+
+enum class ResourceCompression : uint32_t {
+  kNone,
+  kZlib,
+};
+
+struct ResourcePackHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t entry_count;
+  uint32_t names_size;
+
+  // Byte offsets from the start of the file.
+  uint64_t entries_offset;
+  uint64_t names_offset;
+};
+
+struct ResourcePackEntry {
+  uint64_t offset;       // Of the stored blob.
+  uint64_t stored_size;  // In the file.
+  uint64_t size;         // Once decompressed.
+  uint32_t name_offset;  // Into the names section.
+  uint32_t name_size;
+  uint32_t compression;  // ResourceCompression.
+  uint32_t reserved;
+};
+
+static_assert(sizeof(ResourcePackHeader) == 32);
+static_assert(sizeof(ResourcePackEntry) == 40);
+
+struct ResourcePackInput {
+  std::string name;
+  const uint8_t* data = nullptr;  // Not owned.
+  size_t size = 0;
+  bool compress = false;  // Stored as is anyway, unless that's smaller.
+};
+
+// Writes 'inputs' as a pack. Returns 'false' if names repeat, or the file
+// couldn't be written.
+bool WriteResourcePack(const char* path, std::vector<ResourcePackInput> inputs);
+
+struct ResourceView {
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+};
+
+class ResourcePack {
+ public:
+  ResourcePack() = default;
+
+  // Maps the pack at 'path' and checks its table of contents. Check valid()
+  // for success.
+  explicit ResourcePack(const char* path);
+
+  ResourcePack(const ResourcePack&) = delete;
+  ResourcePack& operator=(const ResourcePack&) = delete;
+
+  ResourcePack(ResourcePack&& other) { *this = std::move(other); }
+  ResourcePack& operator=(ResourcePack&& other) {
+    std::swap(file_, other.file_);
+    std::swap(header_, other.header_);
+    std::swap(entries_, other.entries_);
+    std::swap(names_, other.names_);
+    std::swap(inflated_, other.inflated_);
+    std::swap(inflated_bytes_, other.inflated_bytes_);
+    return *this;
+  }
+
+  bool valid() const { return header_ != nullptr; }
+
+  size_t size() const { return valid() ? header_->entry_count : 0; }
+  const ResourcePackEntry& entry(size_t i) const { return entries_[i]; }
+  std::string_view name(size_t i) const {
+    return {names_ + entries_[i].name_offset, entries_[i].name_size};
+  }
+
+  // Returns the resource called 'name', or an empty view if there's none or
+  // it fails to decompress. Views stay valid as long as this class.
+  //  - Uncompressed resources point into the mapping, so nothing is read
+  //    until they're used.
+  //  - Compressed ones are inflated on the first call, and kept.
+  ResourceView Find(std::string_view name);
+
+  // Memory held by inflated resources.
+  size_t inflated_bytes() const { return inflated_bytes_; }
+
+ private:
+  MappedFile file_;
+  const ResourcePackHeader* header_ = nullptr;  // Into file_.
+  const ResourcePackEntry* entries_ = nullptr;  // Into file_.
+  const char* names_ = nullptr;                 // Into file_.
+
+  // By entry; null until inflated.
+  std::vector<std::unique_ptr<uint8_t[]>> inflated_;
+  size_t inflated_bytes_ = 0;
+};
+
+}  // namespace fs
+
+#include "fs_resource_pack_impl.h"
+
+#endif  // FS_RESOURCE_PACK_H_
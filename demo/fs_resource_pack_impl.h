@@ -0,0 +1,196 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+#ifndef FS_RESOURCE_PACK_IMPL_H_
+#define FS_RESOURCE_PACK_IMPL_H_
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace fs {
+
+inline uint64_t AlignResourcePackOffset(uint64_t offset, uint64_t alignment) {
+  return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+inline bool WriteResourcePack(const char* path,
+                              std::vector<ResourcePackInput> inputs) {
+  std::sort(inputs.begin(), inputs.end(),
+            [](const ResourcePackInput& a, const ResourcePackInput& b) {
+              return a.name < b.name;
+            });
+  for (size_t i = 1; i < inputs.size(); ++i) {
+    if (inputs[i].name == inputs[i - 1].name) return false;
+  }
+
+  ResourcePackHeader header = {};
+  std::memcpy(header.magic, kResourcePackMagic, sizeof(header.magic));
+  header.version = kResourcePackVersion;
+  header.entry_count = uint32_t(inputs.size());
+  header.entries_offset = sizeof(header);
+  header.names_offset =
+      header.entries_offset + inputs.size() * sizeof(ResourcePackEntry);
+
+  // Compress first, since blob offsets depend on stored sizes.
+  std::vector<ResourcePackEntry> entries(inputs.size());
+  std::vector<std::vector<uint8_t>> compressed(inputs.size());
+  std::string names;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    const ResourcePackInput& input = inputs[i];
+    ResourcePackEntry& entry = entries[i];
+    entry.name_offset = uint32_t(names.size());
+    entry.name_size = uint32_t(input.name.size());
+    names += input.name;
+    entry.size = input.size;
+    entry.stored_size = input.size;
+    entry.compression = uint32_t(ResourceCompression::kNone);
+    if (!input.compress || !input.size) continue;
+
+    uLongf packed_size = compressBound(input.size);
+    compressed[i].resize(packed_size);
+    if (compress2(compressed[i].data(), &packed_size, input.data, input.size,
+                  Z_BEST_COMPRESSION) == Z_OK &&
+        packed_size < input.size) {
+      compressed[i].resize(packed_size);
+      entry.stored_size = packed_size;
+      entry.compression = uint32_t(ResourceCompression::kZlib);
+    } else {
+      compressed[i] = {};
+    }
+  }
+  header.names_size = uint32_t(names.size());
+
+  uint64_t offset = header.names_offset + names.size();
+  for (ResourcePackEntry& entry : entries) {
+    entry.offset = AlignResourcePackOffset(offset, kResourcePackAlignment);
+    offset = entry.offset + entry.stored_size;
+  }
+
+  FILE* const file = std::fopen(path, "wb");
+  if (!file) return false;
+
+  // Writes 'size' bytes at 'offset', zero-padding from the previous section.
+  uint64_t pos = 0;
+  bool ok = true;
+  const auto write = [&](uint64_t offset, const void* data, size_t size) {
+    static const uint8_t kZeros[kResourcePackAlignment] = {};
+    ok = ok && std::fwrite(kZeros, 1, offset - pos, file) == offset - pos &&
+         std::fwrite(data, 1, size, file) == size;
+    pos = offset + size;
+  };
+  write(0, &header, sizeof(header));
+  write(header.entries_offset, entries.data(),
+        entries.size() * sizeof(ResourcePackEntry));
+  write(header.names_offset, names.data(), names.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    write(entries[i].offset,
+          compressed[i].empty() ? inputs[i].data : compressed[i].data(),
+          entries[i].stored_size);
+  }
+  return std::fclose(file) == 0 && ok;
+}
+
+inline ResourcePack::ResourcePack(const char* path) : file_(path) {
+  const uint8_t* const data = file_.data();
+  const size_t size = file_.size();
+  if (size < sizeof(ResourcePackHeader)) return;
+  const ResourcePackHeader* const header = (const ResourcePackHeader*)data;
+  if (std::memcmp(header->magic, kResourcePackMagic, sizeof(header->magic)) !=
+          0 ||
+      header->version != kResourcePackVersion) {
+    return;
+  }
+
+  // Counts are 32-bit, so none of these overflow 64 bits.
+  const auto in_file = [&](uint64_t offset, uint64_t bytes) {
+    return offset <= size && bytes <= size - offset;
+  };
+  if (header->entries_offset % alignof(ResourcePackEntry) != 0 ||
+      !in_file(header->entries_offset,
+               uint64_t(header->entry_count) * sizeof(ResourcePackEntry)) ||
+      !in_file(header->names_offset, header->names_size)) {
+    return;
+  }
+  const ResourcePackEntry* const entries =
+      (const ResourcePackEntry*)(data + header->entries_offset);
+  const char* const names = (const char*)(data + header->names_offset);
+
+  // Only the table of contents is checked; blobs aren't touched until used.
+  for (uint32_t i = 0; i < header->entry_count; ++i) {
+    const ResourcePackEntry& entry = entries[i];
+    const bool stored =
+        entry.compression == uint32_t(ResourceCompression::kNone);
+    if (uint64_t(entry.name_offset) + entry.name_size > header->names_size ||
+        entry.offset % kResourcePackAlignment != 0 ||
+        !in_file(entry.offset, entry.stored_size) ||
+        (stored && entry.stored_size != entry.size) ||
+        (!stored &&
+         entry.compression != uint32_t(ResourceCompression::kZlib))) {
+      return;
+    }
+    // Find(...) relies on the order.
+    const std::string_view current(names + entry.name_offset, entry.name_size);
+    if (i > 0 && std::string_view(names + entries[i - 1].name_offset,
+                                  entries[i - 1].name_size) >= current) {
+      return;
+    }
+  }
+
+  header_ = header;
+  entries_ = entries;
+  names_ = names;
+  inflated_.resize(header->entry_count);
+}
+
+inline ResourceView ResourcePack::Find(std::string_view name) {
+  size_t lo = 0;
+  size_t hi = size();
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    if (this->name(mid) < name) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == size() || this->name(lo) != name) return {};
+
+  const ResourcePackEntry& entry = entries_[lo];
+  const uint8_t* const stored = file_.data() + entry.offset;
+  if (entry.compression == uint32_t(ResourceCompression::kNone)) {
+    return {stored, size_t(entry.size)};
+  }
+
+  if (!inflated_[lo]) {
+    std::unique_ptr<uint8_t[]> inflated(new uint8_t[entry.size]);
+    uLongf inflated_size = entry.size;
+    if (uncompress(inflated.get(), &inflated_size, stored,
+                   entry.stored_size) != Z_OK ||
+        inflated_size != entry.size) {
+      return {};
+    }
+    inflated_[lo] = std::move(inflated);
+    inflated_bytes_ += entry.size;
+  }
+  return {inflated_[lo].get(), size_t(entry.size)};
+}
+
+}  // namespace fs
+
+#endif  // FS_RESOURCE_PACK_IMPL_H_
@@ -0,0 +1,194 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Third-order (9 coefficient) spherical harmonics irradiance from an
+// equirectangular image, in the form IndirectLight::Builder::irradiance wants.
+//
+// Rows can be added in any order as they're decoded, so the projection can
+// ride along with a streaming decode instead of making another pass.
+//
+// Uses the same equirect orientation as cmgen and IBLPrefilterContext: +Y is
+// the top row, and the center column faces +Z.
+//
+
+#ifndef FS_SPHERICAL_HARMONICS_H_
+#define FS_SPHERICAL_HARMONICS_H_
+
+#include <math/vec3.h>
+
+#include <array>
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+#include "fs_worker_pool.h"
+
+namespace fs {
+
+class ShIrradiance {
+ public:
+  // Projects a 'width' x 'height' equirect.
+  //  - 'pool' may be nullptr to run on the calling thread.
+  ShIrradiance(int width, int height, WorkerPool* pool = nullptr)
+      : width_(width), height_(height), pool_(pool) {
+    sin_phi_.resize(3 * size_t(width));
+    cos_phi_.resize(3 * size_t(width));
+    for (int i = 0; i < width; ++i) {
+      const double phi = (2.0 * (i + 0.5) / width - 1.0) * M_PI;
+      for (int c = 0; c < 3; ++c) {
+        sin_phi_[3 * i + c] = float(std::sin(phi));
+        cos_phi_[3 * i + c] = float(std::cos(phi));
+      }
+    }
+  }
+
+  // Adds 'rows' full rows starting at row 'y'. 'pixels' is row-major.
+  void AddRows(int y, int rows, const filament::math::float3* pixels) {
+    const auto add = [&](size_t begin, size_t end) {
+      double sums[9][3] = {};
+      for (size_t i = begin; i < end; ++i) {
+        AddRow(y + int(i), pixels + i * width_, sums);
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (int k = 0; k < 9; ++k) {
+        for (int c = 0; c < 3; ++c) sums_[k][c] += sums[k][c];
+      }
+    };
+    if (pool_) {
+      pool_->ParallelFor(rows, kRowsPerChunk, add);
+    } else {
+      add(0, rows);
+    }
+  }
+
+  // Coefficients for IndirectLight::Builder::irradiance(3, ...).
+  //  - Convolved with the cosine lobe, pre-scaled by 1/pi, and with the basis
+  //    normalization folded in, so the shader only evaluates polynomials.
+  std::array<filament::math::float3, 9> Coefficients() const {
+    // K^2 (squared basis normalization) * A_l / pi (cosine convolution).
+    constexpr double kScale[9] = {
+        1.0 / (4 * M_PI),                      // 1
+        3.0 / (4 * M_PI) * 2.0 / 3.0,          // y
+        3.0 / (4 * M_PI) * 2.0 / 3.0,          // z
+        3.0 / (4 * M_PI) * 2.0 / 3.0,          // x
+        15.0 / (4 * M_PI) * 1.0 / 4.0,         // yx
+        15.0 / (4 * M_PI) * 1.0 / 4.0,         // yz
+        5.0 / (16 * M_PI) * 1.0 / 4.0,         // 3z^2 - 1
+        15.0 / (4 * M_PI) * 1.0 / 4.0,         // zx
+        15.0 / (16 * M_PI) * 1.0 / 4.0,        // x^2 - y^2
+    };
+    std::array<filament::math::float3, 9> sh;
+    for (int k = 0; k < 9; ++k) {
+      sh[k] = {float(sums_[k][0] * kScale[k]), float(sums_[k][1] * kScale[k]),
+               float(sums_[k][2] * kScale[k])};
+    }
+    return sh;
+  }
+
+ private:
+  static constexpr int kRowsPerChunk = 4;
+  // Partial sums per moment; a multiple of 3 so lane j is always channel j % 3.
+  static constexpr int kLanes = 12;
+
+  // Accumulates one row's radiance * basis polynomial * solid angle.
+  //
+  // On a row, y and the ring radius r are constant, and x = r sin(phi),
+  // z = r cos(phi). So every polynomial is a row constant times one of five
+  // column moments. The row is walked as flat floats against the per-channel
+  // sin/cos tables, with kLanes independent partial sums per moment: float
+  // reductions can't be reordered without -ffast-math, but this lane loop is
+  // elementwise, so it vectorizes as is.
+  void AddRow(int row, const filament::math::float3* pixels,
+              double (&sums)[9][3]) const {
+    const double theta = (row + 0.5) / height_ * M_PI;
+    const double y = std::cos(theta);
+    const double r = std::sin(theta);
+    const double d_omega = (2 * M_PI / width_) * (M_PI / height_) * r;
+
+    // Moments: 1, sin, cos, sin*cos, sin^2 (cos^2 = 1 - sin^2).
+    float a0[kLanes] = {}, a1[kLanes] = {}, a2[kLanes] = {};
+    float a3[kLanes] = {}, a4[kLanes] = {};
+    const float* const v = &pixels->x;
+    const float* const sin_phi = sin_phi_.data();
+    const float* const cos_phi = cos_phi_.data();
+    const size_t n = 3 * size_t(width_);
+    size_t k = 0;
+    for (; k + kLanes <= n; k += kLanes) {
+      for (int j = 0; j < kLanes; ++j) {
+        const float p = v[k + j];
+        const float s = sin_phi[k + j];
+        const float co = cos_phi[k + j];
+        a0[j] += p;
+        a1[j] += p * s;
+        a2[j] += p * co;
+        a3[j] += p * s * co;
+        a4[j] += p * s * s;
+      }
+    }
+    for (int j = 0; k < n; ++k, ++j) {
+      const float p = v[k];
+      const float s = sin_phi[k];
+      const float co = cos_phi[k];
+      a0[j] += p;
+      a1[j] += p * s;
+      a2[j] += p * co;
+      a3[j] += p * s * co;
+      a4[j] += p * s * s;
+    }
+
+    float m[5][3] = {};
+    for (int j = 0; j < kLanes; ++j) {
+      m[0][j % 3] += a0[j];
+      m[1][j % 3] += a1[j];
+      m[2][j % 3] += a2[j];
+      m[3][j % 3] += a3[j];
+      m[4][j % 3] += a4[j];
+    }
+
+    for (int c = 0; c < 3; ++c) {
+      const double s0 = m[0][c] * d_omega;
+      const double ss = m[1][c] * d_omega;
+      const double sc = m[2][c] * d_omega;
+      const double ssc = m[3][c] * d_omega;
+      const double sss = m[4][c] * d_omega;
+      const double scc = s0 - sss;
+      sums[0][c] += s0;
+      sums[1][c] += y * s0;
+      sums[2][c] += r * sc;
+      sums[3][c] += r * ss;
+      sums[4][c] += y * r * ss;
+      sums[5][c] += y * r * sc;
+      sums[6][c] += 3 * r * r * scc - s0;
+      sums[7][c] += r * r * ssc;
+      sums[8][c] += r * r * sss - y * y * s0;
+    }
+  }
+
+  int width_ = 0;
+  int height_ = 0;
+  WorkerPool* pool_ = nullptr;  // Not owned.
+
+  std::vector<float> sin_phi_;  // Per column, repeated for each channel.
+  std::vector<float> cos_phi_;
+
+  std::mutex mutex_;  // Guards sums_ while chunks merge.
+  double sums_[9][3] = {};
+};
+
+}  // namespace fs
+
+#endif  // FS_SPHERICAL_HARMONICS_H_
@@ -0,0 +1,235 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Transforms of many scene objects, updated in parallel and committed to
+// Filament's TransformManager once per frame.
+//
+// Positions, rotations and scales are kept as a structure of arrays, so an
+// update touching one of them streams through just that memory, and splits
+// into independent chunks for a WorkerPool. Commit() composes the matrices in
+// parallel too, then sets them inside a single local transform transaction, so
+// Filament resolves world transforms once rather than per call.
+//
+// Usage:
+//
+//   fs::TransformBatch batch(engine, entities.data(), entities.size());
+//   ...  // Every frame:
+//   batch.Update(&pool, [&](const fs::TransformBatch::Chunk& chunk) {
+//     for (size_t i = chunk.begin; i < chunk.end; ++i) chunk.y[i] = ...;
+//   });
+//   batch.Commit(&pool);
+//   const double ms = batch.stats().commit_ms;
+//
+
+#ifndef FS_TRANSFORM_BATCH_H_
+#define FS_TRANSFORM_BATCH_H_
+
+#include <filament/Engine.h>
+#include <filament/TransformManager.h>
+#include <math/mat4.h>
+#include <utils/Entity.h>
+
+#include <chrono>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "fs_worker_pool.h"
+
+namespace fs {
+
+struct TransformBatchStats {
+  double update_ms = 0;   // The last Update(...).
+  double compose_ms = 0;  // Building the last Commit()'s matrices.
+  double commit_ms = 0;   // Its setTransform calls and transaction.
+  size_t committed = 0;   // Transforms it set; 0 if nothing had changed.
+};
+
+class TransformBatch {
+ public:
+  // Objects per parallel chunk: enough that handing a chunk to a worker costs
+  // far less than processing it.
+  static constexpr size_t kGrain = 1024;
+
+  // Mutable views of the arrays, for Update(...): fn(chunk) may write entries
+  // [begin, end) of each.
+  struct Chunk {
+    size_t begin;
+    size_t end;
+    float* x;
+    float* y;
+    float* z;
+    float* qx;  // Unit quaternion (qx, qy, qz, qw).
+    float* qy;
+    float* qz;
+    float* qw;
+    float* scale;  // Uniform.
+  };
+
+  TransformBatch() = default;
+
+  // Adds a transform component to each of 'entities' that doesn't have one.
+  // Objects start at the origin, unrotated, at scale 1.
+  //  - 'engine' and the entities must outlive this class, which doesn't
+  //    destroy either.
+  TransformBatch(filament::Engine* engine, const utils::Entity* entities,
+                 size_t count)
+      : engine_(engine),
+        x_(count, 0),
+        y_(count, 0),
+        z_(count, 0),
+        qx_(count, 0),
+        qy_(count, 0),
+        qz_(count, 0),
+        qw_(count, 1),
+        scale_(count, 1),
+        matrices_(count) {
+    filament::TransformManager& tm = engine_->getTransformManager();
+    entities_.assign(entities, entities + count);
+    for (const utils::Entity entity : entities_) {
+      if (!tm.hasComponent(entity)) tm.create(entity);
+    }
+  }
+
+  TransformBatch(const TransformBatch&) = delete;
+  TransformBatch& operator=(const TransformBatch&) = delete;
+
+  TransformBatch(TransformBatch&& other) { *this = std::move(other); }
+  TransformBatch& operator=(TransformBatch&& other) {
+    std::swap(engine_, other.engine_);
+    std::swap(entities_, other.entities_);
+    std::swap(x_, other.x_);
+    std::swap(y_, other.y_);
+    std::swap(z_, other.z_);
+    std::swap(qx_, other.qx_);
+    std::swap(qy_, other.qy_);
+    std::swap(qz_, other.qz_);
+    std::swap(qw_, other.qw_);
+    std::swap(scale_, other.scale_);
+    std::swap(matrices_, other.matrices_);
+    std::swap(dirty_, other.dirty_);
+    std::swap(stats_, other.stats_);
+    return *this;
+  }
+
+  size_t size() const { return entities_.size(); }
+
+  // Read access, e.g. for culling or level-of-detail passes.
+  const float* x() const { return x_.data(); }
+  const float* y() const { return y_.data(); }
+  const float* z() const { return z_.data(); }
+  const float* scale() const { return scale_.data(); }
+
+  // Calls fn(chunk) over chunks covering every object, on 'pool' if not null,
+  // and marks everything for the next Commit().
+  template <typename F>
+  void Update(WorkerPool* pool, F&& fn) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto run = [&](size_t begin, size_t end) {
+      fn(Chunk{begin, end, x_.data(), y_.data(), z_.data(), qx_.data(),
+               qy_.data(), qz_.data(), qw_.data(), scale_.data()});
+    };
+    if (pool) {
+      pool->ParallelFor(size(), kGrain, run);
+    } else {
+      run(0, size());
+    }
+    dirty_ = true;
+    stats_.update_ms = MsSince(start);
+  }
+
+  // Sets every transform, if any changed since the last call.
+  //  - Composing matrices runs on 'pool', if not null. TransformManager isn't
+  //    thread-safe, so setting them runs on the calling thread.
+  void Commit(WorkerPool* pool = nullptr) {
+    using namespace filament;
+    stats_.compose_ms = stats_.commit_ms = 0;
+    stats_.committed = 0;
+    if (!dirty_ || !engine_) return;
+
+    auto start = std::chrono::steady_clock::now();
+    if (pool) {
+      pool->ParallelFor(size(), kGrain, [this](size_t begin, size_t end) {
+        Compose(begin, end);
+      });
+    } else {
+      Compose(0, size());
+    }
+    stats_.compose_ms = MsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    TransformManager& tm = engine_->getTransformManager();
+    tm.openLocalTransformTransaction();
+    for (size_t i = 0; i < entities_.size(); ++i) {
+      tm.setTransform(tm.getInstance(entities_[i]), matrices_[i]);
+    }
+    tm.commitLocalTransformTransaction();
+    stats_.commit_ms = MsSince(start);
+
+    stats_.committed = size();
+    dirty_ = false;
+  }
+
+  const TransformBatchStats& stats() const { return stats_; }
+
+ private:
+  static double MsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  }
+
+  // Column-major scale * rotation, then translation.
+  void Compose(size_t begin, size_t end) {
+    using filament::math::float4;
+    for (size_t i = begin; i < end; ++i) {
+      const float x = qx_[i], y = qy_[i], z = qz_[i], w = qw_[i];
+      const float s = scale_[i];
+      filament::math::mat4f& m = matrices_[i];
+      m[0] = float4(s * (1 - 2 * (y * y + z * z)), s * 2 * (x * y + w * z),
+                    s * 2 * (x * z - w * y), 0);
+      m[1] = float4(s * 2 * (x * y - w * z), s * (1 - 2 * (x * x + z * z)),
+                    s * 2 * (y * z + w * x), 0);
+      m[2] = float4(s * 2 * (x * z + w * y), s * 2 * (y * z - w * x),
+                    s * (1 - 2 * (x * x + y * y)), 0);
+      m[3] = float4(x_[i], y_[i], z_[i], 1);
+    }
+  }
+
+  filament::Engine* engine_ = nullptr;  // Not owned.
+  // Instances are looked up in Commit(): TransformManager moves its last
+  // component into the slot of any it destroys, so they don't stay valid.
+  std::vector<utils::Entity> entities_;
+
+  // One entry per object.
+  std::vector<float> x_;
+  std::vector<float> y_;
+  std::vector<float> z_;
+  std::vector<float> qx_;
+  std::vector<float> qy_;
+  std::vector<float> qz_;
+  std::vector<float> qw_;
+  std::vector<float> scale_;
+  std::vector<filament::math::mat4f> matrices_;  // Scratch for Commit().
+
+  bool dirty_ = false;
+  TransformBatchStats stats_;
+};
+
+}  // namespace fs
+
+#endif  // FS_TRANSFORM_BATCH_H_
@@ -0,0 +1,150 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// A small persistent thread pool for data-parallel loops.
+//
+// Usage:
+//
+//   fs::WorkerPool pool;
+//   pool.ParallelFor(n, /*grain=*/64, [&](size_t begin, size_t end) {
+//     for (size_t i = begin; i < end; ++i) out[i] = f(in[i]);
+//   });
+//
+
+#ifndef FS_WORKER_POOL_H_
+#define FS_WORKER_POOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace fs {
+
+class WorkerPool {
+ public:
+  // Starts 'num_threads' workers. The thread calling ParallelFor(...) works
+  // too, so the default leaves one hardware thread for it.
+  explicit WorkerPool(int num_threads = DefaultThreadCount()) {
+    for (int i = 0; i < num_threads; ++i) {
+      threads_.emplace_back([this] { WorkerLoop(); });
+    }
+  }
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      quit_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) thread.join();
+  }
+
+  static int DefaultThreadCount() {
+    return std::max(1, int(std::thread::hardware_concurrency()) - 1);
+  }
+
+  // Number of worker threads (not counting the caller).
+  int size() const { return int(threads_.size()); }
+
+  // Calls fn(begin, end) on disjoint chunks covering [0, count), each at most
+  // 'grain' long, and returns when all of them are done.
+  //  - Only one thread may call this at a time.
+  template <typename F>
+  void ParallelFor(size_t count, size_t grain, F&& fn) {
+    if (count == 0) return;
+    grain = std::max<size_t>(grain, 1);
+    if (threads_.empty() || count <= grain) {
+      fn(size_t(0), count);
+      return;
+    }
+
+    using Fn = std::remove_reference_t<F>;
+    const Job job = {
+        [](void* ctx, size_t begin, size_t end) { (*(Fn*)ctx)(begin, end); },
+        (void*)&fn, count, grain};
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job_ = job;
+      next_ = 0;
+      busy_ = int(threads_.size());
+      ++generation_;
+    }
+    wake_.notify_all();
+
+    RunChunks(job);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return busy_ == 0; });
+  }
+
+ private:
+  struct Job {
+    void (*run)(void* ctx, size_t begin, size_t end);
+    void* ctx;
+    size_t count;
+    size_t grain;
+  };
+
+  void RunChunks(const Job& job) {
+    while (true) {
+      const size_t begin = next_.fetch_add(job.grain);
+      if (begin >= job.count) return;
+      job.run(job.ctx, begin, std::min(begin + job.grain, job.count));
+    }
+  }
+
+  void WorkerLoop() {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      wake_.wait(lock, [&] { return quit_ || generation_ != seen; });
+      if (quit_) return;
+      seen = generation_;
+      const Job job = job_;
+
+      lock.unlock();
+      RunChunks(job);
+      lock.lock();
+
+      if (--busy_ == 0) done_.notify_one();
+    }
+  }
+
+  std::vector<std::thread> threads_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;  // Signals a new generation_, or quit_.
+  std::condition_variable done_;  // Signals busy_ reaching 0.
+  Job job_ = {};
+  uint64_t generation_ = 0;
+  int busy_ = 0;  // Workers that haven't finished the current job.
+  bool quit_ = false;
+
+  std::atomic<size_t> next_ = 0;  // Start of the next unclaimed chunk.
+};
+
+}  // namespace fs
+
+#endif  // FS_WORKER_POOL_H_
@@ -0,0 +1,192 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Opt-in counting of heap allocations, to find and keep out per-frame ones.
+//
+// NOTE: this file isn't part of the google/filament release. It is part of
+// ambrusc/filament-glfw-imgui.
+//
+// To enable:
+//  - Build everything with -DFILAMENT_GLFW_IMGUI_TRACK_ALLOCATIONS
+//    (e.g. TRACK_ALLOCATIONS=1 ./build.sh demo).
+//  - Include alloc_tracking_hooks.h from exactly one .cpp, which replaces the
+//    global operator new/delete with counting versions.
+//  - ImGui's allocations come from App's ImGuiPoolAllocator, which counts the
+//    ones that reach malloc (see imgui_allocator.h).
+// Without the macro, the hooks header is empty, and every count stays 0.
+//
+// Counts are kept per thread, so Filament's render and worker threads don't
+// show up in the main thread's numbers.
+//
+// Usage:
+//
+//   using namespace filament_glfw_imgui;
+//   const AllocCounter counter;  // Starts counting on this thread.
+//   app.PollEvents();
+//   ...
+//   app.renderer()->endFrame();
+//   assert(counter.counts().allocs == 0);
+//
+//   // Or, per App phase for the last frame:
+//   const AppAllocStats& stats = app.alloc_stats();
+//
+
+#ifndef FILAMENT_GLFW_IMGUI_ALLOC_TRACKING_H_
+#define FILAMENT_GLFW_IMGUI_ALLOC_TRACKING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+namespace filament_glfw_imgui {
+
+#ifdef FILAMENT_GLFW_IMGUI_TRACK_ALLOCATIONS
+constexpr bool kTrackAllocations = true;
+#else
+constexpr bool kTrackAllocations = false;
+#endif
+
+struct AllocCounts {
+  uint64_t allocs = 0;  // Including imgui_allocs.
+  uint64_t frees = 0;
+  uint64_t bytes = 0;  // Requested by 'allocs', not currently live.
+  uint64_t imgui_allocs = 0;  // Through ImGuiAlloc(...).
+
+  AllocCounts operator-(const AllocCounts& other) const {
+    return {allocs - other.allocs, frees - other.frees, bytes - other.bytes,
+            imgui_allocs - other.imgui_allocs};
+  }
+  AllocCounts& operator+=(const AllocCounts& other) {
+    allocs += other.allocs;
+    frees += other.frees;
+    bytes += other.bytes;
+    imgui_allocs += other.imgui_allocs;
+    return *this;
+  }
+};
+
+class AllocTracker {
+ public:
+  // Called by the hooks, so these must not allocate.
+  static void OnAlloc(size_t bytes) {
+    AllocCounts& counts = ThreadCounts();
+    ++counts.allocs;
+    counts.bytes += bytes;
+    process_allocs_.fetch_add(1, std::memory_order_relaxed);
+  }
+  static void OnFree() {
+    ++ThreadCounts().frees;
+    process_frees_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Totals for the calling thread since it started.
+  static AllocCounts ThisThread() { return ThreadCounts(); }
+
+  // Allocations and frees by every thread.
+  static uint64_t ProcessAllocs() { return process_allocs_.load(); }
+  static uint64_t ProcessFrees() { return process_frees_.load(); }
+
+  // ImGui::SetAllocatorFunctions(...) arguments that count, then use malloc
+  // and free like ImGui's defaults. ImGuiPoolAllocator takes memory from
+  // these too.
+  static void* ImGuiAlloc(size_t size, void* user) {
+    if constexpr (kTrackAllocations) {
+      OnAlloc(size);
+      ++ThreadCounts().imgui_allocs;
+    }
+    return malloc(size);
+  }
+  static void ImGuiFree(void* ptr, void* user) {
+    if (kTrackAllocations && ptr) OnFree();
+    free(ptr);
+  }
+
+ private:
+  // Constant-initialized, so first use doesn't allocate either.
+  static AllocCounts& ThreadCounts() {
+    static thread_local AllocCounts counts;
+    return counts;
+  }
+
+  static inline std::atomic<uint64_t> process_allocs_ = 0;
+  static inline std::atomic<uint64_t> process_frees_ = 0;
+};
+
+// Counts this thread's allocations from construction (or Reset()) on.
+class AllocCounter {
+ public:
+  AllocCounter() : start_(AllocTracker::ThisThread()) {}
+
+  void Reset() { start_ = AllocTracker::ThisThread(); }
+  AllocCounts counts() const { return AllocTracker::ThisThread() - start_; }
+
+ private:
+  AllocCounts start_;
+};
+
+// Stores this thread's allocations during its lifetime into 'out', when
+// tracking is enabled.
+class ScopedAllocCount {
+ public:
+  explicit ScopedAllocCount(AllocCounts& out) : out_(out) {}
+  ~ScopedAllocCount() {
+    if constexpr (kTrackAllocations) out_ = counter_.counts();
+  }
+
+  ScopedAllocCount(const ScopedAllocCount&) = delete;
+  ScopedAllocCount& operator=(const ScopedAllocCount&) = delete;
+
+ private:
+  AllocCounts& out_;
+  AllocCounter counter_;
+};
+
+// The App methods whose allocations App::alloc_stats() reports.
+enum class AppPhase : uint8_t {
+  kPollEvents,
+  kBeginUiFrame,
+  kEndUiFrame,  // Includes Ui::UpdateView(...).
+  kBeginRender,
+  kCount,
+};
+
+inline const char* AppPhaseName(AppPhase phase) {
+  constexpr const char* kNames[] = {"PollEvents", "BeginUiFrame", "EndUiFrame",
+                                    "BeginRender"};
+  return phase < AppPhase::kCount ? kNames[size_t(phase)] : "?";
+}
+
+struct AppAllocStats {
+  // The last complete frame, from one PollEvents() to the next, so including
+  // whatever the app did in between.
+  AllocCounts frame;
+
+  // Each App phase in the last frame.
+  AllocCounts phases[size_t(AppPhase::kCount)];
+
+  // Frames counted since Init(), and how many of them allocated at all.
+  uint64_t frames = 0;
+  uint64_t allocating_frames = 0;
+
+  const AllocCounts& phase(AppPhase p) const { return phases[size_t(p)]; }
+  AllocCounts& phase(AppPhase p) { return phases[size_t(p)]; }
+};
+
+}  // namespace filament_glfw_imgui
+
+#endif  // FILAMENT_GLFW_IMGUI_ALLOC_TRACKING_H_
@@ -0,0 +1,132 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Counting replacements for the global operator new and delete.
+//
+// Include this from exactly ONE .cpp of the program, and only that one: it
+// defines the operators, which the linker then uses everywhere, including
+// Filament's own allocations. Empty unless
+// FILAMENT_GLFW_IMGUI_TRACK_ALLOCATIONS is defined. See alloc_tracking.h.
+//
+// NOTE: this file isn't part of the google/filament release. It is part of
+// ambrusc/filament-glfw-imgui.
+//
+
+#ifndef FILAMENT_GLFW_IMGUI_ALLOC_TRACKING_HOOKS_H_
+#define FILAMENT_GLFW_IMGUI_ALLOC_TRACKING_HOOKS_H_
+
+#ifdef FILAMENT_GLFW_IMGUI_TRACK_ALLOCATIONS
+
+#include <stdlib.h>
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "filament_glfw_imgui/alloc_tracking.h"
+
+namespace filament_glfw_imgui::alloc_hooks {
+
+// Returns nullptr on failure; the throwing operators abort instead, as we
+// build without exceptions.
+inline void* Allocate(size_t size, size_t alignment = 0) {
+  AllocTracker::OnAlloc(size);
+  if (size == 0) size = 1;
+  if (alignment <= alignof(std::max_align_t)) return std::malloc(size);
+  void* ptr = nullptr;
+  return posix_memalign(&ptr, alignment, size) == 0 ? ptr : nullptr;
+}
+
+inline void* AllocateOrAbort(size_t size, size_t alignment = 0) {
+  void* const ptr = Allocate(size, alignment);
+  if (!ptr) std::abort();
+  return ptr;
+}
+
+inline void Free(void* ptr) {
+  if (!ptr) return;
+  AllocTracker::OnFree();
+  std::free(ptr);
+}
+
+}  // namespace filament_glfw_imgui::alloc_hooks
+
+namespace fgi_hooks = filament_glfw_imgui::alloc_hooks;
+
+void* operator new(std::size_t size) {
+  return fgi_hooks::AllocateOrAbort(size);
+}
+void* operator new[](std::size_t size) {
+  return fgi_hooks::AllocateOrAbort(size);
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  return fgi_hooks::Allocate(size);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return fgi_hooks::Allocate(size);
+}
+void* operator new(std::size_t size, std::align_val_t align) {
+  return fgi_hooks::AllocateOrAbort(size, size_t(align));
+}
+void* operator new[](std::size_t size, std::align_val_t align) {
+  return fgi_hooks::AllocateOrAbort(size, size_t(align));
+}
+void* operator new(std::size_t size, std::align_val_t align,
+                   const std::nothrow_t&) noexcept {
+  return fgi_hooks::Allocate(size, size_t(align));
+}
+void* operator new[](std::size_t size, std::align_val_t align,
+                     const std::nothrow_t&) noexcept {
+  return fgi_hooks::Allocate(size, size_t(align));
+}
+
+void operator delete(void* ptr) noexcept { fgi_hooks::Free(ptr); }
+void operator delete[](void* ptr) noexcept { fgi_hooks::Free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { fgi_hooks::Free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept {
+  fgi_hooks::Free(ptr);
+}
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+  fgi_hooks::Free(ptr);
+}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+  fgi_hooks::Free(ptr);
+}
+void operator delete(void* ptr, std::align_val_t) noexcept {
+  fgi_hooks::Free(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+  fgi_hooks::Free(ptr);
+}
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+  fgi_hooks::Free(ptr);
+}
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept {
+  fgi_hooks::Free(ptr);
+}
+void operator delete(void* ptr, std::align_val_t,
+                     const std::nothrow_t&) noexcept {
+  fgi_hooks::Free(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t,
+                       const std::nothrow_t&) noexcept {
+  fgi_hooks::Free(ptr);
+}
+
+#endif  // FILAMENT_GLFW_IMGUI_TRACK_ALLOCATIONS
+
+#endif  // FILAMENT_GLFW_IMGUI_ALLOC_TRACKING_HOOKS_H_
@@ -0,0 +1,59 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Header-only or compiled-library builds.
+//
+// NOTE: this file isn't part of the google/filament release. It is part of
+// ambrusc/filament-glfw-imgui.
+//
+// By default the library is header-only: each translation unit including
+// filament_glfw_imgui.h compiles all of App, Ui, input handling and logging,
+// along with the Filament headers they need.
+//
+// With many such translation units, define FILAMENT_GLFW_IMGUI_COMPILED for
+// ALL of them (e.g. -DFILAMENT_GLFW_IMGUI_COMPILED), and compile
+// filament_glfw_imgui/filament_glfw_imgui.cpp once into the program. Then:
+//  - Public headers declare, and forward-declare Filament types where they
+//    can; the *_impl.h files are only compiled in filament_glfw_imgui.cpp.
+//  - glfw_input::Handler<ToImGui> (WithImGui) and Handler<NoOpHandler> are
+//    instantiated there too. Handlers with other children must include
+//    filament_glfw_imgui/glfw_input_impl.h.
+//  - Include the Filament headers (and material_cache.h) you use yourself,
+//    rather than relying on filament_glfw_imgui.h pulling them in.
+//
+
+#ifndef FILAMENT_GLFW_IMGUI_CONFIG_H_
+#define FILAMENT_GLFW_IMGUI_CONFIG_H_
+
+// Whether headers include their *_impl.h: always when header-only, and only
+// in the implementation file when compiled.
+#if !defined(FILAMENT_GLFW_IMGUI_COMPILED) || \
+    defined(FILAMENT_GLFW_IMGUI_IMPLEMENTATION)
+#define FILAMENT_GLFW_IMGUI_WITH_IMPL 1
+#else
+#define FILAMENT_GLFW_IMGUI_WITH_IMPL 0
+#endif
+
+// Marks out-of-line definitions in *_impl.h: 'inline' when they're compiled
+// into every translation unit, and nothing when they're compiled into one.
+#if defined(FILAMENT_GLFW_IMGUI_COMPILED)
+#define FILAMENT_GLFW_IMGUI_INLINE
+#else
+#define FILAMENT_GLFW_IMGUI_INLINE inline
+#endif
+
+#endif  // FILAMENT_GLFW_IMGUI_CONFIG_H_
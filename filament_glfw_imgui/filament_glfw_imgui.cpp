@@ -14,4 +14,16 @@
 // limitations under the License.
 // -----------------------------------------------------------------------------
 
-#include "filament_glfw_imgui.h"
+// The implementation file for compiled-library builds; see config.h. In
+// header-only builds it compiles, but adds nothing.
+
+#if defined(FILAMENT_GLFW_IMGUI_COMPILED)
+#define FILAMENT_GLFW_IMGUI_IMPLEMENTATION
+#endif
+
+#include "filament_glfw_imgui/filament_glfw_imgui.h"
+
+#if defined(FILAMENT_GLFW_IMGUI_COMPILED)
+template class glfw_input::Handler<glfw_input::NoOpHandler>;
+template class glfw_input::Handler<glfw_input::ToImGui>;
+#endif
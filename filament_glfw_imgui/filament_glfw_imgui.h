@@ -28,14 +28,15 @@
 //
 //   GLFWwindow* window = glfwCreateWindow(...);
 //
-//   // Caller can pass any ostream to 'log', or 'nullptr' to squelch logging.
+//   // Caller can pass any Logger to 'log', or 'nullptr' to squelch logging.
 //   app = filament_glfw_imgui::App(window, imgui_mat_data, imgui_mat_size)
 //
 //   // Init() will return 'false' and log a message if 'window' is null, or
 //   // if any of the initialization steps failed.
 //   if (!app.Init()) return;
 //
-//   // Set up your Filament scene and add your ImGui fonts here.
+//   // Set up your Filament scene and add your ImGui fonts here. Build
+//   // materials through app.material_cache() to share them.
 //
 //   while (app.Run()) {
 //     glfw_input::Input& input = *app.PollEvents();
@@ -64,37 +65,79 @@
 //
 //   app = {};
 //
+// PollEvents() starts a Profiler frame, and each App phase is a profiler zone;
+// add your own with ScopedProfileZone (see profiler.h).
+//
+// Work spanning frames can be written as coroutines run by frame_scheduler(),
+// which PollEvents() resumes within a time budget; see frame_scheduler.h.
+//
+// Texture and buffer uploads can be queued in upload_scheduler(), which
+// EndUiFrame() releases within a per-frame byte budget, UI geometry first; see
+// upload_scheduler.h.
+//
+// Textures and buffers replaced mid-frame are retired through retire_queue(),
+// and destroyed once the frames using them are done; see retire_queue.h.
+//
+// ImGui allocates from pools that live until exit, whose per-frame counts are
+// in imgui_allocator()->stats(); see imgui_allocator.h.
+//
+// To check that the loop doesn't allocate once warmed up, build with
+// FILAMENT_GLFW_IMGUI_TRACK_ALLOCATIONS and read alloc_stats(); see
+// alloc_tracking.h.
+//
+// Header-only by default. Projects with many translation units including this
+// can build it as a library instead: see config.h.
+//
 
 #ifndef FILAMENT_GLFW_IMGUI_H_
 #define FILAMENT_GLFW_IMGUI_H_
 
 #include <GLFW/glfw3.h>
 #include <filament/Engine.h>
-#include <filament/Material.h>
-#include <filament/Renderer.h>
-#include <filament/SwapChain.h>
 #include <imgui/imgui.h>
 
 #include <cstdint>
-#include <ostream>
+#include <memory>
 
+#include "filament_glfw_imgui/alloc_tracking.h"
+#include "filament_glfw_imgui/config.h"
 #include "filament_glfw_imgui/filament_imgui.h"
+#include "filament_glfw_imgui/frame_scheduler.h"
 #include "filament_glfw_imgui/glfw_input.h"
 #include "filament_glfw_imgui/glfw_input_imgui.h"
-#include "filament_native/filament_native.h"
+#include "filament_glfw_imgui/imgui_allocator.h"
+#include "filament_glfw_imgui/logger.h"
+#include "filament_glfw_imgui/profiler.h"
+#include "filament_glfw_imgui/upload_scheduler.h"
 
 namespace filament_glfw_imgui {
 
+// From material_cache.h and retire_queue.h, which filament_glfw_imgui_impl.h
+// includes.
+class MaterialCache;
+struct MaterialPackage;
+class RetireQueue;
+
 class App {
  public:
-  App() = default;
+  App();
 
   // Inputs:
   //   window: must outlive this class. If null, Init() return 'false'.
   //   imgui_filamat: must outlive Init(). If null, Init() returns 'false'.
   //   log: must outlive this class, or if null, logging is silenced.
+  //   backend: e.g. Backend::NOOP to measure CPU cost without a GPU.
   App(GLFWwindow* window, const uint8_t* imgui_filamat,
-      size_t imgui_filamat_size, std::ostream* log = &std::cout);
+      size_t imgui_filamat_size, Logger* log = &Logger::Default(),
+      filament::Engine::Backend backend = filament::Engine::Backend::DEFAULT);
+
+  // As above, but with filament_imgui.filamat compiled per backend. Init()
+  // builds only the package for the backend the engine runs, and returns
+  // 'false' if there's none.
+  //   imgui_packages: must outlive Init().
+  App(GLFWwindow* window, const MaterialPackage* imgui_packages,
+      size_t imgui_package_count, Logger* log = &Logger::Default(),
+      filament::Engine::Backend backend = filament::Engine::Backend::DEFAULT);
 
   App(const App&) = delete;
   App& operator=(const App&) = delete;
@@ -106,17 +149,31 @@ class App {
   GLFWwindow* window() const { return window_; }
   const uint8_t* imgui_filamat() const { return imgui_filamat_; }
   size_t imgui_filamat_size() const { return imgui_filamat_size_; }
-  std::ostream* log() const { return log_; }
+  const MaterialPackage* imgui_packages() const { return imgui_packages_; }
+  size_t imgui_package_count() const { return imgui_package_count_; }
+  Logger* log() const { return log_; }
+  filament::Engine::Backend backend() const { return backend_; }
 
   // Fields created by Init() and destroyed in ~App().
   filament::Engine* engine() const { return engine_; }
   filament::SwapChain* swap_chain() const { return swap_chain_; }
   filament::Renderer* renderer() const { return renderer_; }
   ImGuiContext* ui_context() const { return ui_context_; }
+  ImGuiPoolAllocator* imgui_allocator() const { return imgui_allocator_; }
+  MaterialCache* material_cache() const { return material_cache_.get(); }
+  RetireQueue* retire_queue() const { return retire_queue_.get(); }
+  FrameScheduler* frame_scheduler() const { return frame_scheduler_.get(); }
+  UploadScheduler* upload_scheduler() const {
+    return upload_scheduler_.get();
+  }
   filament::Material* ui_mat() const { return ui_mat_; }
   filament_imgui::Ui* ui() const { return ui_.get(); }
   glfw_input::WithImGui* input() const { return input_.get(); }
 
+  // This thread's heap allocations in the last frame, overall and per phase.
+  // All zeros unless kTrackAllocations.
+  const AppAllocStats& alloc_stats() const { return alloc_stats_; }
+
   // Initializes all derived fields.
   // Returns:
   //  'true' on succes.
@@ -126,7 +183,9 @@ class App {
   // Returns 'true' if the app's mainloop should continue.
   bool Run();
 
-  // Polls for input events. (May be nullptr if 'window' was null in ctor.)
+  // Polls for input events, destroys retired objects the GPU is done with,
+  // and resumes frame_scheduler() coroutines. (May be nullptr if 'window' was
+  // null in ctor.)
   // TODO(ambrus): implement a version for glfwWaitEvents(...).
   glfw_input::State* PollEvents();
 
@@ -134,7 +193,8 @@ class App {
   //  - Fonts may NOT be added between Begin/End-UiFrame().
   void BeginUiFrame();
 
-  // Calls ImGui::Render and updates the Filament ui()->view().
+  // Calls ImGui::Render and updates the Filament ui()->view(), then submits
+  // this frame's upload_scheduler() uploads.
   void EndUiFrame();
 
   // Calls renderer->beginFrame(...) on the swap chain.
@@ -147,23 +207,37 @@ class App {
   GLFWwindow* window_ = nullptr;            // Not owned.
   const uint8_t* imgui_filamat_ = nullptr;  // Not owned.
   size_t imgui_filamat_size_ = 0;
-  std::ostream* log_ = nullptr;  // Not owned.
+  const MaterialPackage* imgui_packages_ = nullptr;  // Not owned.
+  size_t imgui_package_count_ = 0;
+  Logger* log_ = nullptr;  // Not owned.
+  filament::Engine::Backend backend_ = filament::Engine::Backend::DEFAULT;
 
   filament::Engine* engine_ = nullptr;
   filament::SwapChain* swap_chain_ = nullptr;
   filament::Renderer* renderer_ = nullptr;
 
   ImGuiContext* ui_context_ = nullptr;
-  filament::Material* ui_mat_ = nullptr;
+  filament::Material* ui_mat_ = nullptr;           // From material_cache_.
+  ImGuiPoolAllocator* imgui_allocator_ = nullptr;  // Process(); not owned.
 
   // NOTE(ambrus): I'd like these to be by-value fields, but it messes up the
   // "const-correctness" of the accessors.
+  std::unique_ptr<MaterialCache> material_cache_ = nullptr;
+  std::unique_ptr<RetireQueue> retire_queue_ = nullptr;
+  std::unique_ptr<FrameScheduler> frame_scheduler_ = nullptr;
+  std::unique_ptr<UploadScheduler> upload_scheduler_ = nullptr;
   std::unique_ptr<filament_imgui::Ui> ui_ = nullptr;
   std::unique_ptr<glfw_input::WithImGui> input_ = nullptr;
+
+  AppAllocStats alloc_stats_;
+  AllocCounter frame_allocs_;  // Since the last PollEvents().
+  bool counting_frames_ = false;
 };
 
 }  // namespace filament_glfw_imgui
 
+#if FILAMENT_GLFW_IMGUI_WITH_IMPL
 #include "filament_glfw_imgui/filament_glfw_imgui_impl.h"
+#endif
 
 #endif  // FILAMENT_GLFW_IMGUI_H_
@@ -17,44 +17,78 @@
 #ifndef FILAMENT_GLFW_IMGUI_IMPL_H_
 #define FILAMENT_GLFW_IMGUI_IMPL_H_
 
+#include <filament/Material.h>
+#include <filament/Renderer.h>
+#include <filament/SwapChain.h>
 #include <imgui/backends/imgui_impl_glfw.h>
 
+#include "filament_glfw_imgui/material_cache.h"
+#include "filament_glfw_imgui/retire_queue.h"
+#include "filament_native/filament_native.h"
+
 namespace filament_glfw_imgui {
 
-inline App::App(GLFWwindow* window, const uint8_t* imgui_filamat,
-                size_t imgui_filamat_size, std::ostream* log)
+FILAMENT_GLFW_IMGUI_INLINE App::App() = default;
+
+FILAMENT_GLFW_IMGUI_INLINE App::App(GLFWwindow* window,
+                                    const uint8_t* imgui_filamat,
+                                    size_t imgui_filamat_size, Logger* log,
+                                    filament::Engine::Backend backend)
     : window_(window),
       imgui_filamat_(imgui_filamat),
       imgui_filamat_size_(imgui_filamat_size),
-      log_(log) {}
+      log_(log),
+      backend_(backend) {}
+
+FILAMENT_GLFW_IMGUI_INLINE App::App(GLFWwindow* window,
+                                    const MaterialPackage* imgui_packages,
+                                    size_t imgui_package_count, Logger* log,
+                                    filament::Engine::Backend backend)
+    : window_(window),
+      imgui_packages_(imgui_packages),
+      imgui_package_count_(imgui_package_count),
+      log_(log),
+      backend_(backend) {}
 
-inline App::App(App&& other) { *this = std::move(other); }
+FILAMENT_GLFW_IMGUI_INLINE App::App(App&& other) { *this = std::move(other); }
 
-inline App& App::operator=(App&& other) {
+FILAMENT_GLFW_IMGUI_INLINE App& App::operator=(App&& other) {
   std::swap(window_, other.window_);
   std::swap(imgui_filamat_, other.imgui_filamat_);
   std::swap(imgui_filamat_size_, other.imgui_filamat_size_);
+  std::swap(imgui_packages_, other.imgui_packages_);
+  std::swap(imgui_package_count_, other.imgui_package_count_);
   std::swap(log_, other.log_);
+  std::swap(backend_, other.backend_);
 
   std::swap(engine_, other.engine_);
   std::swap(swap_chain_, other.swap_chain_);
   std::swap(renderer_, other.renderer_);
 
   std::swap(ui_context_, other.ui_context_);
+  std::swap(imgui_allocator_, other.imgui_allocator_);
   std::swap(ui_mat_, other.ui_mat_);
 
+  std::swap(material_cache_, other.material_cache_);
+  std::swap(retire_queue_, other.retire_queue_);
+  std::swap(frame_scheduler_, other.frame_scheduler_);
+  std::swap(upload_scheduler_, other.upload_scheduler_);
   std::swap(ui_, other.ui_);
   std::swap(input_, other.input_);
 
+  std::swap(alloc_stats_, other.alloc_stats_);
+  std::swap(frame_allocs_, other.frame_allocs_);
+  std::swap(counting_frames_, other.counting_frames_);
+
   return *this;
 }
 
-inline bool App::Init() {
+FILAMENT_GLFW_IMGUI_INLINE bool App::Init() {
   // Discourage calling Init() more than once.
   if (engine_) {
     if (log_) {
-      (*log_) << "App::Init -> false: Init() should only be called once."
-              << std::endl;
+      log_->Log(LogLevel::kError,
+                "App::Init -> false: Init() should only be called once.");
     }
     return false;
   }
@@ -62,7 +96,7 @@ inline bool App::Init() {
   // Make sure we have a valid window.
   if (!window_) {
     if (log_) {
-      (*log_) << "App::Init -> false: GLFWWindow is null." << std::endl;
+      log_->Log(LogLevel::kError, "App::Init -> false: GLFWWindow is null.");
     }
     return false;
   }
@@ -71,27 +105,48 @@ inline bool App::Init() {
   void* native_swap_chain = InitAndGetNativeSwapChain(window_);
   if (!native_swap_chain) {
     if (log_) {
-      (*log_) << "App::Init -> false: Can't create Filament "
-                 "swap chain because native swap chain is null. Maybe this "
-                 "platform combination is not implemented?"
-              << std::endl;
+      log_->Log(LogLevel::kError,
+                "App::Init -> false: Can't create Filament swap chain because "
+                "native swap chain is null. Maybe this platform combination "
+                "is not implemented?");
     }
     return false;
   }
 
   // Finish intializing Filament.
-  engine_ = filament::Engine::create();
+  engine_ = filament::Engine::create(backend_);
   swap_chain_ = engine_->createSwapChain(native_swap_chain);
   renderer_ = engine_->createRenderer();
 
-  // Initialize ImGui, as well as GLFW and Filament bindings.
+  // Initialize ImGui, as well as GLFW and Filament bindings. ImGui's
+  // allocator functions are global, so the pools must be installed before the
+  // context allocates anything, and stay installed after it's gone.
+  imgui_allocator_ = &ImGuiPoolAllocator::Process();
+  ImGui::SetAllocatorFunctions(ImGuiPoolAllocator::Alloc,
+                               ImGuiPoolAllocator::Free, imgui_allocator_);
   ui_context_ = ImGui::CreateContext();
   ImGui::SetCurrentContext(ui_context_);
   ImGui_ImplGlfw_InitForOther(window_, /*install_callbacks=*/false);
-  ui_mat_ = filament::Material::Builder()
-                .package(imgui_filamat_, imgui_filamat_size_)
-                .build(*engine_);
-  ui_ = std::make_unique<filament_imgui::Ui>(engine_, ui_mat_);
+  material_cache_ = std::make_unique<MaterialCache>(engine_);
+  upload_scheduler_ = std::make_unique<UploadScheduler>(engine_);
+  retire_queue_ = std::make_unique<RetireQueue>(engine_);
+  retire_queue_->set_upload_scheduler(upload_scheduler_.get());
+  frame_scheduler_ = std::make_unique<FrameScheduler>(engine_);
+  ui_mat_ =
+      imgui_packages_
+          ? material_cache_->Acquire(imgui_packages_, imgui_package_count_)
+          : material_cache_->Acquire(imgui_filamat_, imgui_filamat_size_);
+  if (!ui_mat_) {
+    if (log_) {
+      log_->Log(LogLevel::kError,
+                "App::Init -> false: Can't build the ImGui material for "
+                "backend %d.",
+                int(engine_->getBackend()));
+    }
+    return false;
+  }
+  ui_ = std::make_unique<filament_imgui::Ui>(
+      engine_, ui_mat_, retire_queue_.get(), upload_scheduler_.get(), log_);
 
   input_ = std::make_unique<glfw_input::WithImGui>();
   GlfwAttachInputCallbacksAndSetWindowUserPointer(*input_, *window_);
@@ -101,52 +156,87 @@ inline bool App::Init() {
   return true;
 }
 
-inline bool App::Run() { return engine_ && !glfwWindowShouldClose(window_); }
+FILAMENT_GLFW_IMGUI_INLINE bool App::Run() {
+  return engine_ && !glfwWindowShouldClose(window_);
+}
 
 // Polls for input events.
 // TODO(ambrus): implement a version for glfwWaitEvents(...).
-inline glfw_input::State* App::PollEvents() {
+FILAMENT_GLFW_IMGUI_INLINE glfw_input::State* App::PollEvents() {
   if (!engine_) return nullptr;
 
+  // A frame runs from one PollEvents() to the next.
+  Profiler::Get().BeginFrame();
+  imgui_allocator_->EndFrame();
+  if constexpr (kTrackAllocations) {
+    if (counting_frames_) {
+      alloc_stats_.frame = frame_allocs_.counts();
+      ++alloc_stats_.frames;
+      if (alloc_stats_.frame.allocs) ++alloc_stats_.allocating_frames;
+    }
+    frame_allocs_.Reset();
+    counting_frames_ = true;
+  }
+  const ScopedAllocCount count(alloc_stats_.phase(AppPhase::kPollEvents));
+  const ScopedProfileZone zone("App::PollEvents");
+
+  retire_queue_->BeginFrame();
+
   input_->ClearEvents();
   glfwPollEvents();
 
   // TODO(ambrus): check for resize instead of updating every frame.
   UpdateNativeSwapChainSize(window_);
 
+  // Before BeginUiFrame(), so coroutines may still add fonts.
+  frame_scheduler_->RunFrame();
+
   return &input_->state();
 }
 
-inline void App::BeginUiFrame() {
+FILAMENT_GLFW_IMGUI_INLINE void App::BeginUiFrame() {
   if (!engine_) return;
+  const ScopedAllocCount count(alloc_stats_.phase(AppPhase::kBeginUiFrame));
+  const ScopedProfileZone zone("App::BeginUiFrame");
   ImGuiIO& io = ImGui::GetIO();
   if (!io.Fonts->IsBuilt()) ui_->RebuildFontAtlas(*io.Fonts);
   ImGui_ImplGlfw_NewFrame();  // Updates io.DeltaTime and display size.
   ImGui::NewFrame();
 }
 
-inline void App::EndUiFrame() {
+FILAMENT_GLFW_IMGUI_INLINE void App::EndUiFrame() {
   if (!engine_) return;
+  const ScopedAllocCount count(alloc_stats_.phase(AppPhase::kEndUiFrame));
+  const ScopedProfileZone zone("App::EndUiFrame");
   ImGuiIO& io = ImGui::GetIO();
   ImGui::Render();
   ImGui::GetDrawData()->ScaleClipRects(io.DisplayFramebufferScale);
   ui_->UpdateView(*ImGui::GetDrawData(), io);
+  upload_scheduler_->Submit();
 }
 
-inline bool App::BeginRender() {
+FILAMENT_GLFW_IMGUI_INLINE bool App::BeginRender() {
   if (!renderer_) return false;
+  const ScopedAllocCount count(alloc_stats_.phase(AppPhase::kBeginRender));
+  const ScopedProfileZone zone("App::BeginRender");
   return renderer_->beginFrame(swap_chain_);
 }
 
-inline App::~App() {
+FILAMENT_GLFW_IMGUI_INLINE App::~App() {
   if (!engine_) return;
 
+  // Coroutines may hold anything below, so they go first.
+  frame_scheduler_ = {};
   ImGui_ImplGlfw_Shutdown();
   input_ = {};
   ui_ = {};
+  // The pools stay installed: statics may still free ImGui memory at exit.
   ImGui::DestroyContext(ui_context_);
 
-  engine_->destroy(ui_mat_);
+  retire_queue_ = {};      // After everything that retires through it.
+  upload_scheduler_ = {};  // Drops uploads nothing will see.
+  material_cache_->Release(ui_mat_);
+  material_cache_ = {};  // Destroys materials other users leaked.
   engine_->destroy(renderer_);
   engine_->destroy(swap_chain_);
 
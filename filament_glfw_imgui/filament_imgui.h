@@ -58,33 +58,50 @@
 #ifndef FILAMENT_IMGUI_H_
 #define FILAMENT_IMGUI_H_
 
-#include <filament/Camera.h>
-#include <filament/Engine.h>
-#include <filament/IndexBuffer.h>
-#include <filament/Material.h>
-#include <filament/MaterialInstance.h>
-#include <filament/Scene.h>
-#include <filament/Texture.h>
-#include <filament/VertexBuffer.h>
-#include <filament/View.h>
 #include <imgui/imgui.h>
 #include <utils/Entity.h>
-#include <utils/Path.h>
 
+#include <cstddef>
 #include <vector>
 
-namespace filament_imgui {
+#include "filament_glfw_imgui/config.h"
+#include "filament_glfw_imgui/logger.h"
+
+// Only pointers to these are used here; filament_imgui_impl.h includes them.
+namespace filament {
+class Camera;
+class Engine;
+class IndexBuffer;
+class Material;
+class MaterialInstance;
+class Scene;
+class Texture;
+class VertexBuffer;
+class View;
+}  // namespace filament
+
+// From retire_queue.h and upload_scheduler.h, which filament_imgui_impl.h
+// includes.
+namespace filament_glfw_imgui {
+class RetireQueue;
+class UploadScheduler;
+}  // namespace filament_glfw_imgui
 
-// Adds a named font to ImFontAtlas in a single call.
-template <size_t name_size>
-ImFont *AddFont(const char (&name)[name_size], void *data, size_t data_size,
-                float size_px, bool free_when_done, ImFontAtlas &atlas);
+namespace filament_imgui {
 
 // Adds a named font to ImFontAtlas in a single call.
 ImFont *AddFont(const char *name, size_t name_size, void *data,
                 size_t data_size, float size_px, bool free_when_done,
                 ImFontAtlas &atlas);
 
+// Adds a named font to ImFontAtlas in a single call.
+template <size_t name_size>
+ImFont *AddFont(const char (&name)[name_size], void *data, size_t data_size,
+                float size_px, bool free_when_done, ImFontAtlas &atlas) {
+  return AddFont(name, name_size, data, data_size, size_px, free_when_done,
+                 atlas);
+}
+
 // Manages Filament state WITHOUT ever calling global ImGui functions.
 //  - What you pass in is what's used, nothing more.
 class Ui {
@@ -93,7 +110,19 @@ class Ui {
   // Provide a valid engine and material for the UI to use.
   //   engine=nullptr => all UI components will be nullptr.
   //   material=nullptr => memory corruption.
-  Ui(filament::Engine *engine, filament::Material *material);
+  //   retire_queue: replaced textures and buffers are retired through it, if
+  //     set, and must outlive this class. Otherwise, replacing them waits on
+  //     an engine fence.
+  //   uploads: the font atlas and UI geometry are uploaded through it, if
+  //     set, and it must outlive this class. Geometry goes as kUi, so the
+  //     caller must Submit() it every frame before rendering view().
+  //   log: warnings go here, and it must outlive this class; nullptr
+  //     silences them.
+  Ui(filament::Engine *engine, filament::Material *material,
+     filament_glfw_imgui::RetireQueue *retire_queue = nullptr,
+     filament_glfw_imgui::UploadScheduler *uploads = nullptr,
+     filament_glfw_imgui::Logger *log =
+         &filament_glfw_imgui::Logger::Default());
 
   ~Ui();
 
@@ -110,15 +139,25 @@ class Ui {
 
   // Updates view() to with the latest UI state for rendering.
   //  - Must call after ImGui::Render() and before rendering view().
-  //  - May wait on an engine fence internally.
+  //  - Without a retire queue, may wait on an engine fence internally.
   void UpdateView(const ImDrawData &commands, const ImGuiIO &io);
 
   // Render this view after your other views.
   filament::View *view() const { return view_; }
 
  private:
-  filament::Engine *engine_ = nullptr;      // Not owned.
-  filament::Material *material_ = nullptr;  // Not owned.
+  // Replaces the UI renderable with one of 'primitive_count' empty primitives,
+  // creating material instances as needed.
+  void RebuildRenderable(size_t primitive_count);
+
+  // Makes primitives from 'first' on draw nothing.
+  void ClearPrimitives(size_t first);
+
+  filament::Engine *engine_ = nullptr;                        // Not owned.
+  filament::Material *material_ = nullptr;                    // Not owned.
+  filament_glfw_imgui::RetireQueue *retire_queue_ = nullptr;  // Not owned.
+  filament_glfw_imgui::UploadScheduler *uploads_ = nullptr;   // Not owned.
+  filament_glfw_imgui::Logger *log_ = nullptr;                // Not owned.
 
   filament::View *view_ = nullptr;
   filament::Scene *scene_ = nullptr;
@@ -128,6 +167,7 @@ class Ui {
   filament::VertexBuffer *vertex_buffer_ = nullptr;
   filament::IndexBuffer *index_buffer_ = nullptr;
   std::vector<filament::MaterialInstance *> material_instances_;
+  size_t primitive_capacity_ = 0;  // Of ui_entity_'s renderable.
 
   utils::Entity ui_entity_ = {};
   utils::Entity camera_entity_ = {};
@@ -139,6 +179,8 @@ class Ui {
 
 }  // namespace filament_imgui
 
+#if FILAMENT_GLFW_IMGUI_WITH_IMPL
 #include "filament_glfw_imgui/filament_imgui_impl.h"
+#endif
 
 #endif /* FILAMENT_IMGUI_H_ */
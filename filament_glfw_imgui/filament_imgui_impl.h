@@ -17,29 +17,51 @@
 #ifndef FILAMENT_IMGUI_IMPL_H_
 #define FILAMENT_IMGUI_IMPL_H_
 
+#include <filament/Camera.h>
+#include <filament/Engine.h>
 #include <filament/Fence.h>
+#include <filament/IndexBuffer.h>
+#include <filament/Material.h>
+#include <filament/MaterialInstance.h>
 #include <filament/RenderableManager.h>
+#include <filament/Scene.h>
+#include <filament/Texture.h>
 #include <filament/TextureSampler.h>
+#include <filament/VertexBuffer.h>
+#include <filament/View.h>
 #include <filament/Viewport.h>
 #include <utils/EntityManager.h>
 
+#include <algorithm>
 #include <cstdlib>
-#include <iostream>
+#include <cstring>
 #include <utility>
 #include <vector>
 
-namespace filament_imgui {
+#include "filament_glfw_imgui/gpu_memory.h"
+#include "filament_glfw_imgui/logger.h"
+#include "filament_glfw_imgui/profiler.h"
+#include "filament_glfw_imgui/retire_queue.h"
+#include "filament_glfw_imgui/upload_scheduler.h"
 
-template <size_t name_size>
-ImFont *AddFont(const char (&name)[name_size], void *data, size_t data_size,
-                float size_px, bool free_when_done, ImFontAtlas &atlas) {
-  return AddFont(name, name_size, data, data_size, size_px, free_when_done,
-                 atlas);
-}
+namespace filament_imgui {
 
-inline ImFont *AddFont(const char *name, size_t name_size, void *data,
-                       size_t data_size, float size_px, bool free_when_done,
-                       ImFontAtlas &atlas) {
+using filament_glfw_imgui::DestroyTracked;
+using filament_glfw_imgui::GpuMemoryTag;
+using filament_glfw_imgui::Logger;
+using filament_glfw_imgui::LogLevel;
+using filament_glfw_imgui::LogRateLimit;
+using filament_glfw_imgui::RetireOrDestroy;
+using filament_glfw_imgui::ScopedProfileZone;
+using filament_glfw_imgui::TrackBuffer;
+using filament_glfw_imgui::TrackTexture;
+using filament_glfw_imgui::UploadPriority;
+using filament_glfw_imgui::UploadScheduler;
+
+FILAMENT_GLFW_IMGUI_INLINE ImFont *AddFont(const char *name, size_t name_size,
+                                           void *data, size_t data_size,
+                                           float size_px, bool free_when_done,
+                                           ImFontAtlas &atlas) {
   ImFontConfig font_cfg = {};
   font_cfg.FontDataOwnedByAtlas = free_when_done;
   std::memcpy(font_cfg.Name, name, std::min(name_size, sizeof(font_cfg.Name)));
@@ -47,33 +69,42 @@ inline ImFont *AddFont(const char *name, size_t name_size, void *data,
   return atlas.AddFontFromMemoryTTF(data, data_size, size_px, &font_cfg);
 }
 
-inline filament::VertexBuffer *CreateVertexBuffer(filament::Engine &engine,
-                                                  size_t vertex_count) {
+FILAMENT_GLFW_IMGUI_INLINE filament::VertexBuffer *CreateVertexBuffer(
+    filament::Engine &engine, size_t vertex_count) {
   using namespace filament;
-  return filament::VertexBuffer::Builder()
-      .vertexCount(vertex_count)
-      .bufferCount(1)
-      .attribute(VertexAttribute::POSITION, 0,
-                 VertexBuffer::AttributeType::FLOAT2, 0, sizeof(ImDrawVert))
-      .attribute(VertexAttribute::UV0, 0, VertexBuffer::AttributeType::FLOAT2,
-                 sizeof(filament::math::float2), sizeof(ImDrawVert))
-      .attribute(VertexAttribute::COLOR, 0, VertexBuffer::AttributeType::UBYTE4,
-                 2 * sizeof(filament::math::float2), sizeof(ImDrawVert))
-      .normalized(VertexAttribute::COLOR)
-      .build(engine);
+  VertexBuffer *const vb =
+      VertexBuffer::Builder()
+          .vertexCount(vertex_count)
+          .bufferCount(1)
+          .attribute(VertexAttribute::POSITION, 0,
+                     VertexBuffer::AttributeType::FLOAT2, 0,
+                     sizeof(ImDrawVert))
+          .attribute(VertexAttribute::UV0, 0,
+                     VertexBuffer::AttributeType::FLOAT2,
+                     sizeof(filament::math::float2), sizeof(ImDrawVert))
+          .attribute(VertexAttribute::COLOR, 0,
+                     VertexBuffer::AttributeType::UBYTE4,
+                     2 * sizeof(filament::math::float2), sizeof(ImDrawVert))
+          .normalized(VertexAttribute::COLOR)
+          .build(engine);
+  TrackBuffer(vb, GpuMemoryTag::kUiBuffers, vertex_count * sizeof(ImDrawVert));
+  return vb;
 }
 
-inline filament::IndexBuffer *CreateIndexBuffer(filament::Engine &engine,
-                                                size_t index_count) {
+FILAMENT_GLFW_IMGUI_INLINE filament::IndexBuffer *CreateIndexBuffer(
+    filament::Engine &engine, size_t index_count) {
   using namespace filament;
-  return IndexBuffer::Builder()
-      .indexCount(index_count)
-      .bufferType(IndexBuffer::IndexType::USHORT)
-      .build(engine);
+  IndexBuffer *const ib = IndexBuffer::Builder()
+                              .indexCount(index_count)
+                              .bufferType(IndexBuffer::IndexType::USHORT)
+                              .build(engine);
+  TrackBuffer(ib, GpuMemoryTag::kUiBuffers, index_count * sizeof(ImDrawIdx));
+  return ib;
 }
 
-inline filament::Texture *CreateFontTexture(filament::Engine &engine,
-                                            ImFontAtlas &fonts) {
+// Uploads through 'uploads' if it's set.
+FILAMENT_GLFW_IMGUI_INLINE filament::Texture *CreateFontTexture(
+    filament::Engine &engine, ImFontAtlas &fonts, UploadScheduler *uploads) {
   using namespace filament;
 
   unsigned char *temp_pixels = nullptr;
@@ -101,24 +132,36 @@ inline filament::Texture *CreateFontTexture(filament::Engine &engine,
                  .format(Texture::InternalFormat::RGBA8)
                  .sampler(Texture::Sampler::SAMPLER_2D)
                  .build(engine);
-  tex->setImage(
-      engine, 0,
-      Texture::PixelBufferDescriptor(
-          pixels, size, Texture::Format::RGBA, Texture::Type::UBYTE,
-          [](void *buffer, size_t size, void *user) { free(buffer); }));
+  auto pixel_buffer = Texture::PixelBufferDescriptor(
+      pixels, size, Texture::Format::RGBA, Texture::Type::UBYTE,
+      [](void *buffer, size_t size, void *user) { free(buffer); });
+  if (uploads) {
+    uploads->EnqueueImage(tex, 0, std::move(pixel_buffer),
+                          UploadPriority::kHigh);
+  } else {
+    tex->setImage(engine, 0, std::move(pixel_buffer));
+  }
+  TrackTexture(tex, GpuMemoryTag::kFontAtlas);
 
   return tex;
 }
 
-inline void SetScissor(ImVec4 clip_rect, int height_px,
-                       filament::MaterialInstance &mat) {
+FILAMENT_GLFW_IMGUI_INLINE void SetScissor(ImVec4 clip_rect, int height_px,
+                                           filament::MaterialInstance &mat) {
   mat.setScissor(clip_rect.x, height_px - clip_rect.w,
                  (uint16_t)(clip_rect.z - clip_rect.x),
                  (uint16_t)(clip_rect.w - clip_rect.y));
 }
 
-inline Ui::Ui(filament::Engine *engine, filament::Material *material)
-    : engine_(engine), material_(material) {
+FILAMENT_GLFW_IMGUI_INLINE Ui::Ui(
+    filament::Engine *engine, filament::Material *material,
+    filament_glfw_imgui::RetireQueue *retire_queue,
+    filament_glfw_imgui::UploadScheduler *uploads, Logger *log)
+    : engine_(engine),
+      material_(material),
+      retire_queue_(retire_queue),
+      uploads_(uploads),
+      log_(log) {
   if (engine_) {
     using namespace filament;
 
@@ -148,7 +191,7 @@ inline Ui::Ui(filament::Engine *engine, filament::Material *material)
   }
 }
 
-inline Ui::~Ui() {
+FILAMENT_GLFW_IMGUI_INLINE Ui::~Ui() {
   if (engine_) {
     // Engine can handle destroy(nullptr).
     engine_->destroy(scene_);
@@ -161,17 +204,21 @@ inline Ui::~Ui() {
     entity_manager.destroy(camera_entity_);
 
     for (auto m : material_instances_) engine_->destroy(m);
-    engine_->destroy(vertex_buffer_);
-    engine_->destroy(index_buffer_);
-    engine_->destroy(font_atlas_);
+    if (uploads_) uploads_->Cancel(font_atlas_);  // UI geometry isn't queued.
+    DestroyTracked(*engine_, vertex_buffer_);
+    DestroyTracked(*engine_, index_buffer_);
+    DestroyTracked(*engine_, font_atlas_);
   }
 }
 
-inline Ui::Ui(Ui &&other) { *this = std::move(other); }
+FILAMENT_GLFW_IMGUI_INLINE Ui::Ui(Ui &&other) { *this = std::move(other); }
 
-inline Ui &Ui::operator=(Ui &&other) {
+FILAMENT_GLFW_IMGUI_INLINE Ui &Ui::operator=(Ui &&other) {
   std::swap(engine_, other.engine_);
   std::swap(material_, other.material_);
+  std::swap(retire_queue_, other.retire_queue_);
+  std::swap(uploads_, other.uploads_);
+  std::swap(log_, other.log_);
 
   std::swap(view_, other.view_);
   std::swap(scene_, other.scene_);
@@ -182,6 +229,8 @@ inline Ui &Ui::operator=(Ui &&other) {
   std::swap(index_buffer_, other.index_buffer_);
   std::swap(material_instances_, other.material_instances_);
 
+  std::swap(primitive_capacity_, other.primitive_capacity_);
+
   std::swap(ui_entity_, other.ui_entity_);
   std::swap(camera_entity_, other.camera_entity_);
 
@@ -191,20 +240,23 @@ inline Ui &Ui::operator=(Ui &&other) {
   return *this;
 }
 
-inline void Ui::RebuildFontAtlas(ImFontAtlas &fonts) {
+FILAMENT_GLFW_IMGUI_INLINE void Ui::RebuildFontAtlas(ImFontAtlas &fonts) {
   if (!engine_) return;
 
-  // TODO(ambrus): is this fence necessary? Perhaps we have to wait for any
-  // pending render operations before destroying textures that may be in use.
-  filament::Fence::waitAndDestroy(engine_->createFence());
-  engine_->destroy(font_atlas_);  // Ok to call w/nullptr.
-  font_atlas_ = CreateFontTexture(*engine_, fonts);
+  // Frames in flight may still sample the old atlas, whose upload may not
+  // even have gone yet.
+  if (!retire_queue_) filament::Fence::waitAndDestroy(engine_->createFence());
+  if (uploads_) uploads_->Cancel(font_atlas_);
+  RetireOrDestroy(*engine_, retire_queue_, font_atlas_);  // nullptr ok.
+  font_atlas_ = CreateFontTexture(*engine_, fonts, uploads_);
   // We use nullptr as the sentinel for the main font atlas.
   fonts.SetTexID(nullptr);
 }
 
-inline void Ui::UpdateView(const ImDrawData &commands, const ImGuiIO &io) {
+FILAMENT_GLFW_IMGUI_INLINE void Ui::UpdateView(const ImDrawData &commands,
+                                               const ImGuiIO &io) {
   if (!engine_) return;
+  const ScopedProfileZone zone("Ui::UpdateView");
 
   using namespace filament;
 
@@ -227,9 +279,13 @@ inline void Ui::UpdateView(const ImDrawData &commands, const ImGuiIO &io) {
   // std::cout << "Total vertex count: " << commands.TotalVtxCount << std::endl;
   // std::cout << "Total index count: " << commands.TotalIdxCount << std::endl;
 
-  // We rebuild the renderable part of the entity each frame (or draw nothing).
-  engine_->getRenderableManager().destroy(ui_entity_);
-  if (commands.CmdListsCount == 0) return;
+  // The renderable is only rebuilt when it needs more primitives, as building
+  // one allocates; otherwise its primitives are updated in place, and unused
+  // ones draw nothing.
+  if (commands.CmdListsCount == 0) {
+    ClearPrimitives(0);
+    return;
+  }
 
   // Determine if we have any GPU-side resources to swap out.
   const bool rebuild_vertex_buffer =
@@ -239,54 +295,56 @@ inline void Ui::UpdateView(const ImDrawData &commands, const ImGuiIO &io) {
       (index_buffer_ == nullptr ||
        index_buffer_->getIndexCount() < commands.TotalIdxCount);
 
-  // TODO(ambrus): a better way of reporting errors.
-  // Issue a warning if the texture atlas has been invalidated.
-  if (!io.Fonts->IsBuilt()) {
-    std::cout << "ImGuiIO->Fonts->IsBuilt() -> false. RebuildFontAtlas must be "
-                 "called before ImGui::NewFrame() and after ImGui::Render() if "
-                 "the ImGuiIO->Fonts API was used to add new fonts.";
+  // Issue a warning if the texture atlas has been invalidated. This holds
+  // until the app rebuilds the atlas, so don't repeat it every frame.
+  if (log_ && !io.Fonts->IsBuilt()) {
+    static LogRateLimit limit(1, std::chrono::seconds(5));
+    log_->Log(
+        limit, LogLevel::kWarning,
+        "ImGuiIO->Fonts->IsBuilt() -> false. RebuildFontAtlas must be called "
+        "before ImGui::NewFrame() and after ImGui::Render() if the "
+        "ImGuiIO->Fonts API was used to add new fonts.");
   }
 
+  // Buffers grow with headroom, so a UI that grows a little at a time doesn't
+  // reallocate every frame.
   if (rebuild_vertex_buffer || rebuild_index_buffer) {
-    // TODO(ambrus): is this fence necessary? Perhaps we have to wait for any
-    // pending render operations before destroying buffers that may be in use.
-    Fence::waitAndDestroy(engine_->createFence());
+    // Frames in flight may still draw from the old buffers, and uploads to
+    // them still read the old data, so both are retired together.
+    if (!retire_queue_) Fence::waitAndDestroy(engine_->createFence());
 
     if (rebuild_vertex_buffer) {
-      engine_->destroy(vertex_buffer_);  // nullptr ok.
-      vertex_buffer_ = CreateVertexBuffer(*engine_, commands.TotalVtxCount);
-      vertex_data_.resize(commands.TotalVtxCount);
+      const size_t count = commands.TotalVtxCount * 3 / 2;
+      RetireOrDestroy(*engine_, retire_queue_, vertex_buffer_);  // nullptr ok.
+      if (retire_queue_) retire_queue_->Retire(std::move(vertex_data_));
+      vertex_buffer_ = CreateVertexBuffer(*engine_, count);
+      vertex_data_.resize(count);
     }
     if (rebuild_index_buffer) {
-      engine_->destroy(index_buffer_);  // nullptr ok.
-      index_buffer_ = CreateIndexBuffer(*engine_, commands.TotalIdxCount);
-      index_data_.resize(commands.TotalIdxCount);
+      const size_t count = commands.TotalIdxCount * 3 / 2;
+      RetireOrDestroy(*engine_, retire_queue_, index_buffer_);  // nullptr ok.
+      if (retire_queue_) retire_queue_->Retire(std::move(index_data_));
+      index_buffer_ = CreateIndexBuffer(*engine_, count);
+      index_data_.resize(count);
     }
   }
 
   // Count how many renderables we need.
-  int num_renderables = 0;
+  size_t num_renderables = 0;
   for (int i = 0; i < commands.CmdListsCount; ++i) {
     num_renderables += commands.CmdLists[i]->CmdBuffer.size();
   }
-  auto renderable_builder = RenderableManager::Builder(num_renderables);
-  renderable_builder.boundingBox({{0, 0, 0}, {10000, 10000, 10000}})
-      .culling(false);
-
-  // Extend material instances to cover the number of renderables.
-  if (material_instances_.size() < num_renderables) {
-    const int i_first = material_instances_.size();
-    material_instances_.resize(num_renderables);
-    for (int i = i_first; i < material_instances_.size(); ++i) {
-      // TODO(ambrus): null check material_ (maybe in ctor?).
-      material_instances_[i] = material_->createInstance();
-    }
+  if (num_renderables > primitive_capacity_) {
+    RebuildRenderable(std::max(num_renderables, primitive_capacity_ * 3 / 2));
   }
 
-  // Create renderables.
+  auto &renderables = engine_->getRenderableManager();
+  const auto instance = renderables.getInstance(ui_entity_);
+
+  // Fill in primitives.
   int i_vert = 0;
   int i_ind = 0;
-  int i_renderable = 0;
+  size_t i_renderable = 0;
   for (int i = 0; i < commands.CmdListsCount; ++i) {
     const ImDrawList &draw_list = *commands.CmdLists[i];
 
@@ -309,7 +367,7 @@ inline void Ui::UpdateView(const ImDrawData &commands, const ImGuiIO &io) {
       }
     }
 
-    // Create each renderable.
+    // Update each primitive.
     for (const auto &cmd : draw_list.CmdBuffer) {
       // Some commands are user callbacks. ImGui API dictates we call them and
       // then continue.
@@ -327,12 +385,9 @@ inline void Ui::UpdateView(const ImDrawData &commands, const ImGuiIO &io) {
           TextureSampler(TextureSampler::MinFilter::LINEAR,
                          TextureSampler::MagFilter::LINEAR));
 
-      renderable_builder
-          .geometry(i_renderable, RenderableManager::PrimitiveType::TRIANGLES,
-                    vertex_buffer_, index_buffer_, cmd.IdxOffset + i_ind,
-                    cmd.ElemCount)
-          .blendOrder(i_renderable, i_renderable)
-          .material(i_renderable, &mat_instance);
+      renderables.setGeometryAt(
+          instance, i_renderable, RenderableManager::PrimitiveType::TRIANGLES,
+          vertex_buffer_, index_buffer_, cmd.IdxOffset + i_ind, cmd.ElemCount);
 
       ++i_renderable;
     }
@@ -340,21 +395,70 @@ inline void Ui::UpdateView(const ImDrawData &commands, const ImGuiIO &io) {
     i_vert += num_verts;
     i_ind += num_inds;
   }
+  ClearPrimitives(i_renderable);
 
-  // Our UI entity is attached to the scene. Add UI renderables to it.
-  renderable_builder.build(*engine_, ui_entity_);
-
-  // Schedule async copy of data to the GPU.
+  // Schedule async copy of data to the GPU. Through uploads_, UI geometry
+  // still goes this frame, ahead of everything else.
   if (i_vert) {
-    vertex_buffer_->setBufferAt(
-        *engine_, /*buffer_index=*/0,
-        VertexBuffer::BufferDescriptor(vertex_data_.data(),
-                                       i_vert * sizeof(ImDrawVert)));
+    auto vertices = VertexBuffer::BufferDescriptor(
+        vertex_data_.data(), i_vert * sizeof(ImDrawVert));
+    if (uploads_) {
+      uploads_->EnqueueVertices(vertex_buffer_, /*index=*/0,
+                                std::move(vertices), 0, UploadPriority::kUi);
+    } else {
+      vertex_buffer_->setBufferAt(*engine_, /*buffer_index=*/0,
+                                  std::move(vertices));
+    }
   }
   if (i_ind) {
-    index_buffer_->setBuffer(
-        *engine_, IndexBuffer::BufferDescriptor(index_data_.data(),
-                                                i_ind * sizeof(ImDrawIdx)));
+    auto indices = IndexBuffer::BufferDescriptor(index_data_.data(),
+                                                 i_ind * sizeof(ImDrawIdx));
+    if (uploads_) {
+      uploads_->EnqueueIndices(index_buffer_, std::move(indices), 0,
+                               UploadPriority::kUi);
+    } else {
+      index_buffer_->setBuffer(*engine_, std::move(indices));
+    }
+  }
+}
+
+FILAMENT_GLFW_IMGUI_INLINE void Ui::RebuildRenderable(size_t primitive_count) {
+  using namespace filament;
+
+  // Extend material instances to cover the number of primitives.
+  const size_t i_first = material_instances_.size();
+  material_instances_.resize(std::max(i_first, primitive_count));
+  for (size_t i = i_first; i < material_instances_.size(); ++i) {
+    // TODO(ambrus): null check material_ (maybe in ctor?).
+    material_instances_[i] = material_->createInstance();
+  }
+
+  // Primitive i always uses material instance i, and blends in order i.
+  engine_->getRenderableManager().destroy(ui_entity_);
+  auto renderable_builder = RenderableManager::Builder(primitive_count);
+  renderable_builder.boundingBox({{0, 0, 0}, {10000, 10000, 10000}})
+      .culling(false);
+  for (size_t i = 0; i < primitive_count; ++i) {
+    renderable_builder
+        .geometry(i, RenderableManager::PrimitiveType::TRIANGLES,
+                  vertex_buffer_, index_buffer_, 0, 0)
+        .blendOrder(i, i)
+        .material(i, material_instances_[i]);
+  }
+
+  // Our UI entity is attached to the scene. Add UI renderables to it.
+  renderable_builder.build(*engine_, ui_entity_);
+  primitive_capacity_ = primitive_count;
+}
+
+FILAMENT_GLFW_IMGUI_INLINE void Ui::ClearPrimitives(size_t first) {
+  using namespace filament;
+  auto &renderables = engine_->getRenderableManager();
+  const auto instance = renderables.getInstance(ui_entity_);
+  for (size_t i = first; i < primitive_capacity_; ++i) {
+    renderables.setGeometryAt(instance, i,
+                              RenderableManager::PrimitiveType::TRIANGLES,
+                              vertex_buffer_, index_buffer_, 0, 0);
   }
 }
 
@@ -0,0 +1,384 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// C++20 coroutines that span frames, resumed by the frame loop.
+//
+// NOTE: this file isn't part of the google/filament release. It is part of
+// ambrusc/filament-glfw-imgui.
+//
+// Work that takes several frames (loading an environment, rebuilding fonts,
+// streaming uploads) can be written as straight-line code that co_awaits
+// whatever it needs next, instead of a state machine stepped every frame:
+//
+//   - NextFrame(): the next RunFrame().
+//   - GpuFence(): the engine finishing the commands issued so far.
+//   - Worker(fn): fn() returning on a worker thread.
+//   - Until(time) / Delay(duration): a steady_clock deadline.
+//
+// Coroutines only ever run on the thread calling RunFrame(), so they can use
+// the engine and ImGui freely; only Worker(...) jobs run elsewhere. Every
+// co_await resumes in a later RunFrame(), never the one it was awaited in.
+// RunFrame() resumes ready coroutines in the order they became ready, until
+// its time budget is spent, and leaves the rest for the next frame. It can't
+// preempt a coroutine, so keep the code between co_awaits short.
+//
+// App::Init() creates one, and App::PollEvents() runs its frames. Not
+// thread-safe, apart from Worker(...) jobs.
+//
+// Usage:
+//
+//   using namespace filament_glfw_imgui;
+//   FrameScheduler& scheduler = *app.frame_scheduler();
+//
+//   FrameTask LoadMesh(FrameScheduler& scheduler, const char* path) {
+//     MeshData data;
+//     co_await scheduler.Worker([&] { data = Decode(path); });
+//     Mesh mesh = Upload(data);
+//     co_await scheduler.GpuFence();  // Uploaded; 'data' can go.
+//     ...
+//   }
+//
+//   scheduler.Spawn(LoadMesh(scheduler, "bunny.fsmesh"));  // Next frame on.
+//   ...
+//   const uint32_t resumed = scheduler.stats().resumed;  // In the last frame.
+//
+// NOTE: FrameTasks may only co_await the awaitables above, as the scheduler
+// has to know about every suspended coroutine to destroy it at shutdown.
+//
+
+#ifndef FILAMENT_GLFW_IMGUI_FRAME_SCHEDULER_H_
+#define FILAMENT_GLFW_IMGUI_FRAME_SCHEDULER_H_
+
+#include <filament/Engine.h>
+#include <filament/Fence.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "filament_glfw_imgui/profiler.h"
+
+namespace filament_glfw_imgui {
+
+// What coroutines run by FrameScheduler return. Doesn't run until it's given
+// to FrameScheduler::Spawn(...).
+class FrameTask {
+ public:
+  struct promise_type {
+    FrameTask get_return_object() {
+      return FrameTask(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::abort(); }  // Built without exceptions.
+  };
+
+  FrameTask() = default;
+
+  FrameTask(const FrameTask&) = delete;
+  FrameTask& operator=(const FrameTask&) = delete;
+
+  FrameTask(FrameTask&& other) { *this = std::move(other); }
+  FrameTask& operator=(FrameTask&& other) {
+    std::swap(handle_, other.handle_);
+    return *this;
+  }
+
+  // Destroys the coroutine if it was never spawned.
+  ~FrameTask() {
+    if (handle_) handle_.destroy();
+  }
+
+ private:
+  friend class FrameScheduler;
+
+  explicit FrameTask(std::coroutine_handle<> handle) : handle_(handle) {}
+
+  std::coroutine_handle<> handle_;
+};
+
+// For the last RunFrame().
+struct FrameSchedulerStats {
+  uint32_t resumed = 0;   // Coroutines resumed.
+  uint32_t finished = 0;  // Of those, the ones that returned.
+  uint32_t deferred = 0;  // Ready, but left for the next frame by the budget.
+  uint32_t waiting = 0;   // Suspended on something that isn't ready yet.
+  uint32_t tasks = 0;     // Spawned, and not finished.
+  double ms = 0;          // Spent in RunFrame().
+};
+
+class FrameScheduler {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // RunFrame() stops resuming coroutines once it has run this long.
+  static constexpr Clock::duration kDefaultBudget =
+      std::chrono::milliseconds(2);
+
+  // Inputs:
+  //   engine: must outlive this class.
+  //   worker_threads: run Worker(...) jobs; started on first use.
+  explicit FrameScheduler(filament::Engine* engine,
+                          Clock::duration budget = kDefaultBudget,
+                          int worker_threads = 1)
+      : engine_(engine), budget_(budget), worker_count_(worker_threads) {}
+
+  // Worker threads and suspended coroutines point back here.
+  FrameScheduler(const FrameScheduler&) = delete;
+  FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+  // Finishes the Worker(...) jobs already queued, then destroys every
+  // coroutine that hasn't finished, without resuming it.
+  ~FrameScheduler() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      quit_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& thread : workers_) thread.join();
+
+    for (const Waiter& waiter : waiting_) {
+      if (waiter.fence) engine_->destroy(waiter.fence);
+      waiter.handle.destroy();
+    }
+    for (std::coroutine_handle<> handle : ready_) handle.destroy();
+  }
+
+  // Takes over 'task', which starts in the next RunFrame().
+  void Spawn(FrameTask task) {
+    if (!task.handle_) return;
+    waiting_.push_back(
+        {std::exchange(task.handle_, nullptr), WaitKind::kFrame});
+    ++tasks_;
+  }
+
+  // Resumes coroutines whose awaits are satisfied, within budget(). At least
+  // one is resumed if any are ready, so every coroutine makes progress.
+  void RunFrame() {
+    const ScopedProfileZone zone("FrameScheduler::RunFrame");
+    const Clock::time_point start = Clock::now();
+
+    // Checked in the order they were awaited, which ready_ keeps.
+    size_t kept = 0;
+    for (Waiter& waiter : waiting_) {
+      if (Poll(waiter, start)) {
+        ready_.push_back(waiter.handle);
+      } else {
+        waiting_[kept++] = waiter;
+      }
+    }
+    waiting_.resize(kept);
+
+    // Resuming appends to waiting_, not ready_, so nothing runs twice.
+    stats_ = {};
+    size_t resumed = 0;
+    while (resumed < ready_.size() &&
+           (resumed == 0 || Clock::now() - start < budget_)) {
+      const std::coroutine_handle<> handle = ready_[resumed++];
+      handle.resume();
+      if (handle.done()) {
+        handle.destroy();
+        --tasks_;
+        ++stats_.finished;
+      }
+    }
+    ready_.erase(ready_.begin(), ready_.begin() + resumed);
+
+    stats_.resumed = uint32_t(resumed);
+    stats_.deferred = uint32_t(ready_.size());
+    stats_.waiting = uint32_t(waiting_.size());
+    stats_.tasks = uint32_t(tasks_);
+    stats_.ms = std::chrono::duration<double, std::milli>(Clock::now() - start)
+                    .count();
+  }
+
+ private:
+  enum class WaitKind : uint8_t {
+    kFrame,
+    kFence,
+    kWorker,
+    kDeadline,
+  };
+
+  struct Waiter {
+    std::coroutine_handle<> handle;
+    WaitKind kind;
+    filament::Fence* fence = nullptr;         // kFence. Owned.
+    const std::atomic<bool>* done = nullptr;  // kWorker. In the awaiter.
+    Clock::time_point deadline = {};          // kDeadline.
+  };
+
+  // What NextFrame(), GpuFence(), Until(...) and Delay(...) return.
+  struct Awaiter {
+    FrameScheduler* scheduler;
+    Waiter waiter;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      waiter.handle = handle;
+      scheduler->waiting_.push_back(waiter);
+    }
+    void await_resume() const noexcept {}
+  };
+
+  // What Worker(...) returns. Lives in the awaiting coroutine's frame until
+  // the job is done, so the job can point at it.
+  template <typename F>
+  struct WorkerAwaiter {
+    FrameScheduler* scheduler;
+    F fn;
+    std::atomic<bool> done = false;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      scheduler->waiting_.push_back(
+          {handle, WaitKind::kWorker, nullptr, &done});
+      scheduler->Post({&Run, this});
+    }
+    void await_resume() const noexcept {}
+
+    static void Run(void* awaiter) {
+      WorkerAwaiter& self = *(WorkerAwaiter*)awaiter;
+      self.fn();
+      self.done.store(true, std::memory_order_release);
+    }
+  };
+
+ public:
+  // co_await resumes in the next RunFrame().
+  Awaiter NextFrame() { return {this, {{}, WaitKind::kFrame}}; }
+
+  // co_await resumes once the engine has finished every command issued
+  // before the call. The fence is polled, never waited on.
+  Awaiter GpuFence() {
+    return {this, {{}, WaitKind::kFence, engine_->createFence()}};
+  }
+
+  // co_await resumes once fn() has returned on a worker thread. fn() must not
+  // use the engine or ImGui; results can go to the coroutine's locals.
+  template <typename F>
+  WorkerAwaiter<std::decay_t<F>> Worker(F&& fn) {
+    return {this, std::forward<F>(fn)};
+  }
+
+  // co_await resumes in the first RunFrame() at or after 'deadline'.
+  Awaiter Until(Clock::time_point deadline) {
+    return {this, {{}, WaitKind::kDeadline, nullptr, nullptr, deadline}};
+  }
+  Awaiter Delay(Clock::duration duration) {
+    return Until(Clock::now() + duration);
+  }
+
+  Clock::duration budget() const { return budget_; }
+  void set_budget(Clock::duration budget) { budget_ = budget; }
+
+  const FrameSchedulerStats& stats() const { return stats_; }
+
+ private:
+  struct Job {
+    void (*run)(void* awaiter);
+    void* awaiter;
+  };
+
+  // Whether 'waiter' can resume. Destroys its fence once signaled.
+  bool Poll(Waiter& waiter, Clock::time_point now) {
+    switch (waiter.kind) {
+      case WaitKind::kFrame:
+        return true;
+      case WaitKind::kFence:
+        // Errors won't clear either, so only a timeout keeps waiting.
+        if (waiter.fence->wait(filament::Fence::Mode::DONT_FLUSH, 0) ==
+            filament::backend::FenceStatus::TIMEOUT_EXPIRED) {
+          return false;
+        }
+        engine_->destroy(waiter.fence);
+        waiter.fence = nullptr;
+        return true;
+      case WaitKind::kWorker:
+        return waiter.done->load(std::memory_order_acquire);
+      case WaitKind::kDeadline:
+        return now >= waiter.deadline;
+    }
+    return true;
+  }
+
+  void Post(Job job) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back(job);
+    }
+    if (workers_.empty()) {
+      for (int i = 0; i < std::max(1, worker_count_); ++i) {
+        workers_.emplace_back([this] { WorkerLoop(); });
+      }
+    }
+    wake_.notify_one();
+  }
+
+  // Runs jobs in the order posted, until quit_ and none are left.
+  void WorkerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      wake_.wait(lock, [this] { return quit_ || next_job_ < jobs_.size(); });
+      if (next_job_ == jobs_.size()) return;
+      const Job job = jobs_[next_job_++];
+      if (next_job_ == jobs_.size()) {
+        jobs_.clear();
+        next_job_ = 0;
+      }
+
+      lock.unlock();
+      job.run(job.awaiter);
+      lock.lock();
+    }
+  }
+
+  filament::Engine* engine_ = nullptr;  // Not owned.
+  Clock::duration budget_;
+
+  // Suspended coroutines: on something not yet ready, in the order they
+  // awaited it, and ready but not yet resumed, in the order they got ready.
+  // Both keep their capacity, so steady frames don't allocate.
+  std::vector<Waiter> waiting_;
+  std::vector<std::coroutine_handle<>> ready_;
+  size_t tasks_ = 0;
+
+  FrameSchedulerStats stats_;
+
+  const int worker_count_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable wake_;  // Signals a new job, or quit_.
+  std::vector<Job> jobs_;         // Queued from next_job_ on.
+  size_t next_job_ = 0;
+  bool quit_ = false;
+};
+
+}  // namespace filament_glfw_imgui
+
+#endif  // FILAMENT_GLFW_IMGUI_FRAME_SCHEDULER_H_
@@ -63,8 +63,11 @@
 #include <GLFW/glfw3.h>
 
 #include <cstdint>
+#include <limits>
 #include <vector>
 
+#include "filament_glfw_imgui/config.h"
+
 namespace glfw_input {
 
 static constexpr double kDoubleInf = std::numeric_limits<double>::infinity();
@@ -193,7 +196,14 @@ class KeyboardState {
 
 // Input state, usually provided every frame.
 struct State {
-  State() : keys(GLFW_KEY_LAST), all_keys(GLFW_KEY_LAST) {}
+  // Event lists start with room for a busy frame; clearing keeps capacity, so
+  // steady-state frames don't allocate.
+  static constexpr size_t kReservedEvents = 256;
+
+  State() : keys(GLFW_KEY_LAST), all_keys(GLFW_KEY_LAST) {
+    events.reserve(kReservedEvents);
+    all_events.reserve(kReservedEvents);
+  }
 
   // Incremented every time a new event is received.
   // If I've done the math right, at 120 frames/sec and 10 events/frame, this
@@ -356,8 +366,28 @@ void OnGlfwChar(GLFWwindow* window, unsigned int c) {
   handler->OnGlfwChar(window, c);
 }
 
+template <typename HandlerT>
+void GlfwAttachInputCallbacksAndSetWindowUserPointer(const HandlerT& handler,
+                                                     GLFWwindow& window) {
+  glfwSetWindowUserPointer(&window, (void*)&handler);
+  glfwSetWindowFocusCallback(&window, glfw_input::OnGlfwWindowFocus<HandlerT>);
+  glfwSetCursorEnterCallback(&window, glfw_input::OnGlfwCursorEnter<HandlerT>);
+  glfwSetCursorPosCallback(&window, glfw_input::OnGlfwCursorPos<HandlerT>);
+  glfwSetMouseButtonCallback(&window, glfw_input::OnGlfwMouseButton<HandlerT>);
+  glfwSetScrollCallback(&window, glfw_input::OnGlfwScroll<HandlerT>);
+  glfwSetKeyCallback(&window, glfw_input::OnGlfwKey<HandlerT>);
+  glfwSetCharCallback(&window, glfw_input::OnGlfwChar<HandlerT>);
+}
+
+#if defined(FILAMENT_GLFW_IMGUI_COMPILED)
+// Instantiated in filament_glfw_imgui.cpp; see config.h.
+extern template class Handler<NoOpHandler>;
+#endif
+
 }  // namespace glfw_input
 
+#if FILAMENT_GLFW_IMGUI_WITH_IMPL
 #include "filament_glfw_imgui/glfw_input_impl.h"
+#endif
 
 #endif  // GLFW_INPUT_H_
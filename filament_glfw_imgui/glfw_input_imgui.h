@@ -30,6 +30,9 @@
 #include <imgui/backends/imgui_impl_glfw.h>
 #include <imgui/imgui.h>
 
+#include "filament_glfw_imgui/config.h"
+#include "filament_glfw_imgui/glfw_input.h"
+
 namespace glfw_input {
 
 // Sends all input events to the ImGui GLFW backend.
@@ -71,6 +74,11 @@ class ToImGui {
 // 'glfw_input::Input<glfw_input::ToImGui>'
 using WithImGui = Handler<ToImGui>;
 
+#if defined(FILAMENT_GLFW_IMGUI_COMPILED)
+// Instantiated in filament_glfw_imgui.cpp; see config.h.
+extern template class Handler<ToImGui>;
+#endif
+
 }  // namespace glfw_input
 
 #endif  // GLFW_INPUT_IMGUI_H_
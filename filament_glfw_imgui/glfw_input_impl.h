@@ -34,6 +34,8 @@ void ClearBits(Mask& mask, int bits) {
   mask.value &= ~bits;
 }
 
+// Always inline, unlike Handler's members: this file is also included outside
+// filament_glfw_imgui.cpp by handlers with other children (see config.h).
 inline int MouseButtonMask::ButtonToBits(int glfw_mouse_button) {
   return 1 << glfw_mouse_button;
 }
@@ -68,17 +70,19 @@ inline int KeyboardState::Axis(int32_t key_minus, int32_t key_plus) const {
 }
 
 template <typename Child>
-inline Handler<Child>::Handler(Child&& child) : child_(child) {}
+FILAMENT_GLFW_IMGUI_INLINE Handler<Child>::Handler(Child&& child)
+    : child_(child) {}
 
 template <typename Child>
-inline void Handler<Child>::ClearEvents() {
+FILAMENT_GLFW_IMGUI_INLINE void Handler<Child>::ClearEvents() {
   child_.ClearEvents();
   state_.events.clear();
   state_.all_events.clear();
 }
 
 template <typename Child>
-inline bool Handler<Child>::OnGlfwWindowFocus(GLFWwindow* window, int focused) {
+FILAMENT_GLFW_IMGUI_INLINE bool Handler<Child>::OnGlfwWindowFocus(
+    GLFWwindow* window, int focused) {
   const bool child_wants_capture = child_.OnGlfwWindowFocus(window, focused);
 
   ++state_.event_index;
@@ -99,7 +103,8 @@ inline bool Handler<Child>::OnGlfwWindowFocus(GLFWwindow* window, int focused) {
 }
 
 template <typename Child>
-inline bool Handler<Child>::OnGlfwCursorEnter(GLFWwindow* window, int entered) {
+FILAMENT_GLFW_IMGUI_INLINE bool Handler<Child>::OnGlfwCursorEnter(
+    GLFWwindow* window, int entered) {
   const bool child_wants_capture = child_.OnGlfwCursorEnter(window, entered);
 
   ++state_.event_index;
@@ -115,8 +120,8 @@ inline bool Handler<Child>::OnGlfwCursorEnter(GLFWwindow* window, int entered) {
 }
 
 template <typename Child>
-inline bool Handler<Child>::OnGlfwCursorPos(GLFWwindow* window, double x,
-                                            double y) {
+FILAMENT_GLFW_IMGUI_INLINE bool Handler<Child>::OnGlfwCursorPos(
+    GLFWwindow* window, double x, double y) {
   const bool child_wants_capture = child_.OnGlfwCursorPos(window, x, y);
 
   ++state_.event_index;
@@ -142,8 +147,8 @@ inline bool Handler<Child>::OnGlfwCursorPos(GLFWwindow* window, double x,
 }
 
 template <typename Child>
-inline bool Handler<Child>::OnGlfwMouseButton(GLFWwindow* window, int button,
-                                              int action, int mods) {
+FILAMENT_GLFW_IMGUI_INLINE bool Handler<Child>::OnGlfwMouseButton(
+    GLFWwindow* window, int button, int action, int mods) {
   const bool child_wants_capture =
       child_.OnGlfwMouseButton(window, button, action, mods);
 
@@ -166,8 +171,9 @@ inline bool Handler<Child>::OnGlfwMouseButton(GLFWwindow* window, int button,
 }
 
 template <typename Child>
-inline bool Handler<Child>::OnGlfwScroll(GLFWwindow* window, double xoffset,
-                                         double yoffset) {
+FILAMENT_GLFW_IMGUI_INLINE bool Handler<Child>::OnGlfwScroll(GLFWwindow* window,
+                                                             double xoffset,
+                                                             double yoffset) {
   const bool child_wants_capture =
       child_.OnGlfwScroll(window, xoffset, yoffset);
 
@@ -184,8 +190,8 @@ inline bool Handler<Child>::OnGlfwScroll(GLFWwindow* window, double xoffset,
 }
 
 template <typename Child>
-inline bool Handler<Child>::OnGlfwKey(GLFWwindow* window, int key, int scancode,
-                                      int action, int mods) {
+FILAMENT_GLFW_IMGUI_INLINE bool Handler<Child>::OnGlfwKey(
+    GLFWwindow* window, int key, int scancode, int action, int mods) {
   const bool child_wants_capture =
       child_.OnGlfwKey(window, key, scancode, action, mods);
 
@@ -247,7 +253,8 @@ inline bool Handler<Child>::OnGlfwKey(GLFWwindow* window, int key, int scancode,
 }
 
 template <typename Child>
-inline bool Handler<Child>::OnGlfwChar(GLFWwindow* window, unsigned int c) {
+FILAMENT_GLFW_IMGUI_INLINE bool Handler<Child>::OnGlfwChar(GLFWwindow* window,
+                                                           unsigned int c) {
   const bool child_wants_capture = child_.OnGlfwChar(window, c);
 
   ++state_.event_index;
@@ -262,19 +269,6 @@ inline bool Handler<Child>::OnGlfwChar(GLFWwindow* window, unsigned int c) {
   return child_wants_capture;
 }
 
-template <typename HandlerT>
-void GlfwAttachInputCallbacksAndSetWindowUserPointer(const HandlerT& handler,
-                                                     GLFWwindow& window) {
-  glfwSetWindowUserPointer(&window, (void*)&handler);
-  glfwSetWindowFocusCallback(&window, glfw_input::OnGlfwWindowFocus<HandlerT>);
-  glfwSetCursorEnterCallback(&window, glfw_input::OnGlfwCursorEnter<HandlerT>);
-  glfwSetCursorPosCallback(&window, glfw_input::OnGlfwCursorPos<HandlerT>);
-  glfwSetMouseButtonCallback(&window, glfw_input::OnGlfwMouseButton<HandlerT>);
-  glfwSetScrollCallback(&window, glfw_input::OnGlfwScroll<HandlerT>);
-  glfwSetKeyCallback(&window, glfw_input::OnGlfwKey<HandlerT>);
-  glfwSetCharCallback(&window, glfw_input::OnGlfwChar<HandlerT>);
-}
-
 }  // namespace glfw_input
 
 #endif  // GLFW_INPUT_IMPL_H_
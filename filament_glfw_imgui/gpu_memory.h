@@ -0,0 +1,241 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Estimated GPU memory of the textures and buffers we create, by subsystem.
+//
+// Filament doesn't report what its driver allocates, so creators record what
+// they asked for: texels x bytes per texel for textures (with every mip level
+// and face), and capacity x element size for buffers. Drivers add alignment
+// and padding, so treat the numbers as a lower bound.
+//
+// NOTE: this file isn't part of the google/filament release. It is part of
+// ambrusc/filament-glfw-imgui.
+//
+// Usage:
+//
+//   using namespace filament_glfw_imgui;
+//   Texture* tex = Texture::Builder()...build(*engine);
+//   TrackTexture(tex, GpuMemoryTag::kEnvironment);
+//   ...
+//   DestroyTracked(*engine, tex);  // Or UntrackGpuMemory(tex), then destroy.
+//
+//   // Anywhere, e.g. once per frame; it only reads a few atomics:
+//   ShowGpuMemoryWindow();  // From gpu_memory_imgui.h.
+//
+
+#ifndef FILAMENT_GLFW_IMGUI_GPU_MEMORY_H_
+#define FILAMENT_GLFW_IMGUI_GPU_MEMORY_H_
+
+#include <filament/Engine.h>
+#include <filament/Texture.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+namespace filament_glfw_imgui {
+
+enum class GpuMemoryTag : uint8_t {
+  kFontAtlas,
+  kUiBuffers,
+  kEnvironment,  // Skyboxes, reflection cubes, and equirects being filtered.
+  kVisuals,      // Vertex and index buffers of fs visuals and pools.
+  kCount,
+};
+
+inline const char* GpuMemoryTagName(GpuMemoryTag tag) {
+  constexpr const char* kNames[] = {"font atlas", "ui buffers", "environment",
+                                    "visuals"};
+  return tag < GpuMemoryTag::kCount ? kNames[size_t(tag)] : "?";
+}
+
+// Current and peak bytes, and resource count, for one tag (or all of them).
+struct GpuMemoryUsage {
+  size_t bytes = 0;
+  size_t peak_bytes = 0;
+  size_t resources = 0;
+};
+
+// Process-wide, since resources are created and destroyed all over the place.
+// Track/Untrack take a lock, as they're rare (resource creation already costs
+// far more); reading usage is lock-free.
+class GpuMemory {
+ public:
+  static GpuMemory& Get() {
+    static GpuMemory instance;
+    return instance;
+  }
+
+  // Records 'bytes' for 'resource' under 'tag'. Tracking a resource again
+  // replaces its previous record.
+  void Track(const void* resource, GpuMemoryTag tag, size_t bytes) {
+    if (!resource || tag >= GpuMemoryTag::kCount) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto [it, added] = records_.try_emplace(resource, Record{tag, bytes});
+    if (!added) {
+      Subtract(it->second);
+      it->second = {tag, bytes};
+    }
+    Add(it->second);
+  }
+
+  // Forgets 'resource'. Unknown resources and nullptr are ignored.
+  void Untrack(const void* resource) {
+    if (!resource) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = records_.find(resource);
+    if (it == records_.end()) return;
+    Subtract(it->second);
+    records_.erase(it);
+  }
+
+  GpuMemoryUsage usage(GpuMemoryTag tag) const {
+    const Counters& counters = by_tag_[size_t(tag)];
+    return {counters.bytes.load(std::memory_order_relaxed),
+            counters.peak_bytes.load(std::memory_order_relaxed),
+            counters.resources.load(std::memory_order_relaxed)};
+  }
+
+  // All tags together. The peak is of the total, not a sum of peaks.
+  GpuMemoryUsage total() const {
+    return {total_.bytes.load(std::memory_order_relaxed),
+            total_.peak_bytes.load(std::memory_order_relaxed),
+            total_.resources.load(std::memory_order_relaxed)};
+  }
+
+  // Resets peaks to current values, e.g. to measure one scene.
+  void ResetPeaks() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Counters& counters : by_tag_) {
+      counters.peak_bytes.store(counters.bytes.load());
+    }
+    total_.peak_bytes.store(total_.bytes.load());
+  }
+
+ private:
+  struct Record {
+    GpuMemoryTag tag;
+    size_t bytes;
+  };
+
+  struct Counters {
+    std::atomic<size_t> bytes = 0;
+    std::atomic<size_t> peak_bytes = 0;
+    std::atomic<size_t> resources = 0;
+  };
+
+  GpuMemory() = default;
+
+  // Both called with mutex_ held, so plain load/store pairs are enough for
+  // the peaks; the atomics are for lock-free readers.
+  void Add(const Record& record) {
+    for (Counters* counters : {&by_tag_[size_t(record.tag)], &total_}) {
+      const size_t bytes =
+          counters->bytes.fetch_add(record.bytes) + record.bytes;
+      if (bytes > counters->peak_bytes.load()) {
+        counters->peak_bytes.store(bytes);
+      }
+      counters->resources.fetch_add(1);
+    }
+  }
+  void Subtract(const Record& record) {
+    for (Counters* counters : {&by_tag_[size_t(record.tag)], &total_}) {
+      counters->bytes.fetch_sub(record.bytes);
+      counters->resources.fetch_sub(1);
+    }
+  }
+
+  std::mutex mutex_;
+  std::unordered_map<const void*, Record> records_;
+  Counters by_tag_[size_t(GpuMemoryTag::kCount)];
+  Counters total_;
+};
+
+// Bytes per texel of 'format', for uncompressed color and depth formats.
+// 3-component 8- and 16-bit formats are counted padded to 4 components, as
+// most drivers store them.
+inline size_t TexelBytes(filament::Texture::InternalFormat format) {
+  using Format = filament::Texture::InternalFormat;
+  switch (format) {
+    case Format::R8:
+      return 1;
+    case Format::RG8:
+    case Format::R16F:
+      return 2;
+    case Format::RGB8:
+    case Format::RGBA8:
+    case Format::SRGB8_A8:
+    case Format::R11F_G11F_B10F:
+    case Format::RGB10_A2:
+    case Format::RG16F:
+    case Format::R32F:
+    case Format::DEPTH24:
+    case Format::DEPTH32F:
+    case Format::DEPTH24_STENCIL8:
+      return 4;
+    case Format::RGB16F:
+    case Format::RGBA16F:
+    case Format::RG32F:
+      return 8;
+    case Format::RGB32F:
+      return 12;
+    case Format::RGBA32F:
+      return 16;
+    default:
+      return 4;
+  }
+}
+
+// Every level (and face) of 'texture'.
+inline size_t EstimateTextureBytes(const filament::Texture& texture) {
+  const size_t faces =
+      texture.getTarget() == filament::Texture::Sampler::SAMPLER_CUBEMAP ? 6
+                                                                          : 1;
+  size_t texels = 0;
+  for (size_t level = 0; level < texture.getLevels(); ++level) {
+    texels += texture.getWidth(level) * texture.getHeight(level) *
+              texture.getDepth(level);
+  }
+  return texels * faces * TexelBytes(texture.getFormat());
+}
+
+inline void TrackTexture(const filament::Texture* texture, GpuMemoryTag tag) {
+  if (!texture) return;
+  GpuMemory::Get().Track(texture, tag, EstimateTextureBytes(*texture));
+}
+
+inline void TrackBuffer(const void* buffer, GpuMemoryTag tag, size_t bytes) {
+  GpuMemory::Get().Track(buffer, tag, bytes);
+}
+
+inline void UntrackGpuMemory(const void* resource) {
+  GpuMemory::Get().Untrack(resource);
+}
+
+// Untracks and destroys 'resource', which may be anything Engine::destroy(...)
+// takes, tracked or not. nullptr is ok.
+template <typename T>
+void DestroyTracked(filament::Engine& engine, T* resource) {
+  UntrackGpuMemory(resource);
+  engine.destroy(resource);
+}
+
+}  // namespace filament_glfw_imgui
+
+#endif  // FILAMENT_GLFW_IMGUI_GPU_MEMORY_H_
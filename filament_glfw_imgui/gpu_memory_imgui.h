@@ -0,0 +1,95 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// An ImGui window showing gpu_memory.h's usage by subsystem.
+//
+// See gpu_memory.h for usage.
+//
+// NOTE: this file isn't part of the google/filament release. It is part of
+// ambrusc/filament-glfw-imgui.
+//
+
+#ifndef FILAMENT_GLFW_IMGUI_GPU_MEMORY_IMGUI_H_
+#define FILAMENT_GLFW_IMGUI_GPU_MEMORY_IMGUI_H_
+
+#include <imgui/imgui.h>
+
+#include <cstdio>
+
+#include "filament_glfw_imgui/gpu_memory.h"
+
+namespace filament_glfw_imgui {
+
+// Writes 'bytes' as B, KiB or MiB into 'text'.
+inline void FormatGpuBytes(size_t bytes, char* text, size_t text_size) {
+  if (bytes < 1024) {
+    snprintf(text, text_size, "%zu B", bytes);
+  } else if (bytes < 1024 * 1024) {
+    snprintf(text, text_size, "%.1f KiB", bytes / 1024.0);
+  } else {
+    snprintf(text, text_size, "%.1f MiB", bytes / (1024.0 * 1024.0));
+  }
+}
+
+// Draws a table of current bytes, peak bytes and resource count per tag, and
+// their totals. Reads only atomics, so it's cheap enough to call every frame.
+//  - 'open', if given, gets a close button, as with ImGui::Begin(...).
+inline void ShowGpuMemoryWindow(bool* open = nullptr) {
+  if (!ImGui::Begin("GPU memory", open, ImGuiWindowFlags_AlwaysAutoResize)) {
+    ImGui::End();
+    return;
+  }
+
+  const GpuMemory& memory = GpuMemory::Get();
+  const auto row = [](const char* name, const GpuMemoryUsage& usage) {
+    char current[32];
+    char peak[32];
+    FormatGpuBytes(usage.bytes, current, sizeof(current));
+    FormatGpuBytes(usage.peak_bytes, peak, sizeof(peak));
+    ImGui::TableNextRow();
+    ImGui::TableNextColumn();
+    ImGui::TextUnformatted(name);
+    ImGui::TableNextColumn();
+    ImGui::TextUnformatted(current);
+    ImGui::TableNextColumn();
+    ImGui::TextUnformatted(peak);
+    ImGui::TableNextColumn();
+    ImGui::Text("%zu", usage.resources);
+  };
+
+  constexpr ImGuiTableFlags kTableFlags =
+      ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit;
+  if (ImGui::BeginTable("gpu_memory", 4, kTableFlags)) {
+    ImGui::TableSetupColumn("subsystem");
+    ImGui::TableSetupColumn("current");
+    ImGui::TableSetupColumn("peak");
+    ImGui::TableSetupColumn("count");
+    ImGui::TableHeadersRow();
+    for (size_t i = 0; i < size_t(GpuMemoryTag::kCount); ++i) {
+      const GpuMemoryTag tag = GpuMemoryTag(i);
+      row(GpuMemoryTagName(tag), memory.usage(tag));
+    }
+    row("total", memory.total());
+    ImGui::EndTable();
+  }
+  if (ImGui::Button("reset peaks")) GpuMemory::Get().ResetPeaks();
+  ImGui::End();
+}
+
+}  // namespace filament_glfw_imgui
+
+#endif  // FILAMENT_GLFW_IMGUI_GPU_MEMORY_IMGUI_H_
@@ -0,0 +1,243 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Size-class pools for ImGui's allocations.
+//
+// NOTE: this file isn't part of the google/filament release. It is part of
+// ambrusc/filament-glfw-imgui.
+//
+// ImGui allocates mostly ImVector storage, which grows by half its capacity at
+// a time, and is freed and regrown as draw lists are rebuilt every frame. Here
+// each size is rounded up to a class (16-byte steps up to 64 bytes, then four
+// classes per power of two, up to kMaxPooledSize), and freed blocks are kept
+// on their class's free list for the next allocation of that class. Pools
+// grow a slab at a time and are only returned to the system when the
+// allocator is destroyed, so once warmed up, ImGui frames don't call malloc
+// at all: they neither contend with other threads for it nor fragment its
+// heap. Larger blocks go to malloc directly.
+//
+// App::Init() installs Process(), and App::PollEvents() ends its frames. Not
+// thread-safe: like ImGui's context, it's used from one thread.
+//
+// ImGui memory can outlive its context: ImGui's demo windows keep buffers in
+// function-local statics, which free them at exit. The pools must still be
+// there then, and installed, so those blocks don't reach the system's free().
+// Process() is destroyed at exit, after every static constructed later.
+//
+// Usage (without App):
+//
+//   using namespace filament_glfw_imgui;
+//   ImGuiPoolAllocator pools;  // Must outlive the context.
+//   ImGui::SetAllocatorFunctions(ImGuiPoolAllocator::Alloc,
+//                                ImGuiPoolAllocator::Free, &pools);
+//   ImGuiContext* context = ImGui::CreateContext();
+//   ...  // Every frame:
+//   pools.EndFrame();
+//   const uint64_t allocs = pools.stats().frame.allocs;
+//   ...
+//   ImGui::DestroyContext(context);
+//
+
+#ifndef FILAMENT_GLFW_IMGUI_IMGUI_ALLOCATOR_H_
+#define FILAMENT_GLFW_IMGUI_IMGUI_ALLOCATOR_H_
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#include "filament_glfw_imgui/alloc_tracking.h"
+
+namespace filament_glfw_imgui {
+namespace internal {
+
+// Block size classes: 16, 32, 48, 64, then 80, 96, 112, 128, 160, 192, ...
+// Each holds sizes up to its own, which is a multiple of 16.
+constexpr uint32_t PoolSizeClass(size_t bytes) {
+  if (bytes <= 64) return uint32_t((bytes + 15) / 16) - 1;
+  const uint32_t octave = uint32_t(std::bit_width(bytes - 1)) - 1;
+  const size_t step = size_t(1) << (octave - 2);
+  const size_t steps = (bytes + step - 1) / step;  // 5 to 8.
+  return 4 + (octave - 6) * 4 + uint32_t(steps - 5);
+}
+
+constexpr size_t PoolClassSize(uint32_t size_class) {
+  if (size_class < 4) return (size_class + 1) * 16;
+  const uint32_t octave = (size_class - 4) / 4 + 6;
+  return ((size_class - 4) % 4 + 5) * (size_t(1) << (octave - 2));
+}
+
+}  // namespace internal
+
+struct ImGuiAllocCounts {
+  uint64_t allocs = 0;
+  uint64_t frees = 0;
+  uint64_t bytes = 0;  // Requested by 'allocs'.
+
+  // Allocations that called malloc: new slabs, and blocks too large to pool.
+  uint64_t system_allocs = 0;
+};
+
+struct ImGuiAllocStats {
+  ImGuiAllocCounts frame;  // The last complete frame.
+  ImGuiAllocCounts total;  // Since the allocator was created.
+
+  size_t live_bytes = 0;  // Requested, and not yet freed.
+  size_t peak_live_bytes = 0;
+  size_t reserved_bytes = 0;  // Taken from malloc: slabs and large blocks.
+};
+
+class ImGuiPoolAllocator {
+ public:
+  // Requests up to this size are pooled.
+  static constexpr size_t kMaxPooledSize = size_t(1) << 20;
+
+  // Pools grow by at least this much at a time.
+  static constexpr size_t kSlabSize = size_t(64) << 10;
+
+  ImGuiPoolAllocator() = default;
+
+  // ImGui's allocations point into the pools, so they can't move.
+  ImGuiPoolAllocator(const ImGuiPoolAllocator&) = delete;
+  ImGuiPoolAllocator& operator=(const ImGuiPoolAllocator&) = delete;
+
+  // The allocator that lives until exit; see above.
+  static ImGuiPoolAllocator& Process() {
+    static ImGuiPoolAllocator pools;
+    return pools;
+  }
+
+  // Frees every slab, so everything ImGui allocated must be freed already.
+  ~ImGuiPoolAllocator() {
+    while (slabs_) {
+      Slab* const next = slabs_->next;
+      AllocTracker::ImGuiFree(slabs_, nullptr);
+      slabs_ = next;
+    }
+  }
+
+  // ImGui::SetAllocatorFunctions(...) arguments; 'user' is the allocator.
+  static void* Alloc(size_t size, void* user) {
+    return ((ImGuiPoolAllocator*)user)->Allocate(size);
+  }
+  static void Free(void* ptr, void* user) {
+    if (ptr) ((ImGuiPoolAllocator*)user)->Deallocate(ptr);
+  }
+
+  void* Allocate(size_t size) {
+    ++frame_.allocs;
+    frame_.bytes += size;
+    stats_.live_bytes += size;
+    stats_.peak_live_bytes =
+        std::max(stats_.peak_live_bytes, stats_.live_bytes);
+
+    Header* header;
+    if (size > kMaxPooledSize) {
+      ++frame_.system_allocs;
+      header = (Header*)AllocTracker::ImGuiAlloc(sizeof(Header) + size,
+                                                 nullptr);
+      if (!header) return nullptr;
+      stats_.reserved_bytes += sizeof(Header) + size;
+      header->size_class = kLarge;
+    } else {
+      const uint32_t size_class =
+          internal::PoolSizeClass(sizeof(Header) + size);
+      if (!free_[size_class] && !Refill(size_class)) return nullptr;
+      header = free_[size_class];
+      free_[size_class] = header->next;
+      header->size_class = size_class;
+    }
+    header->size = size;
+    return header + 1;
+  }
+
+  void Deallocate(void* ptr) {
+    Header* const header = (Header*)ptr - 1;
+    ++frame_.frees;
+    stats_.live_bytes -= header->size;
+    if (header->size_class == kLarge) {
+      stats_.reserved_bytes -= sizeof(Header) + header->size;
+      AllocTracker::ImGuiFree(header, nullptr);
+      return;
+    }
+    header->next = free_[header->size_class];
+    free_[header->size_class] = header;
+  }
+
+  // Moves this frame's counts into stats().frame and stats().total.
+  void EndFrame() {
+    stats_.frame = frame_;
+    stats_.total.allocs += frame_.allocs;
+    stats_.total.frees += frame_.frees;
+    stats_.total.bytes += frame_.bytes;
+    stats_.total.system_allocs += frame_.system_allocs;
+    frame_ = {};
+  }
+
+  const ImGuiAllocStats& stats() const { return stats_; }
+
+ private:
+  // Precedes every block; keeps blocks 16-byte aligned, as malloc's are.
+  struct alignas(16) Header {
+    union {
+      Header* next;  // While on a free list.
+      size_t size;   // While allocated: the requested size.
+    };
+    uint32_t size_class;
+  };
+  static_assert(sizeof(Header) == 16);
+
+  struct alignas(16) Slab {
+    Slab* next;
+  };
+
+  static constexpr uint32_t kLarge = ~0u;
+
+  static constexpr uint32_t kClassCount =
+      internal::PoolSizeClass(sizeof(Header) + kMaxPooledSize) + 1;
+
+  // Adds a slab of blocks of 'size_class' to its free list.
+  bool Refill(uint32_t size_class) {
+    const size_t block = internal::PoolClassSize(size_class);
+    const size_t count = std::max<size_t>(1, kSlabSize / block);
+    const size_t bytes = sizeof(Slab) + count * block;
+    Slab* const slab = (Slab*)AllocTracker::ImGuiAlloc(bytes, nullptr);
+    if (!slab) return false;
+    ++frame_.system_allocs;
+    stats_.reserved_bytes += bytes;
+    slab->next = slabs_;
+    slabs_ = slab;
+
+    uint8_t* const blocks = (uint8_t*)(slab + 1);
+    for (size_t i = count; i-- > 0;) {
+      Header* const header = (Header*)(blocks + i * block);
+      header->next = free_[size_class];
+      free_[size_class] = header;
+    }
+    return true;
+  }
+
+  Header* free_[kClassCount] = {};
+  Slab* slabs_ = nullptr;
+
+  ImGuiAllocCounts frame_;  // Since the last EndFrame().
+  ImGuiAllocStats stats_;
+};
+
+}  // namespace filament_glfw_imgui
+
+#endif  // FILAMENT_GLFW_IMGUI_IMGUI_ALLOCATOR_H_
@@ -0,0 +1,200 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// A logger that never blocks the calling thread.
+//
+// NOTE: this file isn't part of the google/filament release. It is part of
+// ambrusc/filament-glfw-imgui.
+//
+// Log(...) formats printf-style straight into a fixed-size slot of a bounded,
+// lock-free ring, and a background thread writes the slots to an ostream. The
+// calling thread never waits on I/O, a lock, or the heap: if the ring is full
+// the message is dropped and counted instead, and too-long messages are cut.
+//
+// Usage:
+//
+//   using namespace filament_glfw_imgui;
+//   Logger& log = Logger::Default();  // Writes to std::cout.
+//   log.Log(LogLevel::kInfo, "loaded %s in %.1f ms", path, ms);
+//
+//   // Messages that could repeat every frame should be rate limited. Each
+//   // LogRateLimit is one "message", usually a function-local static:
+//   static LogRateLimit limit;  // 1 message per second by default.
+//   log.Log(limit, LogLevel::kWarning, "font atlas isn't built");
+//
+//   log.Flush();  // Blocks until everything logged so far is written.
+//
+
+#ifndef FILAMENT_GLFW_IMGUI_LOGGER_H_
+#define FILAMENT_GLFW_IMGUI_LOGGER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <thread>
+
+#include "filament_glfw_imgui/config.h"
+
+namespace filament_glfw_imgui {
+
+enum class LogLevel : uint8_t {
+  kDebug,
+  kInfo,
+  kWarning,
+  kError,
+  kOff,  // As a minimum level, silences everything.
+};
+
+inline const char* LogLevelName(LogLevel level) {
+  constexpr const char* kNames[] = {"debug", "info", "warning", "error"};
+  return level < LogLevel::kOff ? kNames[size_t(level)] : "?";
+}
+
+// Allows up to 'burst' messages per 'interval'. Safe to share between
+// threads; under contention it may let a message more or less through.
+class LogRateLimit {
+ public:
+  explicit LogRateLimit(
+      uint32_t burst = 1,
+      std::chrono::steady_clock::duration interval = std::chrono::seconds(1))
+      : burst_(burst), interval_(interval.count()) {}
+
+  LogRateLimit(const LogRateLimit&) = delete;
+  LogRateLimit& operator=(const LogRateLimit&) = delete;
+
+  // Returns 'true' if a message may go out at 'now', and sets 'suppressed' to
+  // the number of messages held back since the last one that went out.
+  bool Allow(std::chrono::steady_clock::time_point now, uint32_t& suppressed) {
+    const int64_t ticks = now.time_since_epoch().count();
+    int64_t start = window_start_.load(std::memory_order_relaxed);
+    if (ticks - start >= interval_ &&
+        window_start_.compare_exchange_strong(start, ticks)) {
+      count_.store(0, std::memory_order_relaxed);
+    }
+    if (count_.fetch_add(1, std::memory_order_relaxed) < burst_) {
+      suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+      return true;
+    }
+    suppressed_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+ private:
+  const uint32_t burst_;
+  const int64_t interval_;  // In steady_clock ticks.
+  std::atomic<int64_t> window_start_ = INT64_MIN / 2;
+  std::atomic<uint32_t> count_ = 0;
+  std::atomic<uint32_t> suppressed_ = 0;
+};
+
+struct LoggerOptions {
+  LogLevel min_level = LogLevel::kInfo;
+
+  // Rounded up to a power of two. Each slot holds one message of up to
+  // Logger::kMaxMessage bytes.
+  size_t capacity = 256;
+};
+
+class Logger {
+ public:
+  static constexpr size_t kMaxMessage = 240;
+
+  // Starts the writer thread.
+  //  - 'sink' must outlive this class, or if null, messages are discarded.
+  explicit Logger(std::ostream* sink, const LoggerOptions& options = {});
+
+  Logger(const Logger&) = delete;
+  Logger& operator=(const Logger&) = delete;
+
+  // Writes everything still queued, then stops the writer thread.
+  ~Logger();
+
+  // Process-wide logger writing to std::cout, for code without one passed in.
+  static Logger& Default() {
+    static Logger logger(&std::cout);
+    return logger;
+  }
+
+  // Queues a message, unless it's below min_level() or the ring is full.
+  // Returns 'true' if it was queued.
+  bool Log(LogLevel level, const char* format, ...)
+      __attribute__((format(printf, 3, 4)));
+
+  // As above, but also drops the message if 'limit' doesn't allow it. The
+  // next message that goes out says how many were suppressed.
+  bool Log(LogRateLimit& limit, LogLevel level, const char* format, ...)
+      __attribute__((format(printf, 4, 5)));
+
+  // Blocks until every message queued before the call has been written and
+  // the sink flushed. Meant for exit paths and tests, not for frames.
+  void Flush();
+
+  LogLevel min_level() const { return min_level_.load(); }
+  void set_min_level(LogLevel level) { min_level_.store(level); }
+  bool enabled(LogLevel level) const {
+    return level >= min_level_.load(std::memory_order_relaxed) &&
+           level < LogLevel::kOff;
+  }
+
+  // Messages dropped because the ring was full.
+  uint64_t dropped() const { return dropped_.load(); }
+
+ private:
+  struct Slot {
+    // Vyukov's bounded-queue sequence: == position when free for a producer,
+    // position + 1 once written, position + capacity once read.
+    std::atomic<uint64_t> sequence;
+    LogLevel level;
+    uint32_t suppressed;
+    double seconds;  // Since the logger started.
+    char text[kMaxMessage];
+  };
+
+  bool Push(LogLevel level, uint32_t suppressed, const char* format,
+            va_list args);
+  void Drain();
+
+  std::ostream* sink_ = nullptr;  // Not owned.
+  std::atomic<LogLevel> min_level_;
+  const std::chrono::steady_clock::time_point start_;
+
+  std::unique_ptr<Slot[]> slots_;
+  size_t mask_ = 0;
+
+  // Producers claim positions from head_; written_ is the writer thread's
+  // read position, published for Flush().
+  alignas(64) std::atomic<uint64_t> head_ = 0;
+  alignas(64) std::atomic<uint64_t> written_ = 0;
+  std::atomic<uint32_t> signal_ = 0;  // Bumped to wake the writer.
+  std::atomic<bool> stop_ = false;
+  std::atomic<uint64_t> dropped_ = 0;
+
+  std::thread writer_;
+};
+
+}  // namespace filament_glfw_imgui
+
+#if FILAMENT_GLFW_IMGUI_WITH_IMPL
+#include "filament_glfw_imgui/logger_impl.h"
+#endif
+
+#endif  // FILAMENT_GLFW_IMGUI_LOGGER_H_
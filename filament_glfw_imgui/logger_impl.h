@@ -0,0 +1,160 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+#ifndef FILAMENT_GLFW_IMGUI_LOGGER_IMPL_H_
+#define FILAMENT_GLFW_IMGUI_LOGGER_IMPL_H_
+
+#include <cstring>
+
+namespace filament_glfw_imgui {
+
+FILAMENT_GLFW_IMGUI_INLINE Logger::Logger(std::ostream* sink,
+                                          const LoggerOptions& options)
+    : sink_(sink),
+      min_level_(options.min_level),
+      start_(std::chrono::steady_clock::now()) {
+  size_t capacity = 1;
+  while (capacity < options.capacity) capacity *= 2;
+  slots_ = std::make_unique<Slot[]>(capacity);
+  mask_ = capacity - 1;
+  for (size_t i = 0; i < capacity; ++i) {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  writer_ = std::thread([this] { Drain(); });
+}
+
+FILAMENT_GLFW_IMGUI_INLINE Logger::~Logger() {
+  stop_.store(true, std::memory_order_release);
+  signal_.fetch_add(1, std::memory_order_release);
+  signal_.notify_one();
+  if (writer_.joinable()) writer_.join();
+}
+
+FILAMENT_GLFW_IMGUI_INLINE bool Logger::Log(LogLevel level, const char* format,
+                                            ...) {
+  if (!enabled(level)) return false;
+  va_list args;
+  va_start(args, format);
+  const bool queued = Push(level, /*suppressed=*/0, format, args);
+  va_end(args);
+  return queued;
+}
+
+FILAMENT_GLFW_IMGUI_INLINE bool Logger::Log(LogRateLimit& limit, LogLevel level,
+                                            const char* format, ...) {
+  if (!enabled(level)) return false;
+  uint32_t suppressed = 0;
+  if (!limit.Allow(std::chrono::steady_clock::now(), suppressed)) return false;
+  va_list args;
+  va_start(args, format);
+  const bool queued = Push(level, suppressed, format, args);
+  va_end(args);
+  return queued;
+}
+
+FILAMENT_GLFW_IMGUI_INLINE void Logger::Flush() {
+  const uint64_t target = head_.load(std::memory_order_acquire);
+  signal_.fetch_add(1, std::memory_order_release);
+  signal_.notify_one();
+  uint64_t written = written_.load(std::memory_order_acquire);
+  while (written < target) {
+    written_.wait(written, std::memory_order_acquire);
+    written = written_.load(std::memory_order_acquire);
+  }
+}
+
+FILAMENT_GLFW_IMGUI_INLINE bool Logger::Push(LogLevel level,
+                                             uint32_t suppressed,
+                                             const char* format, va_list args) {
+  // Claim a slot. A slot whose sequence is behind our position still holds an
+  // unread message from the previous lap, so the ring is full.
+  uint64_t pos = head_.load(std::memory_order_relaxed);
+  Slot* slot = nullptr;
+  for (;;) {
+    slot = &slots_[pos & mask_];
+    const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    const int64_t diff = int64_t(sequence - pos);
+    if (diff == 0) {
+      if (head_.compare_exchange_weak(pos, pos + 1,
+                                      std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    } else {
+      pos = head_.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->level = level;
+  slot->suppressed = suppressed;
+  slot->seconds = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start_)
+                      .count();
+  const int length = std::vsnprintf(slot->text, kMaxMessage, format, args);
+  if (length >= int(kMaxMessage)) {
+    std::memcpy(slot->text + kMaxMessage - 4, "...", 4);
+  } else if (length < 0) {
+    std::snprintf(slot->text, kMaxMessage, "(bad format: %s)", format);
+  }
+
+  slot->sequence.store(pos + 1, std::memory_order_release);
+  signal_.fetch_add(1, std::memory_order_release);
+  signal_.notify_one();
+  return true;
+}
+
+FILAMENT_GLFW_IMGUI_INLINE void Logger::Drain() {
+  uint64_t tail = 0;
+  for (;;) {
+    // Read the signal and stop flag before draining, so that anything pushed
+    // after the drain bumps the signal and ends the wait below.
+    const uint32_t signal = signal_.load(std::memory_order_acquire);
+    const bool stopping = stop_.load(std::memory_order_acquire);
+
+    const uint64_t first = tail;
+    for (;;) {
+      Slot& slot = slots_[tail & mask_];
+      if (slot.sequence.load(std::memory_order_acquire) != tail + 1) break;
+      if (sink_) {
+        char prefix[48];
+        const int n = std::snprintf(prefix, sizeof(prefix), "[%9.3f %s] ",
+                                    slot.seconds, LogLevelName(slot.level));
+        sink_->write(prefix, n);
+        sink_->write(slot.text, std::strlen(slot.text));
+        if (slot.suppressed) {
+          (*sink_) << " (" << slot.suppressed << " similar suppressed)";
+        }
+        sink_->put('\n');
+      }
+      slot.sequence.store(tail + mask_ + 1, std::memory_order_release);
+      ++tail;
+    }
+    if (tail != first) {
+      if (sink_) sink_->flush();
+      written_.store(tail, std::memory_order_release);
+      written_.notify_all();
+    }
+
+    if (stopping) return;
+    signal_.wait(signal, std::memory_order_acquire);
+  }
+}
+
+}  // namespace filament_glfw_imgui
+
+#endif  // FILAMENT_GLFW_IMGUI_LOGGER_IMPL_H_
@@ -0,0 +1,215 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Reference-counted Filament materials, keyed by their package data, so each
+// .filamat is parsed and uploaded once no matter how many users it has.
+//
+// NOTE: this file isn't part of the google/filament release. It is part of
+// ambrusc/filament-glfw-imgui.
+//
+// Usage:
+//
+//   // App::Init() creates one of these; see App::material_cache().
+//   MaterialCache& cache = *app.material_cache();
+//
+//   filament::Material* mat = cache.Acquire(filamat_data, filamat_size);
+//   filament::MaterialInstance* instance = mat->createInstance();
+//   ...
+//   engine->destroy(instance);
+//   cache.Release(mat);  // Destroys 'mat' if this was the last user.
+//
+//   // Or, with a package per backend (e.g. `matc -p desktop -a vulkan`),
+//   // which are smaller and quicker to parse than one for all of them, build
+//   // just the one the engine runs:
+//   const MaterialPackage packages[] = {
+//       {Backend::VULKAN, vulkan_data, vulkan_size},
+//       {Backend::OPENGL, opengl_data, opengl_size}};
+//   filament::Material* mat = cache.Acquire(packages, 2);
+//
+
+#ifndef FILAMENT_GLFW_IMGUI_MATERIAL_CACHE_H_
+#define FILAMENT_GLFW_IMGUI_MATERIAL_CACHE_H_
+
+#include <filament/Engine.h>
+#include <filament/Material.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace filament_glfw_imgui {
+
+// A material compiled for one backend.
+struct MaterialPackage {
+  filament::Engine::Backend backend;
+  const void* data;  // Not owned.
+  size_t size;
+};
+
+// Returns the package for 'backend' in 'packages', or nullptr if there's
+// none. The NOOP backend doesn't run shaders, so it takes the first package.
+inline const MaterialPackage* FindMaterialPackage(
+    filament::Engine::Backend backend, const MaterialPackage* packages,
+    size_t count) {
+  if (count && backend == filament::Engine::Backend::NOOP) return packages;
+  for (size_t i = 0; i < count; ++i) {
+    if (packages[i].backend == backend) return &packages[i];
+  }
+  return nullptr;
+}
+
+class MaterialCache {
+ public:
+  MaterialCache() = default;
+
+  // 'engine' must outlive this class.
+  explicit MaterialCache(filament::Engine* engine) : engine_(engine) {}
+
+  MaterialCache(const MaterialCache&) = delete;
+  MaterialCache& operator=(const MaterialCache&) = delete;
+
+  MaterialCache(MaterialCache&& other) { *this = std::move(other); }
+  MaterialCache& operator=(MaterialCache&& other) {
+    std::swap(engine_, other.engine_);
+    std::swap(entries_, other.entries_);
+    std::swap(builds_, other.builds_);
+    std::swap(hits_, other.hits_);
+    std::swap(build_ms_, other.build_ms_);
+    std::swap(built_bytes_, other.built_bytes_);
+    return *this;
+  }
+
+  // Destroys every material still cached, whether released or not.
+  ~MaterialCache() {
+    if (!engine_) return;
+    for (const Entry& entry : entries_) engine_->destroy(entry.material);
+  }
+
+  // Returns the material built from 'package', building it on first use.
+  //  - Matches on content, so the same .filamat loaded twice (e.g. from file)
+  //    is still shared. 'package' needn't outlive the call: the cache keeps a
+  //    copy of each to compare against.
+  //  - Each address is only hashed and compared the first time it's seen;
+  //    after that, the same address and size find the material right away.
+  //    So while a material is cached, don't reuse the memory its package was
+  //    acquired from for a different package of the same size.
+  //  - Each call must be balanced by a Release(...).
+  filament::Material* Acquire(const void* package, size_t size) {
+    for (Entry& entry : entries_) {
+      if (entry.package.size() != size) continue;
+      for (const void* source : entry.sources) {
+        if (source == package) return Hit(entry);
+      }
+    }
+
+    const uint64_t hash = Hash(package, size);
+    for (Entry& entry : entries_) {
+      if (entry.hash == hash && entry.package.size() == size &&
+          !std::memcmp(entry.package.data(), package, size)) {
+        entry.sources.push_back(package);
+        return Hit(entry);
+      }
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    filament::Material* const material =
+        filament::Material::Builder().package(package, size).build(*engine_);
+    build_ms_ += std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+    if (!material) return nullptr;
+    const uint8_t* const bytes = (const uint8_t*)package;
+    entries_.push_back({{bytes, bytes + size}, {package}, hash, material, 1});
+    ++builds_;
+    built_bytes_ += size;
+    return material;
+  }
+
+  // As above, with the package of 'packages' for the engine's backend; see
+  // FindMaterialPackage(...). Returns nullptr if there's none.
+  //  - Only that package is read, so the others needn't even be paged in.
+  filament::Material* Acquire(const MaterialPackage* packages, size_t count) {
+    const MaterialPackage* const package =
+        FindMaterialPackage(engine_->getBackend(), packages, count);
+    return package ? Acquire(package->data, package->size) : nullptr;
+  }
+
+  // Drops a reference from Acquire(...), and destroys the material when it
+  // was the last one. nullptr is ignored.
+  void Release(const filament::Material* material) {
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      if (entries_[i].material != material) continue;
+      if (--entries_[i].refs == 0) {
+        engine_->destroy(entries_[i].material);
+        entries_[i] = std::move(entries_.back());
+        entries_.pop_back();
+      }
+      return;
+    }
+  }
+
+  // Distinct materials currently alive.
+  size_t size() const { return entries_.size(); }
+
+  // Acquire(...) calls that built a material, and that found one.
+  size_t builds() const { return builds_; }
+  size_t hits() const { return hits_; }
+
+  // Time spent parsing packages and building materials, including failed
+  // builds, and the size of the packages built.
+  double build_ms() const { return build_ms_; }
+  size_t built_bytes() const { return built_bytes_; }
+
+ private:
+  // 64-bit FNV-1a.
+  static uint64_t Hash(const void* data, size_t size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; ++i) {
+      hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+  }
+
+  // Few materials are alive at once, so a flat list beats a map.
+  struct Entry {
+    std::vector<uint8_t> package;      // A copy, as callers' may go away.
+    std::vector<const void*> sources;  // Addresses acquired from.
+    uint64_t hash;
+    filament::Material* material;
+    int refs;
+  };
+
+  // Counts a cache hit on 'entry'.
+  filament::Material* Hit(Entry& entry) {
+    ++entry.refs;
+    ++hits_;
+    return entry.material;
+  }
+
+  filament::Engine* engine_ = nullptr;  // Not owned.
+  std::vector<Entry> entries_;
+  size_t builds_ = 0;
+  size_t hits_ = 0;
+  double build_ms_ = 0;
+  size_t built_bytes_ = 0;
+};
+
+}  // namespace filament_glfw_imgui
+
+#endif  // FILAMENT_GLFW_IMGUI_MATERIAL_CACHE_H_
@@ -0,0 +1,208 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Nested, named timing zones for the last few hundred frames.
+//
+// NOTE: this file isn't part of the google/filament release. It is part of
+// ambrusc/filament-glfw-imgui.
+//
+// Cheap enough to leave on: a zone is two steady_clock reads and a store into
+// storage allocated once, up front. Zones are recorded on ONE thread (the one
+// running the frame loop), which is also the one that may read them, e.g. with
+// the ProfilerWindow from profiler_imgui.h.
+//
+// App::PollEvents() starts each frame, and App's phases are zones already.
+//
+// Usage:
+//
+//   using namespace filament_glfw_imgui;
+//   {
+//     const ScopedProfileZone zone("Physics");  // Nests in any open zone.
+//     ...
+//   }
+//
+//   // Without App, start frames yourself:
+//   Profiler::Get().BeginFrame();
+//
+
+#ifndef FILAMENT_GLFW_IMGUI_PROFILER_H_
+#define FILAMENT_GLFW_IMGUI_PROFILER_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace filament_glfw_imgui {
+
+struct ProfileZone {
+  // Must outlive the profiler, e.g. a string literal. Zones with the same name
+  // under the same parent are merged in aggregates.
+  const char* name = nullptr;
+  uint64_t start_ns = 0;  // Since the profiler was created.
+  uint64_t end_ns = 0;
+  uint32_t depth = 0;  // 0 for zones not nested in another.
+};
+
+struct ProfileFrame {
+  uint64_t number = 0;  // Counts every frame, including unrecorded ones.
+  uint64_t start_ns = 0;
+  uint64_t end_ns = 0;  // The next frame's start.
+
+  // In the order they began; a zone's parent is the closest earlier zone with
+  // a smaller depth.
+  const ProfileZone* zones = nullptr;
+  uint32_t zone_count = 0;
+  uint32_t dropped_zones = 0;  // Past kMaxZonesPerFrame or kMaxDepth.
+
+  double ms() const { return (end_ns - start_ns) * 1e-6; }
+};
+
+class Profiler {
+ public:
+  static constexpr size_t kMaxFrames = 240;
+  static constexpr size_t kMaxZonesPerFrame = 256;
+  static constexpr size_t kMaxDepth = 16;
+
+  Profiler()
+      : epoch_(std::chrono::steady_clock::now()),
+        zones_(new ProfileZone[kMaxFrames * kMaxZonesPerFrame]) {
+    for (size_t i = 0; i < kMaxFrames; ++i) {
+      frames_[i].zones = &zones_[i * kMaxZonesPerFrame];
+    }
+  }
+
+  Profiler(const Profiler&) = delete;
+  Profiler& operator=(const Profiler&) = delete;
+
+  // The profiler App and ScopedProfileZone use by default.
+  static Profiler& Get() {
+    static Profiler instance;
+    return instance;
+  }
+
+  // Ends the current frame, closing zones still open, and starts the next.
+  void BeginFrame() {
+    const uint64_t now = Now();
+    if (recording_) {
+      while (depth_ > 0) EndZone(now);
+      frames_[head_].end_ns = now;
+      head_ = (head_ + 1) % kMaxFrames;
+      count_ = std::min(count_ + 1, kMaxFrames - 1);
+    }
+    depth_ = 0;
+    ++frame_number_;
+
+    // Pausing takes effect at frame boundaries, so frames are never partial.
+    recording_ = !paused_;
+    if (recording_) {
+      ProfileFrame& frame = frames_[head_];
+      frame.number = frame_number_;
+      frame.start_ns = now;
+      frame.end_ns = now;
+      frame.zone_count = 0;
+      frame.dropped_zones = 0;
+    }
+  }
+
+  void BeginZone(const char* name) {
+    if (!recording_) return;
+    ProfileFrame& frame = frames_[head_];
+    if (depth_ < kMaxDepth) {
+      if (frame.zone_count < kMaxZonesPerFrame) {
+        open_[depth_] = frame.zone_count;
+        zones_[head_ * kMaxZonesPerFrame + frame.zone_count++] = {
+            name, Now(), 0, uint32_t(depth_)};
+      } else {
+        open_[depth_] = kNone;
+        ++frame.dropped_zones;
+      }
+    } else {
+      ++frame.dropped_zones;
+    }
+    ++depth_;
+  }
+
+  void EndZone() {
+    if (recording_ && depth_ > 0) EndZone(Now());
+  }
+
+  // While paused, frames aren't recorded, so the ones kept can be inspected.
+  bool paused() const { return paused_; }
+  void set_paused(bool paused) { paused_ = paused; }
+
+  // Completed frames; frame(0) is the oldest, frame(frame_count() - 1) the
+  // latest.
+  size_t frame_count() const { return count_; }
+  const ProfileFrame& frame(size_t i) const {
+    return frames_[(head_ + kMaxFrames - count_ + i) % kMaxFrames];
+  }
+
+ private:
+  static constexpr uint32_t kNone = ~0u;
+
+  uint64_t Now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - epoch_)
+        .count();
+  }
+
+  void EndZone(uint64_t now) {
+    --depth_;
+    if (depth_ < kMaxDepth && open_[depth_] != kNone) {
+      zones_[head_ * kMaxZonesPerFrame + open_[depth_]].end_ns = now;
+    }
+  }
+
+  const std::chrono::steady_clock::time_point epoch_;
+  std::unique_ptr<ProfileZone[]> zones_;
+  ProfileFrame frames_[kMaxFrames];
+
+  // The frame being recorded, which takes a slot of its own, so at most
+  // kMaxFrames - 1 completed frames are kept.
+  size_t head_ = 0;
+  size_t count_ = 0;
+  uint64_t frame_number_ = 0;
+  bool recording_ = false;
+  bool paused_ = false;
+
+  // Indices of open zones in the current frame, by depth.
+  uint32_t open_[kMaxDepth] = {};
+  size_t depth_ = 0;  // May exceed kMaxDepth; deeper zones are dropped.
+};
+
+// Records a zone from construction to destruction.
+class ScopedProfileZone {
+ public:
+  explicit ScopedProfileZone(const char* name,
+                             Profiler& profiler = Profiler::Get())
+      : profiler_(profiler) {
+    profiler_.BeginZone(name);
+  }
+  ~ScopedProfileZone() { profiler_.EndZone(); }
+
+  ScopedProfileZone(const ScopedProfileZone&) = delete;
+  ScopedProfileZone& operator=(const ScopedProfileZone&) = delete;
+
+ private:
+  Profiler& profiler_;
+};
+
+}  // namespace filament_glfw_imgui
+
+#endif  // FILAMENT_GLFW_IMGUI_PROFILER_H_
@@ -0,0 +1,331 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// An ImGui window showing profiler.h's zones live.
+//
+// NOTE: this file isn't part of the google/filament release. It is part of
+// ambrusc/filament-glfw-imgui.
+//
+// The window has three parts:
+//  - A bar per recorded frame, red when over budget. Clicking one pauses the
+//    profiler and selects that frame.
+//  - The selected (or latest) frame's zones as a timeline, one row per depth.
+//    Ctrl + mouse wheel zooms; the scrollbar scrolls.
+//  - A flame graph of zones merged by call path over every recorded frame.
+//    Widths are shares of total frame time.
+//
+// Usage:
+//
+//   // Keep across frames; it holds selection and zoom.
+//   filament_glfw_imgui::ProfilerWindow profiler_window;
+//   ...
+//   profiler_window.Show(&show_profiler);  // Between Begin/End-UiFrame().
+//
+
+#ifndef FILAMENT_GLFW_IMGUI_PROFILER_IMGUI_H_
+#define FILAMENT_GLFW_IMGUI_PROFILER_IMGUI_H_
+
+#include <imgui/imgui.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "filament_glfw_imgui/profiler.h"
+
+namespace filament_glfw_imgui {
+
+class ProfilerWindow {
+ public:
+  explicit ProfilerWindow(Profiler& profiler = Profiler::Get())
+      : profiler_(&profiler) {}
+
+  // Draws the window.
+  //  - 'open', if given, gets a close button, as with ImGui::Begin(...).
+  void Show(bool* open = nullptr);
+
+  // Frames slower than this are highlighted.
+  float budget_ms = 1000.0f / 60;
+
+ private:
+  // A call path in the flame graph. Children are a linked list.
+  struct FlameNode {
+    const char* name = nullptr;
+    uint64_t total_ns = 0;
+    uint64_t calls = 0;
+    int first_child = -1;
+    int next_sibling = -1;
+  };
+
+  static constexpr float kRowHeight = 20;
+
+  void ShowFrameBars();
+  void ShowTimeline(const ProfileFrame& frame);
+  void ShowFlameGraph();
+
+  // Adds a child named 'name' to node 'parent', unless it has one already.
+  int FlameChild(int parent, const char* name);
+  void DrawFlameNode(int node, float x, float y, float width, double root_ns,
+                     size_t frames, ImDrawList& draw_list);
+
+  // Draws a labeled box, and returns 'true' if the mouse is over it.
+  static bool DrawZoneBox(ImDrawList& draw_list, ImVec2 min, ImVec2 max,
+                          const char* name);
+
+  Profiler* profiler_ = nullptr;  // Not owned.
+
+  // Frame shown in the timeline, as an index for Profiler::frame(...). Only
+  // meaningful while paused; otherwise the latest frame is shown.
+  int selected_ = -1;
+  float zoom_ = 1;
+
+  // Rebuilt every Show(), but keeps its capacity.
+  std::vector<FlameNode> flame_;
+};
+
+inline void ProfilerWindow::Show(bool* open) {
+  ImGui::SetNextWindowSize(ImVec2(640, 480), ImGuiCond_FirstUseEver);
+  if (!ImGui::Begin("Profiler", open)) {
+    ImGui::End();
+    return;
+  }
+
+  bool paused = profiler_->paused();
+  if (ImGui::Checkbox("pause", &paused)) {
+    profiler_->set_paused(paused);
+    if (!paused) selected_ = -1;
+  }
+  ImGui::SameLine();
+  ImGui::SetNextItemWidth(120);
+  ImGui::DragFloat("budget (ms)", &budget_ms, 0.1f, 1.0f, 100.0f, "%.1f");
+  ImGui::SameLine();
+  ImGui::SetNextItemWidth(120);
+  ImGui::SliderFloat("zoom", &zoom_, 1, 1000, "%.1fx",
+                     ImGuiSliderFlags_Logarithmic);
+
+  if (profiler_->frame_count() == 0) {
+    ImGui::TextUnformatted("No frames recorded yet.");
+    ImGui::End();
+    return;
+  }
+
+  ShowFrameBars();
+
+  const size_t count = profiler_->frame_count();
+  if (!profiler_->paused() || selected_ < 0 || selected_ >= int(count)) {
+    selected_ = int(count) - 1;
+  }
+  const ProfileFrame& frame = profiler_->frame(selected_);
+  ImGui::Text("frame %llu: %.2f ms%s, %u zones",
+              (unsigned long long)frame.number, frame.ms(),
+              frame.ms() > budget_ms ? " (over budget)" : "", frame.zone_count);
+  if (frame.dropped_zones) {
+    ImGui::SameLine();
+    ImGui::Text("(%u dropped)", frame.dropped_zones);
+  }
+  ShowTimeline(frame);
+
+  ImGui::Separator();
+  ImGui::Text("All %zu frames, by call path:", count);
+  ShowFlameGraph();
+
+  ImGui::End();
+}
+
+inline void ProfilerWindow::ShowFrameBars() {
+  constexpr float kHeight = 60;
+  const size_t count = profiler_->frame_count();
+  const float width = std::max(ImGui::GetContentRegionAvail().x, 1.0f);
+  const float bar_width = width / Profiler::kMaxFrames;
+  const ImVec2 origin = ImGui::GetCursorScreenPos();
+  ImGui::InvisibleButton("frames", ImVec2(width, kHeight));
+
+  // Bars are scaled so the budget sits halfway up.
+  ImDrawList& draw_list = *ImGui::GetWindowDrawList();
+  draw_list.AddRectFilled(origin, ImVec2(origin.x + width, origin.y + kHeight),
+                          IM_COL32(30, 30, 30, 255));
+  for (size_t i = 0; i < count; ++i) {
+    const ProfileFrame& frame = profiler_->frame(i);
+    const float height =
+        kHeight * std::min(float(frame.ms()) / (2 * budget_ms), 1.0f);
+    const float x = origin.x + i * bar_width;
+    const bool over = frame.ms() > budget_ms;
+    const bool selected = profiler_->paused() && int(i) == selected_;
+    const ImU32 color = selected ? IM_COL32(255, 255, 255, 255)
+                        : over   ? IM_COL32(220, 60, 50, 255)
+                                 : IM_COL32(80, 180, 90, 255);
+    draw_list.AddRectFilled(
+        ImVec2(x, origin.y + kHeight - height),
+        ImVec2(x + std::max(bar_width - 1, 1.0f), origin.y + kHeight), color);
+  }
+  const float budget_y = origin.y + kHeight / 2;
+  draw_list.AddLine(ImVec2(origin.x, budget_y),
+                    ImVec2(origin.x + width, budget_y),
+                    IM_COL32(255, 255, 0, 128));
+
+  if (!ImGui::IsItemHovered()) return;
+  const int hovered = int((ImGui::GetIO().MousePos.x - origin.x) / bar_width);
+  if (hovered < 0 || hovered >= int(count)) return;
+  const ProfileFrame& frame = profiler_->frame(hovered);
+  ImGui::SetTooltip("frame %llu: %.2f ms", (unsigned long long)frame.number,
+                    frame.ms());
+  if (ImGui::IsItemClicked()) {
+    profiler_->set_paused(true);
+    selected_ = hovered;
+  }
+}
+
+inline void ProfilerWindow::ShowTimeline(const ProfileFrame& frame) {
+  uint32_t rows = 1;
+  for (uint32_t i = 0; i < frame.zone_count; ++i) {
+    rows = std::max(rows, frame.zones[i].depth + 1);
+  }
+
+  const float height = rows * kRowHeight + ImGui::GetStyle().ScrollbarSize;
+  ImGui::BeginChild("timeline", ImVec2(0, height), true,
+                    ImGuiWindowFlags_HorizontalScrollbar);
+  if (ImGui::IsWindowHovered() && ImGui::GetIO().KeyCtrl &&
+      ImGui::GetIO().MouseWheel != 0) {
+    zoom_ *= ImGui::GetIO().MouseWheel > 0 ? 1.25f : 0.8f;
+    zoom_ = std::clamp(zoom_, 1.0f, 1000.0f);
+  }
+
+  const float width = ImGui::GetContentRegionAvail().x * zoom_;
+  const ImVec2 origin = ImGui::GetCursorScreenPos();
+  ImGui::Dummy(ImVec2(width, rows * kRowHeight));
+
+  const double frame_ns = std::max<double>(frame.end_ns - frame.start_ns, 1);
+  const auto x_of = [&](uint64_t ns) {
+    return origin.x + float((ns - frame.start_ns) / frame_ns) * width;
+  };
+
+  ImDrawList& draw_list = *ImGui::GetWindowDrawList();
+  for (uint32_t i = 0; i < frame.zone_count; ++i) {
+    const ProfileZone& zone = frame.zones[i];
+    const float y = origin.y + zone.depth * kRowHeight;
+    const ImVec2 min(x_of(zone.start_ns), y);
+    const ImVec2 max(std::max(x_of(zone.end_ns), min.x + 1), y + kRowHeight);
+    if (DrawZoneBox(draw_list, min, max, zone.name)) {
+      ImGui::SetTooltip("%s\n%.3f ms", zone.name,
+                        (zone.end_ns - zone.start_ns) * 1e-6);
+    }
+  }
+
+  // Mark the budget, if this frame went past it.
+  const double budget_ns = double(budget_ms) * 1e6;
+  if (budget_ns < frame_ns) {
+    const float x = origin.x + float(budget_ns / frame_ns) * width;
+    draw_list.AddLine(ImVec2(x, origin.y),
+                      ImVec2(x, origin.y + rows * kRowHeight),
+                      IM_COL32(255, 255, 0, 200), 2);
+  }
+  ImGui::EndChild();
+}
+
+inline void ProfilerWindow::ShowFlameGraph() {
+  // Merge zones by call path. Node 0 is the frame itself.
+  flame_.clear();
+  flame_.push_back({"frame"});
+  const size_t count = profiler_->frame_count();
+  for (size_t f = 0; f < count; ++f) {
+    const ProfileFrame& frame = profiler_->frame(f);
+    flame_[0].total_ns += frame.end_ns - frame.start_ns;
+    ++flame_[0].calls;
+
+    // path[d] is the node of the open zone at depth d - 1.
+    int path[Profiler::kMaxDepth + 1] = {0};
+    for (uint32_t i = 0; i < frame.zone_count; ++i) {
+      const ProfileZone& zone = frame.zones[i];
+      const int node = FlameChild(path[zone.depth], zone.name);
+      flame_[node].total_ns += zone.end_ns - zone.start_ns;
+      ++flame_[node].calls;
+      path[zone.depth + 1] = node;
+    }
+  }
+
+  int depth = 0;
+  for (size_t f = 0; f < count; ++f) {
+    const ProfileFrame& frame = profiler_->frame(f);
+    for (uint32_t i = 0; i < frame.zone_count; ++i) {
+      depth = std::max(depth, int(frame.zones[i].depth) + 1);
+    }
+  }
+
+  const float width = std::max(ImGui::GetContentRegionAvail().x, 1.0f);
+  const ImVec2 origin = ImGui::GetCursorScreenPos();
+  ImGui::Dummy(ImVec2(width, (depth + 1) * kRowHeight));
+  DrawFlameNode(0, origin.x, origin.y, width,
+                std::max<double>(flame_[0].total_ns, 1), count,
+                *ImGui::GetWindowDrawList());
+}
+
+inline int ProfilerWindow::FlameChild(int parent, const char* name) {
+  int* link = &flame_[parent].first_child;
+  while (*link >= 0) {
+    const FlameNode& node = flame_[*link];
+    if (node.name == name || !std::strcmp(node.name, name)) return *link;
+    link = &flame_[*link].next_sibling;
+  }
+  // 'link' points into flame_, so take the index before growing it.
+  const int index = int(flame_.size());
+  *link = index;
+  flame_.push_back({name});
+  return index;
+}
+
+inline void ProfilerWindow::DrawFlameNode(int node, float x, float y,
+                                          float width, double root_ns,
+                                          size_t frames,
+                                          ImDrawList& draw_list) {
+  const FlameNode& n = flame_[node];
+  if (width < 1) return;
+  if (DrawZoneBox(draw_list, ImVec2(x, y), ImVec2(x + width, y + kRowHeight),
+                  n.name)) {
+    ImGui::SetTooltip("%s\n%.3f ms per frame, %.1f%% of frame time\n"
+                      "%.1f calls per frame",
+                      n.name, n.total_ns * 1e-6 / frames,
+                      100 * n.total_ns / root_ns, double(n.calls) / frames);
+  }
+  for (int child = n.first_child; child >= 0;
+       child = flame_[child].next_sibling) {
+    const float child_width =
+        width * float(flame_[child].total_ns /
+                      std::max<double>(n.total_ns, 1));
+    DrawFlameNode(child, x, y + kRowHeight, child_width, root_ns, frames,
+                  draw_list);
+    x += child_width;
+  }
+}
+
+inline bool ProfilerWindow::DrawZoneBox(ImDrawList& draw_list, ImVec2 min,
+                                        ImVec2 max, const char* name) {
+  // Color by name, so a zone keeps its color across frames and views.
+  uint32_t hash = 2166136261u;
+  for (const char* c = name; *c; ++c) hash = (hash ^ uint8_t(*c)) * 16777619u;
+  const ImU32 color = ImColor::HSV((hash % 360) / 360.0f, 0.5f, 0.75f);
+
+  draw_list.AddRectFilled(min, ImVec2(max.x - 1, max.y - 1), color);
+  const ImVec4 clip(min.x, min.y, max.x - 2, max.y);
+  draw_list.AddText(nullptr, 0, ImVec2(min.x + 3, min.y + 2),
+                    IM_COL32(0, 0, 0, 255), name, nullptr, 0, &clip);
+  return ImGui::IsWindowHovered() && ImGui::IsMouseHoveringRect(min, max);
+}
+
+}  // namespace filament_glfw_imgui
+
+#endif  // FILAMENT_GLFW_IMGUI_PROFILER_IMGUI_H_
@@ -0,0 +1,198 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Deferred destruction of Filament objects, without waiting on the GPU.
+//
+// NOTE: this file isn't part of the google/filament release. It is part of
+// ambrusc/filament-glfw-imgui.
+//
+// Replacing a texture or buffer mid-frame used to mean waiting on a fence, so
+// the frames still in flight were done with the old one before destroying it.
+// Instead, retire the old object: it's kept until a fence created after the
+// last frame that could use it has signaled, which BeginFrame() checks without
+// blocking. The same goes for CPU memory that pending uploads still read from
+// (BufferDescriptors without a callback).
+//
+// App::Init() creates one, App::PollEvents() begins its frames, and Ui and
+// fs::Environment retire through it. Not thread-safe: use it from the thread
+// that drives the engine.
+//
+// Usage:
+//
+//   using namespace filament_glfw_imgui;
+//   RetireQueue& retire = *app.retire_queue();
+//
+//   retire.Retire(old_texture);             // Instead of DestroyTracked(...).
+//   retire.Retire(std::move(old_vertices));  // A std::vector uploads read.
+//
+//   // Or, for code that may run without a queue:
+//   RetireOrDestroy(*engine, queue, old_texture);
+//
+
+#ifndef FILAMENT_GLFW_IMGUI_RETIRE_QUEUE_H_
+#define FILAMENT_GLFW_IMGUI_RETIRE_QUEUE_H_
+
+#include <filament/Engine.h>
+#include <filament/Fence.h>
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "filament_glfw_imgui/gpu_memory.h"
+#include "filament_glfw_imgui/upload_scheduler.h"
+
+namespace filament_glfw_imgui {
+
+class RetireQueue {
+ public:
+  RetireQueue() = default;
+
+  // 'engine' must outlive this class.
+  explicit RetireQueue(filament::Engine* engine) : engine_(engine) {}
+
+  RetireQueue(const RetireQueue&) = delete;
+  RetireQueue& operator=(const RetireQueue&) = delete;
+
+  RetireQueue(RetireQueue&& other) { *this = std::move(other); }
+  RetireQueue& operator=(RetireQueue&& other) {
+    std::swap(engine_, other.engine_);
+    std::swap(uploads_, other.uploads_);
+    std::swap(retired_, other.retired_);
+    std::swap(batches_, other.batches_);
+    std::swap(sealed_, other.sealed_);
+    std::swap(destroyed_, other.destroyed_);
+    return *this;
+  }
+
+  // Waits for the engine to finish, then destroys everything still retired.
+  // Only for teardown: this is the one place the queue blocks.
+  ~RetireQueue() {
+    if (!engine_) return;
+    if (!retired_.empty()) engine_->flushAndWait();
+    Destroy(retired_.size());
+    for (const Batch& batch : batches_) engine_->destroy(batch.fence);
+  }
+
+  // Retire(...) cancels the uploads still queued in 'uploads' to what it
+  // retires. It must outlive this class, or be reset first.
+  void set_upload_scheduler(UploadScheduler* uploads) { uploads_ = uploads; }
+
+  // Keeps 'resource' (anything Engine::destroy(...) takes) until the frames
+  // in flight are done with it, then untracks and destroys it. nullptr is ok.
+  template <typename T>
+  void Retire(T* resource) {
+    if (!resource) return;
+    if (uploads_) uploads_->Cancel(resource);
+    retired_.push_back({(void*)resource, [](filament::Engine& engine, void* p) {
+                          DestroyTracked(engine, (T*)p);
+                        }});
+  }
+
+  // As above, for CPU memory that pending uploads still read from. Leaves
+  // 'data' empty.
+  template <typename T>
+  void Retire(std::vector<T>&& data) {
+    if (!data.capacity()) return;
+    retired_.push_back(
+        {new std::vector<T>(std::move(data)),
+         [](filament::Engine&, void* p) { delete (std::vector<T>*)p; }});
+  }
+
+  // Call once per frame, before rendering.
+  //  - Puts what was retired since the last call behind a new fence, which
+  //    signals once the frames submitted so far are done.
+  //  - Destroys what older fences cover, if they've signaled, without
+  //    waiting for those that haven't.
+  void BeginFrame() {
+    if (!engine_) return;
+    if (sealed_ < retired_.size()) {
+      batches_.push_back({engine_->createFence(), retired_.size()});
+      sealed_ = retired_.size();
+    }
+
+    size_t done = 0;
+    while (done < batches_.size() &&
+           batches_[done].fence->wait(filament::Fence::Mode::DONT_FLUSH, 0) !=
+               filament::backend::FenceStatus::TIMEOUT_EXPIRED) {
+      engine_->destroy(batches_[done].fence);
+      ++done;
+    }
+    if (!done) return;
+
+    // Batches are in retirement order, so the done ones cover a prefix.
+    const size_t count = batches_[done - 1].end;
+    Destroy(count);
+    batches_.erase(batches_.begin(), batches_.begin() + done);
+    for (Batch& batch : batches_) batch.end -= count;
+    sealed_ -= count;
+  }
+
+  // Retired, and not yet destroyed.
+  size_t size() const { return retired_.size(); }
+
+  // Destroyed since this was created.
+  size_t destroyed() const { return destroyed_; }
+
+ private:
+  struct Retired {
+    void* object;
+    void (*destroy)(filament::Engine& engine, void* object);
+  };
+
+  // Covers retired_ up to 'end', from the previous batch's end.
+  struct Batch {
+    filament::Fence* fence;
+    size_t end;
+  };
+
+  // Destroys the 'count' oldest retired objects.
+  void Destroy(size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      retired_[i].destroy(*engine_, retired_[i].object);
+    }
+    retired_.erase(retired_.begin(), retired_.begin() + count);
+    destroyed_ += count;
+  }
+
+  filament::Engine* engine_ = nullptr;  // Not owned.
+  UploadScheduler* uploads_ = nullptr;  // Not owned.
+
+  // Oldest first; those before sealed_ have a fence in batches_. Both keep
+  // their capacity, so steady frames don't allocate.
+  std::vector<Retired> retired_;
+  std::vector<Batch> batches_;
+  size_t sealed_ = 0;
+
+  size_t destroyed_ = 0;
+};
+
+// Retires 'resource' through 'queue', or if that's null, untracks and destroys
+// it right away. nullptr is ok.
+template <typename T>
+void RetireOrDestroy(filament::Engine& engine, RetireQueue* queue,
+                     T* resource) {
+  if (queue) {
+    queue->Retire(resource);
+  } else {
+    DestroyTracked(engine, resource);
+  }
+}
+
+}  // namespace filament_glfw_imgui
+
+#endif  // FILAMENT_GLFW_IMGUI_RETIRE_QUEUE_H_
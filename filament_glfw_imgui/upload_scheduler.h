@@ -0,0 +1,352 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Spreads texture and buffer uploads over frames, within a byte budget.
+//
+// NOTE: this file isn't part of the google/filament release. It is part of
+// ambrusc/filament-glfw-imgui.
+//
+// Left alone, the font atlas, UI geometry, environment cubes and meshes can
+// all upload in the same frame, which then stalls on the copies. Instead,
+// subsystems enqueue uploads here with a priority, and Submit() hands them to
+// the engine once per frame: most urgent first, in the order enqueued, until
+// the frame's budget is spent. kUi uploads go first and always in the frame
+// they were enqueued, budget or not, as the UI drawn that frame reads them;
+// their bytes still count against the budget.
+//
+// An upload larger than the budget goes alone, in a frame of its own. Until
+// an upload is submitted, its target keeps its old contents (uninitialized,
+// for new ones), so enqueue what's on screen with a high priority.
+//
+// App::Init() creates one, and App::EndUiFrame() submits its frames. Ui
+// enqueues through it, and RetireQueue cancels the uploads of what it
+// retires. Not thread-safe.
+//
+// Usage:
+//
+//   using namespace filament_glfw_imgui;
+//   UploadScheduler& uploads = *app.upload_scheduler();
+//
+//   uploads.EnqueueImage(texture, /*level=*/0, std::move(pixels),
+//                        UploadPriority::kNormal);
+//   ...
+//   uploads.Cancel(texture);  // Before destroying it, if it may be pending.
+//   engine->destroy(texture);
+//
+//   // Once per frame, before rendering:
+//   uploads.Submit();
+//   const size_t bytes = uploads.stats().bytes;  // This frame's uploads.
+//
+
+#ifndef FILAMENT_GLFW_IMGUI_UPLOAD_SCHEDULER_H_
+#define FILAMENT_GLFW_IMGUI_UPLOAD_SCHEDULER_H_
+
+#include <filament/Engine.h>
+#include <filament/IndexBuffer.h>
+#include <filament/Texture.h>
+#include <filament/VertexBuffer.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "filament_glfw_imgui/profiler.h"
+
+namespace filament_glfw_imgui {
+
+// Most urgent first.
+enum class UploadPriority : uint8_t {
+  kUi,      // Geometry for this frame's UI; never deferred.
+  kHigh,    // On screen now, e.g. a rebuilt font atlas.
+  kNormal,  // On screen soon, e.g. a loaded environment.
+  kLow,     // Streaming and prefetching.
+  kCount,
+};
+
+inline const char* UploadPriorityName(UploadPriority priority) {
+  constexpr const char* kNames[] = {"ui", "high", "normal", "low"};
+  return priority < UploadPriority::kCount ? kNames[size_t(priority)] : "?";
+}
+
+struct UploadStats {
+  // In the last Submit().
+  size_t bytes = 0;     // Every upload submitted, kUi ones included.
+  size_t ui_bytes = 0;  // kUi uploads.
+  uint32_t uploads = 0;
+
+  // Left for later frames after the last Submit().
+  uint32_t queued = 0;
+  size_t queued_bytes = 0;
+
+  // Since the scheduler was created.
+  size_t total_bytes = 0;
+  size_t peak_frame_bytes = 0;
+};
+
+class UploadScheduler {
+ public:
+  static constexpr size_t kDefaultBudget = size_t(8) << 20;
+
+  UploadScheduler() = default;
+
+  // 'engine' must outlive this class.
+  explicit UploadScheduler(filament::Engine* engine,
+                           size_t budget_bytes = kDefaultBudget)
+      : engine_(engine), budget_(budget_bytes) {}
+
+  UploadScheduler(const UploadScheduler&) = delete;
+  UploadScheduler& operator=(const UploadScheduler&) = delete;
+
+  UploadScheduler(UploadScheduler&& other) { *this = std::move(other); }
+  UploadScheduler& operator=(UploadScheduler&& other) {
+    std::swap(engine_, other.engine_);
+    std::swap(budget_, other.budget_);
+    for (size_t i = 0; i < kQueueCount; ++i) {
+      std::swap(queues_[i], other.queues_[i]);
+      std::swap(heads_[i], other.heads_[i]);
+    }
+    std::swap(stats_, other.stats_);
+    return *this;
+  }
+
+  // Uploads still queued are dropped: their descriptors' callbacks run, but
+  // nothing reaches the engine.
+  ~UploadScheduler() = default;
+
+  // Replaces buffer 'index' of 'target' from 'byte_offset' on, like
+  // VertexBuffer::setBufferAt(...).
+  void EnqueueVertices(filament::VertexBuffer* target, uint8_t index,
+                       filament::VertexBuffer::BufferDescriptor&& buffer,
+                       uint32_t byte_offset, UploadPriority priority) {
+    Upload& upload = Push(priority, Kind::kVertices, target, buffer.size);
+    upload.index = index;
+    upload.byte_offset = byte_offset;
+    upload.buffer = std::move(buffer);
+  }
+
+  // Like IndexBuffer::setBuffer(...).
+  void EnqueueIndices(filament::IndexBuffer* target,
+                      filament::IndexBuffer::BufferDescriptor&& buffer,
+                      uint32_t byte_offset, UploadPriority priority) {
+    Upload& upload = Push(priority, Kind::kIndices, target, buffer.size);
+    upload.byte_offset = byte_offset;
+    upload.buffer = std::move(buffer);
+  }
+
+  // Replaces mip 'level' of a 2D 'target', like Texture::setImage(...).
+  void EnqueueImage(filament::Texture* target, uint8_t level,
+                    filament::Texture::PixelBufferDescriptor&& pixels,
+                    UploadPriority priority) {
+    Upload& upload = Push(priority, Kind::kImage, target, pixels.size);
+    upload.index = level;
+    upload.pixels = std::move(pixels);
+  }
+
+  // Replaces a 'width' x 'height' rectangle at ('x', 'y') of mip 'level' of a
+  // 2D 'target', like the sub-image Texture::setImage(...).
+  void EnqueueSubImage(filament::Texture* target, uint8_t level, uint32_t x,
+                       uint32_t y, uint32_t width, uint32_t height,
+                       filament::Texture::PixelBufferDescriptor&& pixels,
+                       UploadPriority priority) {
+    Upload& upload = Push(priority, Kind::kSubImage, target, pixels.size);
+    upload.index = level;
+    upload.rect[0] = x;
+    upload.rect[1] = y;
+    upload.rect[2] = width;
+    upload.rect[3] = height;
+    upload.pixels = std::move(pixels);
+  }
+
+  // Replaces mip 'level' of a cubemap 'target', with a face at each offset
+  // into 'pixels'.
+  void EnqueueCubeImage(filament::Texture* target, uint8_t level,
+                        filament::Texture::PixelBufferDescriptor&& pixels,
+                        const filament::Texture::FaceOffsets& faces,
+                        UploadPriority priority) {
+    Upload& upload = Push(priority, Kind::kCubeImage, target, pixels.size);
+    upload.index = level;
+    upload.pixels = std::move(pixels);
+    upload.faces = faces;
+  }
+
+  // Drops the queued uploads to 'target', e.g. before destroying it. nullptr
+  // is ignored.
+  void Cancel(const void* target) {
+    if (!target) return;
+    for (size_t i = 0; i < kQueueCount; ++i) {
+      std::vector<Upload>& queue = queues_[i];
+      size_t kept = heads_[i];
+      for (size_t j = heads_[i]; j < queue.size(); ++j) {
+        if (queue[j].target != target) {
+          if (kept != j) queue[kept] = std::move(queue[j]);
+          ++kept;
+          continue;
+        }
+        stats_.queued_bytes -= queue[j].bytes;
+        --stats_.queued;
+        Drop(std::move(queue[j]));
+      }
+      queue.erase(queue.begin() + kept, queue.end());
+    }
+  }
+
+  // 'true' while uploads to 'target' are waiting for a Submit().
+  bool Queued(const void* target) const {
+    for (size_t i = 0; i < kQueueCount; ++i) {
+      const std::vector<Upload>& queue = queues_[i];
+      for (size_t j = heads_[i]; j < queue.size(); ++j) {
+        if (queue[j].target == target) return true;
+      }
+    }
+    return false;
+  }
+
+  // Hands this frame's uploads to the engine: every kUi one, then the others
+  // by priority while they fit in budget(). The first of the others goes even
+  // if it doesn't fit, so every upload gets through eventually.
+  // Call once per frame, before rendering.
+  void Submit() {
+    const ScopedProfileZone zone("UploadScheduler::Submit");
+    stats_.bytes = 0;
+    stats_.ui_bytes = 0;
+    stats_.uploads = 0;
+
+    bool over_budget_ok = true;  // Until the first non-kUi upload.
+    for (size_t i = 0; i < kQueueCount; ++i) {
+      std::vector<Upload>& queue = queues_[i];
+      size_t& head = heads_[i];
+      const bool ui = i == size_t(UploadPriority::kUi);
+      while (head < queue.size()) {
+        Upload& upload = queue[head];
+        if (!ui) {
+          if (!over_budget_ok && stats_.bytes + upload.bytes > budget_) break;
+          over_budget_ok = false;
+        }
+        Apply(upload);
+        stats_.bytes += upload.bytes;
+        if (ui) stats_.ui_bytes += upload.bytes;
+        ++stats_.uploads;
+        stats_.queued_bytes -= upload.bytes;
+        --stats_.queued;
+        ++head;
+      }
+      // Lower priorities wait for this one to drain.
+      const bool drained = head == queue.size();
+      // Drops the submitted uploads once they're at least half the queue, so
+      // steady streaming doesn't grow it. Queues keep their capacity, so
+      // steady frames don't allocate.
+      if (head && 2 * head >= queue.size()) {
+        queue.erase(queue.begin(), queue.begin() + head);
+        head = 0;
+      }
+      if (!drained) break;
+    }
+
+    stats_.total_bytes += stats_.bytes;
+    stats_.peak_frame_bytes = std::max(stats_.peak_frame_bytes, stats_.bytes);
+  }
+
+  size_t budget() const { return budget_; }
+  void set_budget(size_t budget_bytes) { budget_ = budget_bytes; }
+
+  const UploadStats& stats() const { return stats_; }
+
+ private:
+  enum class Kind : uint8_t {
+    kVertices,
+    kIndices,
+    kImage,
+    kSubImage,
+    kCubeImage,
+  };
+
+  struct Upload {
+    Kind kind;
+    void* target;  // Not owned.
+    size_t bytes;
+    uint8_t index = 0;  // Vertex buffer index, or mip level.
+    uint32_t byte_offset = 0;
+    filament::VertexBuffer::BufferDescriptor buffer;  // Buffers only.
+    filament::Texture::PixelBufferDescriptor pixels;  // Textures only.
+    filament::Texture::FaceOffsets faces;             // kCubeImage only.
+    uint32_t rect[4] = {};                            // kSubImage: x, y, w, h.
+  };
+
+  static constexpr size_t kQueueCount = size_t(UploadPriority::kCount);
+
+  // Runs the descriptors' callbacks: they only call back when destroyed, not
+  // when assigned over.
+  static void Drop(Upload) {}
+
+  Upload& Push(UploadPriority priority, Kind kind, void* target,
+               size_t bytes) {
+    ++stats_.queued;
+    stats_.queued_bytes += bytes;
+    std::vector<Upload>& queue = queues_[size_t(priority)];
+    Upload& upload = queue.emplace_back();
+    upload.kind = kind;
+    upload.target = target;
+    upload.bytes = bytes;
+    return upload;
+  }
+
+  void Apply(Upload& upload) {
+    using namespace filament;
+    switch (upload.kind) {
+      case Kind::kVertices:
+        ((VertexBuffer*)upload.target)
+            ->setBufferAt(*engine_, upload.index, std::move(upload.buffer),
+                          upload.byte_offset);
+        break;
+      case Kind::kIndices:
+        ((IndexBuffer*)upload.target)
+            ->setBuffer(*engine_, std::move(upload.buffer),
+                        upload.byte_offset);
+        break;
+      case Kind::kImage:
+        ((Texture*)upload.target)
+            ->setImage(*engine_, upload.index, std::move(upload.pixels));
+        break;
+      case Kind::kSubImage:
+        ((Texture*)upload.target)
+            ->setImage(*engine_, upload.index, upload.rect[0], upload.rect[1],
+                       upload.rect[2], upload.rect[3],
+                       std::move(upload.pixels));
+        break;
+      case Kind::kCubeImage:
+        ((Texture*)upload.target)
+            ->setImage(*engine_, upload.index, std::move(upload.pixels),
+                       upload.faces);
+        break;
+    }
+  }
+
+  filament::Engine* engine_ = nullptr;  // Not owned.
+  size_t budget_ = kDefaultBudget;
+
+  // A FIFO per priority: queues_[i] from heads_[i] on.
+  std::vector<Upload> queues_[kQueueCount];
+  size_t heads_[kQueueCount] = {};
+
+  UploadStats stats_;
+};
+
+}  // namespace filament_glfw_imgui
+
+#endif  // FILAMENT_GLFW_IMGUI_UPLOAD_SCHEDULER_H_
@@ -0,0 +1,151 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Checks UploadScheduler's ordering: a priority level that the budget stops
+// part-way (or before its first upload) holds back every lower priority. Also
+// checks what Queued(...) reports around a Submit().
+//
+// Uploads go through the NOOP backend; only what Submit() hands to the engine
+// each frame is checked, through its stats().
+//
+
+#include <filament/Engine.h>
+#include <filament/Texture.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "filament_glfw_imgui/upload_scheduler.h"
+
+namespace {
+
+using filament_glfw_imgui::UploadPriority;
+using filament_glfw_imgui::UploadScheduler;
+
+int failures = 0;
+
+#define CHECK_EQ(a, b)                                                       \
+  do {                                                                       \
+    const long long a_ = (long long)(a), b_ = (long long)(b);                \
+    if (a_ != b_) {                                                          \
+      std::printf("%s:%d: %s == %lld, expected %lld\n", __FILE__, __LINE__, \
+                  #a, a_, b_);                                               \
+      ++failures;                                                            \
+    }                                                                        \
+  } while (0)
+
+constexpr size_t kBudget = 1024;
+
+filament::Texture* CreateTexture(filament::Engine& engine) {
+  using namespace filament;
+  return Texture::Builder()
+      .width(64)
+      .height(64)
+      .levels(1)
+      .format(Texture::InternalFormat::RGBA8)
+      .sampler(Texture::Sampler::SAMPLER_2D)
+      .build(engine);
+}
+
+// A 'bytes'-sized upload to 'texture', freed by its callback.
+void Enqueue(UploadScheduler& uploads, filament::Texture* texture,
+             size_t bytes, UploadPriority priority) {
+  using namespace filament;
+  uploads.EnqueueImage(
+      texture, 0,
+      Texture::PixelBufferDescriptor(
+          calloc(bytes, 1), bytes, Texture::Format::RGBA,
+          Texture::Type::UBYTE,
+          [](void* buffer, size_t size, void* user) { free(buffer); }),
+      priority);
+}
+
+// kNormal fits one small upload, then stops at one over the budget: the small
+// kLow upload must wait for it, even once the submitted prefix is compacted.
+void TestPartlySubmittedQueueHoldsLowerPriorities(filament::Engine& engine,
+                                                  filament::Texture* texture) {
+  UploadScheduler uploads(&engine, kBudget);
+  Enqueue(uploads, texture, 512, UploadPriority::kNormal);
+  Enqueue(uploads, texture, 4 * kBudget, UploadPriority::kNormal);
+  Enqueue(uploads, texture, 16, UploadPriority::kLow);
+
+  uploads.Submit();
+  CHECK_EQ(uploads.stats().bytes, 512);
+  CHECK_EQ(uploads.stats().queued, 2);
+
+  uploads.Submit();  // Over budget, so alone.
+  CHECK_EQ(uploads.stats().bytes, 4 * kBudget);
+  CHECK_EQ(uploads.stats().queued, 1);
+
+  uploads.Submit();
+  CHECK_EQ(uploads.stats().bytes, 16);
+  CHECK_EQ(uploads.stats().queued, 0);
+}
+
+// kHigh spends the budget, so kNormal submits nothing this frame: kLow must
+// still wait.
+void TestUnsubmittedQueueHoldsLowerPriorities(filament::Engine& engine,
+                                              filament::Texture* texture) {
+  UploadScheduler uploads(&engine, kBudget);
+  Enqueue(uploads, texture, 512, UploadPriority::kHigh);
+  Enqueue(uploads, texture, 4 * kBudget, UploadPriority::kNormal);
+  Enqueue(uploads, texture, 16, UploadPriority::kLow);
+
+  uploads.Submit();
+  CHECK_EQ(uploads.stats().bytes, 512);
+  CHECK_EQ(uploads.stats().queued, 2);
+
+  uploads.Submit();
+  CHECK_EQ(uploads.stats().bytes, 4 * kBudget);
+  CHECK_EQ(uploads.stats().queued, 1);
+
+  uploads.Submit();
+  CHECK_EQ(uploads.stats().bytes, 16);
+  CHECK_EQ(uploads.stats().queued, 0);
+}
+
+// Queued(...) covers only what a Submit() hasn't handed to the engine.
+void TestQueuedUntilSubmitted(filament::Engine& engine,
+                              filament::Texture* texture) {
+  UploadScheduler uploads(&engine, kBudget);
+  CHECK_EQ(uploads.Queued(texture), false);
+  Enqueue(uploads, texture, 512, UploadPriority::kLow);
+  CHECK_EQ(uploads.Queued(texture), true);
+  CHECK_EQ(uploads.Queued(&engine), false);
+
+  uploads.Submit();
+  CHECK_EQ(uploads.Queued(texture), false);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  using namespace filament;
+  Engine* engine = Engine::create(Engine::Backend::NOOP);
+  Texture* const texture = CreateTexture(*engine);
+
+  TestPartlySubmittedQueueHoldsLowerPriorities(*engine, texture);
+  TestUnsubmittedQueueHoldsLowerPriorities(*engine, texture);
+  TestQueuedUntilSubmitted(*engine, texture);
+
+  engine->flushAndWait();  // Runs the descriptors' callbacks.
+  engine->destroy(texture);
+  Engine::destroy(&engine);
+
+  std::printf("upload_scheduler_test: %s\n", failures ? "FAILED" : "passed");
+  return failures ? 1 : 0;
+}
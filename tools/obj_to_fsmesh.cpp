@@ -0,0 +1,213 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Converts a Wavefront .obj to .fsmesh (see demo/fs_mesh_file.h).
+//
+//   obj_to_fsmesh input.obj output.fsmesh [--normalize]
+//
+// Reads positions, normals and polygonal faces (fan-triangulated); texture
+// coordinates, groups and materials are ignored. Faces without normals get
+// smooth, area-weighted ones. The result is vertex-cache optimized.
+//  --normalize: centers the mesh and scales it into [-1, 1], which also keeps
+//               positions in half precision's accurate range.
+//
+
+#include <math/vec3.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "fs_mapped_file.h"
+#include "fs_mesh.h"
+#include "fs_mesh_file.h"
+
+namespace {
+
+using filament::math::float3;
+
+struct Obj {
+  std::vector<float3> positions;
+  std::vector<float3> normals;
+
+  // Triangles, as (position, normal) index pairs; normal is -1 if absent.
+  std::vector<int> corner_positions;
+  std::vector<int> corner_normals;
+};
+
+// Resolves a 1-based, or negative relative, .obj index. Returns -1 if it's
+// out of range.
+int ResolveIndex(long index, size_t count) {
+  if (index > 0 && size_t(index) <= count) return int(index - 1);
+  if (index < 0 && size_t(-index) <= count) return int(count + index);
+  return -1;
+}
+
+bool ParseObj(const char* text, const char* end, Obj& obj) {
+  std::vector<int> face_positions;
+  std::vector<int> face_normals;
+  int line = 1;
+  for (const char* cur = text; cur < end; ++line) {
+    const char* const eol = (const char*)std::memchr(cur, '\n', end - cur);
+    const char* const next = eol ? eol + 1 : end;
+
+    // strtof and strtol stop at the newline, or at the end of the mapping,
+    // which the final line of a file without one would run past. Copy it.
+    char buf[1024];
+    const size_t len = std::min(size_t(next - cur), sizeof(buf) - 1);
+    std::memcpy(buf, cur, len);
+    buf[len] = 0;
+    cur = next;
+
+    char* p = buf;
+    if (p[0] == 'v' && (p[1] == ' ' || p[1] == 'n')) {
+      const bool normal = p[1] == 'n';
+      p += 2;
+      float3 v;
+      for (int i = 0; i < 3; ++i) v[i] = std::strtof(p, &p);
+      (normal ? obj.normals : obj.positions).push_back(v);
+    } else if (p[0] == 'f' && p[1] == ' ') {
+      face_positions.clear();
+      face_normals.clear();
+      p += 2;
+      for (;;) {
+        char* after = nullptr;
+        const long v = std::strtol(p, &after, 10);
+        if (after == p) break;
+        p = after;
+        long n = 0;
+        if (*p == '/') {
+          std::strtol(p + 1, &p, 10);  // Texture coordinate, if any.
+          if (*p == '/') n = std::strtol(p + 1, &p, 10);
+        }
+        face_positions.push_back(ResolveIndex(v, obj.positions.size()));
+        face_normals.push_back(n ? ResolveIndex(n, obj.normals.size()) : -1);
+        if (face_positions.back() < 0 || (n && face_normals.back() < 0)) {
+          std::fprintf(stderr, "line %d: index out of range\n", line);
+          return false;
+        }
+      }
+      for (size_t i = 2; i < face_positions.size(); ++i) {
+        for (size_t k : {size_t(0), i - 1, i}) {
+          obj.corner_positions.push_back(face_positions[k]);
+          obj.corner_normals.push_back(face_normals[k]);
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// Any unit tangent perpendicular to 'n'. The layout has no UVs for a real one
+// to follow.
+float3 AnyTangent(const float3& n) {
+  const float3 axis =
+      std::abs(n.x) < 0.9f ? float3(1, 0, 0) : float3(0, 1, 0);
+  return normalize(cross(axis, n));
+}
+
+fs::MeshData BuildMesh(const Obj& obj, bool normalize_size) {
+  using namespace filament::math;
+
+  // Smooth normals per position, for corners without one.
+  std::vector<float3> smooth(obj.positions.size(), float3(0));
+  for (size_t c = 0; c < obj.corner_positions.size(); c += 3) {
+    const float3& a = obj.positions[obj.corner_positions[c]];
+    const float3& b = obj.positions[obj.corner_positions[c + 1]];
+    const float3& d = obj.positions[obj.corner_positions[c + 2]];
+    const float3 area_normal = cross(b - a, d - a);  // Length is 2x area.
+    for (int k = 0; k < 3; ++k) {
+      smooth[obj.corner_positions[c + k]] += area_normal;
+    }
+  }
+
+  float3 lo(INFINITY);
+  float3 hi(-INFINITY);
+  for (const float3& p : obj.positions) {
+    lo = min(lo, p);
+    hi = max(hi, p);
+  }
+  const float3 center = normalize_size ? 0.5f * (lo + hi) : float3(0);
+  const float extent = std::max({hi.x - lo.x, hi.y - lo.y, hi.z - lo.z});
+  const float scale = normalize_size && extent > 0 ? 2 / extent : 1;
+
+  // One vertex per distinct (position, normal) pair.
+  fs::MeshData mesh;
+  std::unordered_map<uint64_t, uint32_t> vertex_ids;
+  for (size_t c = 0; c < obj.corner_positions.size(); ++c) {
+    const int pi = obj.corner_positions[c];
+    const int ni = obj.corner_normals[c];
+    const uint64_t key = (uint64_t(uint32_t(pi)) << 32) | uint32_t(ni);
+    auto [it, added] = vertex_ids.try_emplace(key, mesh.vertices.size());
+    if (added) {
+      float3 n = ni >= 0 ? obj.normals[ni] : smooth[pi];
+      n = length(n) > 0 ? normalize(n) : float3(0, 0, 1);
+      const float3 t = AnyTangent(n);
+      mesh.vertices.push_back(fs::PackMeshVertex(
+          (obj.positions[pi] - center) * scale, t, cross(n, t), n,
+          0xffffffffu));
+    }
+    mesh.indices.push_back(it->second);
+  }
+  fs::ComputeMeshBounds(mesh);
+  return mesh;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::fprintf(stderr, "usage: %s input.obj output.fsmesh [--normalize]\n",
+                 argv[0]);
+    return 1;
+  }
+  const bool normalize_size = argc > 3 && !std::strcmp(argv[3], "--normalize");
+
+  const fs::MappedFile file(argv[1], /*sequential=*/true);
+  if (!file.valid()) {
+    std::fprintf(stderr, "can't read %s\n", argv[1]);
+    return 1;
+  }
+  Obj obj;
+  const char* const text = (const char*)file.data();
+  if (!ParseObj(text, text + file.size(), obj)) return 1;
+  if (obj.corner_positions.empty()) {
+    std::fprintf(stderr, "%s has no faces\n", argv[1]);
+    return 1;
+  }
+
+  fs::MeshData mesh = BuildMesh(obj, normalize_size);
+  const float acmr_before =
+      fs::AverageCacheMissRatio(mesh.indices, mesh.vertices.size());
+  fs::OptimizeMesh(mesh);
+  const float acmr_after =
+      fs::AverageCacheMissRatio(mesh.indices, mesh.vertices.size());
+
+  if (!fs::WriteMeshFile(argv[2], mesh)) {
+    std::fprintf(stderr, "can't write %s\n", argv[2]);
+    return 1;
+  }
+  std::printf("%s: %zu vertices, %zu triangles, acmr %.3f -> %.3f, %zu KiB\n",
+              argv[2], mesh.vertices.size(), mesh.indices.size() / 3,
+              acmr_before, acmr_after,
+              (mesh.VertexBytes() + mesh.IndexBytes()) / 1024);
+  return 0;
+}
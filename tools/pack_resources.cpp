@@ -0,0 +1,97 @@
+// -----------------------------------------------------------------------------
+// Copyright 2023 filament_glfw_imgui Library Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -----------------------------------------------------------------------------
+
+//
+// Writes files into an .fspack resource pack (see demo/fs_resource_pack.h).
+//
+//   pack_resources output.fspack [--zlib | --store] [name=]file ...
+//
+// Resources are named after their file, without its directory, unless a name
+// is given. --zlib compresses the files after it, where that makes them
+// smaller, until a --store. Afterwards the pack is read back and checked.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "fs_mapped_file.h"
+#include "fs_resource_pack.h"
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::fprintf(stderr,
+                 "usage: %s output.fspack [--zlib | --store] [name=]file ...\n",
+                 argv[0]);
+    return 1;
+  }
+
+  // Mapped until the pack is written.
+  std::vector<fs::MappedFile> files;
+  std::vector<fs::ResourcePackInput> inputs;
+  bool compress = false;
+  for (int i = 2; i < argc; ++i) {
+    const char* arg = argv[i];
+    if (!std::strcmp(arg, "--zlib") || !std::strcmp(arg, "--store")) {
+      compress = !std::strcmp(arg, "--zlib");
+      continue;
+    }
+    const char* const equals = std::strchr(arg, '=');
+    const char* const path = equals ? equals + 1 : arg;
+    const char* const slash = std::strrchr(path, '/');
+    const std::string name = equals ? std::string(arg, equals)
+                                    : std::string(slash ? slash + 1 : path);
+
+    fs::MappedFile& file = files.emplace_back(path);
+    if (!file.valid()) {
+      std::fprintf(stderr, "can't read %s\n", path);
+      return 1;
+    }
+    inputs.push_back({name, file.data(), file.size(), compress});
+  }
+
+  if (!fs::WriteResourcePack(argv[1], inputs)) {
+    std::fprintf(stderr, "can't write %s; are names unique?\n", argv[1]);
+    return 1;
+  }
+
+  fs::ResourcePack pack(argv[1]);
+  if (!pack.valid() || pack.size() != inputs.size()) {
+    std::fprintf(stderr, "can't read back %s\n", argv[1]);
+    return 1;
+  }
+  size_t stored = 0;
+  size_t raw = 0;
+  for (size_t i = 0; i < pack.size(); ++i) {
+    const fs::ResourcePackEntry& entry = pack.entry(i);
+    const std::string name(pack.name(i));
+    const fs::ResourceView view = pack.Find(name);
+    if (!view.data) {
+      std::fprintf(stderr, "can't read back %s from %s\n", name.c_str(),
+                   argv[1]);
+      return 1;
+    }
+    std::printf("  %-40s %9zu -> %9zu bytes%s\n", name.c_str(),
+                size_t(entry.size), size_t(entry.stored_size),
+                entry.compression ? " (zlib)" : "");
+    stored += entry.stored_size;
+    raw += entry.size;
+  }
+  std::printf("%s: %zu resources, %zu -> %zu bytes\n", argv[1], pack.size(),
+              raw, stored);
+  return 0;
+}